@@ -0,0 +1,8 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+// Number of global operator new calls since program start. Used to check
+// that hot loops stay allocation-free.
+long long heapAllocationCount();
+
+#endif // ALLOC_STATS_H
@@ -0,0 +1,282 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "profiler.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+#ifdef _WIN32
+// Blocks handed to waveOut at once; more survive longer hitches but lag more
+static const int WAVEOUT_BUFFERS = 4;
+
+class WaveOutOutput : public AudioOutput {
+public:
+    WaveOutOutput() : device(nullptr), doneEvent(nullptr), next(0) {}
+
+    bool open() {
+        doneEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+        WAVEFORMATEX format = {};
+        format.wFormatTag = WAVE_FORMAT_PCM;
+        format.nChannels = AUDIO_CHANNELS;
+        format.nSamplesPerSec = AUDIO_SAMPLE_RATE;
+        format.wBitsPerSample = 16;
+        format.nBlockAlign = AUDIO_CHANNELS * 2;
+        format.nAvgBytesPerSec = AUDIO_SAMPLE_RATE * format.nBlockAlign;
+        if (!doneEvent || waveOutOpen(&device, WAVE_MAPPER, &format, (DWORD_PTR)doneEvent, 0, CALLBACK_EVENT) !=
+                              MMSYSERR_NOERROR) {
+            printf("SOUND ERROR: Cannot open the sound device\n");
+            if (doneEvent) CloseHandle(doneEvent);
+            doneEvent = nullptr;
+            device = nullptr;
+            return false;
+        }
+        for (int i = 0; i < WAVEOUT_BUFFERS; i++) {
+            memset(&headers[i], 0, sizeof(WAVEHDR));
+            headers[i].lpData = (LPSTR)buffers[i];
+            headers[i].dwBufferLength = sizeof(buffers[i]);
+            waveOutPrepareHeader(device, &headers[i], sizeof(WAVEHDR));
+            queued[i] = false;
+        }
+        next = 0;
+        return true;
+    }
+
+    // Waits for the oldest buffer to finish playing, then queues the block in it
+    bool write(const int16_t* samples, int frames) {
+        WAVEHDR& header = headers[next];
+        while (queued[next] && !(header.dwFlags & WHDR_DONE)) {
+            WaitForSingleObject(doneEvent, 100);
+        }
+        frames = std::min(frames, AUDIO_BLOCK_FRAMES);
+        memcpy(buffers[next], samples, (size_t)frames * AUDIO_CHANNELS * sizeof(int16_t));
+        header.dwBufferLength = (DWORD)(frames * AUDIO_CHANNELS * sizeof(int16_t));
+        header.dwFlags &= ~WHDR_DONE;
+        queued[next] = true;
+        next = (next + 1) % WAVEOUT_BUFFERS;
+        return waveOutWrite(device, &header, sizeof(WAVEHDR)) == MMSYSERR_NOERROR;
+    }
+
+    void close() {
+        if (!device) return;
+        waveOutReset(device);
+        for (int i = 0; i < WAVEOUT_BUFFERS; i++) {
+            waveOutUnprepareHeader(device, &headers[i], sizeof(WAVEHDR));
+        }
+        waveOutClose(device);
+        CloseHandle(doneEvent);
+        device = nullptr;
+        doneEvent = nullptr;
+    }
+
+    bool blocks() const { return true; }
+    const char* name() const { return "waveOut"; }
+
+private:
+    HWAVEOUT device;
+    HANDLE doneEvent;
+    WAVEHDR headers[WAVEOUT_BUFFERS];
+    int16_t buffers[WAVEOUT_BUFFERS][AUDIO_BLOCK_FRAMES * AUDIO_CHANNELS];
+    bool queued[WAVEOUT_BUFFERS];
+    int next;
+};
+
+AudioOutput* createDeviceOutput() {
+    return new WaveOutOutput();
+}
+#else
+AudioOutput* createDeviceOutput() {
+    return new NullAudioOutput();
+}
+#endif
+
+AudioMixer::AudioMixer()
+    : commandHead(0), commandTail(0), nextVoiceId(1), output(nullptr), stopping(false), voicesPlaying(0),
+      framesMixed(0), commandsDropped(0), samplesClipped(0) {
+    memset(voices, 0, sizeof(voices));
+}
+
+AudioMixer::~AudioMixer() {
+    finish();
+}
+
+int AudioMixer::addClip(SoundClip&& clip) {
+    clips.push_back(std::move(clip));
+    return (int)clips.size() - 1;
+}
+
+int AudioMixer::loadClip(const char* path) {
+    SoundClip clip;
+    if (!loadWav(path, clip)) return -1;
+    return addClip(std::move(clip));
+}
+
+bool AudioMixer::send(const Command& command) {
+    uint32_t head = commandHead.load(std::memory_order_relaxed);
+    if (head - commandTail.load(std::memory_order_acquire) >= (uint32_t)AUDIO_COMMAND_CAPACITY) {
+        commandsDropped++;
+        return false;
+    }
+    commands[head % AUDIO_COMMAND_CAPACITY] = command;
+    commandHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+int AudioMixer::play(int clip, bool loop, float volume) {
+    if (clip < 0 || clip >= (int)clips.size()) return -1;
+    Command command = {COMMAND_PLAY, clip, nextVoiceId, loop, volume};
+    if (!send(command)) return -1;
+    // Ids stay positive, 0 marks a free voice
+    nextVoiceId = nextVoiceId == INT32_MAX ? 1 : nextVoiceId + 1;
+    return command.voice;
+}
+
+void AudioMixer::stop(int voice) {
+    if (voice <= 0) return;
+    Command command = {COMMAND_STOP, -1, voice, false, 0.0f};
+    send(command);
+}
+
+void AudioMixer::stopAll() {
+    Command command = {COMMAND_STOP_ALL, -1, 0, false, 0.0f};
+    send(command);
+}
+
+void AudioMixer::apply(const Command& command) {
+    switch (command.type) {
+        case COMMAND_PLAY: {
+            Voice* free = nullptr;
+            for (Voice& voice : voices) {
+                if (voice.id == 0) {
+                    free = &voice;
+                    break;
+                }
+            }
+            if (!free) {
+                commandsDropped++;
+                return;
+            }
+            Voice voice = {command.voice, command.clip, 0, command.loop, command.volume, 0.0f};
+            *free = voice;
+            break;
+        }
+        case COMMAND_STOP:
+        case COMMAND_STOP_ALL:
+            for (Voice& voice : voices) {
+                if (voice.id != 0 && voice.fade == 0.0f && (command.type == COMMAND_STOP_ALL || voice.id == command.voice)) {
+                    voice.fade = std::max(voice.volume, 1e-6f) / AUDIO_FADE_FRAMES;
+                }
+            }
+            break;
+    }
+}
+
+void AudioMixer::mix(int16_t* out, int frames) {
+    uint32_t tail = commandTail.load(std::memory_order_relaxed);
+    uint32_t head = commandHead.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+        apply(commands[tail % AUDIO_COMMAND_CAPACITY]);
+    }
+    commandTail.store(tail, std::memory_order_release);
+
+    while (frames > 0) {
+        int block = std::min(frames, AUDIO_BLOCK_FRAMES);
+        mixBlock(out, block);
+        out += block * AUDIO_CHANNELS;
+        frames -= block;
+    }
+}
+
+void AudioMixer::mixBlock(int16_t* out, int frames) {
+    int samples = frames * AUDIO_CHANNELS;
+    std::fill(accumulator, accumulator + samples, 0.0f);
+
+    int playing = 0;
+    for (Voice& voice : voices) {
+        if (voice.id == 0) continue;
+        const SoundClip& clip = clips[voice.clip];
+        int length = clip.frames();
+        for (int i = 0; i < frames; i++) {
+            if (voice.position >= length) {
+                if (!voice.loop || length == 0) break;
+                voice.position = 0;
+            }
+            if (voice.fade > 0.0f) {
+                voice.volume -= voice.fade;
+                if (voice.volume <= 0.0f) break;
+            }
+            const int16_t* frame = &clip.samples[(size_t)voice.position * AUDIO_CHANNELS];
+            for (int c = 0; c < AUDIO_CHANNELS; c++) {
+                accumulator[i * AUDIO_CHANNELS + c] += frame[c] * voice.volume;
+            }
+            voice.position++;
+        }
+        bool ended = voice.position >= length && !voice.loop;
+        if (ended || length == 0 || (voice.fade > 0.0f && voice.volume <= 0.0f)) {
+            voice.id = 0;
+        } else {
+            playing++;
+        }
+    }
+
+    long long clipped = 0;
+    for (int i = 0; i < samples; i++) {
+        float value = accumulator[i];
+        if (value > 32767.0f || value < -32768.0f) {
+            value = std::max(-32768.0f, std::min(32767.0f, value));
+            clipped++;
+        }
+        out[i] = (int16_t)value;
+    }
+    voicesPlaying = playing;
+    framesMixed += frames;
+    samplesClipped += clipped;
+}
+
+bool AudioMixer::start(AudioOutput* target) {
+    finish();
+    if (!target->open()) return false;
+    output = target;
+    stopping = false;
+    thread = std::thread(&AudioMixer::run, this);
+    return true;
+}
+
+void AudioMixer::finish() {
+    if (!thread.joinable()) return;
+    stopping = true;
+    thread.join();
+    output->close();
+    output = nullptr;
+}
+
+void AudioMixer::run() {
+    int16_t block[AUDIO_BLOCK_FRAMES * AUDIO_CHANNELS];
+    const std::chrono::duration<double> blockTime(AUDIO_BLOCK_FRAMES / (double)AUDIO_SAMPLE_RATE);
+    auto due = std::chrono::steady_clock::now();
+    while (!stopping.load()) {
+        {
+            PROFILE_SCOPE("AudioMixer::mix");
+            mix(block, AUDIO_BLOCK_FRAMES);
+        }
+        if (!output->write(block, AUDIO_BLOCK_FRAMES)) {
+            printf("SOUND ERROR: Writing to %s failed, sound stopped\n", output->name());
+            return;
+        }
+        if (!output->blocks()) {
+            // Keep real time; after a long stall start over rather than rush
+            due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockTime);
+            auto now = std::chrono::steady_clock::now();
+            if (due < now - std::chrono::milliseconds(100)) due = now;
+            std::this_thread::sleep_until(due);
+        }
+    }
+}
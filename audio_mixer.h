@@ -0,0 +1,143 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "wav_file.h"
+
+// Sounds that can play at once; a play with none free is dropped
+const int MAX_VOICES = 16;
+
+// Play/stop commands waiting for the audio thread
+const int AUDIO_COMMAND_CAPACITY = 64;
+
+// Frames mixed per block, about 12 ms: the latency of a play or stop
+const int AUDIO_BLOCK_FRAMES = 512;
+
+// Stopped voices fade out over this many frames instead of clicking
+const int AUDIO_FADE_FRAMES = 256;
+
+// Where mixed blocks go. A device blocks in write() until it has room; the
+// others return at once and the mixer thread keeps real time itself.
+class AudioOutput {
+public:
+    virtual ~AudioOutput() {}
+    virtual bool open() = 0;
+    virtual bool write(const int16_t* samples, int frames) = 0;
+    virtual void close() = 0;
+    virtual bool blocks() const { return false; }
+    virtual const char* name() const = 0;
+};
+
+// Mixes and throws the result away, for machines without a sound device
+class NullAudioOutput : public AudioOutput {
+public:
+    bool open() { return true; }
+    bool write(const int16_t*, int) { return true; }
+    void close() {}
+    const char* name() const { return "none"; }
+};
+
+// Records the mix into a WAV file
+class WavFileOutput : public AudioOutput {
+public:
+    explicit WavFileOutput(const char* path) : path(path) {}
+    bool open() { return writer.open(path); }
+    bool write(const int16_t* samples, int frames) { return writer.write(samples, frames); }
+    void close() { writer.close(); }
+    const char* name() const { return path; }
+
+private:
+    const char* path;
+    WavWriter writer;
+};
+
+// The sound card through waveOut on Windows; elsewhere there is no device
+// backend yet and this is a NullAudioOutput
+AudioOutput* createDeviceOutput();
+
+// Plays any number of decoded clips at once, looping or not. Clips are added
+// before start() and never change after, so the audio thread reads them
+// without locks. play() and stop() go through a lock-free queue and never
+// wait for the audio thread; only one thread may send them at a time.
+class AudioMixer {
+public:
+    AudioMixer();
+    ~AudioMixer();
+
+    // Index of the new clip, or -1 if the file does not decode
+    int addClip(SoundClip&& clip);
+    int loadClip(const char* path);
+    int clipCount() const { return (int)clips.size(); }
+
+    // Returns a voice id for stop(), or -1 if the clip does not exist or
+    // the queue is full. A play that finds every voice busy is dropped
+    // and counted with the full-queue ones.
+    int play(int clip, bool loop, float volume = 1.0f);
+    void stop(int voice);
+    void stopAll();
+
+    // Mixes blocks into output on a new thread until finish()
+    bool start(AudioOutput* output);
+    void finish();
+    bool running() const { return thread.joinable(); }
+
+    // Applies the queued commands and mixes the next frames. The audio
+    // thread calls this; without start() it renders offline.
+    void mix(int16_t* out, int frames);
+
+    int activeVoices() const { return voicesPlaying.load(); }
+    long long mixedFrames() const { return framesMixed.load(); }
+    long long droppedCommands() const { return commandsDropped.load(); }
+    long long clippedSamples() const { return samplesClipped.load(); }
+
+private:
+    enum CommandType { COMMAND_PLAY, COMMAND_STOP, COMMAND_STOP_ALL };
+
+    struct Command {
+        CommandType type;
+        int clip;
+        int voice;
+        bool loop;
+        float volume;
+    };
+
+    // Owned by the audio thread
+    struct Voice {
+        int id;          // 0 when free
+        int clip;
+        int position;    // Next frame
+        bool loop;
+        float volume;
+        float fade;      // Volume lost per frame once stopped
+    };
+
+    bool send(const Command& command);
+    void apply(const Command& command);
+    void mixBlock(int16_t* out, int frames);
+    void run();
+
+    std::vector<SoundClip> clips;
+
+    // Single producer, single consumer ring
+    Command commands[AUDIO_COMMAND_CAPACITY];
+    std::atomic<uint32_t> commandHead; // Written by the sending thread
+    std::atomic<uint32_t> commandTail; // Written by the mixing thread
+    int nextVoiceId;
+
+    Voice voices[MAX_VOICES];
+    float accumulator[AUDIO_BLOCK_FRAMES * AUDIO_CHANNELS];
+
+    AudioOutput* output;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::atomic<int> voicesPlaying;
+    std::atomic<long long> framesMixed;
+    std::atomic<long long> commandsDropped;
+    std::atomic<long long> samplesClipped;
+};
+
+#endif // AUDIO_MIXER_H
@@ -0,0 +1,541 @@
+// fire_bench: microbenchmarks for the simulation and render kernels.
+// Prints one JSON document so results can be kept and compared between
+// versions; progress goes to stderr.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "simulation.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "scene_batches.h"
+#include "scene_grid.h"
+#include "camera.h"
+#include "software_renderer.h"
+#include "particle_kernels.h"
+#include "job_system.h"
+#include "spatial_hash.h"
+#include "water.h"
+#include "hud.h"
+#include "alloc_stats.h"
+#include "road_network.h"
+#include "dispatch.h"
+#include "incident_batch.h"
+
+// Each benchmark runs REPEATS batches after one warmup batch; a batch is
+// sized to take about batchSeconds
+const int REPEATS = 5;
+
+struct BenchOptions {
+    const char* outPath;
+    const char* filter;
+    double batchSeconds;
+    int threads;
+    ParticleKernel kernel;
+};
+
+struct BenchResult {
+    std::string name;
+    long long iterations;        // Per batch
+    double nsPerIteration;       // Median batch
+    double minNsPerIteration;    // Fastest batch
+    double nsPerParticle;        // < 0 when the benchmark has no particles
+    double allocationsPerIteration;
+};
+
+// One iteration of a benchmark; returns the particles it touched, 0 for none
+typedef std::function<long long()> BenchFunction;
+
+static BenchOptions options;
+static std::vector<BenchResult> results;
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void runBenchmark(const char* name, const BenchFunction& function) {
+    if (options.filter && !strstr(name, options.filter)) return;
+    fprintf(stderr, "  %s...\n", name);
+
+    // Warm up and size the batch from how long one iteration takes
+    auto start = std::chrono::steady_clock::now();
+    long long iterations = 0;
+    do {
+        function();
+        iterations++;
+    } while (secondsSince(start) < options.batchSeconds * 0.25);
+    double perIteration = secondsSince(start) / iterations;
+    long long batch = std::max(1LL, (long long)(options.batchSeconds / std::max(perIteration, 1e-9)));
+
+    double batchNs[REPEATS];
+    long long particles = 0;
+    long long allocations = 0;
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        long long allocationsBefore = heapAllocationCount();
+        start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < batch; i++) {
+            particles += function();
+        }
+        batchNs[repeat] = secondsSince(start) * 1e9 / batch;
+        allocations += heapAllocationCount() - allocationsBefore;
+    }
+    std::sort(batchNs, batchNs + REPEATS);
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = batch;
+    result.nsPerIteration = batchNs[REPEATS / 2];
+    result.minNsPerIteration = batchNs[0];
+    long long totalIterations = batch * REPEATS;
+    double particlesPerIteration = (double)particles / totalIterations;
+    result.nsPerParticle = particles > 0 ? result.nsPerIteration / particlesPerIteration : -1.0;
+    result.allocationsPerIteration = (double)allocations / totalIterations;
+    results.push_back(result);
+}
+
+// A pool of count live particles spread over the scene
+static void fillPool(ParticlePool& pool, int count) {
+    pool.setCapacity(count);
+    int first = 0;
+    pool.spawnBlock(count, first);
+    for (int i = 0; i < count; i++) {
+        pool.x[i] = 100.0f + (i % 600);
+        pool.y[i] = 400.0f - (i % 300);
+        pool.velocity[i] = 0.5f + (i % 100) / 100.0f;
+        pool.life[i] = 1000.0f; // Never dies during the run
+        pool.size[i] = 2.0f + (i % 3);
+    }
+}
+
+static void benchParticleUpdate(const char* name, int count) {
+    ParticlePool pool;
+    fillPool(pool, count);
+    float simTime = 0.0f;
+    runBenchmark(name, [&]() -> long long {
+        simTime += 1.0f / 60.0f;
+        integrateParticles(options.kernel, pool.x, pool.y, pool.velocity, pool.life, pool.count, simTime,
+                           1.0f / 60.0f);
+        return pool.count;
+    });
+}
+
+// A simulation mid-fire: every window of the lowest floors of a generated
+// city burning, fluid at its default size
+static void startFire(Simulation& sim, int buildings, JobSystem* jobs) {
+    sim.setScene(generateCityScene(buildings, 1));
+    sim.setParticleKernel(options.kernel);
+    sim.setSeed(1);
+    sim.setJobSystem(jobs);
+    sim.currentState = FIRE_START;
+    sim.simTime = sim.scene.timings.fireStart;
+    sim.fireStartTime = sim.simTime;
+    for (const BuildingLayout& building : sim.layout.buildings) {
+        for (int w = 0; w < std::min(building.windowCount, 2 * building.windowsPerFloor); w++) {
+            sim.fireGrid.ignite(building.firstWindow + w);
+        }
+    }
+    sim.fireOrigin = sim.fireGrid.burningWindows().empty() ? -1 : sim.fireGrid.burningWindows()[0];
+}
+
+static void benchEmission(JobSystem* jobs) {
+    Simulation sim;
+    startFire(sim, 200, jobs);
+    sim.setParticleCapacity((int)sim.fireGrid.burningWindows().size() * PARTICLES_PER_EMITTER);
+    runBenchmark("emission", [&]() -> long long {
+        sim.fireParticles.clear();
+        sim.emitFromBurningWindows();
+        return sim.fireParticles.count;
+    });
+}
+
+// The scenario timeline without particles or smoke: state changes, trucks
+// and crew, restarted every 40 simulated seconds
+static void benchStateMachine() {
+    Simulation sim;
+    sim.setParticleCapacity(0);
+    sim.setFluidResolution(0);
+    sim.setSeed(1);
+    runBenchmark("state_machine_step", [&]() -> long long {
+        if (sim.simTime > 40.0f) {
+            sim.reset();
+        }
+        sim.step(1.0f / 60.0f);
+        return 0;
+    });
+}
+
+// The batch geometry that replaced drawBuilding and friends
+static void benchGeometry() {
+    Simulation sim;
+    VertexBatch batch;
+    runBenchmark("static_geometry", [&]() -> long long {
+        buildStaticBatch(batch, sim.scene, sim.layout);
+        return 0;
+    });
+
+    Simulation city;
+    startFire(city, 200, nullptr);
+    runBenchmark("static_geometry_200_buildings", [&]() -> long long {
+        buildStaticBatch(batch, city.scene, city.layout);
+        return 0;
+    });
+
+    // Burning windows, trucks and every particle's quad
+    city.step(1.0f / 60.0f);
+    std::vector<Vertex> quads(city.fireParticles.capacity() * 4);
+    runBenchmark("dynamic_geometry", [&]() -> long long {
+        buildUnderlayBatch(batch, city);
+        buildOverlayBatch(batch, city, true, 0.5f);
+        writeParticleQuads(city.fireParticles, LOOK_FIRE, quads.data(), 0, city.fireParticles.count, 0.5f);
+        return city.fireParticles.count;
+    });
+
+    // What the window does per frame for a city: the visible cells at the
+    // original zoom, and zoomed all the way out the coarse cells and sprites
+    SceneGrid grid;
+    grid.build(city.scene, city.layout, false);
+    std::vector<VertexBatch::Command> ranges;
+    Camera camera;
+    camera.setBounds(sceneBounds(city.scene));
+    ViewRect street = camera.view(800);
+    runBenchmark("grid_cull_200_buildings", [&]() -> long long {
+        grid.cull(street, ranges);
+        return 0;
+    });
+    camera.zoomAt(0.0f, 400.0f, 250.0f, 800, 500);
+    ViewRect whole = camera.view(800);
+    std::vector<float> bins;
+    std::vector<Vertex> sprites;
+    runBenchmark("particle_sprites_zoomed_out", [&]() -> long long {
+        int binned = 0;
+        buildParticleSprites(city.fireParticles, LOOK_FIRE, 0.5f, whole, PARTICLE_SPRITE_PIXELS / whole.scale, bins, sprites, binned);
+        return city.fireParticles.count;
+    });
+}
+
+// Half a million mixed particles: hoses' worth of drops hashed, and the
+// fire particles around them doused
+static void benchWater(JobSystem* jobs) {
+    const int count = 250000;
+    ParticlePool water, fire;
+    fillPool(water, count);
+    fillPool(fire, count);
+    // Scattered over a city's worth of street, as in a large fire
+    RandomStream random(1, 0);
+    for (int i = 0; i < count; i++) {
+        water.x[i] = random.nextFloat() * 20000.0f;
+        water.y[i] = random.nextFloat() * 400.0f;
+        fire.x[i] = random.nextFloat() * 20000.0f;
+        fire.y[i] = random.nextFloat() * 400.0f;
+    }
+    SpatialHash drops;
+    drops.setup(WATER_QUENCH_RADIUS, count);
+
+    runBenchmark("spatial_hash_build_250k", [&]() -> long long {
+        drops.build(water.x, water.y, water.count, jobs);
+        return water.count;
+    });
+    runBenchmark("water_vs_fire_500k", [&]() -> long long {
+        drops.build(water.x, water.y, water.count, jobs);
+        parallelFor(jobs, fire.count, PARTICLE_CHUNK_SIZE, [&](int begin, int end, int) {
+            quenchFireParticles(fire, begin, end, drops, 1.0f / 60.0f);
+        });
+        return water.count + fire.count;
+    });
+}
+
+// 50k occupants leaving a burning city, every building as full as it gets:
+// one agent step (neighbor grid and moves), and their quads. The crowd
+// starts over every 300 steps, so the mix of floors, stairs and road stays
+// the same.
+static void benchCrowd(JobSystem* jobs) {
+    const int count = 50000;
+    Simulation sim;
+    startFire(sim, 400, jobs);
+    sim.setCrowdCapacity(count);
+    sim.setOccupants(count);
+    auto evacuateAll = [&]() {
+        sim.crowd.clear();
+        sim.evacuated.assign(sim.evacuated.size(), 0);
+        sim.agentsWalking = 0;
+        for (int b = 0; b < (int)sim.scene.buildings.size() && sim.crowd.count < count; b++) {
+            sim.evacuate(b);
+        }
+    };
+    evacuateAll();
+
+    int steps = 0;
+    runBenchmark("crowd_step_50k", [&]() -> long long {
+        if (++steps % 300 == 0) {
+            evacuateAll();
+        }
+        sim.moveCrowd(1.0f / 60.0f);
+        return sim.crowd.count;
+    });
+    std::vector<Vertex> quads((size_t)count * 4);
+    runBenchmark("crowd_quads_50k", [&]() -> long long {
+        parallelFor(jobs, sim.crowd.count, AGENT_CHUNK_SIZE, [&](int begin, int end, int) {
+            writeAgentQuads(sim.crowd, quads.data(), begin, end, 0.5f);
+        });
+        return sim.crowd.count;
+    });
+}
+
+// A 32 x 32 grid of city blocks with 64 stations of 32 trucks each:
+// working out every route once, and sending two trucks to each of 1000
+// incidents at once from a fleet where all are free
+static void benchDispatch() {
+    const int side = 32, incidents = 1000;
+    std::vector<RoadNodeDesc> nodes;
+    std::vector<RoadDesc> roads;
+    for (int row = 0; row < side; row++) {
+        for (int column = 0; column < side; column++) {
+            int node = row * side + column;
+            nodes.push_back({column * 100.0f, row * 100.0f});
+            if (column > 0) roads.push_back({node - 1, node});
+            if (row > 0) roads.push_back({node - side, node});
+        }
+    }
+    std::vector<int> stationNodes, truckStations;
+    for (int s = 0; s < 64; s++) {
+        stationNodes.push_back((s / 8 * 4 + 2) * side + s % 8 * 4 + 2);
+        truckStations.insert(truckStations.end(), 32, s);
+    }
+    RandomStream random(1, 0);
+    std::vector<int> incidentNodes;
+    for (int i = 0; i < incidents; i++) {
+        incidentNodes.push_back(random.nextInt(side * side));
+    }
+
+    RoadNetwork network;
+    network.build(nodes, roads);
+    runBenchmark("road_tables_1k_nodes", [&]() -> long long {
+        network.build(nodes, roads);
+        return 0;
+    });
+    Dispatcher dispatcher;
+    dispatcher.build(network, stationNodes, truckStations);
+    std::vector<DispatchOrder> orders;
+    orders.reserve(incidents * 2);
+    runBenchmark("dispatch_1000_incidents", [&]() -> long long {
+        dispatcher.reset();
+        orders.clear();
+        dispatcher.dispatch(incidentNodes.data(), incidents, 2, orders);
+        return incidents;
+    });
+}
+
+// One step of count independent incidents with jittered timings, all
+// restarted every 40 simulated seconds
+static void benchIncidentBatch(const char* name, int count) {
+    const ScenarioTimings base = defaultScene().timings;
+    RandomStream random(1, 0);
+    std::vector<ScenarioTimings> timings(count);
+    std::vector<float> ready((size_t)count * INCIDENT_CONDITION_COUNT, 0.0f);
+    for (int i = 0; i < count; i++) {
+        float shift = random.nextFloat() * 5.0f;
+        ScenarioTimings& t = timings[i];
+        t = base;
+        for (float* field : {&t.fireStart, &t.alarm, &t.crewArrive, &t.firefightersArrive, &t.extinguishing,
+                             &t.allClear, &t.trucksLeaving}) {
+            *field += shift;
+        }
+        float* r = &ready[(size_t)i * INCIDENT_CONDITION_COUNT];
+        r[CONDITION_CREW_IN_PLACE] = t.crewArrive + random.nextFloat() * 4.0f;
+        r[CONDITION_TRUCKS_PARKED] = t.firefightersArrive + random.nextFloat() * 6.0f;
+        r[CONDITION_FIRE_OUT] = t.extinguishing + random.nextFloat() * 8.0f;
+    }
+    IncidentBatch batch;
+    batch.setCapacity(count, count);
+    auto restart = [&]() {
+        batch.clear();
+        for (int i = 0; i < count; i++) {
+            batch.add(timings[i], &ready[(size_t)i * INCIDENT_CONDITION_COUNT]);
+        }
+    };
+    restart();
+    runBenchmark(name, [&]() -> long long {
+        if (batch.time > 40.0f) {
+            restart();
+        }
+        batch.step(1.0f / 60.0f);
+        return count;
+    });
+}
+
+// Status panels for 1 and 32 incidents: a frame where nothing changed,
+// and one where every timer ticks
+static void benchHud() {
+    Simulation sim;
+    sim.setSeed(1);
+    while (sim.simTime < 20.0f) {
+        sim.step(1.0f / 60.0f);
+    }
+    const int sizes[2] = {1, 32};
+    for (int panels : sizes) {
+        Hud hud;
+        std::vector<StatusPanel> status(panels);
+        for (int i = 0; i < panels; i++) {
+            status[i].setup(hud, 10.0f + (i % 4) * 400.0f, 10.0f + (i / 4) * 120.0f);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "hud_unchanged_%d_panel%s", panels, panels > 1 ? "s" : "");
+        runBenchmark(name, [&]() -> long long {
+            for (StatusPanel& panel : status) {
+                panel.update(hud, sim);
+            }
+            return 0;
+        });
+        snprintf(name, sizeof(name), "hud_timer_tick_%d_panel%s", panels, panels > 1 ? "s" : "");
+        float time = sim.simTime;
+        runBenchmark(name, [&]() -> long long {
+            time += 0.1f;
+            sim.simTime = time;
+            for (StatusPanel& panel : status) {
+                panel.update(hud, sim);
+            }
+            return 0;
+        });
+    }
+}
+
+// A whole headless frame: one step, the snapshot and the software render
+static void benchFrame(JobSystem* jobs) {
+    // The alarm never goes off, so the fire burns for as long as it runs
+    Scene scene = defaultScene();
+    scene.timings.alarm = 1e9f;
+    Simulation sim;
+    sim.setScene(scene);
+    sim.setParticleKernel(options.kernel);
+    sim.setSeed(1);
+    sim.setJobSystem(jobs);
+
+    // Into the fire, with the particle count at its steady level
+    while (sim.simTime < scene.timings.fireStart + 5.0f) {
+        sim.step(1.0f / 60.0f);
+    }
+
+    runBenchmark("headless_step", [&]() -> long long {
+        sim.step(1.0f / 60.0f);
+        return sim.fireParticles.count;
+    });
+
+    SoftwareRenderer softwareRenderer;
+    softwareRenderer.setSize(800, 500);
+    softwareRenderer.setScene(sim.scene, sim.layout);
+    FrameSnapshot snapshot;
+    Framebuffer frame;
+    runBenchmark("headless_frame_800x500", [&]() -> long long {
+        sim.step(1.0f / 60.0f);
+        captureFrame(sim, true, snapshot);
+        softwareRenderer.render(snapshot, frame, jobs);
+        return sim.fireParticles.count;
+    });
+}
+
+static bool writeResults(FILE* file) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"kernel\": \"%s\",\n", particleKernelName(options.kernel));
+    fprintf(file, "  \"threads\": %d,\n", options.threads);
+    fprintf(file, "  \"repeats\": %d,\n", REPEATS);
+    fprintf(file, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"iterations\": %lld, \"ns_per_iteration\": %.1f, "
+                "\"min_ns_per_iteration\": %.1f, ", r.name.c_str(), r.iterations, r.nsPerIteration,
+                r.minNsPerIteration);
+        if (r.nsPerParticle >= 0.0) {
+            fprintf(file, "\"ns_per_particle\": %.3f, ", r.nsPerParticle);
+        } else {
+            fprintf(file, "\"ns_per_particle\": null, ");
+        }
+        fprintf(file, "\"allocations_per_iteration\": %.3f}%s\n", r.allocationsPerIteration,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return ferror(file) == 0;
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --out <file>      Write the JSON results to a file instead of stdout\n");
+    printf("  --filter <text>   Only run benchmarks whose name contains text\n");
+    printf("  --quick           Shorter batches, for a smoke test\n");
+    printf("  --threads <n>     Worker threads for the step and frame benchmarks (default 1)\n");
+    printf("  --kernel <name>   Particle kernel: auto, scalar, sse2 or avx2 (default auto)\n");
+    printf("  --help            Show this help\n");
+}
+
+int main(int argc, char** argv) {
+    options.outPath = nullptr;
+    options.filter = nullptr;
+    options.batchSeconds = 0.2;
+    options.threads = 1;
+    options.kernel = KERNEL_AUTO;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--out") == 0 && hasValue) {
+            options.outPath = argv[++i];
+        } else if (strcmp(arg, "--filter") == 0 && hasValue) {
+            options.filter = argv[++i];
+        } else if (strcmp(arg, "--quick") == 0) {
+            options.batchSeconds = 0.02;
+        } else if (strcmp(arg, "--threads") == 0 && hasValue) {
+            options.threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(arg, "--kernel") == 0 && hasValue) {
+            const char* name = argv[++i];
+            if (!parseParticleKernel(name, options.kernel) || !isParticleKernelSupported(options.kernel)) {
+                printf("ERROR: Unknown or unsupported kernel '%s'\n", name);
+                return 1;
+            }
+        } else if (strcmp(arg, "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            printf("Unknown option: %s\n", arg);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.kernel == KERNEL_AUTO) {
+        options.kernel = detectParticleKernel();
+    }
+
+    fprintf(stderr, "fire_bench: kernel %s, %d threads\n", particleKernelName(options.kernel), options.threads);
+    JobSystem jobs(options.threads);
+    JobSystem* jobSystem = options.threads > 1 ? &jobs : nullptr;
+
+    benchParticleUpdate("particle_update_1k", 1000);
+    benchParticleUpdate("particle_update_100k", 100000);
+    benchParticleUpdate("particle_update_1m", 1000000);
+    benchEmission(jobSystem);
+    benchStateMachine();
+    benchGeometry();
+    benchWater(jobSystem);
+    benchCrowd(jobSystem);
+    benchDispatch();
+    benchIncidentBatch("incident_step_100k", 100000);
+    benchIncidentBatch("incident_step_1m", 1000000);
+    benchHud();
+    benchFrame(jobSystem);
+
+    FILE* file = options.outPath ? fopen(options.outPath, "w") : stdout;
+    if (!file) {
+        printf("ERROR: Cannot write '%s'\n", options.outPath);
+        return 1;
+    }
+    bool ok = writeResults(file);
+    if (options.outPath) {
+        ok = fclose(file) == 0 && ok;
+        fprintf(stderr, "Wrote %zu results to %s\n", results.size(), options.outPath);
+    }
+    return ok ? 0 : 1;
+}
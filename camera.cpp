@@ -0,0 +1,83 @@
+#include "camera.h"
+
+#include <algorithm>
+
+#include "scene.h"
+
+ViewRect sceneBounds(const Scene& scene) {
+    ViewRect bounds = {0.0f, 0.0f, VIEW_WIDTH, VIEW_HEIGHT, 1.0f};
+    for (const CloudDesc& cloud : scene.clouds) {
+        bounds.left = std::min(bounds.left, cloud.x - cloud.size);
+        bounds.right = std::max(bounds.right, cloud.x + cloud.size);
+        bounds.top = std::min(bounds.top, cloud.y - cloud.size);
+    }
+    for (const TreeDesc& tree : scene.trees) {
+        bounds.left = std::min(bounds.left, tree.x - 15.0f);
+        bounds.right = std::max(bounds.right, tree.x + 15.0f);
+    }
+    for (const BuildingDesc& b : scene.buildings) {
+        bounds.left = std::min(bounds.left, b.x - 10.0f); // Roofs overhang
+        bounds.right = std::max(bounds.right, b.x + b.width + 10.0f);
+        bounds.top = std::min(bounds.top, 400.0f - b.height - 20.0f);
+    }
+    return bounds;
+}
+
+Camera::Camera() : centerX(VIEW_WIDTH * 0.5f), centerY(VIEW_HEIGHT * 0.5f), zoomLevel(1.0f) {
+    bounds = ViewRect{0.0f, 0.0f, VIEW_WIDTH, VIEW_HEIGHT, 1.0f};
+}
+
+void Camera::setBounds(const ViewRect& sceneArea) {
+    bounds = sceneArea;
+    clamp();
+}
+
+void Camera::reset() {
+    centerX = VIEW_WIDTH * 0.5f;
+    centerY = VIEW_HEIGHT * 0.5f;
+    zoomLevel = 1.0f;
+    clamp();
+}
+
+void Camera::pan(float dx, float dy, int pixelWidth, int pixelHeight) {
+    centerX -= dx * VIEW_WIDTH / (zoomLevel * std::max(pixelWidth, 1));
+    centerY -= dy * VIEW_HEIGHT / (zoomLevel * std::max(pixelHeight, 1));
+    clamp();
+}
+
+void Camera::zoomAt(float factor, float x, float y, int pixelWidth, int pixelHeight) {
+    // The scene point under the cursor, before and after
+    float u = x / std::max(pixelWidth, 1) - 0.5f;
+    float v = y / std::max(pixelHeight, 1) - 0.5f;
+    float sceneX = centerX + u * VIEW_WIDTH / zoomLevel;
+    float sceneY = centerY + v * VIEW_HEIGHT / zoomLevel;
+    zoomLevel *= factor;
+    clamp();
+    centerX = sceneX - u * VIEW_WIDTH / zoomLevel;
+    centerY = sceneY - v * VIEW_HEIGHT / zoomLevel;
+    clamp();
+}
+
+ViewRect Camera::view(int pixelWidth) const {
+    float halfWidth = VIEW_WIDTH * 0.5f / zoomLevel;
+    float halfHeight = VIEW_HEIGHT * 0.5f / zoomLevel;
+    ViewRect rect = {centerX - halfWidth, centerY - halfHeight, centerX + halfWidth, centerY + halfHeight,
+                     pixelWidth / (2.0f * halfWidth)};
+    return rect;
+}
+
+void Camera::clamp() {
+    // Out until the whole scene fits, in to MAX_ZOOM
+    float width = bounds.right - bounds.left;
+    float height = bounds.bottom - bounds.top;
+    float minZoom = std::min(1.0f, std::min(VIEW_WIDTH / width, VIEW_HEIGHT / height));
+    zoomLevel = std::max(minZoom, std::min(MAX_ZOOM, zoomLevel));
+
+    // Keep the view inside the bounds, centered where it is larger
+    float halfWidth = VIEW_WIDTH * 0.5f / zoomLevel;
+    float halfHeight = VIEW_HEIGHT * 0.5f / zoomLevel;
+    centerX = width <= 2.0f * halfWidth ? (bounds.left + bounds.right) * 0.5f
+                                        : std::max(bounds.left + halfWidth, std::min(bounds.right - halfWidth, centerX));
+    centerY = height <= 2.0f * halfHeight ? (bounds.top + bounds.bottom) * 0.5f
+                                          : std::max(bounds.top + halfHeight, std::min(bounds.bottom - halfHeight, centerY));
+}
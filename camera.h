@@ -0,0 +1,56 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+struct Scene;
+
+// The part of the scene a frame shows, in scene units, and how many pixels
+// a scene unit covers on screen
+struct ViewRect {
+    float left, top, right, bottom;
+    float scale;
+
+    bool overlaps(float l, float t, float r, float b) const {
+        return l <= right && r >= left && t <= bottom && b >= top;
+    }
+};
+
+// Size of the original fixed view; zoom 1 shows exactly this much
+const float VIEW_WIDTH = 800.0f;
+const float VIEW_HEIGHT = 500.0f;
+
+const float MAX_ZOOM = 8.0f;
+
+// Area covered by the scene's geometry; never smaller than the original
+// 800x500 street
+ViewRect sceneBounds(const Scene& scene);
+
+// Pannable, zoomable 2D camera over the scene. Zoom 1 centered on the
+// original street gives the old fixed gluOrtho2D(0, 800, 500, 0) view.
+// The view never leaves the scene bounds and can zoom out until the whole
+// scene fits.
+class Camera {
+public:
+    Camera();
+
+    void setBounds(const ViewRect& bounds);
+    void reset(); // The original view
+
+    // Pans by a distance in screen pixels of a window pixelWidth wide
+    void pan(float dx, float dy, int pixelWidth, int pixelHeight);
+
+    // Zooms by factor keeping the scene point under (x, y) in place; x and
+    // y are window pixels
+    void zoomAt(float factor, float x, float y, int pixelWidth, int pixelHeight);
+
+    ViewRect view(int pixelWidth) const;
+    float zoom() const { return zoomLevel; }
+
+private:
+    void clamp();
+
+    ViewRect bounds;
+    float centerX, centerY;
+    float zoomLevel;
+};
+
+#endif // CAMERA_H
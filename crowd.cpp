@@ -0,0 +1,243 @@
+#include "crowd.h"
+#include "spatial_hash.h"
+#include "scene.h"
+#include "fire_grid.h"
+#include "state_io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Top of the road and how far down it agents may walk
+const float ROAD_TOP = 400.0f;
+const float ROAD_BOTTOM = 450.0f;
+
+CrowdAgents::CrowdAgents()
+    : count(0), droppedSpawns(0),
+      x(nullptr), y(nullptr), velocityX(nullptr), velocityY(nullptr), speed(nullptr), floorY(nullptr),
+      goalX(nullptr), goalY(nullptr), previousX(nullptr), previousY(nullptr), building(nullptr), phase(nullptr),
+      maxCount(0) {
+}
+
+void CrowdAgents::setCapacity(int newCapacity) {
+    if (newCapacity < 0) newCapacity = 0;
+
+    // One block, ten arrays
+    storage.assign((size_t)newCapacity * 10, 0.0f);
+    float* base = storage.data();
+    x = base;
+    y = base + newCapacity;
+    velocityX = base + newCapacity * 2;
+    velocityY = base + newCapacity * 3;
+    speed = base + newCapacity * 4;
+    floorY = base + newCapacity * 5;
+    goalX = base + newCapacity * 6;
+    goalY = base + newCapacity * 7;
+    previousX = base + newCapacity * 8;
+    previousY = base + newCapacity * 9;
+    buildingStorage.assign(newCapacity, 0);
+    phaseStorage.assign(newCapacity, 0);
+    building = buildingStorage.data();
+    phase = phaseStorage.data();
+
+    maxCount = newCapacity;
+    clear();
+}
+
+int CrowdAgents::spawnBlock(int requested, int& first) {
+    int granted = requested < maxCount - count ? requested : maxCount - count;
+    if (granted < 0) granted = 0;
+    droppedSpawns += requested - granted;
+    first = count;
+    count += granted;
+    return granted;
+}
+
+void CrowdAgents::clear() {
+    count = 0;
+    droppedSpawns = 0;
+}
+
+void CrowdAgents::countPhases(int counts[4]) const {
+    counts[0] = counts[1] = counts[2] = counts[3] = 0;
+    for (int i = 0; i < count; i++) {
+        counts[phase[i]]++;
+    }
+}
+
+void CrowdAgents::saveState(StateWriter& out) const {
+    out.value(count);
+    out.value(droppedSpawns);
+    const float* arrays[10] = {x, y, velocityX, velocityY, speed, floorY, goalX, goalY, previousX, previousY};
+    for (const float* array : arrays) {
+        out.write(array, (size_t)count * sizeof(float));
+    }
+    out.write(building, (size_t)count * sizeof(int));
+    out.write(phase, (size_t)count);
+}
+
+bool CrowdAgents::loadState(StateReader& in, int buildingCount) {
+    int newCount = 0;
+    if (!in.value(newCount) || newCount < 0 || newCount > maxCount) return false;
+    count = newCount;
+    in.value(droppedSpawns);
+    float* arrays[10] = {x, y, velocityX, velocityY, speed, floorY, goalX, goalY, previousX, previousY};
+    for (float* array : arrays) {
+        in.read(array, (size_t)count * sizeof(float));
+    }
+    in.read(building, (size_t)count * sizeof(int));
+    in.read(phase, (size_t)count);
+    if (!in.ok()) return false;
+
+    // Indices used to look things up must be in range
+    for (int i = 0; i < count; i++) {
+        if (building[i] < 0 || building[i] >= buildingCount || phase[i] > AGENT_SAFE) return false;
+    }
+    return true;
+}
+
+int occupantCapacity(const BuildingDesc& building) {
+    int floors = std::max(1, building.floors);
+    int across = (int)(building.width / AGENT_SPACING);
+    int deep = std::max(1, (int)(building.height / floors * 0.5f / AGENT_SPACING));
+    return floors * across * deep;
+}
+
+void placeOccupants(CrowdAgents& crowd, int first, int count, int building, const Scene& scene,
+                    const float* random) {
+    const BuildingDesc& b = scene.buildings[building];
+    const float* offsetX = random;
+    const float* floorPick = random + count;
+    const float* depth = random + 2 * count;
+    const float* pace = random + 3 * count;
+    const float* assemblyX = random + 4 * count;
+    const float* assemblyY = random + 5 * count;
+
+    int floors = std::max(1, b.floors);
+    float floorHeight = b.height / floors;
+    float doorX = b.x + b.width * 0.5f;
+    for (int a = 0; a < count; a++) {
+        int i = first + a;
+        int floor = std::min(floors - 1, (int)(floorPick[a] * floors));
+        crowd.x[i] = b.x + AGENT_RADIUS + offsetX[a] * std::max(0.0f, b.width - 2.0f * AGENT_RADIUS);
+
+        // Depth into the room stands in for the third dimension
+        crowd.floorY[i] = ROAD_TOP - floor * floorHeight - AGENT_RADIUS - depth[a] * floorHeight * 0.5f;
+        crowd.y[i] = crowd.floorY[i];
+        crowd.velocityX[i] = 0.0f;
+        crowd.velocityY[i] = 0.0f;
+        crowd.speed[i] = AGENT_MIN_SPEED + pace[a] * (AGENT_MAX_SPEED - AGENT_MIN_SPEED);
+
+        // Out of the door and away along the road on the side it started
+        float away = AGENT_ASSEMBLY_GAP + assemblyX[a] * AGENT_ASSEMBLY_SPREAD;
+        crowd.goalX[i] = crowd.x[i] < doorX ? b.x - away : b.x + b.width + away;
+        crowd.goalY[i] = ROAD_TOP + 2.0f * AGENT_RADIUS + assemblyY[a] * (ROAD_BOTTOM - ROAD_TOP - 4.0f * AGENT_RADIUS);
+        crowd.previousX[i] = crowd.x[i];
+        crowd.previousY[i] = crowd.y[i];
+        crowd.building[i] = building;
+        crowd.phase[i] = AGENT_FLOOR;
+    }
+}
+
+int moveAgents(CrowdAgents& crowd, int begin, int end, float deltaTime, const SpatialHash& agents,
+               const unsigned char* phases, const SpatialHash& windows, const FireGrid& fire, const Scene& scene) {
+    const float inverseSpacingSquared = 1.0f / (AGENT_SPACING * AGENT_SPACING);
+    // Peaks at AGENT_SEPARATION_SPEED, a little over half the spacing apart
+    const float separation = AGENT_SEPARATION_SPEED * 2.6f / AGENT_SPACING;
+    const float fireRangeSquared = AGENT_FIRE_RANGE * AGENT_FIRE_RANGE;
+    const float doorY = ROAD_TOP - AGENT_RADIUS;
+    float response = std::min(1.0f, AGENT_RESPONSE * deltaTime);
+    int walking = 0;
+
+    for (int i = begin; i < end; i++) {
+        float x = crowd.x[i], y = crowd.y[i];
+        crowd.previousX[i] = x;
+        crowd.previousY[i] = y;
+        int phase = crowd.phase[i];
+        if (phase == AGENT_SAFE) continue;
+
+        const BuildingDesc& b = scene.buildings[crowd.building[i]];
+        float doorX = b.x + b.width * 0.5f;
+        bool inStairwell = std::fabs(x - doorX) < AGENT_STAIR_HALF_WIDTH;
+        if (phase == AGENT_FLOOR && inStairwell) {
+            phase = AGENT_STAIRS;
+        }
+        if (phase == AGENT_STAIRS && inStairwell && y >= doorY - AGENT_ARRIVE_RADIUS) {
+            phase = AGENT_OUTSIDE;
+        }
+
+        float targetX = doorX, targetY = crowd.floorY[i];
+        if (phase == AGENT_STAIRS) {
+            targetY = doorY;
+        } else if (phase == AGENT_OUTSIDE) {
+            targetX = crowd.goalX[i];
+            targetY = crowd.goalY[i];
+        }
+        float toX = targetX - x, toY = targetY - y;
+        float distance = std::sqrt(toX * toX + toY * toY);
+        if (phase == AGENT_OUTSIDE && distance < AGENT_ARRIVE_RADIUS) {
+            crowd.phase[i] = AGENT_SAFE;
+            crowd.velocityX[i] = 0.0f;
+            crowd.velocityY[i] = 0.0f;
+            continue;
+        }
+
+        // Burning windows close by push the agent away and hurry it on
+        float pushX = 0.0f, pushY = 0.0f;
+        bool nearFire = false;
+        windows.forEachNear(x, y, [&](int window, float windowX, float windowY) {
+            float dx = x - windowX, dy = y - windowY;
+            float d2 = dx * dx + dy * dy;
+            if (d2 >= fireRangeSquared || !fire.isBurning(window)) return;
+            float d = std::sqrt(d2);
+            if (d > 1e-4f) {
+                float strength = AGENT_FIRE_SPEED * (1.0f - d / AGENT_FIRE_RANGE) / d;
+                pushX += dx * strength;
+                pushY += dy * strength;
+            }
+            nearFire = true;
+        });
+
+        // Neighbors too close push apart, d (1 - d^2 / spacing^2) strong:
+        // no square root or division per neighbor, and the agent itself
+        // adds nothing. Agents on the same spot are split by index. Those
+        // already safe make room, or the last ones out could be held off
+        // their assembly points for good.
+        agents.forEachNear(x, y, [&](int other, float otherX, float otherY) {
+            if (phases[other] == AGENT_SAFE) return;
+            float dx = x - otherX, dy = y - otherY;
+            float d2 = dx * dx + dy * dy;
+            if (d2 < 1e-8f && other != i) {
+                dx = other < i ? 0.01f : -0.01f;
+            }
+            float strength = std::max(0.0f, 1.0f - d2 * inverseSpacingSquared) * separation;
+            pushX += dx * strength;
+            pushY += dy * strength;
+        });
+
+        // Head for the target without overshooting it in one step
+        float pace = crowd.speed[i] * (nearFire ? AGENT_PANIC_FACTOR : 1.0f);
+        float wanted = distance > 1e-4f ? std::min(pace, distance / deltaTime) / distance : 0.0f;
+        float vx = crowd.velocityX[i], vy = crowd.velocityY[i];
+        vx += (toX * wanted + pushX - vx) * response;
+        vy += (toY * wanted + pushY - vy) * response;
+        x += vx * deltaTime;
+        y += vy * deltaTime;
+
+        // Walls: inside the building until the door, then on the road
+        if (phase < AGENT_OUTSIDE) {
+            x = std::max(b.x + AGENT_RADIUS, std::min(b.x + b.width - AGENT_RADIUS, x));
+            y = std::max(ROAD_TOP - b.height + AGENT_RADIUS, std::min(doorY, y));
+        } else {
+            y = std::max(doorY, std::min(ROAD_BOTTOM - AGENT_RADIUS, y));
+        }
+
+        crowd.x[i] = x;
+        crowd.y[i] = y;
+        crowd.velocityX[i] = vx;
+        crowd.velocityY[i] = vy;
+        crowd.phase[i] = (unsigned char)phase;
+        walking++;
+    }
+    return walking;
+}
@@ -0,0 +1,125 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <vector>
+
+class StateWriter;
+class StateReader;
+class SpatialHash;
+class FireGrid;
+struct Scene;
+struct BuildingDesc;
+
+// Default number of occupants preallocated at startup
+const int DEFAULT_CROWD_CAPACITY = 65536;
+
+// Occupants who leave each building once it burns
+const int DEFAULT_OCCUPANTS = 200;
+
+// Agents per job, for moving and drawing
+const int AGENT_CHUNK_SIZE = 4096;
+
+// Random numbers drawn per occupant: x, floor, depth, speed, assembly x, assembly y
+const int RANDOMS_PER_AGENT = 6;
+
+// Agents closer than AGENT_SPACING push each other apart, up to
+// AGENT_SEPARATION_SPEED units per second; the neighbor grid's cells are
+// this wide
+const float AGENT_RADIUS = 2.0f;
+const float AGENT_SPACING = 4.0f;
+const float AGENT_SEPARATION_SPEED = 40.0f;
+
+// Walking speeds in units per second; near a burning window agents are
+// pushed away from it and hurry
+const float AGENT_MIN_SPEED = 22.0f;
+const float AGENT_MAX_SPEED = 38.0f;
+const float AGENT_FIRE_RANGE = 16.0f;
+const float AGENT_FIRE_SPEED = 60.0f;
+const float AGENT_PANIC_FACTOR = 1.6f;
+
+// How fast velocity follows the wanted one, per second
+const float AGENT_RESPONSE = 8.0f;
+
+// The stairwell runs down the middle of a building to the door
+const float AGENT_STAIR_HALF_WIDTH = 6.0f;
+
+// Assembly points along the road, past the building's side
+const float AGENT_ASSEMBLY_GAP = 20.0f;
+const float AGENT_ASSEMBLY_SPREAD = 160.0f;
+const float AGENT_ARRIVE_RADIUS = 3.0f;
+
+// Where an occupant is on the way out
+enum AgentPhase {
+    AGENT_FLOOR,   // Walking along its floor to the stairwell
+    AGENT_STAIRS,  // Going down to the door
+    AGENT_OUTSIDE, // On the road, heading for its assembly point
+    AGENT_SAFE     // Standing at the assembly point
+};
+
+// Fixed-capacity structure-of-arrays storage for evacuating occupants,
+// like ParticlePool. Agents are never removed, so an index stays with one
+// occupant for the whole run.
+class CrowdAgents {
+public:
+    CrowdAgents();
+
+    // Reallocates all arrays and drops every agent
+    void setCapacity(int newCapacity);
+    int capacity() const { return maxCount; }
+
+    // Reserves up to requested consecutive agents starting at first.
+    // Returns how many were granted; the rest count as dropped.
+    int spawnBlock(int requested, int& first);
+
+    void clear();
+
+    // Counts agents per phase into counts[4]
+    void countPhases(int counts[4]) const;
+
+    // Live agents only; loading fails if they do not fit
+    void saveState(StateWriter& out) const;
+    bool loadState(StateReader& in, int buildingCount);
+
+    int count;
+    long long droppedSpawns;
+
+    float* x;
+    float* y;          // Feet
+    float* velocityX;
+    float* velocityY;
+    float* speed;      // Walking speed
+    float* floorY;     // Where it walks along its floor
+    float* goalX;      // Assembly point
+    float* goalY;
+    float* previousX;  // Position before the last step, for drawing between steps
+    float* previousY;
+    int* building;     // Index into the scene's buildings
+    unsigned char* phase; // AgentPhase
+
+private:
+    int maxCount;
+    std::vector<float> storage;
+    std::vector<int> buildingStorage;
+    std::vector<unsigned char> phaseStorage;
+};
+
+// People a building holds: every floor filled at AGENT_SPACING, half a
+// floor deep. More would only stand on each other.
+int occupantCapacity(const BuildingDesc& building);
+
+// Places agents [first, first + count) of building at random spots on its
+// floors, with assembly points on the side of the building they start on.
+// random holds RANDOMS_PER_AGENT * count numbers in [0, 1).
+void placeOccupants(CrowdAgents& crowd, int first, int count, int building, const Scene& scene,
+                    const float* random);
+
+// Moves agents [begin, end) one step toward their goals. Neighbors come
+// from agents, hashed at the start of the step, with phases copied then
+// too, and never from the arrays being written, so the result does not
+// depend on how the agents are split across jobs. windows holds the
+// layout's window centers; burning ones push agents away. Returns how
+// many are still on their way.
+int moveAgents(CrowdAgents& crowd, int begin, int end, float deltaTime, const SpatialHash& agents,
+               const unsigned char* phases, const SpatialHash& windows, const FireGrid& fire, const Scene& scene);
+
+#endif // CROWD_H
@@ -0,0 +1,106 @@
+#include "dispatch.h"
+#include "road_network.h"
+
+#include <algorithm>
+
+Dispatcher::Dispatcher() : stationCount(0) {
+}
+
+void Dispatcher::build(const RoadNetwork& roads, const std::vector<int>& stationNodes,
+                       const std::vector<int>& truckStations) {
+    int nodes = roads.nodeCount();
+    stationCount = (int)stationNodes.size();
+    nearestStations.assign((size_t)nodes * stationCount, 0);
+    reachable.assign(nodes, 0);
+    for (int node = 0; node < nodes; node++) {
+        int* order = nearestStations.data() + (size_t)node * stationCount;
+        for (int s = 0; s < stationCount; s++) {
+            order[s] = s;
+        }
+        auto distanceFrom = [&](int s) { return roads.distance(stationNodes[s], node); };
+        std::stable_sort(order, order + stationCount,
+                         [&](int a, int b) { return distanceFrom(a) < distanceFrom(b); });
+        while (reachable[node] < stationCount && distanceFrom(order[reachable[node]]) < ROAD_UNREACHABLE) {
+            reachable[node]++;
+        }
+    }
+
+    truckStation = truckStations;
+    stationFirst.assign(stationCount + 1, 0);
+    for (int station : truckStation) {
+        stationFirst[station + 1]++;
+    }
+    for (int s = 0; s < stationCount; s++) {
+        stationFirst[s + 1] += stationFirst[s];
+    }
+    parked.assign(truckStation.size(), 0);
+    freeCount.assign(stationCount, 0);
+    busy.assign(truckStation.size(), 0);
+    reset();
+}
+
+void Dispatcher::reset() {
+    // Highest index at the bottom of each stack, so the lowest goes first
+    std::fill(freeCount.begin(), freeCount.end(), 0);
+    for (int truck = (int)truckStation.size() - 1; truck >= 0; truck--) {
+        int station = truckStation[truck];
+        parked[stationFirst[station] + freeCount[station]++] = truck;
+    }
+    std::fill(busy.begin(), busy.end(), 0);
+}
+
+int Dispatcher::dispatch(const int* incidentNodes, int incidentCount, int trucksEach,
+                         std::vector<DispatchOrder>& orders) {
+    int sent = 0;
+    if (stationCount == 0) return sent;
+    for (int incident = 0; incident < incidentCount; incident++) {
+        int node = incidentNodes[incident];
+        const int* order = &nearestStations[(size_t)node * stationCount];
+        int slot = 0;
+        for (int k = 0; k < reachable[node] && slot < trucksEach; k++) {
+            int station = order[k];
+            while (freeCount[station] > 0 && slot < trucksEach) {
+                int truck = parked[stationFirst[station] + --freeCount[station]];
+                busy[truck] = 1;
+                orders.push_back({truck, incident, slot++});
+                sent++;
+            }
+        }
+    }
+    return sent;
+}
+
+void Dispatcher::take(int truck) {
+    if (busy[truck]) return;
+    int station = truckStation[truck];
+    int* first = &parked[stationFirst[station]];
+    int* last = first + freeCount[station];
+    int* position = std::find(first, last, truck);
+    std::copy(position + 1, last, position);
+    freeCount[station]--;
+    busy[truck] = 1;
+}
+
+void Dispatcher::release(int truck) {
+    if (!busy[truck]) return;
+
+    // Into its place by index, so the lowest is still on top; stations
+    // hold few trucks
+    int station = truckStation[truck];
+    int* first = &parked[stationFirst[station]];
+    int k = freeCount[station]++;
+    while (k > 0 && first[k - 1] < truck) {
+        first[k] = first[k - 1];
+        k--;
+    }
+    first[k] = truck;
+    busy[truck] = 0;
+}
+
+int Dispatcher::freeTrucks() const {
+    int total = 0;
+    for (int count : freeCount) {
+        total += count;
+    }
+    return total;
+}
@@ -0,0 +1,55 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <vector>
+
+class RoadNetwork;
+
+// A truck sent to an incident; slot is its place in the line there, 0 in
+// front, in the order the trucks were picked
+struct DispatchOrder {
+    int truck;
+    int incident;
+    int slot;
+};
+
+// Sends free trucks to incidents, nearest station first. When it is built,
+// the stations are sorted by driving distance once for every road node, so
+// a decision walks the incident node's list and takes free trucks until
+// the incident has enough: no routing or sorting per incident.
+class Dispatcher {
+public:
+    Dispatcher();
+
+    // stationNodes[s] is the node of station s, truckStations[t] the station
+    // of truck t. Every truck starts free.
+    void build(const RoadNetwork& roads, const std::vector<int>& stationNodes, const std::vector<int>& truckStations);
+
+    // Every truck free again, at its station
+    void reset();
+
+    // Up to trucksEach orders for each incident at incidentNodes[i], in
+    // incident order, appended to orders. An incident gets fewer when the
+    // stations that can reach it run out. Returns the number of orders.
+    int dispatch(const int* incidentNodes, int incidentCount, int trucksEach, std::vector<DispatchOrder>& orders);
+
+    // Marks a free truck busy without an order, e.g. after loading a state
+    void take(int truck);
+
+    // A busy truck is back at its station
+    void release(int truck);
+
+    int freeTrucks() const;
+
+private:
+    int stationCount;
+    std::vector<int> nearestStations; // Per node, stationCount entries, reachable ones first
+    std::vector<int> reachable;       // Per node, how many stations can reach it
+    std::vector<int> truckStation;
+    std::vector<int> stationFirst;    // Station s's trucks are parked[first[s], first[s + 1])
+    std::vector<int> parked;          // Free ones first, lowest index taken first
+    std::vector<int> freeCount;
+    std::vector<char> busy;
+};
+
+#endif // DISPATCH_H
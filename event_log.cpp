@@ -0,0 +1,118 @@
+#include "event_log.h"
+
+#include <cstdio>
+#include <algorithm>
+
+static const char* const codeNames[EVENT_CODE_COUNT] = {
+    "simulation_started",
+    "normal_operation",
+    "fire_detected",
+    "window_ignited",
+    "alarm",
+    "crew_arriving",
+    "firefighters_dispatched",
+    "extinguishing",
+    "fire_out",
+    "trucks_leaving",
+    "evacuation"
+};
+
+const char* eventCodeName(int code) {
+    return code >= 0 && code < EVENT_CODE_COUNT ? codeNames[code] : "unknown";
+}
+
+void formatEvent(const SimEvent& event, char* out, size_t size) {
+    switch (event.code) {
+        case EVENT_SIMULATION_STARTED: snprintf(out, size, "System: Simulation started"); break;
+        case EVENT_NORMAL_OPERATION: snprintf(out, size, "System: Normal operation"); break;
+        case EVENT_FIRE_DETECTED:
+            if (event.building >= 0) {
+                snprintf(out, size, "ALERT: Fire detected in building %d!", event.building);
+            } else {
+                snprintf(out, size, "ALERT: Fire detected in building!");
+            }
+            break;
+        case EVENT_WINDOW_IGNITED:
+            snprintf(out, size, "ALERT: Fire at building %d, window %d", event.building, event.window);
+            break;
+        case EVENT_ALARM: snprintf(out, size, "ALERT: Alarm activated!"); break;
+        case EVENT_CREW_ARRIVING: snprintf(out, size, "UPDATE: Emergency crew arriving"); break;
+        case EVENT_FIREFIGHTERS_DISPATCHED: snprintf(out, size, "UPDATE: Firefighters dispatched"); break;
+        case EVENT_EXTINGUISHING: snprintf(out, size, "UPDATE: Firefighters extinguishing fire"); break;
+        case EVENT_FIRE_OUT: snprintf(out, size, "UPDATE: Fire extinguished!"); break;
+        case EVENT_TRUCKS_LEAVING: snprintf(out, size, "UPDATE: Firefighters leaving scene"); break;
+        case EVENT_EVACUATION: snprintf(out, size, "ALERT: Evacuating building %d", event.building); break;
+        default: snprintf(out, size, "Event %d", event.code); break;
+    }
+}
+
+// Set in a stamp while its writer fills the slot
+static const uint64_t STAMP_WRITING = 1ull << 63;
+
+EventLog::EventLog() : next(0), skippedCount(0) {
+    for (Slot& slot : slots) {
+        slot.stamp.store(0, std::memory_order_relaxed);
+        slot.skipped.store(0, std::memory_order_relaxed);
+    }
+}
+
+void EventLog::log(EventCode code, float time, int state, int incident, int building, int window) {
+    uint64_t sequence = next.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[sequence & (EVENT_LOG_CAPACITY - 1)];
+
+    // Take the slot unless another writer is still filling it, or a later
+    // lap already has. Either way this event is skipped rather than waited
+    // for, and marked so readers know it will never come.
+    uint64_t stamp = slot.stamp.load(std::memory_order_relaxed);
+    do {
+        if ((stamp & STAMP_WRITING) || stamp > sequence) {
+            markSkipped(sequence);
+            return;
+        }
+    } while (!slot.stamp.compare_exchange_weak(stamp, STAMP_WRITING | (sequence + 1), std::memory_order_relaxed));
+
+    // Readers that see the writing bit, or a stamp that changed under them,
+    // retry or skip the slot
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event.sequence = sequence;
+    slot.event.time = time;
+    slot.event.code = code;
+    slot.event.state = state;
+    slot.event.incident = incident;
+    slot.event.building = building;
+    slot.event.window = window;
+    slot.stamp.store(sequence + 1, std::memory_order_release);
+}
+
+void EventLog::markSkipped(uint64_t sequence) {
+    // The latest skip in the slot wins, without waiting on anyone
+    Slot& slot = slots[sequence & (EVENT_LOG_CAPACITY - 1)];
+    uint64_t marked = slot.skipped.load(std::memory_order_relaxed);
+    while (marked < sequence + 1 &&
+           !slot.skipped.compare_exchange_weak(marked, sequence + 1, std::memory_order_release)) {
+    }
+    skippedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool EventLog::skipped(uint64_t sequence) const {
+    const Slot& slot = slots[sequence & (EVENT_LOG_CAPACITY - 1)];
+    return slot.skipped.load(std::memory_order_acquire) == sequence + 1;
+}
+
+bool EventLog::read(uint64_t sequence, SimEvent& out) const {
+    const Slot& slot = slots[sequence & (EVENT_LOG_CAPACITY - 1)];
+    if (slot.stamp.load(std::memory_order_acquire) != sequence + 1) return false;
+    out = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.stamp.load(std::memory_order_relaxed) == sequence + 1;
+}
+
+int EventLog::latest(SimEvent* out, int count) const {
+    uint64_t end = total();
+    uint64_t begin = end - std::min<uint64_t>(end, (uint64_t)std::max(0, count));
+    int copied = 0;
+    for (uint64_t sequence = begin; sequence < end; sequence++) {
+        if (read(sequence, out[copied])) copied++;
+    }
+    return copied;
+}
@@ -0,0 +1,91 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Events kept in memory; older ones are overwritten. Must be a power of two.
+const int EVENT_LOG_CAPACITY = 1024;
+
+// What happened. Names for files come from eventCodeName(), HUD lines from
+// formatEvent(); new codes go at the end so old files still read.
+enum EventCode {
+    EVENT_SIMULATION_STARTED,
+    EVENT_NORMAL_OPERATION,
+    EVENT_FIRE_DETECTED,
+    EVENT_WINDOW_IGNITED,
+    EVENT_ALARM,
+    EVENT_CREW_ARRIVING,
+    EVENT_FIREFIGHTERS_DISPATCHED,
+    EVENT_EXTINGUISHING,
+    EVENT_FIRE_OUT,
+    EVENT_TRUCKS_LEAVING,
+    EVENT_EVACUATION,
+    EVENT_CODE_COUNT
+};
+
+// One fixed-size record with no pointers, copied into the ring and written
+// to binary event files as is
+struct SimEvent {
+    uint64_t sequence;  // Logging order, from 0
+    float time;         // Sim seconds
+    int32_t code;       // EventCode
+    int32_t state;      // SimState after the event
+    int32_t incident;   // 0 in a single-incident run
+    int32_t building;   // Index into scene.buildings, -1 if none
+    int32_t window;     // Within the building, floor * windowsPerFloor + col; -1 if none
+};
+
+// "fire_detected" and so on
+const char* eventCodeName(int code);
+
+// The HUD line for an event
+void formatEvent(const SimEvent& event, char* out, size_t size);
+
+// The latest EVENT_LOG_CAPACITY events in a fixed ring. Any thread may log
+// without locks or allocation. Logging never waits for readers: when the
+// ring wraps the oldest events are overwritten, and readers copying by
+// sequence number can tell they missed them. Writers never wait either: a
+// writer whose slot is still being filled by one a whole lap earlier skips
+// its event.
+class EventLog {
+public:
+    EventLog();
+
+    void log(EventCode code, float time, int state, int incident, int building, int window);
+
+    // Events ever logged; the next one gets this sequence number
+    uint64_t total() const { return next.load(std::memory_order_acquire); }
+
+    // Copies event sequence into out. False if it is still being written,
+    // was skipped or was already overwritten.
+    bool read(uint64_t sequence, SimEvent& out) const;
+
+    // Whether event sequence was skipped, so read() will never find it.
+    // Only known while the slot has not been skipped again a lap later.
+    bool skipped(uint64_t sequence) const;
+
+    // Up to count of the latest events, oldest first; returns how many
+    int latest(SimEvent* out, int count) const;
+
+    // Events skipped because their slot was busy
+    uint64_t skippedTotal() const { return skippedCount.load(std::memory_order_relaxed); }
+
+private:
+    // Gives up on event sequence; self-checks skip one on purpose
+    void markSkipped(uint64_t sequence);
+    friend bool checkEventLog();
+
+    struct Slot {
+        std::atomic<uint64_t> stamp;   // sequence + 1, with the top bit set while writing; 0 for never
+        std::atomic<uint64_t> skipped; // sequence + 1 of the latest event skipped here
+        SimEvent event;
+    };
+
+    Slot slots[EVENT_LOG_CAPACITY];
+    std::atomic<uint64_t> next;
+    std::atomic<uint64_t> skippedCount;
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,96 @@
+#include "event_sink.h"
+
+#include <chrono>
+#include <cstring>
+
+EventFileFormat eventFormatForPath(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot && (strcmp(dot, ".jsonl") == 0 || strcmp(dot, ".json") == 0)) {
+        return EVENT_FILE_JSONL;
+    }
+    return EVENT_FILE_BINARY;
+}
+
+EventSink::EventSink()
+    : source(nullptr), file(nullptr), format(EVENT_FILE_BINARY), cursor(0), writeFailed(false),
+      stopping(false), writtenCount(0), lostCount(0) {
+}
+
+EventSink::~EventSink() {
+    finish();
+}
+
+bool EventSink::start(const char* path, const EventLog& log, uint64_t first) {
+    finish();
+    format = eventFormatForPath(path);
+    file = fopen(path, format == EVENT_FILE_JSONL ? "w" : "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR: Cannot write '%s'\n", path);
+        return false;
+    }
+    if (format == EVENT_FILE_BINARY) {
+        uint32_t header[2] = {(uint32_t)sizeof(SimEvent), 0};
+        fwrite(EVENT_FILE_MAGIC, 1, sizeof(EVENT_FILE_MAGIC), file);
+        fwrite(header, sizeof(header), 1, file);
+    }
+
+    source = &log;
+    cursor = first;
+    writeFailed = false;
+    writtenCount = 0;
+    lostCount = 0;
+    stopping = false;
+    thread = std::thread(&EventSink::run, this);
+    return true;
+}
+
+bool EventSink::finish() {
+    if (!thread.joinable()) return !writeFailed;
+    stopping = true;
+    thread.join();
+    if (fclose(file) != 0) {
+        writeFailed = true;
+    }
+    file = nullptr;
+    return !writeFailed;
+}
+
+void EventSink::run() {
+    while (!stopping.load()) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(EVENT_SINK_INTERVAL_MS));
+    }
+    drain();
+    fflush(file);
+}
+
+void EventSink::drain() {
+    uint64_t end = source->total();
+    if (end - cursor > (uint64_t)EVENT_LOG_CAPACITY) {
+        lostCount += (long long)(end - EVENT_LOG_CAPACITY - cursor);
+        cursor = end - EVENT_LOG_CAPACITY;
+    }
+
+    SimEvent event;
+    while (cursor < end) {
+        if (!source->read(cursor, event)) {
+            // Still being written: pick it up next time. Skipped or
+            // overwritten: gone.
+            if (!source->skipped(cursor) && source->total() - cursor <= (uint64_t)EVENT_LOG_CAPACITY) break;
+            lostCount++;
+        } else if (!writeFailed) {
+            writeFailed = !writeEvent(event);
+            writtenCount += writeFailed ? 0 : 1;
+        }
+        cursor++;
+    }
+}
+
+bool EventSink::writeEvent(const SimEvent& event) {
+    if (format == EVENT_FILE_BINARY) {
+        return fwrite(&event, sizeof(event), 1, file) == 1;
+    }
+    return fprintf(file, "{\"seq\":%llu,\"time\":%.4f,\"code\":\"%s\",\"state\":%d,\"incident\":%d,"
+                   "\"building\":%d,\"window\":%d}\n", (unsigned long long)event.sequence, event.time,
+                   eventCodeName(event.code), event.state, event.incident, event.building, event.window) > 0;
+}
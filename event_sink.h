@@ -0,0 +1,64 @@
+#ifndef EVENT_SINK_H
+#define EVENT_SINK_H
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "event_log.h"
+
+// Binary event files start with this magic and the record size, followed
+// by SimEvent records as laid out in memory (little endian on every
+// platform we build for)
+const char EVENT_FILE_MAGIC[8] = {'F', 'I', 'R', 'E', 'E', 'V', 'T', '1'};
+
+// How often the sink thread drains the log
+const int EVENT_SINK_INTERVAL_MS = 20;
+
+enum EventFileFormat {
+    EVENT_FILE_BINARY,
+    EVENT_FILE_JSONL
+};
+
+// .jsonl and .json mean one JSON object per line; anything else is binary
+EventFileFormat eventFormatForPath(const char* path);
+
+// Streams an EventLog to a file from a background thread, so logging never
+// touches the disk. The sink polls the log and never holds the producers
+// up; if it falls more than EVENT_LOG_CAPACITY events behind, the oldest
+// are counted as lost.
+class EventSink {
+public:
+    EventSink();
+    ~EventSink();
+
+    // Writes every event from sequence first on, as long as the log still
+    // holds it. False if the file cannot be created.
+    bool start(const char* path, const EventLog& log, uint64_t first);
+
+    // Writes what is left and closes the file. False if a write failed.
+    bool finish();
+
+    bool running() const { return thread.joinable(); }
+
+    long long written() const { return writtenCount.load(); }
+    long long lost() const { return lostCount.load(); }
+
+private:
+    void run();
+    void drain();
+    bool writeEvent(const SimEvent& event);
+
+    const EventLog* source;
+    FILE* file;
+    EventFileFormat format;
+    uint64_t cursor;       // Next sequence to write
+    bool writeFailed;
+
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::atomic<long long> writtenCount;
+    std::atomic<long long> lostCount;
+};
+
+#endif // EVENT_SINK_H
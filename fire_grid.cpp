@@ -0,0 +1,355 @@
+#include "fire_grid.h"
+#include "state_io.h"
+#include "scene_layout.h"
+#include "job_system.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Heat is measured in units of the ignition point
+const float IGNITION_HEAT = 1.0f;
+const float EXTINGUISH_HEAT = 0.5f; // A burning cell cooled below this goes out
+const float MAX_HEAT = 2.0f;
+const float MIN_HEAT = 1e-3f;       // Anything colder counts as cold
+
+// Rates per second
+const float BURN_HEAT_RATE = 0.5f;  // Heat a burning cell produces
+const float BURN_RATE = 0.05f;      // Fuel it uses; a window burns for 20 s
+const float SPREAD_RATE = 0.3f;     // Heat from a burning neighbor of weight 1
+const float COOLING_RATE = 0.05f;   // Fraction of heat lost
+
+// Neighbor weights; flames climb faster than they spread sideways or down
+const float WEIGHT_ABOVE = 1.0f;
+const float WEIGHT_SIDE = 0.4f;
+const float WEIGHT_BELOW = 0.2f;
+const float WEIGHT_ACROSS = 0.3f;   // Edge windows of the next building, at zero gap
+const float MAX_SPREAD_GAP = 150.0f; // Wider streets stop the fire
+
+// Active tiles per job
+const int TILE_CHUNK_SIZE = 64;
+
+struct FireEdge {
+    int cell;
+    int neighbor;
+    float weight;
+};
+
+FireGrid::FireGrid() : current(0) {
+}
+
+void FireGrid::build(const Scene& scene, const SceneLayout& layout) {
+    int windowCount = (int)layout.windows.size();
+    cellWindow.clear();
+    cellTile.clear();
+    tileStart.clear();
+    windowCell.assign(windowCount, -1);
+    cellWindow.reserve(windowCount);
+    cellTile.reserve(windowCount);
+
+    // Number cells tile by tile so a tile is one contiguous run
+    for (int b = 0; b < (int)scene.buildings.size(); b++) {
+        const BuildingLayout& building = layout.buildings[b];
+        int floors = scene.buildings[b].floors;
+        int columns = building.windowsPerFloor;
+
+        for (int floor0 = 0; floor0 < floors; floor0 += FIRE_TILE_FLOORS) {
+            for (int column0 = 0; column0 < columns; column0 += FIRE_TILE_COLUMNS) {
+                int tile = (int)tileStart.size();
+                tileStart.push_back((int)cellWindow.size());
+
+                int floorEnd = std::min(floors, floor0 + FIRE_TILE_FLOORS);
+                int columnEnd = std::min(columns, column0 + FIRE_TILE_COLUMNS);
+                for (int floor = floor0; floor < floorEnd; floor++) {
+                    for (int column = column0; column < columnEnd; column++) {
+                        int window = building.firstWindow + floor * columns + column;
+                        windowCell[window] = (int)cellWindow.size();
+                        cellWindow.push_back(window);
+                        cellTile.push_back(tile);
+                    }
+                }
+            }
+        }
+    }
+    int cells = (int)cellWindow.size();
+    int tiles = (int)tileStart.size();
+    tileStart.push_back(cells);
+
+    // Neighbors inside each building
+    std::vector<FireEdge> edges;
+    edges.reserve((size_t)cells * 4);
+    for (int b = 0; b < (int)scene.buildings.size(); b++) {
+        const BuildingLayout& building = layout.buildings[b];
+        int floors = scene.buildings[b].floors;
+        int columns = building.windowsPerFloor;
+
+        for (int floor = 0; floor < floors; floor++) {
+            for (int column = 0; column < columns; column++) {
+                int cell = windowCell[building.firstWindow + floor * columns + column];
+                if (floor + 1 < floors) {
+                    edges.push_back({cell, windowCell[building.firstWindow + (floor + 1) * columns + column], WEIGHT_ABOVE});
+                }
+                if (floor > 0) {
+                    edges.push_back({cell, windowCell[building.firstWindow + (floor - 1) * columns + column], WEIGHT_BELOW});
+                }
+                if (column > 0) {
+                    edges.push_back({cell, windowCell[building.firstWindow + floor * columns + column - 1], WEIGHT_SIDE});
+                }
+                if (column + 1 < columns) {
+                    edges.push_back({cell, windowCell[building.firstWindow + floor * columns + column + 1], WEIGHT_SIDE});
+                }
+            }
+        }
+    }
+
+    // Across the street: right column of a building to the left column of
+    // the next one, between windows at about the same height
+    std::vector<int> byX(scene.buildings.size());
+    for (int b = 0; b < (int)byX.size(); b++) byX[b] = b;
+    std::sort(byX.begin(), byX.end(), [&](int a, int b) { return scene.buildings[a].x < scene.buildings[b].x; });
+
+    for (int i = 0; i + 1 < (int)byX.size(); i++) {
+        const BuildingDesc& left = scene.buildings[byX[i]];
+        const BuildingDesc& right = scene.buildings[byX[i + 1]];
+        float gap = right.x - (left.x + left.width);
+        if (gap >= MAX_SPREAD_GAP) continue;
+
+        float weight = WEIGHT_ACROSS * (1.0f - std::max(0.0f, gap) / MAX_SPREAD_GAP);
+        float reach = 0.5f * std::max(left.height / left.floors, right.height / right.floors);
+        const BuildingLayout& leftLayout = layout.buildings[byX[i]];
+        const BuildingLayout& rightLayout = layout.buildings[byX[i + 1]];
+
+        for (int leftFloor = 0; leftFloor < left.floors; leftFloor++) {
+            int leftWindow = leftLayout.firstWindow + leftFloor * left.windowsPerFloor + left.windowsPerFloor - 1;
+            for (int rightFloor = 0; rightFloor < right.floors; rightFloor++) {
+                int rightWindow = rightLayout.firstWindow + rightFloor * right.windowsPerFloor;
+                if (fabs(layout.windows[leftWindow].y - layout.windows[rightWindow].y) > reach) continue;
+                edges.push_back({windowCell[leftWindow], windowCell[rightWindow], weight});
+                edges.push_back({windowCell[rightWindow], windowCell[leftWindow], weight});
+            }
+        }
+    }
+
+    // Bucket edges by cell into compressed rows
+    neighborStart.assign(cells + 1, 0);
+    for (const FireEdge& edge : edges) {
+        neighborStart[edge.cell + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        neighborStart[c + 1] += neighborStart[c];
+    }
+    neighborCell.resize(edges.size());
+    neighborWeight.resize(edges.size());
+    std::vector<int> fill(neighborStart.begin(), neighborStart.end() - 1);
+    for (const FireEdge& edge : edges) {
+        int slot = fill[edge.cell]++;
+        neighborCell[slot] = edge.neighbor;
+        neighborWeight[slot] = edge.weight;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        heat[i].resize(cells);
+        burning[i].resize(cells);
+    }
+    fuel.resize(cells);
+    water.resize(cells);
+    tileActive.resize(tiles);
+    activeTiles.reserve(tiles);
+    keptTiles.reserve(tiles);
+    burningList.reserve(cells);
+    clear();
+}
+
+void FireGrid::clear() {
+    for (int i = 0; i < 2; i++) {
+        std::fill(heat[i].begin(), heat[i].end(), 0.0f);
+        std::fill(burning[i].begin(), burning[i].end(), 0);
+    }
+    std::fill(fuel.begin(), fuel.end(), 1.0f);
+    std::fill(water.begin(), water.end(), 0.0f);
+    std::fill(tileActive.begin(), tileActive.end(), 0);
+    activeTiles.clear();
+    burningList.clear();
+    current = 0;
+}
+
+void FireGrid::ignite(int window) {
+    int cell = windowCell[window];
+    if (burning[current][cell] || fuel[cell] <= 0.0f) return;
+
+    heat[current][cell] = std::max(heat[current][cell], IGNITION_HEAT);
+    burning[current][cell] = 1;
+    burningList.push_back(window);
+    activateTile(cellTile[cell]);
+    activateAround(cell);
+}
+
+void FireGrid::addWater(int window, float heat) {
+    // Only active tiles are stepped, and stepping is what dries a cell
+    int cell = windowCell[window];
+    if (tileActive[cellTile[cell]]) {
+        water[cell] += heat;
+    }
+}
+
+int FireGrid::activeCellCount() const {
+    int count = 0;
+    for (int tile : activeTiles) {
+        count += tileStart[tile + 1] - tileStart[tile];
+    }
+    return count;
+}
+
+void FireGrid::activateTile(int tile) {
+    if (!tileActive[tile]) {
+        tileActive[tile] = 1;
+        activeTiles.push_back(tile);
+    }
+}
+
+void FireGrid::activateAround(int cell) {
+    for (int k = neighborStart[cell]; k < neighborStart[cell + 1]; k++) {
+        activateTile(cellTile[neighborCell[k]]);
+    }
+}
+
+void FireGrid::updateTiles(int begin, int end, float deltaTime) {
+    const float* heatIn = heat[current].data();
+    const unsigned char* burningIn = burning[current].data();
+    float* heatOut = heat[current ^ 1].data();
+    unsigned char* burningOut = burning[current ^ 1].data();
+
+    for (int i = begin; i < end; i++) {
+        int tile = activeTiles[i];
+        for (int c = tileStart[tile]; c < tileStart[tile + 1]; c++) {
+            float gain = 0.0f;
+            for (int k = neighborStart[c]; k < neighborStart[c + 1]; k++) {
+                if (burningIn[neighborCell[k]]) {
+                    gain += neighborWeight[k];
+                }
+            }
+
+            float h = heatIn[c];
+            float rate = SPREAD_RATE * gain - COOLING_RATE * h;
+            bool isBurning = burningIn[c] != 0;
+            if (isBurning) {
+                rate += BURN_HEAT_RATE;
+                fuel[c] = std::max(0.0f, fuel[c] - BURN_RATE * deltaTime);
+            }
+            h = std::min(MAX_HEAT, std::max(0.0f, h + rate * deltaTime - water[c]));
+            water[c] = 0.0f;
+
+            if (isBurning) {
+                isBurning = fuel[c] > 0.0f && h >= EXTINGUISH_HEAT;
+            } else {
+                isBurning = fuel[c] > 0.0f && h >= IGNITION_HEAT;
+            }
+            heatOut[c] = h;
+            burningOut[c] = isBurning ? 1 : 0;
+        }
+    }
+}
+
+void FireGrid::step(float deltaTime, JobSystem* jobs) {
+    if (activeTiles.empty()) return;
+    PROFILE_SCOPE("FireGrid::step");
+
+    parallelFor(jobs, (int)activeTiles.size(), TILE_CHUNK_SIZE, [&](int begin, int end, int) {
+        updateTiles(begin, end, deltaTime);
+    });
+    current ^= 1;
+
+    // Put tiles that went cold to sleep; both buffers are zeroed so they
+    // stay consistent while nobody touches them
+    keptTiles.clear();
+    for (int tile : activeTiles) {
+        bool warm = false;
+        for (int c = tileStart[tile]; c < tileStart[tile + 1]; c++) {
+            warm = warm || burning[current][c] || heat[current][c] > MIN_HEAT;
+        }
+
+        if (warm) {
+            keptTiles.push_back(tile);
+            continue;
+        }
+        tileActive[tile] = 0;
+        for (int c = tileStart[tile]; c < tileStart[tile + 1]; c++) {
+            heat[0][c] = heat[1][c] = 0.0f;
+            burning[0][c] = burning[1][c] = 0;
+        }
+    }
+    activeTiles.swap(keptTiles);
+
+    collectBurning();
+}
+
+void FireGrid::collectBurning() {
+    burningList.clear();
+
+    // Tiles next to a burning cell wake up; they hold nothing burning yet
+    int count = (int)activeTiles.size();
+    for (int i = 0; i < count; i++) {
+        int tile = activeTiles[i];
+        for (int c = tileStart[tile]; c < tileStart[tile + 1]; c++) {
+            if (burning[current][c]) {
+                burningList.push_back(cellWindow[c]);
+                activateAround(c);
+            }
+        }
+    }
+
+    // Walk memory in order on the next step
+    if ((int)activeTiles.size() != count) {
+        std::sort(activeTiles.begin(), activeTiles.end());
+    }
+}
+
+void FireGrid::saveState(StateWriter& out) const {
+    out.value(current);
+    for (int i = 0; i < 2; i++) {
+        out.array(heat[i]);
+        out.array(burning[i]);
+    }
+    out.array(fuel);
+    out.array(tileActive);
+    out.array(activeTiles);
+    out.array(burningList);
+}
+
+bool FireGrid::loadState(StateReader& in) {
+    size_t cells = cellWindow.size();
+    size_t tiles = tileActive.size();
+    in.value(current);
+    for (int i = 0; i < 2; i++) {
+        in.array(heat[i]);
+        in.array(burning[i]);
+    }
+    in.array(fuel);
+    in.array(tileActive);
+    in.array(activeTiles);
+    in.array(burningList);
+    bool ok = in.ok() && (current == 0 || current == 1) && fuel.size() == cells && tileActive.size() == tiles &&
+              activeTiles.size() <= tiles;
+    for (int i = 0; i < 2; i++) {
+        ok = ok && heat[i].size() == cells && burning[i].size() == cells;
+    }
+    for (size_t k = 0; ok && k < activeTiles.size(); k++) {
+        ok = activeTiles[k] >= 0 && (size_t)activeTiles[k] < tiles;
+    }
+    for (size_t k = 0; ok && k < burningList.size(); k++) {
+        ok = burningList[k] >= 0 && (size_t)burningList[k] < windowCell.size();
+    }
+    if (!ok) {
+        // Back to the sizes the scene needs, so clear() leaves a valid grid
+        for (int i = 0; i < 2; i++) {
+            heat[i].assign(cells, 0.0f);
+            burning[i].assign(cells, 0);
+        }
+        fuel.assign(cells, 1.0f);
+        tileActive.assign(tiles, 0);
+        activeTiles.clear();
+        burningList.clear();
+        current = 0;
+    }
+    return ok;
+}
@@ -0,0 +1,99 @@
+#ifndef FIRE_GRID_H
+#define FIRE_GRID_H
+
+#include <vector>
+
+#include "scene.h"
+
+class SceneLayout;
+class JobSystem;
+class StateWriter;
+class StateReader;
+
+// Cells per tile: a block of floors x columns of one building
+const int FIRE_TILE_FLOORS = 4;
+const int FIRE_TILE_COLUMNS = 8;
+
+// Fire spread over every window of the scene. Each window is a cell with
+// heat and fuel; a burning cell heats its neighbors (mostly the one above,
+// less to the sides and below, a little across a narrow street) until they
+// ignite, and goes out when its fuel is spent or it is cooled enough, by
+// the air or by water from the hoses.
+//
+// Cells are stored tile by tile so neighbors are close in memory. Heat and
+// burning flags are double buffered, so every cell of a step reads the same
+// previous state and tiles can be updated in parallel. Only tiles that are
+// warm, burning, or next to a burning cell are touched at all.
+class FireGrid {
+public:
+    FireGrid();
+
+    // Needs a layout built from the same scene
+    void build(const Scene& scene, const SceneLayout& layout);
+
+    // Cold, full of fuel, nothing active
+    void clear();
+
+    // Sets a window on fire; index into SceneLayout::windows
+    void ignite(int window);
+
+    // Water that landed on a window since the last step takes away this
+    // much heat in the next one. Cold windows shrug it off.
+    void addWater(int window, float heat);
+
+    void step(float deltaTime, JobSystem* jobs);
+
+    bool isBurning(int window) const {
+        return burning[current][windowCell[window]] != 0;
+    }
+    float heatAt(int window) const {
+        return heat[current][windowCell[window]];
+    }
+
+    // Windows burning after the last step or ignition
+    const std::vector<int>& burningWindows() const { return burningList; }
+
+    int cellCount() const { return (int)cellWindow.size(); }
+    int activeCellCount() const;
+
+    // Heat, fuel, burning flags and active tiles; loading needs a grid
+    // built from the same scene
+    void saveState(StateWriter& out) const;
+    bool loadState(StateReader& in);
+
+    // Current state in cell order, for hashing
+    const float* heatData() const { return heat[current].data(); }
+    const float* fuelData() const { return fuel.data(); }
+
+private:
+    void updateTiles(int begin, int end, float deltaTime);
+    void activateTile(int tile);
+    void activateAround(int cell);
+    void collectBurning();
+
+    // Cell <-> window mapping
+    std::vector<int> cellWindow;
+    std::vector<int> windowCell;
+    std::vector<int> cellTile;
+
+    // Neighbors in compressed rows: cell c's are [neighborStart[c], neighborStart[c + 1])
+    std::vector<int> neighborStart;
+    std::vector<int> neighborCell;
+    std::vector<float> neighborWeight;
+
+    // Tile t is cells [tileStart[t], tileStart[t + 1])
+    std::vector<int> tileStart;
+    std::vector<unsigned char> tileActive;
+    std::vector<int> activeTiles;
+    std::vector<int> keptTiles;
+
+    std::vector<float> heat[2];
+    std::vector<unsigned char> burning[2];
+    std::vector<float> fuel;
+    std::vector<float> water; // Used up by every step, so never saved
+    int current;
+
+    std::vector<int> burningList;
+};
+
+#endif // FIRE_GRID_H
@@ -0,0 +1,302 @@
+#include "fluid.h"
+#include "state_io.h"
+#include "job_system.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUID_X86_SIMD 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define FLUID_X86_SIMD 0
+#endif
+
+// Rows per job
+const int FLUID_ROW_CHUNK = 8;
+
+// Iterations are even so the Jacobi ping-pong ends in the field itself
+const int DIFFUSE_ITERATIONS = 4;
+const int PRESSURE_ITERATIONS = 40;
+
+const float VISCOSITY = 20.0f;        // Scene units^2 per second
+const float HEAT_DIFFUSION = 20.0f;
+const float BUOYANCY = 60.0f;         // Upward acceleration per unit of heat
+const float SMOKE_DECAY = 0.3f;       // Fraction lost per second
+const float HEAT_DECAY = 1.0f;
+const float SMOKE_PER_PARTICLE = 0.02f; // Per second at full life
+const float HEAT_PER_PARTICLE = 0.04f;
+
+// Boundary kinds for setBoundary()
+const int BOUNDARY_SCALAR = 0;
+const int BOUNDARY_U = 1; // Horizontal velocity, mirrored at the side walls
+const int BOUNDARY_V = 2; // Vertical velocity, mirrored at top and bottom
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// out[i] = (rhs[i] + a * (sum of the four neighbors of x[i])) * inverseDenominator
+#if FLUID_X86_SIMD
+TARGET_SSE2
+static void jacobiRow(float* out, const float* x, const float* rhs, int count, int stride,
+                      float a, float inverseDenominator) {
+    const __m128 a4 = _mm_set1_ps(a);
+    const __m128 inverse4 = _mm_set1_ps(inverseDenominator);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(x + i - 1), _mm_loadu_ps(x + i + 1));
+        sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(x + i - stride), _mm_loadu_ps(x + i + stride)));
+        __m128 result = _mm_add_ps(_mm_loadu_ps(rhs + i), _mm_mul_ps(a4, sum));
+        _mm_storeu_ps(out + i, _mm_mul_ps(result, inverse4));
+    }
+    for (; i < count; i++) {
+        float sum = (x[i - 1] + x[i + 1]) + (x[i - stride] + x[i + stride]);
+        out[i] = (rhs[i] + a * sum) * inverseDenominator;
+    }
+}
+#else
+static void jacobiRow(float* out, const float* x, const float* rhs, int count, int stride,
+                      float a, float inverseDenominator) {
+    for (int i = 0; i < count; i++) {
+        float sum = (x[i - 1] + x[i + 1]) + (x[i - stride] + x[i + stride]);
+        out[i] = (rhs[i] + a * sum) * inverseDenominator;
+    }
+}
+#endif
+
+// Bilinear sample at cell coordinates, clamped to the interior
+static inline float sampleField(const float* field, int stride, int width, int height, float x, float y) {
+    x = std::min(std::max(x, 0.5f), width + 0.5f);
+    y = std::min(std::max(y, 0.5f), height + 0.5f);
+    int i0 = (int)x;
+    int j0 = (int)y;
+    float s1 = x - i0;
+    float t1 = y - j0;
+    const float* row0 = field + j0 * stride + i0;
+    const float* row1 = row0 + stride;
+    return (1.0f - t1) * ((1.0f - s1) * row0[0] + s1 * row0[1]) +
+           t1 * ((1.0f - s1) * row1[0] + s1 * row1[1]);
+}
+
+FluidSolver::FluidSolver() : width(0), height(0), cellSize(1.0f), jobs(nullptr) {
+    timings = {0.0, 0.0, 0.0, 0.0};
+}
+
+void FluidSolver::setResolution(int newWidth, int newHeight) {
+    width = std::max(0, newWidth);
+    height = width > 0 ? std::max(1, newHeight) : 0;
+    cellSize = width > 0 ? FLUID_SCENE_WIDTH / width : 1.0f;
+
+    size_t cells = width > 0 ? (size_t)cellCount() : 0;
+    std::vector<float>* fields[] = {&u, &v, &uPrevious, &vPrevious, &smoke, &smokePrevious,
+                                    &heat, &heatPrevious, &pressure, &divergence, &scratch};
+    for (std::vector<float>* field : fields) {
+        field->assign(cells, 0.0f);
+    }
+}
+
+void FluidSolver::clear() {
+    std::vector<float>* fields[] = {&u, &v, &uPrevious, &vPrevious, &smoke, &smokePrevious,
+                                    &heat, &heatPrevious, &pressure, &divergence, &scratch};
+    for (std::vector<float>* field : fields) {
+        std::fill(field->begin(), field->end(), 0.0f);
+    }
+}
+
+void FluidSolver::addParticleSources(const float* x, const float* y, const float* life, int count,
+                                     float deltaTime) {
+    if (!enabled()) return;
+
+    // Serial so sums do not depend on the thread count; cheap next to the solve
+    float inverseCell = 1.0f / cellSize;
+    for (int p = 0; p < count; p++) {
+        if (life[p] <= 0.0f) continue;
+        int i = std::min(width, std::max(1, (int)(x[p] * inverseCell) + 1));
+        int j = std::min(height, std::max(1, (int)(y[p] * inverseCell) + 1));
+        int cell = index(i, j);
+        smoke[cell] += SMOKE_PER_PARTICLE * life[p] * deltaTime;
+        heat[cell] += HEAT_PER_PARTICLE * life[p] * deltaTime;
+    }
+}
+
+void FluidSolver::advectPoints(float* x, float* y, int count, float deltaTime) const {
+    if (!enabled()) return;
+
+    int stride = width + 2;
+    float inverseCell = 1.0f / cellSize;
+    for (int p = 0; p < count; p++) {
+        // Cell i's center is at (i - 0.5) * cellSize
+        float cellX = x[p] * inverseCell + 0.5f;
+        float cellY = y[p] * inverseCell + 0.5f;
+        x[p] += sampleField(u.data(), stride, width, height, cellX, cellY) * deltaTime;
+        y[p] += sampleField(v.data(), stride, width, height, cellX, cellY) * deltaTime;
+    }
+}
+
+void FluidSolver::setBoundary(int kind, float* field) const {
+    for (int i = 1; i <= width; i++) {
+        field[index(i, 0)] = kind == BOUNDARY_V ? -field[index(i, 1)] : field[index(i, 1)];
+        field[index(i, height + 1)] = kind == BOUNDARY_V ? -field[index(i, height)] : field[index(i, height)];
+    }
+    for (int j = 1; j <= height; j++) {
+        field[index(0, j)] = kind == BOUNDARY_U ? -field[index(1, j)] : field[index(1, j)];
+        field[index(width + 1, j)] = kind == BOUNDARY_U ? -field[index(width, j)] : field[index(width, j)];
+    }
+    field[index(0, 0)] = 0.5f * (field[index(1, 0)] + field[index(0, 1)]);
+    field[index(0, height + 1)] = 0.5f * (field[index(1, height + 1)] + field[index(0, height)]);
+    field[index(width + 1, 0)] = 0.5f * (field[index(width, 0)] + field[index(width + 1, 1)]);
+    field[index(width + 1, height + 1)] = 0.5f * (field[index(width, height + 1)] + field[index(width + 1, height)]);
+}
+
+void FluidSolver::jacobi(int kind, float* field, const float* rhs, float a, float inverseDenominator,
+                         int iterations) {
+    int stride = width + 2;
+    float* buffers[2] = {field, scratch.data()};
+
+    for (int k = 0; k < iterations; k++) {
+        const float* in = buffers[k & 1];
+        float* out = buffers[(k + 1) & 1];
+        parallelFor(jobs, height, FLUID_ROW_CHUNK, [&](int begin, int end, int) {
+            for (int j = begin + 1; j <= end; j++) {
+                int row = index(1, j);
+                jacobiRow(out + row, in + row, rhs + row, width, stride, a, inverseDenominator);
+            }
+        });
+        setBoundary(kind, out);
+    }
+}
+
+void FluidSolver::diffuse(int kind, float* field, const float* previous, float rate, float deltaTime) {
+    float a = deltaTime * rate / (cellSize * cellSize);
+    memcpy(field, previous, sizeof(float) * cellCount());
+    jacobi(kind, field, previous, a, 1.0f / (1.0f + 4.0f * a), DIFFUSE_ITERATIONS);
+}
+
+void FluidSolver::project(float* velocityX, float* velocityY) {
+    float* div = divergence.data();
+    float* p = pressure.data();
+    int stride = width + 2;
+
+    // Right-hand side of the pressure Poisson equation, scaled by cellSize^2
+    parallelFor(jobs, height, FLUID_ROW_CHUNK, [&](int begin, int end, int) {
+        for (int j = begin + 1; j <= end; j++) {
+            for (int i = 1; i <= width; i++) {
+                int c = index(i, j);
+                div[c] = -0.5f * cellSize * (velocityX[c + 1] - velocityX[c - 1] +
+                                             velocityY[c + stride] - velocityY[c - stride]);
+            }
+        }
+    });
+    setBoundary(BOUNDARY_SCALAR, div);
+    std::fill(pressure.begin(), pressure.end(), 0.0f);
+
+    jacobi(BOUNDARY_SCALAR, p, div, 1.0f, 0.25f, PRESSURE_ITERATIONS);
+
+    // Subtract the pressure gradient
+    float scale = 0.5f / cellSize;
+    parallelFor(jobs, height, FLUID_ROW_CHUNK, [&](int begin, int end, int) {
+        for (int j = begin + 1; j <= end; j++) {
+            for (int i = 1; i <= width; i++) {
+                int c = index(i, j);
+                velocityX[c] -= scale * (p[c + 1] - p[c - 1]);
+                velocityY[c] -= scale * (p[c + stride] - p[c - stride]);
+            }
+        }
+    });
+    setBoundary(BOUNDARY_U, velocityX);
+    setBoundary(BOUNDARY_V, velocityY);
+}
+
+void FluidSolver::advect(int kind, float* field, const float* previous, const float* velocityX,
+                         const float* velocityY, float deltaTime, float keep) {
+    int stride = width + 2;
+    float cellsPerUnit = deltaTime / cellSize;
+
+    // Trace each cell center back along the velocity and sample there
+    parallelFor(jobs, height, FLUID_ROW_CHUNK, [&](int begin, int end, int) {
+        for (int j = begin + 1; j <= end; j++) {
+            for (int i = 1; i <= width; i++) {
+                int c = index(i, j);
+                float x = i - cellsPerUnit * velocityX[c];
+                float y = j - cellsPerUnit * velocityY[c];
+                field[c] = keep * sampleField(previous, stride, width, height, x, y);
+            }
+        }
+    });
+    setBoundary(kind, field);
+}
+
+void FluidSolver::step(float deltaTime, JobSystem* jobSystem) {
+    if (!enabled()) return;
+    PROFILE_SCOPE("FluidSolver::step");
+    jobs = jobSystem;
+
+    // Hot air rises; up is -y in scene coordinates
+    auto start = std::chrono::steady_clock::now();
+    float lift = BUOYANCY * deltaTime;
+    parallelFor(jobs, height, FLUID_ROW_CHUNK, [&](int begin, int end, int) {
+        for (int j = begin + 1; j <= end; j++) {
+            float* row = &v[index(1, j)];
+            const float* rowHeat = &heat[index(1, j)];
+            for (int i = 0; i < width; i++) {
+                row[i] -= lift * rowHeat[i];
+            }
+        }
+    });
+    setBoundary(BOUNDARY_V, v.data());
+    timings.sources = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    u.swap(uPrevious);
+    v.swap(vPrevious);
+    heat.swap(heatPrevious);
+    diffuse(BOUNDARY_U, u.data(), uPrevious.data(), VISCOSITY, deltaTime);
+    diffuse(BOUNDARY_V, v.data(), vPrevious.data(), VISCOSITY, deltaTime);
+    diffuse(BOUNDARY_SCALAR, heat.data(), heatPrevious.data(), HEAT_DIFFUSION, deltaTime);
+    timings.diffuse = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    project(u.data(), v.data());
+    timings.project = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    u.swap(uPrevious);
+    v.swap(vPrevious);
+    advect(BOUNDARY_U, u.data(), uPrevious.data(), uPrevious.data(), vPrevious.data(), deltaTime, 1.0f);
+    advect(BOUNDARY_V, v.data(), vPrevious.data(), uPrevious.data(), vPrevious.data(), deltaTime, 1.0f);
+    smoke.swap(smokePrevious);
+    heat.swap(heatPrevious);
+    advect(BOUNDARY_SCALAR, smoke.data(), smokePrevious.data(), u.data(), v.data(), deltaTime,
+           std::max(0.0f, 1.0f - SMOKE_DECAY * deltaTime));
+    advect(BOUNDARY_SCALAR, heat.data(), heatPrevious.data(), u.data(), v.data(), deltaTime,
+           std::max(0.0f, 1.0f - HEAT_DECAY * deltaTime));
+    timings.advect = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    project(u.data(), v.data());
+    timings.project += millisecondsSince(start);
+
+    jobs = nullptr;
+}
+
+// The previous fields are overwritten before they are read in every step
+void FluidSolver::saveState(StateWriter& out) const {
+    const std::vector<float>* fields[] = {&u, &v, &smoke, &heat};
+    for (const std::vector<float>* field : fields) {
+        out.array(*field);
+    }
+}
+
+bool FluidSolver::loadState(StateReader& in) {
+    std::vector<float>* fields[] = {&u, &v, &smoke, &heat};
+    size_t cells = u.size();
+    for (std::vector<float>* field : fields) {
+        if (!in.array(*field) || field->size() != cells) return false;
+    }
+    return true;
+}
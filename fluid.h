@@ -0,0 +1,88 @@
+#ifndef FLUID_H
+#define FLUID_H
+
+#include <vector>
+
+class JobSystem;
+class StateWriter;
+class StateReader;
+
+// Scene area the fluid covers, in scene units
+const float FLUID_SCENE_WIDTH = 800.0f;
+const float FLUID_SCENE_HEIGHT = 500.0f;
+
+// Default grid width in cells; the height follows the scene's aspect ratio
+const int DEFAULT_FLUID_RESOLUTION = 128;
+
+// Wall time of the last step per stage, in milliseconds
+struct FluidTimings {
+    double sources;  // Buoyancy
+    double diffuse;  // Viscosity and heat diffusion
+    double project;  // Both pressure projections
+    double advect;   // Velocity, smoke and heat
+};
+
+// Stable fluids (Stam 1999) for smoke and hot air over the scene: implicit
+// diffusion and pressure projection by Jacobi iteration, semi-Lagrangian
+// advection. Hot air rises by buoyancy and carries smoke and particles.
+//
+// Jacobi instead of Gauss-Seidel so every row of an iteration only reads
+// the previous one: rows are split across the job system and the inner
+// loop is plain SIMD. Results do not depend on the thread count.
+class FluidSolver {
+public:
+    FluidSolver();
+
+    // width x height cells over the scene; 0 turns the solver off
+    void setResolution(int width, int height);
+    bool enabled() const { return width > 0; }
+    int gridWidth() const { return width; }
+    int gridHeight() const { return height; }
+
+    // Everything at rest, no smoke, no heat
+    void clear();
+
+    // Every live particle adds smoke and heat at its cell, by life left
+    void addParticleSources(const float* x, const float* y, const float* life, int count, float deltaTime);
+
+    // Moves points along the velocity field; positions in scene units
+    void advectPoints(float* x, float* y, int count, float deltaTime) const;
+
+    void step(float deltaTime, JobSystem* jobs);
+
+    // Velocity, smoke and heat; loading needs the same resolution
+    void saveState(StateWriter& out) const;
+    bool loadState(StateReader& in);
+
+    // Row-major fields with a one cell border, (width + 2) * (height + 2)
+    const float* smokeData() const { return smoke.data(); }
+    const float* heatData() const { return heat.data(); }
+    int cellCount() const { return (width + 2) * (height + 2); }
+
+    FluidTimings timings;
+
+private:
+    int index(int i, int j) const { return i + (width + 2) * j; }
+
+    void setBoundary(int kind, float* field) const;
+    void diffuse(int kind, float* field, const float* previous, float rate, float deltaTime);
+    void project(float* u, float* v);
+    // keep scales the result, for decay
+    void advect(int kind, float* field, const float* previous, const float* u, const float* v,
+                float deltaTime, float keep);
+    void jacobi(int kind, float* field, const float* rhs, float a, float inverseDenominator, int iterations);
+
+    int width, height;
+    float cellSize; // Scene units per cell
+
+    std::vector<float> u, v;           // Velocity, scene units per second
+    std::vector<float> uPrevious, vPrevious;
+    std::vector<float> smoke, smokePrevious;
+    std::vector<float> heat, heatPrevious;
+    std::vector<float> pressure, divergence;
+    std::vector<float> scratch;        // Jacobi ping-pong buffer
+
+    JobSystem* jobs; // For the duration of step()
+};
+
+#endif // FLUID_H
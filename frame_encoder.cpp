@@ -0,0 +1,174 @@
+#include "frame_encoder.h"
+
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include "profiler.h"
+
+FrameEncoder::FrameEncoder()
+    : path(nullptr), format(IMAGE_PPM), ordered(false), dropWhenFull(false), queueHead(0), queueCount(0),
+      nextSequence(0), nextWrite(0), stopping(false), writeFailed(false) {
+    memset(&counters, 0, sizeof(counters));
+}
+
+FrameEncoder::~FrameEncoder() {
+    finish();
+}
+
+bool FrameEncoder::start(const char* framePath, int width, int height, int ringSize, int threadCount,
+                         bool dropFrames) {
+    finish();
+    if (strcmp(framePath, "-") != 0 && !isFramePattern(framePath)) {
+        return false;
+    }
+
+    path = framePath;
+    format = imageFormatForPath(path);
+    ordered = strcmp(path, "-") == 0;
+    dropWhenFull = dropFrames;
+
+    ringSize = std::max(1, ringSize);
+    slots.clear();
+    slots.resize(ringSize);
+    freeSlots.clear();
+    for (int i = ringSize - 1; i >= 0; i--) {
+        slots[i].frame.resize(width, height);
+        freeSlots.push_back(i);
+    }
+    queue.assign(ringSize, 0);
+    queueHead = 0;
+    queueCount = 0;
+    nextSequence = 0;
+    nextWrite = 0;
+    stopping = false;
+    writeFailed = false;
+    memset(&counters, 0, sizeof(counters));
+
+    for (int i = 0; i < std::max(1, threadCount); i++) {
+        workers.emplace_back(&FrameEncoder::workerLoop, this);
+    }
+    return true;
+}
+
+bool FrameEncoder::finish() {
+    if (workers.empty()) return !writeFailed;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    return !writeFailed;
+}
+
+bool FrameEncoder::failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writeFailed;
+}
+
+Framebuffer* FrameEncoder::acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (writeFailed) return nullptr;
+
+    if (freeSlots.empty()) {
+        if (dropWhenFull) {
+            counters.dropped++;
+            return nullptr;
+        }
+        auto start = std::chrono::steady_clock::now();
+        changed.wait(lock, [&] { return !freeSlots.empty() || writeFailed; });
+        counters.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (writeFailed) return nullptr;
+    }
+
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+    return &slots[slot].frame;
+}
+
+void FrameEncoder::submit(Framebuffer* frame, long long frameNumber) {
+    int slot = 0;
+    while (&slots[slot].frame != frame) slot++;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[slot].sequence = nextSequence++;
+        slots[slot].frameNumber = frameNumber;
+        queue[(queueHead + queueCount) % (int)queue.size()] = slot;
+        queueCount++;
+        counters.submitted++;
+        counters.queueDepth++;
+        counters.peakQueueDepth = std::max(counters.peakQueueDepth, counters.queueDepth);
+    }
+    changed.notify_all();
+}
+
+FrameEncoderStats FrameEncoder::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void FrameEncoder::workerLoop() {
+    std::vector<unsigned char> bytes;
+    char framePath[1024];
+
+    for (;;) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return queueCount > 0 || stopping; });
+            if (queueCount == 0) return;
+            slot = queue[queueHead];
+            queueHead = (queueHead + 1) % (int)queue.size();
+            queueCount--;
+        }
+        Slot& work = slots[slot];
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            PROFILE_SCOPE("encodeFrame");
+            bytes.clear();
+            encodeImage(format, work.frame, bytes);
+        }
+        auto encoded = std::chrono::steady_clock::now();
+
+        // After a failed write the rest are skipped
+        bool skip;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (ordered) {
+                changed.wait(lock, [&] { return nextWrite == work.sequence; });
+            }
+            skip = writeFailed;
+        }
+        formatFramePath(path, work.frameNumber, framePath, sizeof(framePath));
+        bool ok = !skip;
+        if (ok) {
+            PROFILE_SCOPE("writeFrame");
+            ok = writeImageFile(framePath, bytes);
+        }
+        auto written = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            double encodeMs = std::chrono::duration<double, std::milli>(encoded - start).count();
+            counters.encodeMs += encodeMs;
+            counters.worstEncodeMs = std::max(counters.worstEncodeMs, encodeMs);
+            counters.writeMs += std::chrono::duration<double, std::milli>(written - encoded).count();
+            counters.queueDepth--;
+            if (ok) {
+                counters.written++;
+            } else {
+                writeFailed = true;
+            }
+            if (ordered) nextWrite++;
+            freeSlots.push_back(slot);
+        }
+        changed.notify_all();
+    }
+}
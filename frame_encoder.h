@@ -0,0 +1,90 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "software_renderer.h"
+#include "image_writer.h"
+
+const int DEFAULT_ENCODER_RING_SIZE = 8;
+const int DEFAULT_ENCODER_THREADS = 2;
+
+struct FrameEncoderStats {
+    long long submitted;
+    long long written;
+    long long dropped;    // acquire() found the ring full
+    int queueDepth;       // Frames submitted and not yet written
+    int peakQueueDepth;
+    double encodeMs;      // Totals over all written frames
+    double writeMs;
+    double worstEncodeMs;
+    double stallMs;       // Producer time blocked in acquire()
+};
+
+// Writes frames in the background so capturing one costs a copy into a
+// preallocated buffer. The producer takes a free frame from a bounded ring,
+// fills it and submits it; worker threads encode and write it, then hand
+// it back. When the ring is full the producer either drops the frame
+// (a live window must not stall) or waits for a free one (offscreen, where
+// every frame counts). Frames reach stdout in submit order; files are
+// written as soon as they are encoded.
+class FrameEncoder {
+public:
+    FrameEncoder();
+    ~FrameEncoder();
+
+    // path is a frame pattern or "-"; frames are width x height to start
+    // with. Returns false if the pattern is not usable.
+    bool start(const char* path, int width, int height, int ringSize, int threadCount, bool dropWhenFull);
+
+    // Waits for every submitted frame and stops the workers. False if any
+    // write failed.
+    bool finish();
+
+    bool running() const { return !workers.empty(); }
+    bool failed();
+
+    // A frame to fill, or nullptr if it was dropped or a write failed.
+    // Every acquired frame must be submitted.
+    Framebuffer* acquire();
+
+    // frameNumber names the file; it may skip numbers after drops
+    void submit(Framebuffer* frame, long long frameNumber);
+
+    FrameEncoderStats stats();
+
+private:
+    struct Slot {
+        Framebuffer frame;
+        long long sequence;    // Submit order
+        long long frameNumber;
+    };
+
+    void workerLoop();
+
+    const char* path;
+    ImageFormat format;
+    bool ordered;        // Writes to one stream must keep their order
+    bool dropWhenFull;
+
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;   // Stack
+    std::vector<int> queue;       // Ring of submitted slots, oldest at queueHead
+    int queueHead;
+    int queueCount;
+    long long nextSequence;
+    long long nextWrite;
+    bool stopping;
+    bool writeFailed;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::thread> workers;
+
+    FrameEncoderStats counters;
+};
+
+#endif // FRAME_ENCODER_H
@@ -0,0 +1,294 @@
+#include "hud.h"
+#include "simulation.h"
+#include "event_log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// 8x8 bitmap font for ASCII 32..126, public domain (font8x8_basic). One
+// byte per row, top down; bit 0 is the leftmost pixel.
+static const unsigned char font8x8[HUD_GLYPH_COUNT][8] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00}, // !
+    {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00}, // #
+    {0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00}, // $
+    {0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00}, // %
+    {0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00}, // &
+    {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00}, // (
+    {0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00}, // )
+    {0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00}, // *
+    {0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ,
+    {0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // .
+    {0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00}, // /
+    {0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00}, // 0
+    {0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00}, // 1
+    {0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00}, // 2
+    {0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00}, // 3
+    {0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00}, // 4
+    {0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00}, // 5
+    {0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00}, // 6
+    {0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00}, // 7
+    {0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00}, // 8
+    {0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00}, // 9
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ;
+    {0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00}, // <
+    {0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00}, // =
+    {0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00}, // >
+    {0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00}, // ?
+    {0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, // @
+    {0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00}, // A
+    {0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00}, // B
+    {0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00}, // C
+    {0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00}, // D
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00}, // E
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00}, // F
+    {0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00}, // G
+    {0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00}, // H
+    {0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // I
+    {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00}, // J
+    {0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00}, // K
+    {0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00}, // L
+    {0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00}, // M
+    {0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00}, // N
+    {0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00}, // O
+    {0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00}, // P
+    {0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00}, // Q
+    {0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00}, // R
+    {0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00}, // S
+    {0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // T
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00}, // U
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // V
+    {0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00}, // W
+    {0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00}, // X
+    {0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00}, // Y
+    {0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00}, // Z
+    {0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00}, // [
+    {0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00}, // backslash
+    {0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00}, // ]
+    {0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF}, // _
+    {0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}, // `
+    {0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00}, // a
+    {0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00}, // b
+    {0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00}, // c
+    {0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00}, // d
+    {0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00}, // e
+    {0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00}, // f
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // g
+    {0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00}, // h
+    {0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // i
+    {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E}, // j
+    {0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00}, // k
+    {0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // l
+    {0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00}, // m
+    {0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00}, // n
+    {0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00}, // o
+    {0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F}, // p
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78}, // q
+    {0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00}, // r
+    {0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00}, // s
+    {0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00}, // t
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00}, // u
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // v
+    {0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00}, // w
+    {0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00}, // x
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // y
+    {0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00}, // z
+    {0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00}, // {
+    {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}, // |
+    {0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00}, // }
+    {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}  // ~
+};
+
+void buildGlyphAtlas(std::vector<unsigned char>& alpha) {
+    alpha.assign(HUD_ATLAS_WIDTH * HUD_ATLAS_HEIGHT, 0);
+    for (int cell = 0; cell <= HUD_SOLID_CELL; cell++) {
+        int left = (cell % HUD_ATLAS_COLUMNS) * HUD_GLYPH_SIZE;
+        int top = (cell / HUD_ATLAS_COLUMNS) * HUD_GLYPH_SIZE;
+        for (int row = 0; row < HUD_GLYPH_SIZE; row++) {
+            unsigned char bits = cell == HUD_SOLID_CELL ? 0xFF : font8x8[cell][row];
+            for (int column = 0; column < HUD_GLYPH_SIZE; column++) {
+                alpha[(top + row) * HUD_ATLAS_WIDTH + left + column] = (bits >> column) & 1 ? 255 : 0;
+            }
+        }
+    }
+}
+
+// Atlas coordinates of a cell; inset shrinks them toward the middle, so a
+// stretched solid cell never samples its neighbors
+static void cellCoordinates(int cell, float inset, float& u0, float& v0, float& u1, float& v1) {
+    float cellU = (float)HUD_GLYPH_SIZE / HUD_ATLAS_WIDTH;
+    float cellV = (float)HUD_GLYPH_SIZE / HUD_ATLAS_HEIGHT;
+    u0 = (cell % HUD_ATLAS_COLUMNS + inset) * cellU;
+    v0 = (cell / HUD_ATLAS_COLUMNS + inset) * cellV;
+    u1 = (cell % HUD_ATLAS_COLUMNS + 1 - inset) * cellU;
+    v1 = (cell / HUD_ATLAS_COLUMNS + 1 - inset) * cellV;
+}
+
+static void writeQuad(HudVertex* out, float left, float top, float right, float bottom, int cell, float inset,
+                      const unsigned char color[4]) {
+    float u0, v0, u1, v1;
+    cellCoordinates(cell, inset, u0, v0, u1, v1);
+    out[0] = HudVertex{left, top, u0, v0, color[0], color[1], color[2], color[3]};
+    out[1] = HudVertex{right, top, u1, v0, color[0], color[1], color[2], color[3]};
+    out[2] = HudVertex{right, bottom, u1, v1, color[0], color[1], color[2], color[3]};
+    out[3] = HudVertex{left, bottom, u0, v1, color[0], color[1], color[2], color[3]};
+}
+
+static unsigned char colorByte(float value) {
+    return (unsigned char)(std::max(0.0f, std::min(1.0f, value)) * 255.0f + 0.5f);
+}
+
+// Hud
+
+Hud::Hud() : version(0), layouts(0) {
+}
+
+int Hud::addPanel(float left, float top, float right, float bottom, const float color[4], int lineCount) {
+    Panel panel;
+    panel.firstLine = (int)lines.size();
+    panel.lines = lineCount;
+    panels.push_back(panel);
+
+    unsigned char background[4] = {colorByte(color[0]), colorByte(color[1]), colorByte(color[2]),
+                                   colorByte(color[3])};
+    int first = (int)vertices.size();
+    vertices.resize(first + 4 + lineCount * HUD_LINE_CHARS * 4);
+    writeQuad(&vertices[first], left, top, right, bottom, HUD_SOLID_CELL, 0.25f, background);
+
+    // Lines start empty: zero-sized quads draw nothing
+    for (int i = 0; i < lineCount; i++) {
+        Line line;
+        line.text[0] = '\0';
+        line.x = line.y = 0.0f;
+        line.scale = 0.0f;
+        memset(line.color, 0, sizeof(line.color));
+        line.first = first + 4 + i * HUD_LINE_CHARS * 4;
+        lines.push_back(line);
+        memset(&vertices[line.first], 0, HUD_LINE_CHARS * 4 * sizeof(HudVertex));
+    }
+    version++;
+    return (int)panels.size() - 1;
+}
+
+void Hud::setLine(int panel, int index, float x, float y, float scale, const char* text, const float color[3]) {
+    if (panel < 0 || panel >= (int)panels.size() || index < 0 || index >= panels[panel].lines) return;
+    Line& line = lines[panels[panel].firstLine + index];
+
+    unsigned char bytes[4] = {colorByte(color[0]), colorByte(color[1]), colorByte(color[2]), 255};
+    if (line.x == x && line.y == y && line.scale == scale && memcmp(line.color, bytes, sizeof(bytes)) == 0 &&
+        strncmp(line.text, text, HUD_LINE_CHARS) == 0) {
+        return;
+    }
+    snprintf(line.text, sizeof(line.text), "%s", text);
+    line.x = x;
+    line.y = y;
+    line.scale = scale;
+    memcpy(line.color, bytes, sizeof(bytes));
+
+    // Spaces and the unused rest of the run become empty quads
+    float size = HUD_GLYPH_SIZE * scale;
+    HudVertex* out = &vertices[line.first];
+    int length = (int)strlen(line.text);
+    for (int i = 0; i < HUD_LINE_CHARS; i++, out += 4) {
+        int c = i < length ? (unsigned char)line.text[i] : ' ';
+        if (c == ' ') {
+            memset(out, 0, 4 * sizeof(HudVertex));
+            continue;
+        }
+        if (c < HUD_FIRST_GLYPH || c >= HUD_FIRST_GLYPH + HUD_GLYPH_COUNT) {
+            c = '?';
+        }
+        float left = x + i * size;
+        writeQuad(out, left, y, left + size, y + size, c - HUD_FIRST_GLYPH, 0.0f, line.color);
+    }
+    version++;
+    layouts++;
+}
+
+// StatusPanel
+
+// Panel size in HUD units, and where its lines go
+const float STATUS_PANEL_WIDTH = 390.0f;
+const float STATUS_PANEL_HEIGHT = 114.0f;
+const int STATUS_LINES = 5;
+const int STATUS_EVENT_LINES = 3;
+
+StatusPanel::StatusPanel() : panel(-1), panelLeft(0.0f), panelTop(0.0f), state(-1), tenths(-1), eventTotal(0), firstEvent(0) {
+}
+
+void StatusPanel::setup(Hud& hud, float left, float top) {
+    const float background[4] = {0.0f, 0.0f, 0.0f, 0.7f};
+    panelLeft = left;
+    panelTop = top;
+    panel = hud.addPanel(left, top, left + STATUS_PANEL_WIDTH, top + STATUS_PANEL_HEIGHT, background, STATUS_LINES);
+    state = -1;
+    tenths = -1;
+}
+
+static const char* statusText(SimState state, float color[3]) {
+    static const float white[3] = {1.0f, 1.0f, 1.0f};
+    static const float red[3] = {1.0f, 0.0f, 0.0f};
+    static const float green[3] = {0.0f, 1.0f, 0.0f};
+    static const float blue[3] = {0.0f, 0.5f, 1.0f};
+    const float* c = white;
+    const char* text = "";
+    switch (state) {
+        case NORMAL: text = "Status: Normal"; break;
+        case FIRE_START: text = "ALERT: Fire detected!"; c = red; break;
+        case ALARM: text = "ALERT: Alarm activated!"; c = red; break;
+        case HUMANS_ARRIVE: text = "Emergency crew arriving"; c = green; break;
+        case FIREFIGHTERS_ARRIVE: text = "Firefighters arriving"; c = green; break;
+        case EXTINGUISHING: text = "Extinguishing fire"; c = blue; break;
+        case ALL_CLEAR: text = "ALL CLEAR - Fire out"; c = green; break;
+        case TRUCKS_LEAVING: text = "Firefighters leaving"; c = green; break;
+    }
+    memcpy(color, c, sizeof(float) * 3);
+    return text;
+}
+
+void StatusPanel::update(Hud& hud, const Simulation& sim) {
+    if (panel < 0) return;
+    static const float white[3] = {1.0f, 1.0f, 1.0f};
+    char line[HUD_LINE_CHARS + 1];
+
+    if (state != (int)sim.currentState) {
+        state = (int)sim.currentState;
+        float color[3];
+        const char* text = statusText(sim.currentState, color);
+        hud.setLine(panel, 0, panelLeft + 10.0f, panelTop + 10.0f, 2.0f, text, color);
+    }
+
+    // The timer shows tenths of a second, so it changes ten times a second
+    long long shown = (long long)std::floor(sim.simTime * 10.0f + 0.5f);
+    if (shown != tenths) {
+        tenths = shown;
+        snprintf(line, sizeof(line), "Time: %lld.%llds", shown / 10, shown % 10);
+        hud.setLine(panel, 1, panelLeft + 10.0f, panelTop + 36.0f, 2.0f, line, white);
+    }
+
+    // Latest events of this run
+    uint64_t total = sim.events.total();
+    if (total != eventTotal || sim.firstEvent != firstEvent) {
+        eventTotal = total;
+        firstEvent = sim.firstEvent;
+        SimEvent latest[STATUS_EVENT_LINES];
+        int count = (int)std::min<uint64_t>(STATUS_EVENT_LINES, total - sim.firstEvent);
+        count = sim.events.latest(latest, count);
+        for (int i = 0; i < STATUS_EVENT_LINES; i++) {
+            line[0] = '\0';
+            if (i < count) {
+                formatEvent(latest[i], line, sizeof(line));
+            }
+            hud.setLine(panel, STATUS_LINES - STATUS_EVENT_LINES + i, panelLeft + 10.0f, panelTop + 66.0f + i * 14.0f, 1.0f,
+                        line, white);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <cstdint>
+#include <vector>
+
+class Simulation;
+
+// The glyph atlas: 8x8 cells for printable ASCII, 16 to a row, then one
+// solid cell for panel backgrounds
+const int HUD_GLYPH_SIZE = 8;
+const int HUD_FIRST_GLYPH = 32;
+const int HUD_GLYPH_COUNT = 95;
+const int HUD_SOLID_CELL = HUD_GLYPH_COUNT;
+const int HUD_ATLAS_COLUMNS = 16;
+const int HUD_ATLAS_WIDTH = 128;
+const int HUD_ATLAS_HEIGHT = 64;
+
+// Longest text line; longer text is cut off
+const int HUD_LINE_CHARS = 48;
+
+// Position, atlas coordinates and 8-bit RGBA color; the atlas only holds
+// coverage, the color comes from the vertex
+struct HudVertex {
+    float x, y;
+    float u, v;
+    unsigned char r, g, b, a;
+};
+
+// One byte of coverage per atlas pixel, 0 or 255, rows top down
+void buildGlyphAtlas(std::vector<unsigned char>& alpha);
+
+// Text panels laid out into one array of quads, four vertices per glyph,
+// drawn with the atlas in a single call. Every line owns a fixed run of
+// quads; setLine() lays a line out again only when its text, place or
+// color changed, and leaves unused quads empty. Panels are added up front,
+// so updating and drawing never touch the heap.
+class Hud {
+public:
+    Hud();
+
+    // A panel with a background of the given color and room for lines
+    // lines; returns its index
+    int addPanel(float left, float top, float right, float bottom, const float color[4], int lines);
+
+    // Text with its top left corner at (x, y), glyphs scale pixels a dot
+    void setLine(int panel, int line, float x, float y, float scale, const char* text, const float color[3]);
+
+    std::vector<HudVertex> vertices;
+    unsigned int version; // Changes whenever vertices do
+    long long layouts;    // Lines laid out again, for checks and stats
+
+private:
+    struct Line {
+        char text[HUD_LINE_CHARS + 1];
+        float x, y, scale;
+        unsigned char color[4];
+        int first; // First vertex
+    };
+
+    struct Panel {
+        int firstLine;
+        int lines;
+    };
+
+    std::vector<Panel> panels;
+    std::vector<Line> lines;
+};
+
+// The status panel of one incident: state, time and the latest events.
+// Each line is formatted again only when what it shows changes: the state,
+// the time at the tenth of a second shown, or the event log.
+class StatusPanel {
+public:
+    StatusPanel();
+
+    // Adds the panel to hud with its top left corner at (left, top)
+    void setup(Hud& hud, float left, float top);
+    void update(Hud& hud, const Simulation& sim);
+
+    float left() const { return panelLeft; }
+    float top() const { return panelTop; }
+
+private:
+    int panel;
+    float panelLeft, panelTop;
+    int state;
+    long long tenths;
+    uint64_t eventTotal;
+    uint64_t firstEvent;
+};
+
+#endif // HUD_H
@@ -0,0 +1,215 @@
+#include "image_writer.h"
+
+#include <cstring>
+
+#include "software_renderer.h"
+
+// Largest stored deflate block
+const int DEFLATE_BLOCK_SIZE = 65535;
+
+ImageFormat imageFormatForPath(const char* path) {
+    if (strcmp(path, "-") == 0) return IMAGE_RAW;
+
+    size_t length = strlen(path);
+    if (length >= 4 && (strcmp(path + length - 4, ".png") == 0 || strcmp(path + length - 4, ".PNG") == 0)) {
+        return IMAGE_PNG;
+    }
+    return IMAGE_PPM;
+}
+
+// Row y counted from the top of the image
+bool isFramePattern(const char* pattern) {
+    int conversions = 0;
+    for (const char* c = pattern; *c; c++) {
+        if (*c != '%') continue;
+        if (c[1] == '%') {
+            c++;
+            continue;
+        }
+        c++;
+        while (*c == '0' || *c == '-' || (*c >= '1' && *c <= '9')) c++;
+        if (*c != 'd') return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+void formatFramePath(const char* pattern, long long frameNumber, char* path, size_t size) {
+    if (strcmp(pattern, "-") == 0) {
+        snprintf(path, size, "-");
+        return;
+    }
+    snprintf(path, size, pattern, (int)frameNumber);
+}
+
+static void appendRgbRow(const Framebuffer& frame, int y, std::vector<unsigned char>& out) {
+    int row = frame.bottomUp ? frame.height - 1 - y : y;
+    const unsigned char* in = frame.pixels.data() + (size_t)row * frame.width * 4;
+    size_t start = out.size();
+    out.resize(start + (size_t)frame.width * 3);
+    unsigned char* rgb = out.data() + start;
+    for (int x = 0; x < frame.width; x++, in += 4, rgb += 3) {
+        rgb[0] = in[0];
+        rgb[1] = in[1];
+        rgb[2] = in[2];
+    }
+}
+
+void encodePpm(const Framebuffer& frame, std::vector<unsigned char>& out) {
+    char header[64];
+    int length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", frame.width, frame.height);
+    out.insert(out.end(), header, header + length);
+    for (int y = 0; y < frame.height; y++) {
+        appendRgbRow(frame, y, out);
+    }
+}
+
+void encodeRaw(const Framebuffer& frame, std::vector<unsigned char>& out) {
+    for (int y = 0; y < frame.height; y++) {
+        appendRgbRow(frame, y, out);
+    }
+}
+
+// PNG
+
+// Built on first use; a function static is thread safe to initialize
+struct CrcTable {
+    unsigned int entries[256];
+
+    CrcTable() {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+    }
+};
+
+static unsigned int crc32(const unsigned char* data, size_t length) {
+    static const CrcTable table;
+    unsigned int c = 0xffffffffu;
+    for (size_t i = 0; i < length; i++) {
+        c = table.entries[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffffu;
+}
+
+static unsigned int adler32(const unsigned char* data, size_t length) {
+    // 5552 bytes is the most that can be summed before the modulo overflows
+    unsigned int a = 1, b = 0;
+    while (length > 0) {
+        size_t run = length < 5552 ? length : 5552;
+        length -= run;
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        data += run;
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void appendU32(std::vector<unsigned char>& out, unsigned int value) {
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+// Length, type and CRC around the data in [start, end of out)
+static void beginChunk(std::vector<unsigned char>& out, const char* type, size_t& start) {
+    appendU32(out, 0);
+    out.insert(out.end(), type, type + 4);
+    start = out.size();
+}
+
+static void endChunk(std::vector<unsigned char>& out, size_t start) {
+    unsigned int length = (unsigned int)(out.size() - start);
+    unsigned char* header = out.data() + start - 8;
+    header[0] = (unsigned char)(length >> 24);
+    header[1] = (unsigned char)(length >> 16);
+    header[2] = (unsigned char)(length >> 8);
+    header[3] = (unsigned char)length;
+    appendU32(out, crc32(out.data() + start - 4, length + 4));
+}
+
+void encodePng(const Framebuffer& frame, std::vector<unsigned char>& out) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.insert(out.end(), signature, signature + 8);
+
+    size_t start;
+    beginChunk(out, "IHDR", start);
+    appendU32(out, (unsigned int)frame.width);
+    appendU32(out, (unsigned int)frame.height);
+    out.push_back(8); // Bit depth
+    out.push_back(2); // RGB
+    out.push_back(0); // Deflate
+    out.push_back(0); // Adaptive filters
+    out.push_back(0); // No interlace
+    endChunk(out, start);
+
+    // Scanlines with filter type 0, then cut into stored blocks in place:
+    // each block gets a 5 byte header, so the image bytes move up as we go
+    beginChunk(out, "IDAT", start);
+    out.push_back(0x78); // zlib: deflate, 32K window
+    out.push_back(0x01); // No preset dictionary, fastest
+    size_t imageStart = out.size();
+    for (int y = 0; y < frame.height; y++) {
+        out.push_back(0);
+        appendRgbRow(frame, y, out);
+    }
+    size_t imageSize = out.size() - imageStart;
+    unsigned int checksum = adler32(out.data() + imageStart, imageSize);
+
+    size_t blocks = imageSize == 0 ? 1 : (imageSize + DEFLATE_BLOCK_SIZE - 1) / DEFLATE_BLOCK_SIZE;
+    out.resize(out.size() + blocks * 5);
+    unsigned char* base = out.data() + imageStart;
+    for (size_t block = blocks; block-- > 0;) {
+        size_t offset = block * DEFLATE_BLOCK_SIZE;
+        size_t length = imageSize - offset < (size_t)DEFLATE_BLOCK_SIZE ? imageSize - offset : DEFLATE_BLOCK_SIZE;
+        unsigned char* header = base + offset + block * 5;
+        memmove(header + 5, base + offset, length);
+        header[0] = block + 1 == blocks ? 1 : 0; // Final block flag, stored
+        header[1] = (unsigned char)length;
+        header[2] = (unsigned char)(length >> 8);
+        header[3] = (unsigned char)~length;
+        header[4] = (unsigned char)(~length >> 8);
+    }
+    appendU32(out, checksum);
+    endChunk(out, start);
+
+    beginChunk(out, "IEND", start);
+    endChunk(out, start);
+}
+
+void encodeImage(ImageFormat format, const Framebuffer& frame, std::vector<unsigned char>& out) {
+    switch (format) {
+        case IMAGE_PPM: encodePpm(frame, out); break;
+        case IMAGE_PNG: encodePng(frame, out); break;
+        case IMAGE_RAW: encodeRaw(frame, out); break;
+    }
+}
+
+bool writeImageFile(const char* path, const std::vector<unsigned char>& bytes) {
+    bool toStdout = strcmp(path, "-") == 0;
+    FILE* file = toStdout ? stdout : fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR: Cannot write '%s'\n", path);
+        return false;
+    }
+
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    if (toStdout) {
+        ok = fflush(file) == 0 && ok;
+    } else {
+        ok = fclose(file) == 0 && ok;
+    }
+    if (!ok) {
+        fprintf(stderr, "ERROR: Short write to '%s'\n", path);
+    }
+    return ok;
+}
@@ -0,0 +1,34 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdio>
+#include <vector>
+
+struct Framebuffer;
+
+enum ImageFormat {
+    IMAGE_PPM,  // Binary P6
+    IMAGE_PNG,  // 8-bit RGB, stored (uncompressed) deflate blocks
+    IMAGE_RAW   // Bare RGB24 rows, for piping into an encoder
+};
+
+// .png is PNG, anything else PPM; "-" is raw frames on stdout
+ImageFormat imageFormatForPath(const char* path);
+
+// A file name with exactly one integer conversion for the frame number,
+// like frame_%05d.png
+bool isFramePattern(const char* pattern);
+
+// The file for one frame of a pattern; "-" stays "-"
+void formatFramePath(const char* pattern, long long frameNumber, char* path, size_t size);
+
+// Encoders append to out, so a buffer kept across frames stops allocating
+void encodePpm(const Framebuffer& frame, std::vector<unsigned char>& out);
+void encodePng(const Framebuffer& frame, std::vector<unsigned char>& out);
+void encodeRaw(const Framebuffer& frame, std::vector<unsigned char>& out);
+void encodeImage(ImageFormat format, const Framebuffer& frame, std::vector<unsigned char>& out);
+
+// Writes bytes to a new file, or appends them to stdout for "-"
+bool writeImageFile(const char* path, const std::vector<unsigned char>& bytes);
+
+#endif // IMAGE_WRITER_H
@@ -0,0 +1,105 @@
+#include "incident_batch.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const IncidentTransition transitions[TRUCKS_LEAVING] = {
+    {FIRE_START, &ScenarioTimings::fireStart, CONDITION_NONE, EVENT_FIRE_DETECTED},
+    {ALARM, &ScenarioTimings::alarm, CONDITION_NONE, EVENT_ALARM},
+    {HUMANS_ARRIVE, &ScenarioTimings::crewArrive, CONDITION_NONE, EVENT_CREW_ARRIVING},
+    {FIREFIGHTERS_ARRIVE, &ScenarioTimings::firefightersArrive, CONDITION_CREW_IN_PLACE, EVENT_FIREFIGHTERS_DISPATCHED},
+    {EXTINGUISHING, &ScenarioTimings::extinguishing, CONDITION_TRUCKS_PARKED, EVENT_EXTINGUISHING},
+    {ALL_CLEAR, &ScenarioTimings::allClear, CONDITION_FIRE_OUT, EVENT_FIRE_OUT},
+    {TRUCKS_LEAVING, &ScenarioTimings::trucksLeaving, CONDITION_NONE, EVENT_TRUCKS_LEAVING},
+};
+
+const IncidentTransition* incidentTransition(int state) {
+    return state >= 0 && state < TRUCKS_LEAVING ? &transitions[state] : nullptr;
+}
+
+IncidentBatch::IncidentBatch() : time(0.0f), count(0), droppedEvents(0), maxCount(0), eventCapacity(0) {
+}
+
+void IncidentBatch::setCapacity(int capacity, int newEventCapacity) {
+    maxCount = std::max(0, capacity);
+    eventCapacity = std::max(0, newEventCapacity);
+    state.assign(maxCount, NORMAL);
+    nextAt.assign(maxCount, INFINITY);
+    schedule.assign((size_t)maxCount * SCHEDULE_ROW, INFINITY);
+    events.clear();
+    events.reserve(eventCapacity);
+    clear();
+}
+
+void IncidentBatch::clear() {
+    time = 0.0f;
+    count = 0;
+    droppedEvents = 0;
+    events.clear();
+}
+
+int IncidentBatch::add(const ScenarioTimings& timings, const float conditionReady[INCIDENT_CONDITION_COUNT]) {
+    if (count >= maxCount) return -1;
+    int i = count++;
+    state[i] = NORMAL;
+    float* row = &schedule[(size_t)i * SCHEDULE_ROW];
+    for (int s = 0; s < TRUCKS_LEAVING; s++) {
+        const IncidentTransition& transition = transitions[s];
+        float due = timings.*transition.timing;
+        if (transition.condition != CONDITION_NONE) {
+            due = std::max(due, conditionReady[transition.condition]);
+        }
+        row[s] = time + due;
+    }
+    row[TRUCKS_LEAVING] = time;
+    nextAt[i] = row[NORMAL];
+    return i;
+}
+
+int IncidentBatch::step(float deltaTime) {
+    events.clear();
+    time += deltaTime;
+    const float now = time;
+    const float* due = nextAt.data();
+    for (int begin = 0; begin < count; begin += INCIDENT_BLOCK_SIZE) {
+        int end = std::min(count, begin + INCIDENT_BLOCK_SIZE);
+
+        // Whether anything in the block is due
+        int any = 0;
+        for (int i = begin; i < end; i++) {
+            any |= (int)(now > due[i]);
+        }
+        if (!any) continue;
+
+        // Then again in lanes of INCIDENT_LANE_SIZE, gathering the due ones
+        // so their schedule rows are fetched together rather than one per scan
+        int dueIndex[INCIDENT_BLOCK_SIZE];
+        int dueCount = 0;
+        for (int lane = begin; lane < end; lane += INCIDENT_LANE_SIZE) {
+            int laneEnd = std::min(end, lane + INCIDENT_LANE_SIZE);
+            int laneAny = 0;
+            for (int i = lane; i < laneEnd; i++) {
+                laneAny |= (int)(now > due[i]);
+            }
+            if (!laneAny) continue;
+            for (int i = lane; i < laneEnd; i++) {
+                dueIndex[dueCount] = i;
+                dueCount += (int)(now > due[i]);
+            }
+        }
+        for (int k = 0; k < dueCount; k++) {
+            int i = dueIndex[k];
+            const float* row = &schedule[(size_t)i * SCHEDULE_ROW];
+            const IncidentTransition& transition = transitions[state[i]];
+            state[i] = (uint8_t)transition.to;
+            nextAt[i] = transition.to == TRUCKS_LEAVING ? INFINITY : row[transition.to];
+            if ((int)events.size() < eventCapacity) {
+                events.push_back({now - row[TRUCKS_LEAVING], (uint32_t)i, (uint8_t)transition.event,
+                                  (uint8_t)transition.to});
+            } else {
+                droppedEvents++;
+            }
+        }
+    }
+    return (int)events.size();
+}
@@ -0,0 +1,100 @@
+#ifndef INCIDENT_BATCH_H
+#define INCIDENT_BATCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "simulation.h"
+
+// Incidents per block of the batch step, and per lane within a block; a
+// block or lane with no transition due is only read once
+const int INCIDENT_BLOCK_SIZE = 1024;
+const int INCIDENT_LANE_SIZE = 16;
+
+// What besides the clock a transition waits for
+enum IncidentCondition {
+    CONDITION_NONE,
+    CONDITION_CREW_IN_PLACE,
+    CONDITION_TRUCKS_PARKED,
+    CONDITION_FIRE_OUT,
+    INCIDENT_CONDITION_COUNT
+};
+
+// The incident state machine as a table, one row per state but the last:
+// a state moves on to the next one once the clock is past its timing and
+// the condition holds, logging event. Simulation::step and IncidentBatch
+// both run it.
+struct IncidentTransition {
+    SimState to;
+    float ScenarioTimings::*timing;
+    IncidentCondition condition;
+    EventCode event;
+};
+
+// The row for leaving state, nullptr for the last state
+const IncidentTransition* incidentTransition(int state);
+
+// A state change of one incident, 12 bytes
+struct IncidentEvent {
+    float time;        // Incident clock
+    uint32_t incident;
+    uint8_t code;      // EventCode
+    uint8_t state;     // SimState after it
+};
+
+// Many independent incidents stepped together through the same table:
+// city-wide what-if runs without particles, fire or trucks. Each incident
+// has its own timings and the clock times at which its conditions came
+// true, e.g. from a road network or a full Simulation run, so when each
+// state may move on is worked out when it is added. The batch keeps one
+// clock and each incident the time its current state is due, so a step
+// only reads that column in a branch-free loop the compiler vectorizes;
+// only blocks where something is due are looked at again. Storage is
+// preallocated, so stepping never touches the heap.
+class IncidentBatch {
+public:
+    IncidentBatch();
+
+    // Room for capacity incidents and eventCapacity events per step; drops
+    // every incident
+    void setCapacity(int capacity, int eventCapacity);
+    int capacity() const { return maxCount; }
+
+    // Drops every incident and sets the batch clock back to 0
+    void clear();
+
+    // A new incident in NORMAL, its clock starting now. ready[c] is the
+    // incident clock time at which condition c came true; a transition
+    // waiting for it happens on the first step after both that and its
+    // timing. Returns the index, -1 when full.
+    int add(const ScenarioTimings& timings, const float ready[INCIDENT_CONDITION_COUNT]);
+
+    // Advances the clock by deltaTime and makes the transitions that are
+    // due, at most one per incident, like a Simulation step. Their events
+    // replace the previous step's; returns how many there are.
+    int step(float deltaTime);
+
+    // Seconds since the incident started; the same sums as Simulation's
+    // simTime for incidents added at batch time 0
+    float clock(int incident) const { return time - schedule[(size_t)incident * SCHEDULE_ROW + TRUCKS_LEAVING]; }
+
+    float time; // Batch clock
+    int count;
+    long long droppedEvents; // Transitions past eventCapacity in one step
+    std::vector<IncidentEvent> events;
+
+    // Per incident
+    std::vector<uint8_t> state; // SimState
+    std::vector<float> nextAt;  // Batch time the current state may move on
+
+private:
+    // A row per incident: the batch time each state may move on, then the
+    // one it started at, so a transition reads one 32-byte row
+    static const int SCHEDULE_ROW = TRUCKS_LEAVING + 1;
+
+    int maxCount;
+    int eventCapacity;
+    std::vector<float> schedule;
+};
+
+#endif // INCIDENT_BATCH_H
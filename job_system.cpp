@@ -0,0 +1,137 @@
+#include "job_system.h"
+
+#include <algorithm>
+
+bool JobSystem::WorkQueue::pushBack(const Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (count == QUEUE_CAPACITY) return false;
+    jobs[(head + count) % QUEUE_CAPACITY] = job;
+    count++;
+    return true;
+}
+
+bool JobSystem::WorkQueue::popBack(Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (count == 0) return false;
+    count--;
+    job = jobs[(head + count) % QUEUE_CAPACITY];
+    return true;
+}
+
+bool JobSystem::WorkQueue::stealFront(Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (count == 0) return false;
+    job = jobs[head];
+    head = (head + 1) % QUEUE_CAPACITY;
+    count--;
+    return true;
+}
+
+JobSystem::JobSystem(int threadCount)
+    : queues(threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())),
+      queuedJobs(0), stopping(false) {
+    // Queue 0 belongs to the thread calling parallelFor
+    for (int i = 1; i < (int)queues.size(); i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::runJob(const Job& job) {
+    job.fn(job.context, job.begin, job.end, job.chunk);
+    job.remaining->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool JobSystem::findJob(int index, Job& job) {
+    if (queues[index].popBack(job)) {
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Steal, starting with the next queue so thieves spread out
+    int queueCount = (int)queues.size();
+    for (int i = 1; i < queueCount; i++) {
+        if (queues[(index + i) % queueCount].stealFront(job)) {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::workerLoop(int index) {
+    Job job;
+    for (;;) {
+        if (findJob(index, job)) {
+            runJob(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCondition.wait(lock, [this]() {
+            return stopping || queuedJobs.load(std::memory_order_relaxed) > 0;
+        });
+        if (stopping) return;
+    }
+}
+
+void JobSystem::parallelForChunks(int count, int chunkSize, ChunkFunction fn, void* context) {
+    if (count <= 0) return;
+    if (chunkSize < 1) chunkSize = 1;
+
+    int chunkCount = (count + chunkSize - 1) / chunkSize;
+    std::atomic<int> remaining(chunkCount);
+
+    // Deal chunks out round-robin; run inline whatever does not fit
+    int queueCount = (int)queues.size();
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        int begin = chunk * chunkSize;
+        int end = std::min(count, begin + chunkSize);
+        Job job = {fn, context, begin, end, chunk, &remaining};
+
+        if (queueCount > 1 && queues[chunk % queueCount].pushBack(job)) {
+            queuedJobs.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            runJob(job);
+        }
+    }
+
+    if (queueCount > 1) {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wakeCondition.notify_all();
+    }
+
+    // Help out until every chunk has finished
+    Job job;
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (findJob(0, job)) {
+            runJob(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void parallelForChunks(JobSystem* jobs, int count, int chunkSize, ChunkFunction fn, void* context) {
+    if (jobs && jobs->threadCount() > 1) {
+        jobs->parallelForChunks(count, chunkSize, fn, context);
+        return;
+    }
+
+    if (chunkSize < 1) chunkSize = 1;
+    for (int begin = 0, chunk = 0; begin < count; begin += chunkSize, chunk++) {
+        fn(context, begin, std::min(count, begin + chunkSize), chunk);
+    }
+}
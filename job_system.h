@@ -0,0 +1,79 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work function for one chunk [begin, end). chunk is the chunk's index,
+// which only depends on count and chunkSize, never on the thread count.
+typedef void (*ChunkFunction)(void* context, int begin, int end, int chunk);
+
+// Small thread pool with one bounded deque per worker. Owners pop from the
+// back of their own deque, idle workers steal from the front of others'.
+// The thread calling parallelFor works too, so a pool of N threads starts
+// N - 1 workers. Only one thread may call parallelFor at a time, and jobs
+// must not call it themselves.
+class JobSystem {
+public:
+    // threadCount <= 0 uses every hardware thread
+    explicit JobSystem(int threadCount);
+    ~JobSystem();
+
+    int threadCount() const { return (int)queues.size(); }
+
+    // Splits [0, count) into chunks and blocks until all of them ran
+    void parallelForChunks(int count, int chunkSize, ChunkFunction fn, void* context);
+
+private:
+    struct Job {
+        ChunkFunction fn;
+        void* context;
+        int begin;
+        int end;
+        int chunk;
+        std::atomic<int>* remaining;
+    };
+
+    static const int QUEUE_CAPACITY = 1024;
+
+    struct WorkQueue {
+        std::mutex mutex;
+        Job jobs[QUEUE_CAPACITY];
+        int head;  // Oldest job, stolen first
+        int count;
+
+        WorkQueue() : head(0), count(0) {}
+        bool pushBack(const Job& job);
+        bool popBack(Job& job);
+        bool stealFront(Job& job);
+    };
+
+    void workerLoop(int index);
+    bool findJob(int index, Job& job);
+    static void runJob(const Job& job);
+
+    std::vector<WorkQueue> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<int> queuedJobs;
+    bool stopping;
+};
+
+// Runs fn(begin, end, chunk) for each chunk of [0, count), on jobs if given,
+// otherwise inline on the calling thread in chunk order
+void parallelForChunks(JobSystem* jobs, int count, int chunkSize, ChunkFunction fn, void* context);
+
+template <typename Function>
+void parallelFor(JobSystem* jobs, int count, int chunkSize, const Function& function) {
+    ChunkFunction trampoline = [](void* context, int begin, int end, int chunk) {
+        (*static_cast<const Function*>(context))(begin, end, chunk);
+    };
+    parallelForChunks(jobs, count, chunkSize, trampoline, (void*)&function);
+}
+
+#endif // JOB_SYSTEM_H
@@ -1,680 +1,1664 @@
-#include <GL/glut.h>
-#include <vector>
-#include <cmath>
-#include <ctime>
-#include <cstdlib>
-#include <string>
-#include <algorithm>
-#include <windows.h>
-#include <mmsystem.h>
-#include <fstream>
-#include <direct.h>
-
-// Manual library linking for GCC
-#ifdef __GNUC__
-#define WINMM_LIB "winmm"
-#else
-#pragma comment(lib, "winmm.lib")
-#endif
-
-// Particle structures
-struct FireParticle {
-    float x, y;
-    float velocity;
-    float life;
-    float size;
-    int windowIndex;
-};
-
-struct FireTruck {
-    float x;
-    bool arrived;
-    bool spraying;
-    bool leaving;
-};
-
-// Simulation states
-enum SimState {
-    NORMAL,
-    FIRE_START,
-    ALARM,
-    HUMANS_ARRIVE,
-    FIREFIGHTERS_ARRIVE,
-    EXTINGUISHING,
-    ALL_CLEAR,
-    TRUCKS_LEAVING
-};
-
-// Global variables
-SimState currentState = NORMAL;
-float simTime = 0.0f;
-std::vector<FireParticle> fireParticles;
-std::vector<std::string> eventLog;
-bool alarmBlinking = false;
-float alarmBlinkTimer = 0.0f;
-int burningWindow = -1;
-FireTruck truck1 = {-100.0f, false, false, false};
-FireTruck truck2 = {-150.0f, false, false, false};
-float humanPosition = 800.0f;
-
-// Sound flags
-bool alarmSoundPlaying = false;
-bool truckSoundPlaying = false;
-bool waterSoundPlaying = false;
-
-// Colors
-GLfloat buildingColors[3][3] = {
-    {0.7f, 0.7f, 0.7f},  // Main building
-    {0.6f, 0.6f, 0.8f},  // Left building
-    {0.8f, 0.6f, 0.6f}   // Right building
-};
-GLfloat windowColor[3] = {0.8f, 0.9f, 1.0f};
-GLfloat fireColors[3][3] = {
-    {1.0f, 0.3f, 0.0f},  // Orange
-    {1.0f, 0.6f, 0.0f},  // Yellow-orange
-    {0.3f, 0.3f, 0.3f}   // Gray (smoke)
-};
-GLfloat roadColor[3] = {0.2f, 0.2f, 0.2f};
-GLfloat treeColors[2][3] = {
-    {0.0f, 0.5f, 0.0f},  // Leaves
-    {0.4f, 0.2f, 0.0f}   // Trunk
-};
-
-// Sound helper functions
-bool checkSoundFile(const char* filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.good()) {
-        printf("SOUND ERROR: File '%s' not found!\n", filename);
-        return false;
-    }
-    file.close();
-    return true;
-}
-
-void playAlarmSound() {
-    if (!alarmSoundPlaying) {
-        if (checkSoundFile("fire.wav")) {
-            if (!PlaySoundA("fire.wav", NULL, SND_ASYNC | SND_LOOP | SND_FILENAME)) {
-                printf("Failed to play alarm! Error: %lu\n", (unsigned long)GetLastError());
-            } else {
-                alarmSoundPlaying = true;
-            }
-        }
-    }
-}
-
-void stopAlarmSound() {
-    PlaySound(NULL, NULL, 0);
-    alarmSoundPlaying = false;
-}
-
-void playTruckSound() {
-    if (!truckSoundPlaying) {
-        if (checkSoundFile("TruckArrive.wav")) {
-            if (!PlaySoundA("TruckArrive.wav", NULL, SND_ASYNC | SND_LOOP | SND_FILENAME)) {
-                printf("Failed to play truck! Error: %lu\n", (unsigned long)GetLastError());
-            } else {
-                truckSoundPlaying = true;
-            }
-        }
-    }
-}
-
-void stopTruckSound() {
-    PlaySound(NULL, NULL, 0);
-    truckSoundPlaying = false;
-}
-
-void playWaterSound() {
-    if (!waterSoundPlaying) {
-        if (checkSoundFile("WaterSpray.wav")) {
-            if (!PlaySoundA("WaterSpray.wav", NULL, SND_ASYNC | SND_LOOP | SND_FILENAME)) {
-                printf("Failed to play water! Error: %lu\n", (unsigned long)GetLastError());
-            } else {
-                waterSoundPlaying = true;
-            }
-        }
-    }
-}
-
-void stopWaterSound() {
-    PlaySound(NULL, NULL, 0);
-    waterSoundPlaying = false;
-}
-
-void init() {
-    glClearColor(0.53f, 0.81f, 0.98f, 1.0f); // Sky blue
-
-    // Initial event log
-    eventLog.push_back("System: Simulation started");
-    eventLog.push_back("System: Normal operation");
-
-    srand(static_cast<unsigned int>(time(NULL)));
-}
-
-void drawSky() {
-    // Gradient sky
-    glBegin(GL_QUADS);
-    glColor3f(0.53f, 0.81f, 0.98f); // Top color
-    glVertex2f(0, 0);
-    glVertex2f(800, 0);
-    glColor3f(0.7f, 0.9f, 1.0f);    // Bottom color
-    glVertex2f(800, 500);
-    glVertex2f(0, 500);
-    glEnd();
-}
-
-void drawCloud(float x, float y, float size) {
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glBegin(GL_POLYGON);
-    for (int i = 0; i < 20; i++) {
-        float angle = 2.0f * 3.14159f * i / 20;
-        glVertex2f(x + size * cos(angle), y + size * sin(angle));
-    }
-    glEnd();
-}
-
-void drawRoad() {
-    // Main road
-    glColor3fv(roadColor);
-    glBegin(GL_QUADS);
-    glVertex2f(0, 400);
-    glVertex2f(800, 400);
-    glVertex2f(800, 450);
-    glVertex2f(0, 450);
-    glEnd();
-
-    // Road markings
-    glColor3f(1.0f, 1.0f, 1.0f);
-    for (int i = 0; i < 8; i++) {
-        glBegin(GL_QUADS);
-        glVertex2f(50 + i * 100, 425);
-        glVertex2f(80 + i * 100, 425);
-        glVertex2f(80 + i * 100, 430);
-        glVertex2f(50 + i * 100, 430);
-        glEnd();
-    }
-}
-
-void drawBuilding(int index, float x, float width, float height, int floors, int windowsPerFloor) {
-    // Building structure
-    glColor3fv(buildingColors[index]);
-    glBegin(GL_QUADS);
-    glVertex2f(x, 400);
-    glVertex2f(x + width, 400);
-    glVertex2f(x + width, 400 - height);
-    glVertex2f(x, 400 - height);
-    glEnd();
-
-    // Windows
-    float windowWidth = width / (windowsPerFloor + 1);
-    float windowHeight = height / (floors + 1) * 0.6f;
-    float floorHeight = height / floors;
-
-    for (int floor = 0; floor < floors; floor++) {
-        for (int col = 0; col < windowsPerFloor; col++) {
-            // Determine if this window is on fire
-            bool isBurning = (index == 0 && currentState >= FIRE_START && currentState < ALL_CLEAR &&
-                             burningWindow == floor * windowsPerFloor + col);
-
-            if (isBurning) {
-                glColor3f(1.0f, 0.5f, 0.0f); // Fire glow
-            } else {
-                glColor3fv(windowColor);
-            }
-
-            glBegin(GL_QUADS);
-            float winX = x + (col + 0.5f) * windowWidth;
-            float winY = 400 - (floor + 0.5f) * floorHeight;
-            glVertex2f(winX - windowWidth*0.4f, winY - windowHeight*0.5f);
-            glVertex2f(winX + windowWidth*0.4f, winY - windowHeight*0.5f);
-            glVertex2f(winX + windowWidth*0.4f, winY + windowHeight*0.5f);
-            glVertex2f(winX - windowWidth*0.4f, winY + windowHeight*0.5f);
-            glEnd();
-
-            // Window frame
-            glColor3f(0.3f, 0.3f, 0.3f);
-            glLineWidth(1.0f);
-            glBegin(GL_LINE_LOOP);
-            glVertex2f(winX - windowWidth*0.4f, winY - windowHeight*0.5f);
-            glVertex2f(winX + windowWidth*0.4f, winY - windowHeight*0.5f);
-            glVertex2f(winX + windowWidth*0.4f, winY + windowHeight*0.5f);
-            glVertex2f(winX - windowWidth*0.4f, winY + windowHeight*0.5f);
-            glEnd();
-        }
-    }
-
-    // Roof
-    if (index == 0) { // Only main building has a special roof
-        glColor3f(0.4f, 0.4f, 0.4f);
-        glBegin(GL_QUADS);
-        glVertex2f(x - 10, 400 - height);
-        glVertex2f(x + width + 10, 400 - height);
-        glVertex2f(x + width, 400 - height - 20);
-        glVertex2f(x, 400 - height - 20);
-        glEnd();
-    }
-}
-
-void drawTrees() {
-    // Draw trees along the road
-    for (int i = 0; i < 15; i++) {
-        float x = 50 + i * 50;
-        if (x > 250 && x < 550) continue; // Don't draw trees behind main building
-
-        // Trunk
-        glColor3fv(treeColors[1]);
-        glBegin(GL_QUADS);
-        glVertex2f(x - 5, 400);
-        glVertex2f(x + 5, 400);
-        glVertex2f(x + 5, 370);
-        glVertex2f(x - 5, 370);
-        glEnd();
-
-        // Leaves
-        glColor3fv(treeColors[0]);
-        glBegin(GL_POLYGON);
-        for (int j = 0; j < 20; j++) {
-            float angle = 2.0f * 3.14159f * j / 20;
-            glVertex2f(x + 15 * cos(angle), 370 + 15 * sin(angle));
-        }
-        glEnd();
-    }
-}
-
-void updateFireParticles(float deltaTime) {
-    // Remove dead particles
-    fireParticles.erase(
-        std::remove_if(fireParticles.begin(), fireParticles.end(),
-            [](const FireParticle& p) { return p.life <= 0.0f; }),
-        fireParticles.end());
-
-    // Update existing particles
-    for (auto& p : fireParticles) {
-        p.y += p.velocity * deltaTime * 50.0f;
-        p.x += (sin(simTime * 2.0f + p.x) * 0.5f * deltaTime * 50.0f);
-        p.life -= 0.5f * deltaTime;
-    }
-
-    // Add new particles if fire is active
-    if (currentState >= FIRE_START && currentState < ALL_CLEAR && burningWindow != -1) {
-        int windowsPerFloor = 5;
-        int floor = burningWindow / windowsPerFloor;
-        int col = burningWindow % windowsPerFloor;
-
-        float windowWidth = 100.0f / (windowsPerFloor + 1);
-        float floorHeight = 150.0f / 5;
-        float winX = 300 + (col + 0.5f) * windowWidth;
-        float winY = 400 - (floor + 0.5f) * floorHeight;
-
-        for (int i = 0; i < 5; i++) {
-            FireParticle p;
-            p.x = winX + (rand() % 100 - 50) / 20.0f;
-            p.y = winY + (rand() % 100) / 20.0f;
-            p.velocity = 0.5f + (rand() % 100) / 100.0f;
-            p.life = 0.5f + (rand() % 100) / 200.0f;
-            p.size = 2.0f + (rand() % 10) / 5.0f;
-            p.windowIndex = burningWindow;
-            fireParticles.push_back(p);
-        }
-    }
-}
-
-void drawFire() {
-    if (currentState < FIRE_START || currentState >= ALL_CLEAR) return;
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-    for (const auto& p : fireParticles) {
-        // Determine color based on particle life
-        if (p.life > 0.7f) {
-            glColor4f(fireColors[0][0], fireColors[0][1], fireColors[0][2], 0.8f);
-        } else if (p.life > 0.3f) {
-            glColor4f(fireColors[1][0], fireColors[1][1], fireColors[1][2], p.life);
-        } else {
-            glColor4f(fireColors[2][0], fireColors[2][1], fireColors[2][2], p.life * 0.5f);
-        }
-
-        // Draw particle
-        glPointSize(p.size);
-        glBegin(GL_POINTS);
-        glVertex2f(p.x, p.y);
-        glEnd();
-    }
-
-    glDisable(GL_BLEND);
-}
-
-void drawHumans() {
-    if (currentState < HUMANS_ARRIVE) return;
-
-    glColor3f(0.0f, 0.0f, 0.0f);
-    for (int i = 0; i < 3; i++) {
-        float x = humanPosition + i * 30;
-        float y = 380 + sin(simTime * 2.0f + i) * 5.0f;
-
-        // Head
-        glPointSize(6.0f);
-        glBegin(GL_POINTS);
-        glVertex2f(x, y);
-        glEnd();
-
-        // Body
-        glBegin(GL_LINES);
-        glVertex2f(x, y);
-        glVertex2f(x, y + 15);
-        glEnd();
-
-        // Legs
-        glBegin(GL_LINES);
-        glVertex2f(x, y + 15);
-        glVertex2f(x - 5, y + 25);
-        glVertex2f(x, y + 15);
-        glVertex2f(x + 5, y + 25);
-        glEnd();
-
-        // Arms
-        float armAngle = sin(simTime * 5.0f + i) * 30.0f;
-        glPushMatrix();
-        glTranslatef(x, y + 10, 0.0f);
-        glRotatef(armAngle, 0.0f, 0.0f, 1.0f);
-        glBegin(GL_LINES);
-        glVertex2f(0, 0);
-        glVertex2f(-10, 0);
-        glVertex2f(0, 0);
-        glVertex2f(10, 0);
-        glEnd();
-        glPopMatrix();
-    }
-}
-
-void drawFireTruck(const FireTruck& truck) {
-    // Truck body
-    glColor3f(1.0f, 0.5f, 0.f);
-    glBegin(GL_QUADS);
-    glVertex2f(truck.x, 370);
-    glVertex2f(truck.x + 60, 370);
-    glVertex2f(truck.x + 60, 400);
-    glVertex2f(truck.x, 400);
-    glEnd();
-
-    // Cabin
-    glColor3f(0.9f, 0.9f, 0.9f);
-    glBegin(GL_QUADS);
-    glVertex2f(truck.x + 40, 370);
-    glVertex2f(truck.x + 60, 370);
-    glVertex2f(truck.x + 60, 390);
-    glVertex2f(truck.x + 40, 390);
-    glEnd();
-
-    // Wheels
-    glColor3f(0.1f, 0.1f, 0.1f);
-    for (int i = 0; i < 2; i++) {
-        glBegin(GL_POLYGON);
-        for (int j = 0; j < 20; j++) {
-            float angle = 2.0f * 3.14159f * j / 20;
-            glVertex2f(truck.x + 15 + i * 30 + 10 * cos(angle), 400 + 10 * sin(angle));
-        }
-        glEnd();
-    }
-
-    // Water hose when spraying
-    if (truck.spraying) {
-        int windowsPerFloor = 5;
-        int floor = burningWindow / windowsPerFloor;
-        int col = burningWindow % windowsPerFloor;
-        float windowWidth = 100.0f / (windowsPerFloor + 1);
-        float floorHeight = 150.0f / 5;
-        float targetX = 300 + (col + 0.5f) * windowWidth;
-        float targetY = 400 - (floor + 0.5f) * floorHeight;
-
-        glColor4f(0.2f, 0.5f, 1.0f, 0.6f);
-        glLineWidth(2.0f);
-        glBegin(GL_LINES);
-        glVertex2f(truck.x + 30, 385);
-        glVertex2f(targetX, targetY);
-        glEnd();
-        glLineWidth(1.0f);
-    }
-}
-
-void updateFireTrucks(float deltaTime) {
-    // Truck 1 logic - slower movement (0.8 units/frame)
-    if (currentState == FIREFIGHTERS_ARRIVE && !truck1.arrived) {
-        truck1.x = std::min(200.0f, truck1.x + 0.8f);
-        if (truck1.x >= 200.0f) {
-            truck1.arrived = true;
-        }
-    } else if (currentState == EXTINGUISHING && truck1.arrived) {
-        truck1.spraying = true;
-    } else if (currentState == TRUCKS_LEAVING && !truck1.leaving) {
-        truck1.spraying = false;
-        truck1.leaving = true;
-    }
-
-    if (truck1.leaving) {
-        truck1.x += 1.5f; // Slower leaving speed
-    }
-
-    // Truck 2 logic - slower movement (0.8 units/frame)
-    if (currentState == FIREFIGHTERS_ARRIVE && truck1.x > 150.0f && !truck2.arrived) {
-        truck2.x = std::min(250.0f, truck2.x + 0.8f);
-        if (truck2.x >= 250.0f) {
-            truck2.arrived = true;
-        }
-    } else if (currentState == EXTINGUISHING && truck2.arrived) {
-        truck2.spraying = true;
-    } else if (currentState == TRUCKS_LEAVING && !truck2.leaving) {
-        truck2.spraying = false;
-        truck2.leaving = true;
-    }
-
-    if (truck2.leaving) {
-        truck2.x += 1.5f; // Slower leaving speed
-    }
-}
-
-void updateHumans(float deltaTime) {
-    if (currentState >= HUMANS_ARRIVE && currentState < FIREFIGHTERS_ARRIVE) {
-        humanPosition = std::max(350.0f, humanPosition - 0.5f); // Humans move in from right
-    }
-}
-
-void drawAlarm() {
-    if (currentState < ALARM || currentState >= ALL_CLEAR) return;
-
-    alarmBlinkTimer += 0.1f;
-    if (alarmBlinkTimer > 0.5f) {
-        alarmBlinking = !alarmBlinking;
-        alarmBlinkTimer = 0.0f;
-    }
-
-    if (alarmBlinking) {
-        glColor3f(1.0f, 0.0f, 0.0f);
-        glBegin(GL_QUADS);
-        glVertex2f(280, 250);
-        glVertex2f(290, 250);
-        glVertex2f(290, 260);
-        glVertex2f(280, 260);
-        glEnd();
-    }
-}
-
-void drawInterface() {
-    // Status panel background
-    glColor4f(0.0f, 0.0f, 0.0f, 0.7f);
-    glBegin(GL_QUADS);
-    glVertex2f(10, 10);
-    glVertex2f(300, 10);
-    glVertex2f(300, 120);
-    glVertex2f(10, 120);
-    glEnd();
-
-    // Status text
-    glColor3f(1.0f, 1.0f, 1.0f);
-    std::string statusText;
-    switch(currentState) {
-        case NORMAL: statusText = "Status: Normal"; break;
-        case FIRE_START: statusText = "ALERT: Fire detected!"; glColor3f(1.0f, 0.0f, 0.0f); break;
-        case ALARM: statusText = "ALERT: Alarm activated!"; glColor3f(1.0f, 0.0f, 0.0f); break;
-        case HUMANS_ARRIVE: statusText = "Emergency crew arriving"; glColor3f(0.0f, 1.0f, 0.0f); break;
-        case FIREFIGHTERS_ARRIVE: statusText = "Firefighters arriving"; glColor3f(0.0f, 1.0f, 0.0f); break;
-        case EXTINGUISHING: statusText = "Extinguishing fire"; glColor3f(0.0f, 0.5f, 1.0f); break;
-        case ALL_CLEAR: statusText = "ALL CLEAR - Fire out"; glColor3f(0.0f, 1.0f, 0.0f); break;
-        case TRUCKS_LEAVING: statusText = "Firefighters leaving"; glColor3f(0.0f, 1.0f, 0.0f); break;
-    }
-
-    glRasterPos2f(20, 30);
-    for (char c : statusText) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
-
-    // Timer
-    glColor3f(1.0f, 1.0f, 1.0f);
-    char timeStr[20];
-    snprintf(timeStr, sizeof(timeStr), "Time: %.1fs", simTime);
-    glRasterPos2f(20, 60);
-    for (char c : std::string(timeStr)) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
-
-    // Latest events
-    int startIdx = eventLog.size() > 3 ? eventLog.size() - 3 : 0;
-    for (int i = 0; i < 3 && startIdx + i < eventLog.size(); i++) {
-        glRasterPos2f(20, 90 + i * 20);
-        for (char c : eventLog[startIdx + i]) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
-        }
-    }
-}
-
-void updateSimulation(float deltaTime) {
-    simTime += deltaTime;
-
-    // State transitions
-    if (currentState == NORMAL && simTime > 3.0f) {
-        currentState = FIRE_START;
-        burningWindow = rand() % 15; // 3 floors * 5 windows
-        eventLog.push_back("ALERT: Fire detected in building!");
-    }
-    else if (currentState == FIRE_START && simTime > 6.0f) {
-        currentState = ALARM;
-        eventLog.push_back("ALERT: Alarm activated!");
-        playAlarmSound();
-    }
-    else if (currentState == ALARM && simTime > 9.0f) {
-        currentState = HUMANS_ARRIVE;
-        eventLog.push_back("UPDATE: Emergency crew arriving");
-    }
-    else if (currentState == HUMANS_ARRIVE && humanPosition <= 350.0f && simTime > 12.0f) {
-        currentState = FIREFIGHTERS_ARRIVE;
-        eventLog.push_back("UPDATE: Firefighters dispatched");
-        playTruckSound();
-    }
-    else if (currentState == FIREFIGHTERS_ARRIVE && truck1.arrived && truck2.arrived && simTime > 15.0f) {
-        currentState = EXTINGUISHING;
-        eventLog.push_back("UPDATE: Firefighters extinguishing fire");
-        playWaterSound();
-    }
-    else if (currentState == EXTINGUISHING && simTime > 25.0f) {
-        currentState = ALL_CLEAR;
-        eventLog.push_back("UPDATE: Fire extinguished!");
-        stopAlarmSound();
-        stopWaterSound();
-    }
-    else if (currentState == ALL_CLEAR && simTime > 28.0f) {
-        currentState = TRUCKS_LEAVING;
-        eventLog.push_back("UPDATE: Firefighters leaving scene");
-        stopTruckSound();
-    }
-
-    // Update all elements
-    updateHumans(deltaTime);
-    updateFireTrucks(deltaTime);
-    if (currentState >= FIRE_START && currentState < ALL_CLEAR) {
-        updateFireParticles(deltaTime);
-    }
-}
-
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // Set up 3D orthographic projection
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, 800, 500, 0);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    // Draw scene
-    drawSky();
-    drawCloud(100, 80, 30);
-    drawCloud(500, 120, 40);
-    drawCloud(700, 60, 25);
-    drawRoad();
-    drawTrees();
-
-    // Buildings (left, main, right)
-    drawBuilding(1, 100, 80, 120, 4, 3);  // Left building
-    drawBuilding(0, 300, 100, 150, 5, 5); // Main building
-    drawBuilding(2, 500, 90, 130, 4, 4);  // Right building
-
-    // Draw all elements in proper order
-    drawFire();
-    drawHumans(); // Humans appear before trucks
-    drawFireTruck(truck1);
-    drawFireTruck(truck2);
-    drawAlarm();
-    drawInterface();
-
-    glutSwapBuffers();
-}
-
-void idle() {
-    static int lastTime = 0;
-    int currentTime = glutGet(GLUT_ELAPSED_TIME);
-    float deltaTime = (currentTime - lastTime) / 1000.0f;
-    lastTime = currentTime;
-
-    updateSimulation(deltaTime);
-    glutPostRedisplay();
-}
-
-void cleanup() {
-    stopAlarmSound();
-    stopTruckSound();
-    stopWaterSound();
-}
-
-int main(int argc, char** argv) {
-    // Debug: Print working directory
-    char cwd[1024];
-    if (_getcwd(cwd, sizeof(cwd)) != NULL) {
-        printf("Current directory: %s\n", cwd);
-    }
-
-    // Verify sound files
-    checkSoundFile("FireAlarm.wav");
-    checkSoundFile("TruckArrive.wav");
-    checkSoundFile("WaterSpray.wav");
-
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-    glutInitWindowSize(800, 500);
-    glutCreateWindow("3D Fire Emergency Simulation");
-
-    init();
-
-    glutDisplayFunc(display);
-    glutIdleFunc(idle);
-    atexit([]() {
-        stopAlarmSound();
-        stopTruckSound();
-        stopWaterSound();
-    });
-
-    glutMainLoop();
-    return 0;
-}
+#include <GL/glut.h>
+#include <vector>
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+
+#include "simulation.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "mapped_file.h"
+#include "alloc_stats.h"
+#include "self_check.h"
+#include "job_system.h"
+#include "renderer.h"
+#include "software_renderer.h"
+#include "image_writer.h"
+#include "frame_encoder.h"
+#include "profiler.h"
+#include "step_clock.h"
+#include "event_sink.h"
+#include "snapshot_store.h"
+#include "audio_mixer.h"
+#include "camera.h"
+#include "hud.h"
+#include "sweep.h"
+
+// Global variables
+Simulation sim;
+BatchRenderer renderer;
+FrameEncoder recorder;
+long long recordedFrames = 0;
+EventSink eventSink;
+SnapshotStore snapshots; // Window only, for seeking back
+Hud hud;
+StatusPanel statusPanel;
+
+// [ and ] seek this far back and forward
+const float SEEK_SECONDS = 5.0f;
+
+// The window's view of the scene: arrows or dragging pan, + and - or the
+// wheel zoom, 0 goes back to the original view
+Camera camera;
+int dragX = -1, dragY = -1; // Last mouse position while dragging
+const float PAN_PIXELS = 40.0f;
+const float ZOOM_STEP = 1.25f;
+
+// The window's simulation runs on its own thread at a fixed rate; drawing
+// and stepping take turns on simMutex
+std::mutex simMutex;
+std::thread simThread;
+std::atomic<bool> simRunning(false);
+StepClock simClock;
+std::chrono::steady_clock::time_point lastClockAdvance;
+float renderAlpha = 1.0f; // How far this frame is between the last two steps
+
+// Looping sounds for the stages of an incident, mixed on the audio thread
+enum SoundCue { SOUND_ALARM, SOUND_TRUCK, SOUND_WATER, SOUND_COUNT };
+const char* const SOUND_FILES[SOUND_COUNT] = {"fire.wav", "TruckArrive.wav", "WaterSpray.wav"};
+AudioMixer audio;
+AudioOutput* audioOutput = nullptr;
+int soundClips[SOUND_COUNT] = {-1, -1, -1};
+int soundVoices[SOUND_COUNT] = {0, 0, 0}; // 0 when not playing
+
+// Command line options
+struct Options {
+    bool headless;
+    float seconds;
+    float timeStep;
+    int particleCapacity;
+    int occupants;             // Per burning building
+    int crowdCapacity;
+    ParticleKernel particleKernel;
+    bool selfCheck;
+    int threads;
+    int benchParticles;
+    bool immediateMode;
+    bool renderStats;
+    const char* scenePath;
+    const char* cityPath;     // --generate-city output
+    int cityBuildings;
+    const char* benchLoadPath;
+    int benchFireBuildings;
+    int fluidResolution;
+    uint64_t seed;
+    const char* offscreenPath; // Frame file pattern, or "-" for stdout
+    int renderWidth;
+    int renderHeight;
+    int renderThreads;
+    const char* recordPath;    // Window capture pattern
+    int encodeThreads;
+    int encodeRing;
+    bool profileOverlay;
+    const char* tracePath;     // Chrome trace written on exit
+    const char* eventsPath;    // Event stream, JSONL or binary
+    float startAt;             // Sim seconds to skip ahead before starting
+    float snapshotInterval;
+    int snapshotBudgetMb;
+    const char* loadStatePath;
+    const char* saveStatePath; // State written on exit
+    const char* audioOutPath;  // Mix into a WAV file instead of the sound card
+    bool mute;
+    int sweepRuns;             // Seeds per parameter set; 0 is no sweep
+    std::vector<float> sweepTruckSpeeds;
+    std::vector<float> sweepTimings;
+    float sweepLimit;          // Sim seconds a sweep run may take
+    const char* sweepRunsPath; // One CSV line per run
+    const char* sweepOutPath;  // Summary, JSON for .json, else CSV
+};
+
+Options options;
+
+// Decodes the sounds once; missing ones stay silent
+void loadSounds() {
+    for (int i = 0; i < SOUND_COUNT; i++) {
+        soundClips[i] = audio.loadClip(SOUND_FILES[i]);
+    }
+}
+
+void playSound(SoundCue cue) {
+    if (soundVoices[cue] == 0 && soundClips[cue] >= 0) {
+        soundVoices[cue] = std::max(0, audio.play(soundClips[cue], true));
+    }
+}
+
+// Fades out this sound only; the others keep playing
+void stopSound(SoundCue cue) {
+    if (soundVoices[cue] == 0) return;
+    audio.stop(soundVoices[cue]);
+    soundVoices[cue] = 0;
+}
+
+void playSoundWhile(SoundCue cue, bool wanted) {
+    if (wanted) {
+        playSound(cue);
+    } else {
+        stopSound(cue);
+    }
+}
+
+// The loops follow the current state rather than its changes, so seeking
+// several states at once, or back, leaves the right ones playing
+void updateSounds(SimState state) {
+    playSoundWhile(SOUND_ALARM, state >= ALARM && state <= EXTINGUISHING);
+    playSoundWhile(SOUND_TRUCK, state >= FIREFIGHTERS_ARRIVE && state <= ALL_CLEAR);
+    playSoundWhile(SOUND_WATER, state == EXTINGUISHING);
+}
+
+void init() {
+    glClearColor(0.53f, 0.81f, 0.98f, 1.0f); // Sky blue
+}
+
+void drawSky() {
+    PROFILE_SCOPE("drawSky");
+    // Gradient sky
+    glBegin(GL_QUADS);
+    glColor3f(0.53f, 0.81f, 0.98f); // Top color
+    glVertex2f(0, 0);
+    glVertex2f(800, 0);
+    glColor3f(0.7f, 0.9f, 1.0f);    // Bottom color
+    glVertex2f(800, 500);
+    glVertex2f(0, 500);
+    glEnd();
+}
+
+void drawCloud(float x, float y, float size) {
+    PROFILE_SCOPE("drawCloud");
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_POLYGON);
+    for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+        glVertex2f(x + size * sim.layout.circleX[i], y + size * sim.layout.circleY[i]);
+    }
+    glEnd();
+}
+
+void drawRoad() {
+    PROFILE_SCOPE("drawRoad");
+    // Main road
+    glColor3fv(roadColor);
+    glBegin(GL_QUADS);
+    glVertex2f(0, 400);
+    glVertex2f(800, 400);
+    glVertex2f(800, 450);
+    glVertex2f(0, 450);
+    glEnd();
+
+    // Road markings
+    glColor3f(1.0f, 1.0f, 1.0f);
+    for (int i = 0; i < 8; i++) {
+        glBegin(GL_QUADS);
+        glVertex2f(50 + i * 100, 425);
+        glVertex2f(80 + i * 100, 425);
+        glVertex2f(80 + i * 100, 430);
+        glVertex2f(50 + i * 100, 430);
+        glEnd();
+    }
+}
+
+void drawBuilding(int building) {
+    PROFILE_SCOPE("drawBuilding");
+    const BuildingDesc& desc = sim.scene.buildings[building];
+    float x = desc.x;
+    float width = desc.width;
+    float height = desc.height;
+
+    // Building structure
+    glColor3fv(desc.color);
+    glBegin(GL_QUADS);
+    glVertex2f(x, 400);
+    glVertex2f(x + width, 400);
+    glVertex2f(x + width, 400 - height);
+    glVertex2f(x, 400 - height);
+    glEnd();
+
+    // Windows
+    const BuildingLayout& layout = sim.layout.buildings[building];
+    for (int i = 0; i < layout.windowCount; i++) {
+        const WindowRect& w = sim.layout.window(building, i);
+
+        // Determine if this window is on fire
+        bool isBurning = (sim.currentState >= FIRE_START && sim.currentState < ALL_CLEAR &&
+                          sim.fireGrid.isBurning(layout.firstWindow + i));
+
+        if (isBurning) {
+            glColor3f(1.0f, 0.5f, 0.0f); // Fire glow
+        } else {
+            glColor3fv(windowColor);
+        }
+
+        glBegin(GL_QUADS);
+        glVertex2f(w.left, w.top);
+        glVertex2f(w.right, w.top);
+        glVertex2f(w.right, w.bottom);
+        glVertex2f(w.left, w.bottom);
+        glEnd();
+
+        // Window frame
+        glColor3f(0.3f, 0.3f, 0.3f);
+        glLineWidth(1.0f);
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(w.left, w.top);
+        glVertex2f(w.right, w.top);
+        glVertex2f(w.right, w.bottom);
+        glVertex2f(w.left, w.bottom);
+        glEnd();
+    }
+
+    // Roof
+    if (desc.isMain) { // Only main building has a special roof
+        glColor3f(0.4f, 0.4f, 0.4f);
+        glBegin(GL_QUADS);
+        glVertex2f(x - 10, 400 - height);
+        glVertex2f(x + width + 10, 400 - height);
+        glVertex2f(x + width, 400 - height - 20);
+        glVertex2f(x, 400 - height - 20);
+        glEnd();
+    }
+}
+
+void drawTrees() {
+    PROFILE_SCOPE("drawTrees");
+    // Draw trees along the road
+    for (const TreeDesc& tree : sim.scene.trees) {
+        float x = tree.x;
+
+        // Trunk
+        glColor3fv(treeColors[1]);
+        glBegin(GL_QUADS);
+        glVertex2f(x - 5, 400);
+        glVertex2f(x + 5, 400);
+        glVertex2f(x + 5, 370);
+        glVertex2f(x - 5, 370);
+        glEnd();
+
+        // Leaves
+        glColor3fv(treeColors[0]);
+        glBegin(GL_POLYGON);
+        for (int j = 0; j < CIRCLE_SEGMENTS; j++) {
+            glVertex2f(x + 15 * sim.layout.circleX[j], 370 + 15 * sim.layout.circleY[j]);
+        }
+        glEnd();
+    }
+}
+
+void drawFire() {
+    PROFILE_SCOPE("drawFire");
+    if (sim.currentState < FIRE_START || sim.currentState >= ALL_CLEAR) return;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    const ParticlePool& pool = sim.fireParticles;
+    for (int i = 0; i < pool.count; i++) {
+        float life = pool.life[i];
+
+        // Determine color based on particle life
+        if (life > 0.7f) {
+            glColor4f(fireColors[0][0], fireColors[0][1], fireColors[0][2], 0.8f);
+        } else if (life > 0.3f) {
+            glColor4f(fireColors[1][0], fireColors[1][1], fireColors[1][2], life);
+        } else {
+            glColor4f(fireColors[2][0], fireColors[2][1], fireColors[2][2], life * 0.5f);
+        }
+
+        // Draw particle
+        glPointSize(pool.size[i]);
+        glBegin(GL_POINTS);
+        glVertex2f(pool.previousX[i] + (pool.x[i] - pool.previousX[i]) * renderAlpha,
+                   pool.previousY[i] + (pool.y[i] - pool.previousY[i]) * renderAlpha);
+        glEnd();
+    }
+
+    // Water from the hoses
+    const ParticlePool& water = sim.waterParticles;
+    glColor4f(waterColor[0], waterColor[1], waterColor[2], 0.6f);
+    for (int i = 0; i < water.count; i++) {
+        glPointSize(water.size[i]);
+        glBegin(GL_POINTS);
+        glVertex2f(water.previousX[i] + (water.x[i] - water.previousX[i]) * renderAlpha,
+                   water.previousY[i] + (water.y[i] - water.previousY[i]) * renderAlpha);
+        glEnd();
+    }
+
+    glDisable(GL_BLEND);
+}
+
+void drawHumans() {
+    PROFILE_SCOPE("drawHumans");
+    if (sim.currentState < HUMANS_ARRIVE) return;
+
+    float time = sim.interpolatedTime(renderAlpha);
+    float humanPosition = sim.interpolatedHumanPosition(renderAlpha);
+    glColor3f(0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < 3; i++) {
+        float x = humanPosition + i * 30;
+        float y = 380 + sin(time * 2.0f + i) * 5.0f;
+
+        // Head
+        glPointSize(6.0f);
+        glBegin(GL_POINTS);
+        glVertex2f(x, y);
+        glEnd();
+
+        // Body
+        glBegin(GL_LINES);
+        glVertex2f(x, y);
+        glVertex2f(x, y + 15);
+        glEnd();
+
+        // Legs
+        glBegin(GL_LINES);
+        glVertex2f(x, y + 15);
+        glVertex2f(x - 5, y + 25);
+        glVertex2f(x, y + 15);
+        glVertex2f(x + 5, y + 25);
+        glEnd();
+
+        // Arms
+        float armAngle = sin(time * 5.0f + i) * 30.0f;
+        glPushMatrix();
+        glTranslatef(x, y + 10, 0.0f);
+        glRotatef(armAngle, 0.0f, 0.0f, 1.0f);
+        glBegin(GL_LINES);
+        glVertex2f(0, 0);
+        glVertex2f(-10, 0);
+        glVertex2f(0, 0);
+        glVertex2f(10, 0);
+        glEnd();
+        glPopMatrix();
+    }
+}
+
+// Occupants leaving burning buildings, one quad each
+std::vector<Vertex> occupantQuads;
+
+void drawOccupants() {
+    PROFILE_SCOPE("drawOccupants");
+    const CrowdAgents& crowd = sim.crowd;
+    if (crowd.count == 0) return;
+
+    occupantQuads.resize((size_t)crowd.count * 4);
+    writeAgentQuads(crowd, occupantQuads.data(), 0, crowd.count, renderAlpha);
+    glBegin(GL_QUADS);
+    for (const Vertex& v : occupantQuads) {
+        glColor4ub(v.r, v.g, v.b, v.a);
+        glVertex2f(v.x, v.y);
+    }
+    glEnd();
+}
+
+void drawFireTruck(const FireTruck& truck, const TruckDesc& desc, float x) {
+    PROFILE_SCOPE("drawFireTruck");
+    // Truck body
+    glColor3fv(desc.color);
+    glBegin(GL_QUADS);
+    glVertex2f(x, 370);
+    glVertex2f(x + 60, 370);
+    glVertex2f(x + 60, 400);
+    glVertex2f(x, 400);
+    glEnd();
+
+    // Cabin, at the front
+    float cabin = truck.facingLeft ? x : x + 40;
+    glColor3f(0.9f, 0.9f, 0.9f);
+    glBegin(GL_QUADS);
+    glVertex2f(cabin, 370);
+    glVertex2f(cabin + 20, 370);
+    glVertex2f(cabin + 20, 390);
+    glVertex2f(cabin, 390);
+    glEnd();
+
+    // Wheels
+    glColor3f(0.1f, 0.1f, 0.1f);
+    for (int i = 0; i < 2; i++) {
+        glBegin(GL_POLYGON);
+        for (int j = 0; j < CIRCLE_SEGMENTS; j++) {
+            glVertex2f(x + 15 + i * 30 + 10 * sim.layout.circleX[j], 400 + 10 * sim.layout.circleY[j]);
+        }
+        glEnd();
+    }
+}
+
+void drawAlarm() {
+    PROFILE_SCOPE("drawAlarm");
+    if (sim.currentState < ALARM || sim.currentState >= ALL_CLEAR) return;
+    if (sim.layout.mainBuilding < 0) return;
+
+    // Top left corner of the main building
+    const BuildingDesc& main = sim.scene.buildings[sim.layout.mainBuilding];
+    float x = main.x - 20;
+    float y = 400 - main.height;
+
+    if (sim.alarmLightOn()) {
+        glColor3f(1.0f, 0.0f, 0.0f);
+        glBegin(GL_QUADS);
+        glVertex2f(x, y);
+        glVertex2f(x + 10, y);
+        glVertex2f(x + 10, y + 10);
+        glVertex2f(x, y + 10);
+        glEnd();
+    }
+}
+
+void drawInterface() {
+    PROFILE_SCOPE("drawInterface");
+    statusPanel.update(hud, sim);
+    renderer.drawHud(hud);
+}
+
+// Prints average frame time and batch counts about once a second
+void printRenderStats() {
+    static int frames = 0;
+    static int lastPrint = 0;
+    frames++;
+
+    int now = glutGet(GLUT_ELAPSED_TIME);
+    if (now - lastPrint < 1000) return;
+
+    float frameMs = (now - lastPrint) / (float)frames;
+    if (options.immediateMode) {
+        printf("Frame %.2f ms, immediate mode, %d particles\n", frameMs, sim.fireParticles.count);
+    } else {
+        const RenderStats& r = renderer.stats;
+        printf("Frame %.2f ms, %d draw calls, %d vertices, %d particles\n", frameMs, r.drawCalls, r.vertices,
+               r.particles);
+        printf("  View: zoom %.2f%s, %d cells drawn, %d culled, %d particles in view", camera.zoom(),
+               r.lod ? " (coarse)" : "", r.cellsDrawn, r.cellsCulled, r.particlesDrawn);
+        if (r.lod) {
+            printf(" as %d sprites", r.sprites);
+        }
+        printf(", %d of %d occupants\n", r.agentsDrawn, sim.crowd.count);
+    }
+    if (recorder.running()) {
+        FrameEncoderStats r = recorder.stats();
+        printf("  Recording: %lld written, %lld dropped, queue %d (peak %d)\n", r.written, r.dropped,
+               r.queueDepth, r.peakQueueDepth);
+    }
+    if (sim.fluid.enabled()) {
+        const FluidTimings& t = sim.fluid.timings;
+        printf("  Fluid %dx%d: sources %.3f ms, diffuse %.3f ms, project %.3f ms, advect %.3f ms\n",
+               sim.fluid.gridWidth(), sim.fluid.gridHeight(), t.sources, t.diffuse, t.project, t.advect);
+    }
+    printf("  Sim: %lld steps at %.1f Hz, %lld dropped catching up\n", simClock.steps,
+           1.0 / simClock.stepSeconds(), simClock.droppedSteps);
+    printf("  Snapshots: %d from %.1fs to %.1fs, %.2f MB (%.2f MB uncompressed)\n", snapshots.count(),
+           snapshots.earliestTime(), snapshots.latestTime(), snapshots.storedBytes() / 1048576.0,
+           snapshots.rawBytes() / 1048576.0);
+    frames = 0;
+    lastPrint = now;
+}
+
+// Prints what the frame encoder did; stall is time the producer waited
+void printEncoderStats(FILE* report, FrameEncoder& encoder) {
+    FrameEncoderStats stats = encoder.stats();
+    long long done = stats.submitted - stats.queueDepth;
+    double frames = done > 0 ? (double)done : 1.0;
+    fprintf(report, "  Encoder:        %lld written, %lld dropped, queue peak %d, encode %.3f ms (worst %.3f), "
+            "write %.3f ms, stall %.1f ms total\n", stats.written, stats.dropped, stats.peakQueueDepth,
+            stats.encodeMs / frames, stats.worstEncodeMs, stats.writeMs / frames, stats.stallMs);
+}
+
+// Reads the back buffer into a free encoder frame; rows come bottom up and
+// are flipped while encoding, off this thread. Frames keep the size the
+// recording started at, so a resized window is cropped to its top left
+// corner, or leaves the rest black, rather than reallocating the ring.
+void captureWindow() {
+    PROFILE_SCOPE("captureWindow");
+    Framebuffer* frame = recorder.acquire();
+    long long frameNumber = recordedFrames++;
+    if (!frame) return;
+
+    int windowWidth = glutGet(GLUT_WINDOW_WIDTH), windowHeight = glutGet(GLUT_WINDOW_HEIGHT);
+    int width = std::min(windowWidth, frame->width), height = std::min(windowHeight, frame->height);
+    if (width < frame->width || height < frame->height) {
+        std::fill(frame->pixels.begin(), frame->pixels.end(), 0);
+    }
+    frame->bottomUp = true;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, frame->width);
+    unsigned char* top = frame->pixels.data() + (size_t)(frame->height - height) * frame->width * 4;
+    glReadPixels(0, windowHeight - height, width, height, GL_RGBA, GL_UNSIGNED_BYTE, top);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    recorder.submit(frame, frameNumber);
+}
+
+// Frame time graph, particle count and draw calls in the top right corner
+void drawProfilerOverlay() {
+    PROFILE_SCOPE("drawProfilerOverlay");
+    const float left = 480, top = 10, right = 790, bottom = 130;
+    const float graphTop = 50, graphBottom = 120;
+    const float graphMs = 33.3f; // Full graph height
+
+    static float frames[PROFILE_FRAME_HISTORY];
+    int count = profileFrameHistory(frames, PROFILE_FRAME_HISTORY);
+    float average = 0.0f, worst = 0.0f;
+    for (int i = 0; i < count; i++) {
+        average += frames[i];
+        worst = std::max(worst, frames[i]);
+    }
+    average = count > 0 ? average / count : 0.0f;
+
+    glColor3f(0.0f, 0.0f, 0.0f);
+    glBegin(GL_QUADS);
+    glVertex2f(left, top);
+    glVertex2f(right, top);
+    glVertex2f(right, bottom);
+    glVertex2f(left, bottom);
+    glEnd();
+
+    // 60 fps budget line, then one line per frame, newest on the right
+    float budgetY = graphBottom - (graphBottom - graphTop) * (16.667f / graphMs);
+    glColor3f(0.3f, 0.6f, 0.3f);
+    glBegin(GL_LINES);
+    glVertex2f(left + 10, budgetY);
+    glVertex2f(right - 10, budgetY);
+    glEnd();
+
+    float step = (right - left - 20) / PROFILE_FRAME_HISTORY;
+    glColor3f(1.0f, 0.8f, 0.2f);
+    glBegin(GL_LINE_STRIP);
+    for (int i = 0; i < count; i++) {
+        float ms = std::min(frames[i], graphMs);
+        glVertex2f(right - 10 - (count - 1 - i) * step, graphBottom - (graphBottom - graphTop) * (ms / graphMs));
+    }
+    glEnd();
+
+    char line[128];
+    glColor3f(1.0f, 1.0f, 1.0f);
+    snprintf(line, sizeof(line), "Frame %.2f ms avg, %.2f ms worst", average, worst);
+    glRasterPos2f(left + 10, top + 15);
+    for (const char* c = line; *c; c++) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
+    if (options.immediateMode) {
+        snprintf(line, sizeof(line), "Particles %d, immediate mode", sim.fireParticles.count);
+    } else {
+        snprintf(line, sizeof(line), "Particles %d (%d in view), draw calls %d, cells %d/%d",
+                 sim.fireParticles.count, renderer.stats.particlesDrawn, renderer.stats.drawCalls,
+                 renderer.stats.cellsDrawn, renderer.stats.cellsDrawn + renderer.stats.cellsCulled);
+    }
+    glRasterPos2f(left + 10, top + 32);
+    for (const char* c = line; *c; c++) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
+}
+
+void display() {
+    PROFILE_FRAME();
+    PROFILE_SCOPE("display");
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Orthographic projection of what the camera sees
+    ViewRect view = camera.view(glutGet(GLUT_WINDOW_WIDTH));
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(view.left, view.right, view.bottom, view.top);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    // The sim thread waits while this frame reads the simulation
+    std::unique_lock<std::mutex> simLock(simMutex);
+    double sinceAdvance = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastClockAdvance).count();
+    renderAlpha = simClock.alpha(sinceAdvance);
+    updateSounds(sim.currentState);
+
+    if (options.immediateMode) {
+        // Draw scene
+        drawSky();
+        for (const CloudDesc& cloud : sim.scene.clouds) {
+            drawCloud(cloud.x, cloud.y, cloud.size);
+        }
+        drawRoad();
+        drawTrees();
+
+        for (int i = 0; i < (int)sim.scene.buildings.size(); i++) {
+            drawBuilding(i);
+        }
+
+        // Draw all elements in proper order
+        drawFire();
+        drawOccupants();
+        drawHumans(); // Humans appear before trucks
+        for (int i = 0; i < (int)sim.trucks.size(); i++) {
+            if (sim.truckOnStreet(i)) {
+                drawFireTruck(sim.trucks[i], sim.scene.trucks[i], sim.interpolatedTruckX(i, renderAlpha));
+            }
+        }
+        drawAlarm();
+    } else {
+        renderer.draw(sim, sim.alarmLightOn(), renderAlpha, view);
+    }
+
+    // The HUD stays put in window coordinates
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, VIEW_WIDTH, VIEW_HEIGHT, 0);
+    glMatrixMode(GL_MODELVIEW);
+    drawInterface();
+    if (options.profileOverlay) {
+        drawProfilerOverlay();
+    }
+    if (!options.immediateMode) {
+        PROFILE_COUNTER("drawCalls", renderer.stats.drawCalls);
+    }
+    if (options.renderStats) {
+        printRenderStats();
+    }
+    simLock.unlock();
+
+    if (recorder.running()) {
+        captureWindow();
+    }
+    {
+        PROFILE_SCOPE("glutSwapBuffers");
+        glutSwapBuffers();
+    }
+}
+
+// The layout is in scene units, but anything cached from it is rebuilt on resize
+void reshape(int width, int height) {
+    // The layout is in scene units, so resizing leaves it and the caches
+    // built on it alone
+    glViewport(0, 0, width, height);
+}
+
+// Steps the simulation at the fixed --dt rate however fast the window
+// redraws. A slow frame is caught up with at most MAX_CATCH_UP_STEPS
+// steps; anything beyond that is dropped, so the sim falls behind real
+// time instead of spending ever longer catching up.
+void simulationLoop() {
+    auto last = std::chrono::steady_clock::now();
+    while (simRunning.load()) {
+        auto now = std::chrono::steady_clock::now();
+        int steps;
+        {
+            std::lock_guard<std::mutex> lock(simMutex);
+            steps = simClock.advance(std::chrono::duration<double>(now - last).count());
+            lastClockAdvance = now;
+        }
+        last = now;
+
+        for (int i = 0; i < steps; i++) {
+            std::lock_guard<std::mutex> lock(simMutex);
+            PROFILE_SCOPE("updateSimulation");
+            sim.step((float)simClock.stepSeconds());
+            snapshots.update(sim);
+        }
+
+        double wait;
+        {
+            std::lock_guard<std::mutex> lock(simMutex);
+            wait = simClock.secondsUntilStep();
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+}
+
+void startSimulationThread() {
+    simClock.setStep(options.timeStep, MAX_CATCH_UP_STEPS);
+    lastClockAdvance = std::chrono::steady_clock::now();
+    simRunning = true;
+    simThread = std::thread(simulationLoop);
+}
+
+void stopSimulationThread() {
+    if (!simThread.joinable()) return;
+    simRunning = false;
+    simThread.join();
+}
+
+// Drawing only; the simulation keeps its own time on the sim thread
+void idle() {
+    glutPostRedisplay();
+}
+
+// [ rewinds and ] fast-forwards by SEEK_SECONDS, from the nearest snapshot;
+// + and - zoom on the middle of the window, 0 resets the view
+void keyboard(unsigned char key, int, int) {
+    int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+    if (key == '+' || key == '=' || key == '-') {
+        camera.zoomAt(key == '-' ? 1.0f / ZOOM_STEP : ZOOM_STEP, width * 0.5f, height * 0.5f, width, height);
+        return;
+    }
+    if (key == '0') {
+        camera.reset();
+        return;
+    }
+
+    float offset = key == '[' ? -SEEK_SECONDS : key == ']' ? SEEK_SECONDS : 0.0f;
+    if (offset == 0.0f) return;
+
+    std::lock_guard<std::mutex> lock(simMutex);
+    seekSimulation(sim, &snapshots, std::max(0.0f, sim.simTime + offset), options.timeStep);
+    printf("Seek to %.1fs\n", sim.simTime);
+}
+
+// Arrow keys pan
+void specialKey(int key, int, int) {
+    float dx = key == GLUT_KEY_LEFT ? PAN_PIXELS : key == GLUT_KEY_RIGHT ? -PAN_PIXELS : 0.0f;
+    float dy = key == GLUT_KEY_UP ? PAN_PIXELS : key == GLUT_KEY_DOWN ? -PAN_PIXELS : 0.0f;
+    camera.pan(dx, dy, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+}
+
+// Left drag pans; the wheel (buttons 3 and 4 in freeglut) zooms on the cursor
+void mouse(int button, int state, int x, int y) {
+    if (button == GLUT_LEFT_BUTTON) {
+        dragX = state == GLUT_DOWN ? x : -1;
+        dragY = y;
+    } else if ((button == 3 || button == 4) && state == GLUT_DOWN) {
+        camera.zoomAt(button == 3 ? ZOOM_STEP : 1.0f / ZOOM_STEP, (float)x, (float)y, glutGet(GLUT_WINDOW_WIDTH),
+                      glutGet(GLUT_WINDOW_HEIGHT));
+    }
+}
+
+void motion(int x, int y) {
+    if (dragX < 0) return;
+    camera.pan((float)(x - dragX), (float)(y - dragY), glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+    dragX = x;
+    dragY = y;
+}
+
+void writeTrace(FILE* report) {
+    if (writeChromeTrace(options.tracePath)) {
+        fprintf(report, "Wrote trace to %s\n", options.tracePath);
+    }
+}
+
+// Drains the event stream and says how much of it made it
+void finishEvents(FILE* report) {
+    if (!eventSink.running()) return;
+    bool ok = eventSink.finish();
+    fprintf(report, "%s %lld events to %s, %lld lost\n", ok ? "Wrote" : "ERROR: Failed writing", eventSink.written(),
+            options.eventsPath, eventSink.lost());
+}
+
+// Headless and offscreen runs with --audio-out mix the sounds offline, in
+// sim time, so the soundtrack lines up with the frames
+WavWriter soundtrack;
+double soundtrackOwed = 0.0; // Frames of sim time not mixed yet
+
+bool startSoundtrack() {
+    loadSounds();
+    return soundtrack.open(options.audioOutPath);
+}
+
+void recordSoundtrack(float deltaTime) {
+    if (!soundtrack.isOpen()) return;
+    updateSounds(sim.currentState);
+
+    int16_t block[AUDIO_BLOCK_FRAMES * AUDIO_CHANNELS];
+    soundtrackOwed += deltaTime * (double)AUDIO_SAMPLE_RATE;
+    while (soundtrackOwed >= 1.0) {
+        int frames = (int)std::min(soundtrackOwed, (double)AUDIO_BLOCK_FRAMES);
+        audio.mix(block, frames);
+        soundtrack.write(block, frames);
+        soundtrackOwed -= frames;
+    }
+}
+
+// Stops the audio thread or closes the soundtrack
+void finishAudio(FILE* report) {
+    if (audio.running()) {
+        audio.finish();
+        if (options.audioOutPath) {
+            fprintf(report, "Wrote %.2fs of sound to %s\n", audio.mixedFrames() / (double)AUDIO_SAMPLE_RATE,
+                    options.audioOutPath);
+        }
+        delete audioOutput;
+        audioOutput = nullptr;
+    }
+    if (soundtrack.isOpen()) {
+        double seconds = soundtrack.frames() / (double)AUDIO_SAMPLE_RATE;
+        bool ok = soundtrack.close();
+        fprintf(report, "%s %.2fs of sound to %s\n", ok ? "Wrote" : "ERROR: Failed writing", seconds,
+                options.audioOutPath);
+    }
+}
+
+void saveFinalState(FILE* report) {
+    if (options.saveStatePath && writeStateFile(options.saveStatePath, sim)) {
+        fprintf(report, "Saved state at %.2fs to %s\n", sim.simTime, options.saveStatePath);
+    }
+}
+
+void cleanup() {
+    stopSimulationThread();
+    saveFinalState(stdout);
+    finishAudio(stdout);
+
+    finishEvents(stdout);
+    if (recorder.running()) {
+        recorder.finish();
+        printf("Recording: %s\n", options.recordPath);
+        printEncoderStats(stdout, recorder);
+    }
+
+    // Last, once the simulation and encoder threads no longer record scopes
+    if (options.tracePath) {
+        writeTrace(stdout);
+    }
+}
+
+void printUsage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --headless        Run without a window as fast as the CPU allows\n");
+    printf("  --seconds <s>     Simulated seconds to run in headless mode (default 30)\n");
+    printf("  --dt <s>          Fixed simulation time step (default 1/60)\n");
+    printf("  --particle-capacity <n>  Fire particles preallocated at startup (default %d)\n",
+           DEFAULT_PARTICLE_CAPACITY);
+    printf("  --occupants <n>   People who leave each building once it burns (default %d)\n", DEFAULT_OCCUPANTS);
+    printf("  --crowd-capacity <n>  Occupants preallocated at startup (default %d)\n", DEFAULT_CROWD_CAPACITY);
+    printf("  --kernel <name>   Particle kernel: auto, scalar, sse2 or avx2 (default auto)\n");
+    printf("  --seed <n>        Seed for every random stream; same seed, same run (default: time)\n");
+    printf("  --fluid <cells>   Smoke grid width in cells, 0 turns it off (default %d)\n",
+           DEFAULT_FLUID_RESOLUTION);
+    printf("  --threads <n>     Worker threads for particle updates (default: all cores)\n");
+    printf("  --bench-threads <n>  Time n particles on 1..all threads and exit\n");
+    printf("  --scene <file>    Load buildings, trucks and timings from a scene file\n");
+    printf("  --generate-city <n> <file>  Write a scene with n buildings and exit\n");
+    printf("  --bench-load <file>  Time loading a scene file and exit\n");
+    printf("  --bench-fire <n>  Time fire spread through a city of n buildings and exit\n");
+    printf("  --offscreen <pattern>  Render without a window into frame files (frame_%%05d.png,\n"
+           "                    .ppm) or raw RGB24 on stdout with -, for --seconds at --dt\n");
+    printf("  --render-size <w>x<h>  Offscreen frame size (default 800x500)\n");
+    printf("  --render-threads <n>  Threads for offscreen rasterizing (default: all cores)\n");
+    printf("  --record <pattern>  Capture the window into frame files; frames are dropped\n"
+           "                    rather than slowing the window down\n");
+    printf("  --encode-threads <n>  Threads compressing and writing frames (default %d)\n",
+           DEFAULT_ENCODER_THREADS);
+    printf("  --encode-ring <n>  Frames buffered for the encoder (default %d)\n", DEFAULT_ENCODER_RING_SIZE);
+    printf("  --profile         Show frame times, particles and draw calls over the window\n");
+    printf("  --trace <file>    Write the last %d profiler events as Chrome trace JSON on exit\n",
+           PROFILE_EVENT_CAPACITY);
+    printf("  --events <file>   Stream events as they happen: JSON lines for .jsonl, else binary\n");
+    printf("  --start-at <s>    Fast-forward to this sim time before starting\n");
+    printf("  --snapshot-every <s>  Sim seconds between snapshots for [ and ] seeking (default %g)\n",
+           DEFAULT_SNAPSHOT_INTERVAL);
+    printf("  --snapshot-budget <MB>  Memory for snapshots (default %d)\n", (int)(DEFAULT_SNAPSHOT_BUDGET >> 20));
+    printf("  --load-state <file>  Start from a state saved with --save-state\n");
+    printf("  --save-state <file>  Save the simulation state on exit\n");
+    printf("  --audio-out <file.wav>  Record the sound into a WAV file instead of playing it;\n"
+           "                    headless and offscreen runs record it in sim time\n");
+    printf("  --mute            No sound device; sounds are still mixed\n");
+    printf("  --sweep <n>       Run n seeds from --seed for every parameter set, headless on all\n"
+           "                    cores (--threads), and print the distributions\n");
+    printf("  --sweep-truck-speed <list>  Truck speed factors to sweep, e.g. 0.5,1,2 (default 1)\n");
+    printf("  --sweep-timing <list>  Scenario timing factors to sweep (default 1)\n");
+    printf("  --sweep-limit <s>  Sim seconds a run may take to reach all clear (default %g)\n",
+           DEFAULT_SWEEP_LIMIT);
+    printf("  --sweep-runs <file.csv>  Write every run as it finishes\n");
+    printf("  --sweep-out <file>  Write the summary: JSON for .json, else CSV\n");
+    printf("  --immediate       Draw with the old immediate-mode path instead of batches\n");
+    printf("  --stats           Print frame time and draw calls once a second\n");
+    printf("  --self-check      Run the built-in correctness checks and exit\n");
+    printf("  --help            Show this help\n");
+}
+
+// "0.5,1,2" into factors; false unless all are positive numbers
+bool parseFactors(const char* text, std::vector<float>& factors) {
+    factors.clear();
+    const char* p = text;
+    while (*p) {
+        char* end = nullptr;
+        float value = strtof(p, &end);
+        if (end == p || value <= 0.0f || (*end != ',' && *end != '\0')) return false;
+        factors.push_back(value);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !factors.empty();
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    options.headless = false;
+    options.seconds = 30.0f;
+    options.timeStep = 1.0f / 60.0f;
+    options.particleCapacity = DEFAULT_PARTICLE_CAPACITY;
+    options.occupants = DEFAULT_OCCUPANTS;
+    options.crowdCapacity = DEFAULT_CROWD_CAPACITY;
+    options.particleKernel = KERNEL_AUTO;
+    options.selfCheck = false;
+    options.threads = 0;
+    options.benchParticles = 0;
+    options.immediateMode = false;
+    options.renderStats = false;
+    options.scenePath = nullptr;
+    options.cityPath = nullptr;
+    options.cityBuildings = 0;
+    options.benchLoadPath = nullptr;
+    options.benchFireBuildings = 0;
+    options.fluidResolution = DEFAULT_FLUID_RESOLUTION;
+    options.seed = (uint64_t)time(NULL);
+    options.offscreenPath = nullptr;
+    options.renderWidth = 800;
+    options.renderHeight = 500;
+    options.renderThreads = 0;
+    options.recordPath = nullptr;
+    options.encodeThreads = DEFAULT_ENCODER_THREADS;
+    options.encodeRing = DEFAULT_ENCODER_RING_SIZE;
+    options.profileOverlay = false;
+    options.tracePath = nullptr;
+    options.eventsPath = nullptr;
+    options.startAt = 0.0f;
+    options.snapshotInterval = DEFAULT_SNAPSHOT_INTERVAL;
+    options.snapshotBudgetMb = (int)(DEFAULT_SNAPSHOT_BUDGET >> 20);
+    options.loadStatePath = nullptr;
+    options.saveStatePath = nullptr;
+    options.audioOutPath = nullptr;
+    options.mute = false;
+    options.sweepRuns = 0;
+    options.sweepTruckSpeeds.assign(1, 1.0f);
+    options.sweepTimings.assign(1, 1.0f);
+    options.sweepLimit = DEFAULT_SWEEP_LIMIT;
+    options.sweepRunsPath = nullptr;
+    options.sweepOutPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        } else if (strcmp(arg, "--seconds") == 0 && hasValue) {
+            options.seconds = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--dt") == 0 && hasValue) {
+            options.timeStep = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--particle-capacity") == 0 && hasValue) {
+            options.particleCapacity = atoi(argv[++i]);
+        } else if (strcmp(arg, "--occupants") == 0 && hasValue) {
+            options.occupants = atoi(argv[++i]);
+        } else if (strcmp(arg, "--crowd-capacity") == 0 && hasValue) {
+            options.crowdCapacity = atoi(argv[++i]);
+        } else if (strcmp(arg, "--kernel") == 0 && hasValue) {
+            const char* name = argv[++i];
+            if (!parseParticleKernel(name, options.particleKernel)) {
+                printf("ERROR: Unknown kernel '%s'\n", name);
+                return false;
+            }
+            if (!isParticleKernelSupported(options.particleKernel)) {
+                printf("ERROR: Kernel '%s' is not supported by this CPU\n", name);
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(arg, "--fluid") == 0 && hasValue) {
+            options.fluidResolution = atoi(argv[++i]);
+        } else if (strcmp(arg, "--threads") == 0 && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--bench-threads") == 0 && hasValue) {
+            options.benchParticles = atoi(argv[++i]);
+        } else if (strcmp(arg, "--scene") == 0 && hasValue) {
+            options.scenePath = argv[++i];
+        } else if (strcmp(arg, "--generate-city") == 0 && i + 2 < argc) {
+            options.cityBuildings = atoi(argv[++i]);
+            options.cityPath = argv[++i];
+        } else if (strcmp(arg, "--bench-load") == 0 && hasValue) {
+            options.benchLoadPath = argv[++i];
+        } else if (strcmp(arg, "--bench-fire") == 0 && hasValue) {
+            options.benchFireBuildings = atoi(argv[++i]);
+        } else if (strcmp(arg, "--offscreen") == 0 && hasValue) {
+            options.offscreenPath = argv[++i];
+        } else if (strcmp(arg, "--render-size") == 0 && hasValue) {
+            const char* size = argv[++i];
+            if (sscanf(size, "%dx%d", &options.renderWidth, &options.renderHeight) != 2) {
+                printf("ERROR: --render-size wants <width>x<height>, got '%s'\n", size);
+                return false;
+            }
+        } else if (strcmp(arg, "--render-threads") == 0 && hasValue) {
+            options.renderThreads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--record") == 0 && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (strcmp(arg, "--encode-threads") == 0 && hasValue) {
+            options.encodeThreads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--encode-ring") == 0 && hasValue) {
+            options.encodeRing = atoi(argv[++i]);
+        } else if (strcmp(arg, "--profile") == 0) {
+            options.profileOverlay = true;
+        } else if (strcmp(arg, "--trace") == 0 && hasValue) {
+            options.tracePath = argv[++i];
+        } else if (strcmp(arg, "--events") == 0 && hasValue) {
+            options.eventsPath = argv[++i];
+        } else if (strcmp(arg, "--start-at") == 0 && hasValue) {
+            options.startAt = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--snapshot-every") == 0 && hasValue) {
+            options.snapshotInterval = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--snapshot-budget") == 0 && hasValue) {
+            options.snapshotBudgetMb = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(arg, "--load-state") == 0 && hasValue) {
+            options.loadStatePath = argv[++i];
+        } else if (strcmp(arg, "--save-state") == 0 && hasValue) {
+            options.saveStatePath = argv[++i];
+        } else if (strcmp(arg, "--audio-out") == 0 && hasValue) {
+            options.audioOutPath = argv[++i];
+        } else if (strcmp(arg, "--mute") == 0) {
+            options.mute = true;
+        } else if (strcmp(arg, "--sweep") == 0 && hasValue) {
+            options.sweepRuns = atoi(argv[++i]);
+        } else if (strcmp(arg, "--sweep-truck-speed") == 0 && hasValue) {
+            if (!parseFactors(argv[++i], options.sweepTruckSpeeds)) {
+                printf("ERROR: --sweep-truck-speed wants positive factors like 0.5,1,2\n");
+                return false;
+            }
+        } else if (strcmp(arg, "--sweep-timing") == 0 && hasValue) {
+            if (!parseFactors(argv[++i], options.sweepTimings)) {
+                printf("ERROR: --sweep-timing wants positive factors like 0.8,1,1.2\n");
+                return false;
+            }
+        } else if (strcmp(arg, "--sweep-limit") == 0 && hasValue) {
+            options.sweepLimit = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--sweep-runs") == 0 && hasValue) {
+            options.sweepRunsPath = argv[++i];
+        } else if (strcmp(arg, "--sweep-out") == 0 && hasValue) {
+            options.sweepOutPath = argv[++i];
+        } else if (strcmp(arg, "--immediate") == 0) {
+            options.immediateMode = true;
+        } else if (strcmp(arg, "--stats") == 0) {
+            options.renderStats = true;
+        } else if (strcmp(arg, "--self-check") == 0) {
+            options.selfCheck = true;
+        } else if (strcmp(arg, "--help") == 0) {
+            printUsage(argv[0]);
+            exit(0);
+        } else {
+            printf("Unknown option: %s\n", arg);
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.seconds <= 0.0f || options.timeStep <= 0.0f) {
+        printf("ERROR: --seconds and --dt must be positive\n");
+        return false;
+    }
+    if (options.particleCapacity < 0) {
+        printf("ERROR: --particle-capacity must not be negative\n");
+        return false;
+    }
+    if (options.occupants < 0 || options.crowdCapacity < 0) {
+        printf("ERROR: --occupants and --crowd-capacity must not be negative\n");
+        return false;
+    }
+    if (options.fluidResolution < 0) {
+        printf("ERROR: --fluid must not be negative\n");
+        return false;
+    }
+    if (options.renderWidth <= 0 || options.renderHeight <= 0) {
+        printf("ERROR: --render-size must be positive\n");
+        return false;
+    }
+    if (options.offscreenPath && strcmp(options.offscreenPath, "-") != 0 && !isFramePattern(options.offscreenPath)) {
+        printf("ERROR: --offscreen needs one frame number conversion like frame_%%05d.png, or -\n");
+        return false;
+    }
+    // The window prints to stdout, so it cannot carry frames
+    if (options.recordPath && !isFramePattern(options.recordPath)) {
+        printf("ERROR: --record needs one frame number conversion like frame_%%05d.png\n");
+        return false;
+    }
+    if (options.encodeThreads <= 0 || options.encodeRing <= 0) {
+        printf("ERROR: --encode-threads and --encode-ring must be positive\n");
+        return false;
+    }
+    if (options.cityPath && options.cityBuildings <= 0) {
+        printf("ERROR: --generate-city needs a positive building count\n");
+        return false;
+    }
+    if (options.sweepRuns < 0 || options.sweepLimit <= 0.0f) {
+        printf("ERROR: --sweep and --sweep-limit must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+// Times particle integration and emission over a large pool on 1..N threads
+int runThreadBenchmark(const Options& options) {
+    const int steps = 100;
+    const float timeStep = 1.0f / 60.0f;
+    int maxThreads = options.threads > 0 ? options.threads
+                                         : (int)std::max(1u, std::thread::hardware_concurrency());
+
+    printf("Thread scaling: %d particles, %d steps, kernel %s\n", options.benchParticles, steps,
+           particleKernelName(sim.particleKernel));
+
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double baseline = 0.0;
+    uint64_t firstHash = 0;
+    bool deterministic = true;
+    for (int threads : threadCounts) {
+        JobSystem jobs(threads);
+        Simulation bench;
+        bench.setParticleCapacity(options.benchParticles + steps * PARTICLES_PER_EMITTER);
+        bench.setParticleKernel(sim.particleKernel);
+        bench.setFluidResolution(options.fluidResolution);
+        bench.setSeed(1);
+        bench.setJobSystem(&jobs);
+
+        // Start mid-fire with a full pool of long-lived particles
+        bench.currentState = FIRE_START;
+        bench.simTime = 3.1f;
+        bench.fireOrigin = bench.layout.buildings[bench.layout.mainBuilding].firstWindow + 7;
+        bench.fireGrid.ignite(bench.fireOrigin);
+        ParticlePool& pool = bench.fireParticles;
+        int first = 0;
+        pool.spawnBlock(options.benchParticles, first);
+        for (int i = 0; i < pool.count; i++) {
+            pool.x[i] = 300.0f + (i % 100);
+            pool.y[i] = 400.0f - (i % 150);
+            pool.velocity[i] = -1.0f;
+            pool.life[i] = 1000.0f;
+            pool.size[i] = 2.0f;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; i++) {
+            bench.step(timeStep);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t hash = bench.stateHash();
+        if (threads == 1) {
+            baseline = seconds;
+            firstHash = hash;
+        }
+        deterministic = deterministic && hash == firstHash;
+
+        printf("  %2d threads: %8.2f ms/step  %6.2f ns/particle  speedup %.2fx  hash %016llx\n",
+               threads, seconds * 1000.0 / steps, seconds * 1e9 / ((double)steps * pool.count),
+               seconds > 0.0 ? baseline / seconds : 0.0, (unsigned long long)hash);
+    }
+
+    printf("Results %s across thread counts\n", deterministic ? "identical" : "DIFFER");
+    return deterministic ? 0 : 1;
+}
+
+// Parses a scene file repeatedly and reports the load rate
+int runLoadBenchmark(const Options& options) {
+    const int runs = 20;
+    Scene scene = defaultScene();
+    if (!loadSceneFile(options.benchLoadPath, scene)) {
+        return 1;
+    }
+
+    size_t windows = 0;
+    for (const BuildingDesc& b : scene.buildings) {
+        windows += (size_t)b.floors * b.windowsPerFloor;
+    }
+
+    MappedFile file;
+    if (!file.open(options.benchLoadPath)) {
+        return 1;
+    }
+    size_t bytes = file.size();
+    file.close();
+
+    // Reloading into the same scene reuses its vectors, as a level reload would
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        loadSceneFile(options.benchLoadPath, scene);
+        sim.layout.build(scene);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    printf("Scene load: %s\n", options.benchLoadPath);
+    printf("  Size:           %zu bytes\n", bytes);
+    printf("  Buildings:      %zu (%zu windows)\n", scene.buildings.size(), windows);
+    printf("  Load + layout:  %.3f ms (best of %d)\n", best * 1000.0, runs);
+    printf("  Rate:           %.1f MB/s\n", best > 0.0 ? bytes / best / 1e6 : 0.0);
+    return 0;
+}
+
+// Spreads fire from every other building through a generated city and
+// times the grid update against a 60 Hz frame
+int runFireBenchmark(const Options& options, JobSystem* jobs) {
+    const int steps = 1200;
+    const float timeStep = 1.0f / 60.0f;
+
+    Scene city = generateCityScene(options.benchFireBuildings, 1);
+    SceneLayout layout;
+    layout.build(city);
+    FireGrid grid;
+    grid.build(city, layout);
+    for (int b = 0; b < (int)city.buildings.size(); b += 2) {
+        grid.ignite(layout.buildings[b].firstWindow);
+    }
+
+    double total = 0.0;
+    double worst = 0.0;
+    int peakActive = 0;
+    int peakBurning = 0;
+    for (int i = 0; i < steps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        grid.step(timeStep, jobs);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        total += seconds;
+        worst = std::max(worst, seconds);
+        peakActive = std::max(peakActive, grid.activeCellCount());
+        peakBurning = std::max(peakBurning, (int)grid.burningWindows().size());
+    }
+
+    printf("Fire spread: %d buildings, %d cells, %d steps on %d threads\n", (int)city.buildings.size(),
+           grid.cellCount(), steps, jobs->threadCount());
+    printf("  Peak active cells:  %d\n", peakActive);
+    printf("  Peak burning cells: %d\n", peakBurning);
+    printf("  Step time:          %.3f ms average, %.3f ms worst (60 Hz budget 16.667 ms)\n",
+           total * 1000.0 / steps, worst * 1000.0);
+    return 0;
+}
+
+// Runs every seed of every parameter set on all cores, streams the runs to
+// a CSV file and prints the distributions
+int runSweepMode(const Options& options) {
+    SweepConfig config;
+    config.scene = sim.scene;
+    for (float speed : options.sweepTruckSpeeds) {
+        for (float timing : options.sweepTimings) {
+            config.parameterSets.push_back(SweepParameters{speed, timing});
+        }
+    }
+    config.runsPerSet = options.sweepRuns;
+    config.firstSeed = options.seed;
+    config.timeStep = options.timeStep;
+    config.maxSeconds = options.sweepLimit;
+    config.threads = options.threads;
+    config.particleCapacity = options.particleCapacity;
+    config.occupants = options.occupants;
+    config.crowdCapacity = options.crowdCapacity;
+    config.fluidResolution = options.fluidResolution;
+    config.kernel = options.particleKernel;
+
+    FILE* runsFile = nullptr;
+    if (options.sweepRunsPath) {
+        runsFile = fopen(options.sweepRunsPath, "w");
+        if (!runsFile) {
+            printf("ERROR: Cannot write '%s'\n", options.sweepRunsPath);
+            return 1;
+        }
+        writeSweepRunHeader(runsFile);
+    }
+
+    SweepSummary summary(config.parameterSets);
+    auto start = std::chrono::steady_clock::now();
+    long long runs = runSweep(config, [&](const SweepRun& run) {
+        summary.add(run);
+        if (runsFile) {
+            writeSweepRun(runsFile, run, config.parameterSets[run.parameterSet]);
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    bool failed = runsFile && fclose(runsFile) != 0;
+
+    int threads = options.threads > 0 ? options.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    printf("Sweep: %lld runs, %d parameter sets x %d seeds from %llu, %d threads\n", runs,
+           (int)config.parameterSets.size(), config.runsPerSet, (unsigned long long)config.firstSeed,
+           (int)std::min<long long>(threads, std::max(1LL, runs)));
+    printf("  Wall time:      %.3fs\n", seconds);
+    printf("  Throughput:     %.1f runs/s\n", seconds > 0.0 ? runs / seconds : 0.0);
+    for (const SweepSummary::SetSummary& set : summary.sets) {
+        double clear[3], parked[3], particles[3];
+        set.allClear.percentiles(clear[0], clear[1], clear[2]);
+        set.trucksParked.percentiles(parked[0], parked[1], parked[2]);
+        set.peakParticles.percentiles(particles[0], particles[1], particles[2]);
+        printf("  Trucks x%g, timings x%g: all clear in %lld of %lld, p50 %.1fs p90 %.1fs p99 %.1fs; "
+               "trucks parked p50 %.1fs; peak particles p50 %.0f p99 %.0f\n", set.parameters.truckSpeed,
+               set.parameters.timingScale, set.allClear.count, set.runs, clear[0], clear[1], clear[2], parked[0],
+               particles[0], particles[2]);
+    }
+
+    if (options.sweepOutPath) {
+        FILE* file = fopen(options.sweepOutPath, "w");
+        if (!file) {
+            printf("ERROR: Cannot write '%s'\n", options.sweepOutPath);
+            return 1;
+        }
+        const char* dot = strrchr(options.sweepOutPath, '.');
+        if (dot && strcmp(dot, ".json") == 0) {
+            summary.writeJson(file, runs, seconds);
+        } else {
+            summary.writeCsv(file);
+        }
+        failed = fclose(file) != 0 || failed;
+    }
+    return failed ? 1 : 0;
+}
+
+// Steps the simulation with a fixed time step without creating a window
+int runHeadless(const Options& options) {
+    long long steps = (long long)ceil(options.seconds / options.timeStep);
+    int peakParticles = 0;
+    int peakWater = 0;
+    float evacuatedAt = -1.0f; // Everyone who left is safe
+    long long steadyAllocations = 0;
+    FluidTimings fluidTotal = {0.0, 0.0, 0.0, 0.0};
+    long long fluidSteps = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < steps; i++) {
+        // Steps that change state may log events; all others must not allocate
+        SimState previousState = sim.currentState;
+        long long allocationsBefore = heapAllocationCount();
+        sim.step(options.timeStep);
+        recordSoundtrack(options.timeStep);
+        PROFILE_FRAME();
+        if (sim.currentState == previousState) {
+            steadyAllocations += heapAllocationCount() - allocationsBefore;
+        }
+        peakParticles = std::max(peakParticles, sim.fireParticles.count);
+        peakWater = std::max(peakWater, sim.waterParticles.count);
+        if (sim.crowd.count > 0 && sim.agentsWalking == 0 && evacuatedAt < 0.0f) {
+            evacuatedAt = sim.simTime;
+        }
+
+        if (sim.fluid.enabled() && sim.currentState >= FIRE_START && sim.currentState < ALL_CLEAR) {
+            fluidTotal.sources += sim.fluid.timings.sources;
+            fluidTotal.diffuse += sim.fluid.timings.diffuse;
+            fluidTotal.project += sim.fluid.timings.project;
+            fluidTotal.advect += sim.fluid.timings.advect;
+            fluidSteps++;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double wallSeconds = std::chrono::duration<double>(end - start).count();
+    double simSeconds = steps * (double)options.timeStep;
+
+    printf("Headless run: %lld steps of %.4fs, seed %llu\n", steps, options.timeStep,
+           (unsigned long long)options.seed);
+    printf("  Sim time:       %.2fs\n", simSeconds);
+    printf("  Wall time:      %.4fs\n", wallSeconds);
+    printf("  Throughput:     %.1f sim-s/wall-s\n", wallSeconds > 0.0 ? simSeconds / wallSeconds : 0.0);
+    printf("  Final state:    %d\n", (int)sim.currentState);
+    printf("  Kernel:         %s\n", particleKernelName(sim.particleKernel));
+    printf("  Threads:        %d\n", options.threads > 0 ? options.threads
+                                                     : (int)std::max(1u, std::thread::hardware_concurrency()));
+    printf("  Peak particles: %d of %d\n", peakParticles, sim.fireParticles.capacity());
+    printf("  Dropped spawns: %lld\n", sim.fireParticles.droppedSpawns);
+    printf("  Peak water:     %d of %d\n", peakWater, sim.waterParticles.capacity());
+    printf("  Occupants:      %d out, %d still walking, %lld dropped\n", sim.crowd.count, sim.agentsWalking,
+           sim.crowd.droppedSpawns);
+    if (evacuatedAt >= 0.0f) {
+        printf("  Evacuated:      %.2fs\n", evacuatedAt);
+    }
+    printf("  Steady-state heap allocations: %lld\n", steadyAllocations);
+    printf("  Events logged:  %llu\n", (unsigned long long)(sim.events.total() - sim.firstEvent));
+    printf("  State hash:     %016llx\n", (unsigned long long)sim.stateHash());
+    if (fluidSteps > 0) {
+        printf("  Fluid %dx%d, ms/step: sources %.3f  diffuse %.3f  project %.3f  advect %.3f\n",
+               sim.fluid.gridWidth(), sim.fluid.gridHeight(), fluidTotal.sources / fluidSteps,
+               fluidTotal.diffuse / fluidSteps, fluidTotal.project / fluidSteps, fluidTotal.advect / fluidSteps);
+    }
+    saveFinalState(stdout);
+    finishEvents(stdout);
+    finishAudio(stdout);
+    if (options.tracePath) {
+        writeTrace(stdout);
+    }
+    return 0;
+}
+
+// Draws every step into a CPU framebuffer and writes it out. This thread
+// steps the simulation and copies what a frame needs into one of two
+// snapshots; a render thread rasterizes the other into a frame from the
+// encoder's ring, and the encoder's threads compress and write it.
+int runOffscreen(const Options& options) {
+    long long steps = (long long)ceil(options.seconds / options.timeStep);
+    bool toStdout = strcmp(options.offscreenPath, "-") == 0;
+    FILE* report = toStdout ? stderr : stdout; // stdout carries the frames
+#ifdef _WIN32
+    if (toStdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    JobSystem renderJobs(options.renderThreads);
+    SoftwareRenderer softwareRenderer;
+    softwareRenderer.setSize(options.renderWidth, options.renderHeight);
+    softwareRenderer.setScene(sim.scene, sim.layout);
+
+    // Every frame is wanted, so a full ring holds rendering back
+    FrameEncoder encoder;
+    encoder.start(options.offscreenPath, options.renderWidth, options.renderHeight, options.encodeRing,
+                  options.encodeThreads, false);
+
+    FrameSnapshot snapshots[2];
+    bool full[2] = {false, false};
+    bool finished = false;
+    bool failed = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    double renderMs = 0.0, worstRenderMs = 0.0;
+    long long framesRendered = 0;
+
+    std::thread renderThread([&]() {
+        for (long long index = 0;; index++) {
+            int slot = (int)(index % 2);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return full[slot] || finished; });
+                if (!full[slot]) break;
+            }
+
+            Framebuffer* frame = encoder.acquire();
+            bool ok = frame != nullptr;
+            if (ok) {
+                softwareRenderer.render(snapshots[slot], *frame, &renderJobs);
+                encoder.submit(frame, index);
+                renderMs += softwareRenderer.stats.milliseconds;
+                worstRenderMs = std::max(worstRenderMs, softwareRenderer.stats.milliseconds);
+                framesRendered++;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                full[slot] = false;
+                failed = !ok;
+            }
+            changed.notify_all();
+            if (!ok) break;
+        }
+    });
+
+    double stepMs = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < steps; i++) {
+        auto stepStart = std::chrono::steady_clock::now();
+        sim.step(options.timeStep);
+        recordSoundtrack(options.timeStep);
+        PROFILE_FRAME();
+        stepMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+
+        int slot = (int)(i % 2);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return !full[slot] || failed; });
+            if (failed) break;
+        }
+        captureFrame(sim, sim.alarmLightOn(), snapshots[slot]);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            full[slot] = true;
+        }
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    changed.notify_all();
+    renderThread.join();
+    bool written = encoder.finish();
+
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double frames = framesRendered > 0 ? (double)framesRendered : 1.0;
+    fprintf(report, "Offscreen run: %lld frames of %dx%d to %s\n", encoder.stats().written, options.renderWidth,
+            options.renderHeight, toStdout ? "stdout (raw RGB24)" : options.offscreenPath);
+    fprintf(report, "  Wall time:      %.3fs\n", wallSeconds);
+    fprintf(report, "  Frame rate:     %.1f fps\n", wallSeconds > 0.0 ? framesRendered / wallSeconds : 0.0);
+    fprintf(report, "  Threads:        %d render, %d encode\n", renderJobs.threadCount(), options.encodeThreads);
+    fprintf(report, "  Step time:      %.3f ms average\n", stepMs / std::max(1LL, steps));
+    fprintf(report, "  Render time:    %.3f ms average, %.3f ms worst\n", renderMs / frames, worstRenderMs);
+    printEncoderStats(report, encoder);
+    fprintf(report, "  Final state:    %d\n", (int)sim.currentState);
+    saveFinalState(report);
+    finishEvents(report);
+    finishAudio(report);
+    if (options.tracePath) {
+        writeTrace(report);
+    }
+    return failed || !written ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    sim.setParticleCapacity(options.particleCapacity);
+    sim.setCrowdCapacity(options.crowdCapacity);
+    sim.setOccupants(options.occupants);
+    sim.setParticleKernel(options.particleKernel);
+    sim.setFluidResolution(options.fluidResolution);
+    sim.setSeed(options.seed);
+
+    if (options.cityPath) {
+        Scene city = generateCityScene(options.cityBuildings, (unsigned int)options.seed);
+        if (!saveSceneFile(options.cityPath, city)) {
+            return 1;
+        }
+        printf("Wrote %d buildings to %s\n", options.cityBuildings, options.cityPath);
+        return 0;
+    }
+
+    if (options.benchLoadPath) {
+        return runLoadBenchmark(options);
+    }
+
+    if (options.scenePath) {
+        Scene scene = defaultScene();
+        if (!loadSceneFile(options.scenePath, scene)) {
+            return 1;
+        }
+        sim.setScene(scene);
+    }
+
+    if (options.sweepRuns > 0) {
+        return runSweepMode(options);
+    }
+
+    JobSystem jobs(options.threads);
+    sim.setJobSystem(&jobs);
+
+    if (options.benchFireBuildings > 0) {
+        return runFireBenchmark(options, &jobs);
+    }
+
+    if (options.selfCheck) {
+        return runSelfChecks() ? 0 : 1;
+    }
+
+    if (options.benchParticles > 0) {
+        return runThreadBenchmark(options);
+    }
+
+    // Streams this run's events; a reset keeps logging into the same ring
+    if (options.eventsPath && !eventSink.start(options.eventsPath, sim.events, sim.firstEvent)) {
+        return 1;
+    }
+
+    // Start from a saved state and/or later in the run; the window keeps
+    // snapshots from here on so it can seek back
+    bool windowed = !options.offscreenPath && !options.headless;
+    if (windowed) {
+        snapshots.configure(options.snapshotInterval, (size_t)options.snapshotBudgetMb << 20);
+    }
+    if (options.loadStatePath && !readStateFile(options.loadStatePath, sim)) {
+        return 1;
+    }
+    if (options.startAt > sim.simTime) {
+        seekSimulation(sim, windowed ? &snapshots : nullptr, options.startAt, options.timeStep);
+    }
+
+    if ((options.offscreenPath || options.headless) && options.audioOutPath && !startSoundtrack()) {
+        return 1;
+    }
+
+    if (options.offscreenPath) {
+        return runOffscreen(options);
+    }
+
+    if (options.headless) {
+        return runHeadless(options);
+    }
+
+    // Debug: Print working directory
+    char cwd[1024];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        printf("Current directory: %s\n", cwd);
+    }
+
+    loadSounds();
+    if (options.audioOutPath) {
+        audioOutput = new WavFileOutput(options.audioOutPath);
+    } else {
+        audioOutput = options.mute ? new NullAudioOutput() : createDeviceOutput();
+    }
+    if (!audio.start(audioOutput)) {
+        delete audioOutput;
+        audioOutput = new NullAudioOutput();
+        audio.start(audioOutput);
+    }
+
+    camera.setBounds(sceneBounds(sim.scene));
+    camera.reset();
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(800, 500);
+    glutCreateWindow("3D Fire Emergency Simulation");
+
+    init();
+
+    // Drawing gets its own workers: the sim thread is using jobs
+    static JobSystem renderJobs(options.threads);
+    renderer.init(&renderJobs);
+    statusPanel.setup(hud, 10.0f, 10.0f);
+
+    if (options.recordPath) {
+        recorder.start(options.recordPath, 800, 500, options.encodeRing, options.encodeThreads, true);
+    }
+
+    glutDisplayFunc(display);
+    glutReshapeFunc(reshape);
+    glutIdleFunc(idle);
+    glutKeyboardFunc(keyboard);
+    glutSpecialFunc(specialKey);
+    glutMouseFunc(mouse);
+    glutMotionFunc(motion);
+    atexit(cleanup);
+
+    startSimulationThread();
+    glutMainLoop();
+    return 0;
+}
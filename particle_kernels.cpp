@@ -0,0 +1,206 @@
+#include "particle_kernels.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FIRE_X86_SIMD 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FIRE_X86_SIMD 0
+#endif
+
+// Fast sine constants. 2*pi is split so k * TWO_PI_HI stays exact for
+// the angles the wobble produces (k < 2^15).
+static const float INV_TWO_PI = 0.159154943f;
+static const float TWO_PI_HI = 6.28125f;
+static const float TWO_PI_LO = 0.00193530717958647692f;
+static const float SIN_B = 1.27323954f;   // 4/pi
+static const float SIN_C = -0.405284735f; // -4/pi^2
+static const float SIN_P = 0.225f;
+
+float fastSin(float angle) {
+    // Reduce to [-pi, pi]
+    float k = nearbyintf(angle * INV_TWO_PI);
+    float r = angle - k * TWO_PI_HI - k * TWO_PI_LO;
+
+    // Parabola, then one refinement step
+    float y = SIN_B * r + SIN_C * r * fabsf(r);
+    return SIN_P * (y * fabsf(y) - y) + y;
+}
+
+static void integrateScalar(float* x, float* y, const float* velocity, float* life,
+                            int count, float simTime, float deltaTime) {
+    for (int i = 0; i < count; i++) {
+        y[i] += velocity[i] * deltaTime * 50.0f;
+        x[i] += (sin(simTime * 2.0f + x[i]) * 0.5f * deltaTime * 50.0f);
+        life[i] -= 0.5f * deltaTime;
+    }
+}
+
+// Scalar tail of the SIMD kernels, same math as the vector lanes
+static void integrateFastTail(float* x, float* y, const float* velocity, float* life,
+                              int begin, int count, float simTime, float deltaTime) {
+    float wobble = 0.5f * deltaTime * 50.0f;
+    float aging = 0.5f * deltaTime;
+    for (int i = begin; i < count; i++) {
+        y[i] += velocity[i] * deltaTime * 50.0f;
+        x[i] += fastSin(simTime * 2.0f + x[i]) * wobble;
+        life[i] -= aging;
+    }
+}
+
+#if FIRE_X86_SIMD
+
+TARGET_SSE2
+static inline __m128 fastSin4(__m128 angle) {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 k = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(INV_TWO_PI))));
+    __m128 r = _mm_sub_ps(angle, _mm_mul_ps(k, _mm_set1_ps(TWO_PI_HI)));
+    r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(TWO_PI_LO)));
+
+    __m128 absR = _mm_andnot_ps(signMask, r);
+    __m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_B), r),
+                          _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(SIN_C), r), absR));
+    __m128 absY = _mm_andnot_ps(signMask, y);
+    __m128 refine = _mm_sub_ps(_mm_mul_ps(y, absY), y);
+    return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P), refine), y);
+}
+
+TARGET_SSE2
+static void integrateSSE2(float* x, float* y, const float* velocity, float* life,
+                          int count, float simTime, float deltaTime) {
+    const __m128 dt = _mm_set1_ps(deltaTime);
+    const __m128 fifty = _mm_set1_ps(50.0f);
+    const __m128 phase = _mm_set1_ps(simTime * 2.0f);
+    const __m128 wobble = _mm_set1_ps(0.5f * deltaTime * 50.0f);
+    const __m128 aging = _mm_set1_ps(0.5f * deltaTime);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pv = _mm_loadu_ps(velocity + i);
+        __m128 pl = _mm_loadu_ps(life + i);
+
+        py = _mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(pv, dt), fifty));
+        px = _mm_add_ps(px, _mm_mul_ps(fastSin4(_mm_add_ps(phase, px)), wobble));
+        pl = _mm_sub_ps(pl, aging);
+
+        _mm_storeu_ps(x + i, px);
+        _mm_storeu_ps(y + i, py);
+        _mm_storeu_ps(life + i, pl);
+    }
+    integrateFastTail(x, y, velocity, life, i, count, simTime, deltaTime);
+}
+
+TARGET_AVX2
+static inline __m256 fastSin8(__m256 angle) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 k = _mm256_round_ps(_mm256_mul_ps(angle, _mm256_set1_ps(INV_TWO_PI)),
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_sub_ps(angle, _mm256_mul_ps(k, _mm256_set1_ps(TWO_PI_HI)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(TWO_PI_LO)));
+
+    __m256 absR = _mm256_andnot_ps(signMask, r);
+    __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_B), r),
+                             _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_C), r), absR));
+    __m256 absY = _mm256_andnot_ps(signMask, y);
+    __m256 refine = _mm256_sub_ps(_mm256_mul_ps(y, absY), y);
+    return _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P), refine), y);
+}
+
+TARGET_AVX2
+static void integrateAVX2(float* x, float* y, const float* velocity, float* life,
+                          int count, float simTime, float deltaTime) {
+    const __m256 dt = _mm256_set1_ps(deltaTime);
+    const __m256 fifty = _mm256_set1_ps(50.0f);
+    const __m256 phase = _mm256_set1_ps(simTime * 2.0f);
+    const __m256 wobble = _mm256_set1_ps(0.5f * deltaTime * 50.0f);
+    const __m256 aging = _mm256_set1_ps(0.5f * deltaTime);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pv = _mm256_loadu_ps(velocity + i);
+        __m256 pl = _mm256_loadu_ps(life + i);
+
+        py = _mm256_add_ps(py, _mm256_mul_ps(_mm256_mul_ps(pv, dt), fifty));
+        px = _mm256_add_ps(px, _mm256_mul_ps(fastSin8(_mm256_add_ps(phase, px)), wobble));
+        pl = _mm256_sub_ps(pl, aging);
+
+        _mm256_storeu_ps(x + i, px);
+        _mm256_storeu_ps(y + i, py);
+        _mm256_storeu_ps(life + i, pl);
+    }
+    integrateFastTail(x, y, velocity, life, i, count, simTime, deltaTime);
+}
+
+#endif // FIRE_X86_SIMD
+
+bool isParticleKernelSupported(ParticleKernel kernel) {
+    switch (kernel) {
+        case KERNEL_AUTO:
+        case KERNEL_SCALAR:
+            return true;
+#if FIRE_X86_SIMD
+        case KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+ParticleKernel detectParticleKernel() {
+    if (isParticleKernelSupported(KERNEL_AVX2)) return KERNEL_AVX2;
+    if (isParticleKernelSupported(KERNEL_SSE2)) return KERNEL_SSE2;
+    return KERNEL_SCALAR;
+}
+
+const char* particleKernelName(ParticleKernel kernel) {
+    switch (kernel) {
+        case KERNEL_AUTO: return "auto";
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_SSE2: return "sse2";
+        case KERNEL_AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool parseParticleKernel(const char* name, ParticleKernel& kernel) {
+    const ParticleKernel all[] = {KERNEL_AUTO, KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2};
+    for (ParticleKernel candidate : all) {
+        if (strcmp(name, particleKernelName(candidate)) == 0) {
+            kernel = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void integrateParticles(ParticleKernel kernel, float* x, float* y, const float* velocity,
+                        float* life, int count, float simTime, float deltaTime) {
+    if (kernel == KERNEL_AUTO) {
+        kernel = detectParticleKernel();
+    }
+
+    switch (kernel) {
+#if FIRE_X86_SIMD
+        case KERNEL_SSE2:
+            integrateSSE2(x, y, velocity, life, count, simTime, deltaTime);
+            return;
+        case KERNEL_AVX2:
+            integrateAVX2(x, y, velocity, life, count, simTime, deltaTime);
+            return;
+#endif
+        default:
+            integrateScalar(x, y, velocity, life, count, simTime, deltaTime);
+            return;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef PARTICLE_KERNELS_H
+#define PARTICLE_KERNELS_H
+
+// Particle integration kernels. The scalar kernel is the reference (double
+// precision sin, exactly the original update); the SIMD kernels use a fast
+// float sine and process 4 (SSE2) or 8 (AVX2) particles per instruction.
+enum ParticleKernel {
+    KERNEL_AUTO,
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2
+};
+
+// Best kernel the running CPU supports
+ParticleKernel detectParticleKernel();
+bool isParticleKernelSupported(ParticleKernel kernel);
+const char* particleKernelName(ParticleKernel kernel);
+
+// Returns false for an unknown name
+bool parseParticleKernel(const char* name, ParticleKernel& kernel);
+
+// Rises, wobbles and ages count particles starting at the given pointers
+void integrateParticles(ParticleKernel kernel, float* x, float* y, const float* velocity,
+                        float* life, int count, float simTime, float deltaTime);
+
+// Float sine with about 1e-3 absolute error, same math as the SIMD kernels
+float fastSin(float angle);
+
+#endif // PARTICLE_KERNELS_H
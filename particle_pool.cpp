@@ -0,0 +1,98 @@
+#include "particle_pool.h"
+#include "state_io.h"
+
+#include <cstddef>
+
+ParticlePool::ParticlePool()
+    : count(0), droppedSpawns(0),
+      x(nullptr), y(nullptr), velocity(nullptr), velocityX(nullptr), life(nullptr), size(nullptr),
+      previousX(nullptr), previousY(nullptr),
+      maxCount(0) {
+}
+
+void ParticlePool::setCapacity(int newCapacity) {
+    if (newCapacity < 0) newCapacity = 0;
+
+    // One block, eight arrays
+    storage.assign((size_t)newCapacity * 8, 0.0f);
+    float* base = storage.data();
+    x = base;
+    y = base + newCapacity;
+    velocity = base + newCapacity * 2;
+    life = base + newCapacity * 3;
+    size = base + newCapacity * 4;
+    previousX = base + newCapacity * 5;
+    previousY = base + newCapacity * 6;
+    velocityX = base + newCapacity * 7;
+
+    maxCount = newCapacity;
+    clear();
+}
+
+int ParticlePool::spawn() {
+    if (count >= maxCount) {
+        droppedSpawns++;
+        return -1;
+    }
+    return count++;
+}
+
+int ParticlePool::spawnBlock(int requested, int& first) {
+    int granted = requested < maxCount - count ? requested : maxCount - count;
+    if (granted < 0) granted = 0;
+    droppedSpawns += requested - granted;
+    first = count;
+    count += granted;
+    return granted;
+}
+
+void ParticlePool::kill(int index) {
+    int last = --count;
+    if (index != last) {
+        x[index] = x[last];
+        y[index] = y[last];
+        velocity[index] = velocity[last];
+        velocityX[index] = velocityX[last];
+        life[index] = life[last];
+        size[index] = size[last];
+        previousX[index] = previousX[last];
+        previousY[index] = previousY[last];
+    }
+}
+
+void ParticlePool::removeDead() {
+    int i = 0;
+    while (i < count) {
+        if (life[i] <= 0.0f) {
+            kill(i); // Re-check the particle swapped into i
+        } else {
+            i++;
+        }
+    }
+}
+
+void ParticlePool::clear() {
+    count = 0;
+    droppedSpawns = 0;
+}
+
+void ParticlePool::saveState(StateWriter& out) const {
+    out.value(count);
+    out.value(droppedSpawns);
+    const float* arrays[8] = {x, y, velocity, velocityX, life, size, previousX, previousY};
+    for (const float* array : arrays) {
+        out.write(array, (size_t)count * sizeof(float));
+    }
+}
+
+bool ParticlePool::loadState(StateReader& in) {
+    int newCount = 0;
+    if (!in.value(newCount) || newCount < 0 || newCount > maxCount) return false;
+    count = newCount;
+    in.value(droppedSpawns);
+    float* arrays[8] = {x, y, velocity, velocityX, life, size, previousX, previousY};
+    for (float* array : arrays) {
+        in.read(array, (size_t)count * sizeof(float));
+    }
+    return in.ok();
+}
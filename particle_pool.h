@@ -0,0 +1,58 @@
+#ifndef PARTICLE_POOL_H
+#define PARTICLE_POOL_H
+
+#include <vector>
+
+class StateWriter;
+class StateReader;
+
+// Fixed-capacity structure-of-arrays particle storage. Memory is allocated
+// once by setCapacity(); spawn and kill are O(1) and never touch the heap.
+// Live particles are always packed in [0, count).
+class ParticlePool {
+public:
+    ParticlePool();
+
+    // Reallocates all arrays and drops every live particle
+    void setCapacity(int newCapacity);
+    int capacity() const { return maxCount; }
+
+    // Returns the index of the new particle, or -1 if the pool is full
+    int spawn();
+
+    // Reserves up to requested consecutive particles starting at first.
+    // Returns how many were granted; the rest count as dropped.
+    int spawnBlock(int requested, int& first);
+
+    // Swaps the last live particle into index
+    void kill(int index);
+
+    // Kills every particle whose life ran out
+    void removeDead();
+
+    void clear();
+
+    // Live particles only; loading fails if they do not fit
+    void saveState(StateWriter& out) const;
+    bool loadState(StateReader& in);
+
+    int count;
+    long long droppedSpawns;
+
+    float* x;
+    float* y;
+    float* velocity;  // Upward speed
+    float* velocityX; // Sideways speed; fire leaves it at zero and drifts with the smoke
+    float* life;
+    float* size;
+
+    // Position before the last step, for drawing between steps
+    float* previousX;
+    float* previousY;
+
+private:
+    int maxCount;
+    std::vector<float> storage;
+};
+
+#endif // PARTICLE_POOL_H
@@ -0,0 +1,142 @@
+#include "profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+enum ProfileEventKind {
+    PROFILE_EVENT_SCOPE,
+    PROFILE_EVENT_COUNTER
+};
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t start;     // ns
+    uint64_t duration;  // ns, scopes only
+    double value;       // Counters only
+    int thread;
+    int kind;
+};
+
+// Stamped like EventLog's slots: index + 1 once the event is complete,
+// with STAMP_WRITING set while a writer fills it
+struct ProfileSlot {
+    std::atomic<uint64_t> stamp;
+    ProfileEvent event;
+};
+
+static const uint64_t STAMP_WRITING = 1ull << 63;
+
+// Static storage, so recording never allocates
+static ProfileSlot slots[PROFILE_EVENT_CAPACITY];
+static std::atomic<uint64_t> nextEvent(0);
+
+static float frameHistory[PROFILE_FRAME_HISTORY];
+static std::atomic<uint64_t> frameCount(0);
+static uint64_t lastFrameEnd = 0;
+
+static std::atomic<int> threadCount(0);
+
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+uint64_t profileNow() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Small ids in the order threads first record something
+static int profileThread() {
+    static thread_local int id = threadCount.fetch_add(1);
+    return id;
+}
+
+// A writer a whole lap behind, or one finding the slot still being filled,
+// drops its event rather than waiting or writing over another
+static void recordEvent(const ProfileEvent& event) {
+    uint64_t index = nextEvent.fetch_add(1, std::memory_order_relaxed);
+    ProfileSlot& slot = slots[index & (PROFILE_EVENT_CAPACITY - 1)];
+    uint64_t stamp = slot.stamp.load(std::memory_order_relaxed);
+    do {
+        if ((stamp & STAMP_WRITING) || stamp > index) return;
+    } while (!slot.stamp.compare_exchange_weak(stamp, STAMP_WRITING | (index + 1), std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.stamp.store(index + 1, std::memory_order_release);
+}
+
+void profileRecord(const char* name, uint64_t start, uint64_t end) {
+    ProfileEvent event;
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    event.value = 0.0;
+    event.thread = profileThread();
+    event.kind = PROFILE_EVENT_SCOPE;
+    recordEvent(event);
+}
+
+void profileCounter(const char* name, double value) {
+    ProfileEvent event;
+    event.name = name;
+    event.start = profileNow();
+    event.duration = 0;
+    event.value = value;
+    event.thread = profileThread();
+    event.kind = PROFILE_EVENT_COUNTER;
+    recordEvent(event);
+}
+
+// Frames are marked by one thread, the one drawing or stepping
+void profileFrame() {
+    uint64_t now = profileNow();
+    if (lastFrameEnd != 0) {
+        profileRecord("Frame", lastFrameEnd, now);
+        uint64_t frame = frameCount.load(std::memory_order_relaxed);
+        frameHistory[frame % PROFILE_FRAME_HISTORY] = (now - lastFrameEnd) / 1e6f;
+        frameCount.store(frame + 1, std::memory_order_release);
+    }
+    lastFrameEnd = now;
+}
+
+int profileFrameHistory(float* out, int maxCount) {
+    uint64_t frames = frameCount.load(std::memory_order_acquire);
+    int count = (int)std::min<uint64_t>(std::min(frames, (uint64_t)PROFILE_FRAME_HISTORY), (uint64_t)maxCount);
+    for (int i = 0; i < count; i++) {
+        out[i] = frameHistory[(frames - count + i) % PROFILE_FRAME_HISTORY];
+    }
+    return count;
+}
+
+bool writeChromeTrace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "ERROR: Cannot write '%s'\n", path);
+        return false;
+    }
+
+    uint64_t end = nextEvent.load();
+    uint64_t begin = end > (uint64_t)PROFILE_EVENT_CAPACITY ? end - PROFILE_EVENT_CAPACITY : 0;
+
+    // Timestamps are in microseconds. Slots still being written, or written
+    // over while copied, are left out.
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    const char* separator = "";
+    for (uint64_t i = begin; i < end; i++) {
+        const ProfileSlot& slot = slots[i & (PROFILE_EVENT_CAPACITY - 1)];
+        if (slot.stamp.load(std::memory_order_acquire) != i + 1) continue;
+        ProfileEvent event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.stamp.load(std::memory_order_relaxed) != i + 1) continue;
+        if (event.kind == PROFILE_EVENT_COUNTER) {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}\n",
+                    separator, event.name, event.start / 1000.0, event.thread, event.value);
+        } else {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}\n",
+                    separator, event.name, event.start / 1000.0, event.duration / 1000.0, event.thread);
+        }
+        separator = ",";
+    }
+    fprintf(file, "]}\n");
+
+    return fclose(file) == 0;
+}
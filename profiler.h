@@ -0,0 +1,58 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+
+// Build with -DFIRE_PROFILER=0 and every PROFILE_ macro compiles to nothing
+#ifndef FIRE_PROFILER
+#define FIRE_PROFILER 1
+#endif
+
+// Events kept; older ones are overwritten. Must be a power of two.
+const int PROFILE_EVENT_CAPACITY = 1 << 16;
+
+// Frame times kept for the overlay graph
+const int PROFILE_FRAME_HISTORY = 240;
+
+// Nanoseconds since the profiler started
+uint64_t profileNow();
+
+// Scoped timers and counters go into one ring shared by every thread.
+// Names must be string literals: only the pointer is stored.
+void profileRecord(const char* name, uint64_t start, uint64_t end);
+void profileCounter(const char* name, double value);
+
+// Marks the end of a frame: records it as an event and in the history
+void profileFrame();
+
+// Copies up to maxCount frame times in ms, oldest first; returns how many
+int profileFrameHistory(float* out, int maxCount);
+
+// Every event still in the ring, as Chrome trace-event JSON
+// (chrome://tracing, Perfetto). Meant for after the threads recording into
+// it have stopped; events still being written are left out.
+bool writeChromeTrace(const char* path);
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* scopeName) : name(scopeName), start(profileNow()) {}
+    ~ProfileScope() { profileRecord(name, start, profileNow()); }
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#if FIRE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) profileCounter(name, (double)(value))
+#define PROFILE_FRAME() profileFrame()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNTER(name, value)
+#define PROFILE_FRAME()
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,388 @@
+#ifndef _WIN32
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/glut.h>
+#include <GL/glext.h>
+
+#include "renderer.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "simulation.h"
+#include "hud.h"
+#include "scene.h"
+#include "scene_layout.h"
+#include "job_system.h"
+#include "profiler.h"
+
+#ifdef _WIN32
+// Buffer objects are GL 1.5; Windows only exports GL 1.1, so load them
+static PFNGLGENBUFFERSPROC glGenBuffersPtr = nullptr;
+static PFNGLDELETEBUFFERSPROC glDeleteBuffersPtr = nullptr;
+static PFNGLBINDBUFFERPROC glBindBufferPtr = nullptr;
+static PFNGLBUFFERDATAPROC glBufferDataPtr = nullptr;
+static PFNGLMAPBUFFERPROC glMapBufferPtr = nullptr;
+static PFNGLUNMAPBUFFERPROC glUnmapBufferPtr = nullptr;
+#define glGenBuffers glGenBuffersPtr
+#define glDeleteBuffers glDeleteBuffersPtr
+#define glBindBuffer glBindBufferPtr
+#define glBufferData glBufferDataPtr
+#define glMapBuffer glMapBufferPtr
+#define glUnmapBuffer glUnmapBufferPtr
+
+static bool loadBufferFunctions() {
+    glGenBuffersPtr = (PFNGLGENBUFFERSPROC)wglGetProcAddress("glGenBuffers");
+    glDeleteBuffersPtr = (PFNGLDELETEBUFFERSPROC)wglGetProcAddress("glDeleteBuffers");
+    glBindBufferPtr = (PFNGLBINDBUFFERPROC)wglGetProcAddress("glBindBuffer");
+    glBufferDataPtr = (PFNGLBUFFERDATAPROC)wglGetProcAddress("glBufferData");
+    glMapBufferPtr = (PFNGLMAPBUFFERPROC)wglGetProcAddress("glMapBuffer");
+    glUnmapBufferPtr = (PFNGLUNMAPBUFFERPROC)wglGetProcAddress("glUnmapBuffer");
+    return glGenBuffersPtr && glDeleteBuffersPtr && glBindBufferPtr && glBufferDataPtr &&
+           glMapBufferPtr && glUnmapBufferPtr;
+}
+#else
+static bool loadBufferFunctions() {
+    // Buffer objects need GL 1.5
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    return version && sscanf(version, "%d.%d", &major, &minor) == 2 &&
+           (major > 1 || (major == 1 && minor >= 5));
+}
+#endif
+
+// BatchRenderer
+
+BatchRenderer::BatchRenderer()
+    : jobs(nullptr), useBuffers(false), staticDirty(true), staticLayoutVersion(0), glyphTexture(0), hudVersion(0),
+      hudVertices(-1) {
+    memset(&stats, 0, sizeof(stats));
+    detailBuffer = lodBuffer = underlayBuffer = overlayBuffer = particleBuffer = hudBuffer = GpuBuffer{0, 0};
+}
+
+BatchRenderer::~BatchRenderer() {
+    if (useBuffers) {
+        GLuint ids[6] = {detailBuffer.id, lodBuffer.id, underlayBuffer.id, overlayBuffer.id, particleBuffer.id,
+                         hudBuffer.id};
+        glDeleteBuffers(6, ids);
+    }
+    if (glyphTexture) {
+        GLuint texture = glyphTexture;
+        glDeleteTextures(1, &texture);
+    }
+}
+
+void BatchRenderer::init(JobSystem* jobSystem) {
+    jobs = jobSystem;
+    useBuffers = loadBufferFunctions();
+    if (useBuffers) {
+        GLuint ids[6];
+        glGenBuffers(6, ids);
+        detailBuffer.id = ids[0];
+        lodBuffer.id = ids[1];
+        underlayBuffer.id = ids[2];
+        overlayBuffer.id = ids[3];
+        particleBuffer.id = ids[4];
+        hudBuffer.id = ids[5];
+    } else {
+        printf("Renderer: no buffer objects, drawing batches from client memory\n");
+    }
+    staticDirty = true;
+
+    // The glyph atlas is built once; it holds coverage only, the vertex
+    // color tints it
+    std::vector<unsigned char> atlas;
+    buildGlyphAtlas(atlas);
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, HUD_ATLAS_WIDTH, HUD_ATLAS_HEIGHT, 0, GL_ALPHA, GL_UNSIGNED_BYTE,
+                 atlas.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glyphTexture = texture;
+    hudVertices = -1;
+}
+
+void BatchRenderer::invalidateStatic() {
+    staticDirty = true;
+}
+
+void BatchRenderer::buildStatic(const Scene& scene, const SceneLayout& layout) {
+    detailGrid.build(scene, layout, false);
+    lodGrid.build(scene, layout, true);
+    upload(detailBuffer, detailGrid.batch.vertices, false);
+    upload(lodBuffer, lodGrid.batch.vertices, false);
+    staticDirty = false;
+    staticLayoutVersion = layout.version;
+}
+
+void BatchRenderer::upload(GpuBuffer& buffer, const std::vector<Vertex>& vertices, bool dynamic) {
+    if (!useBuffers) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(),
+                 dynamic ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+    buffer.capacity = (int)vertices.size();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+const Vertex* BatchRenderer::bindVertices(GpuBuffer& buffer, const Vertex* cpuVertices) {
+    // With a bound buffer the pointers are offsets into it
+    const Vertex* base = cpuVertices;
+    if (useBuffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+        base = nullptr;
+    }
+    glVertexPointer(2, GL_FLOAT, sizeof(Vertex), (const char*)base + offsetof(Vertex, x));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), (const char*)base + offsetof(Vertex, r));
+    return base;
+}
+
+void BatchRenderer::drawBatch(GpuBuffer& buffer, const VertexBatch& batch) {
+    if (batch.commands.empty()) return;
+
+    bindVertices(buffer, batch.vertices.data());
+    for (const VertexBatch::Command& command : batch.commands) {
+        GLenum mode = GL_TRIANGLES;
+        if (command.mode == BATCH_LINES) {
+            mode = GL_LINES;
+            glLineWidth(command.lineWidth);
+        }
+        glDrawArrays(mode, command.first, command.count);
+        stats.drawCalls++;
+    }
+    glLineWidth(1.0f);
+    stats.vertices += (int)batch.vertices.size();
+}
+
+void BatchRenderer::drawStatic(SceneGrid& grid, GpuBuffer& buffer, const ViewRect& view) {
+    PROFILE_SCOPE("drawStatic");
+    grid.cull(view, visibleRanges);
+    stats.cellsDrawn = grid.cellsDrawn;
+    stats.cellsCulled = grid.cellsCulled;
+    if (visibleRanges.empty()) return;
+
+    bindVertices(buffer, grid.batch.vertices.data());
+    for (const VertexBatch::Command& range : visibleRanges) {
+        bool lines = range.mode == BATCH_LINES;
+        if (lines) glLineWidth(range.lineWidth);
+        glDrawArrays(lines ? GL_LINES : GL_TRIANGLES, range.first, range.count);
+        stats.drawCalls++;
+        stats.vertices += range.count;
+    }
+    glLineWidth(1.0f);
+}
+
+Vertex* BatchRenderer::beginStream(int vertexCount) {
+    if (!useBuffers) {
+        if ((int)particleVertices.size() < vertexCount) {
+            particleVertices.resize(vertexCount);
+        }
+        return particleVertices.data();
+    }
+
+    // Orphan last frame's storage, then write straight into the new one
+    glBindBuffer(GL_ARRAY_BUFFER, particleBuffer.id);
+    if (vertexCount > particleBuffer.capacity) {
+        particleBuffer.capacity = vertexCount;
+    }
+    glBufferData(GL_ARRAY_BUFFER, (size_t)particleBuffer.capacity * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+    Vertex* out = (Vertex*)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    if (!out) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    return out;
+}
+
+bool BatchRenderer::endStream() {
+    if (useBuffers && !glUnmapBuffer(GL_ARRAY_BUFFER)) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return false;
+    }
+    return true;
+}
+
+void BatchRenderer::drawParticles(const ParticlePool& pool, ParticleLook look, float alpha, const ViewRect& view,
+                                  bool lod) {
+    PROFILE_SCOPE("drawParticles");
+    stats.particles += pool.count;
+    if (pool.count == 0) return;
+
+    // Zoomed out, the particles in each few pixels become one sprite
+    if (lod) {
+        int binned = 0;
+        int sprites = buildParticleSprites(pool, look, alpha, view, PARTICLE_SPRITE_PIXELS / view.scale, spriteBins,
+                                           particleVertices, binned);
+        stats.particlesDrawn += binned;
+        stats.sprites += sprites;
+        if (sprites == 0) return;
+        upload(particleBuffer, particleVertices, true);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        bindVertices(particleBuffer, particleVertices.data());
+        glDrawArrays(GL_QUADS, 0, sprites * 4);
+        glDisable(GL_BLEND);
+        stats.drawCalls++;
+        stats.vertices += sprites * 4;
+        return;
+    }
+
+    // Count what each chunk has in view, then write it packed at the chunk's offset
+    int chunks = (pool.count + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+    if ((int)chunkOffsets.size() < chunks + 1) {
+        chunkOffsets.resize(chunks + 1);
+    }
+    parallelFor(jobs, pool.count, PARTICLE_CHUNK_SIZE, [&](int begin, int end, int chunk) {
+        chunkOffsets[chunk + 1] = countVisibleParticles(pool, begin, end, alpha, view);
+    });
+    chunkOffsets[0] = 0;
+    for (int i = 0; i < chunks; i++) {
+        chunkOffsets[i + 1] += chunkOffsets[i];
+    }
+    int visible = chunkOffsets[chunks];
+    stats.particlesDrawn += visible;
+    if (visible == 0) return;
+
+    int vertexCount = visible * 4;
+    Vertex* out = beginStream(vertexCount);
+    if (!out) return;
+    parallelFor(jobs, pool.count, PARTICLE_CHUNK_SIZE, [&](int begin, int end, int chunk) {
+        writeVisibleParticleQuads(pool, look, out + (size_t)chunkOffsets[chunk] * 4, begin, end, alpha, view);
+    });
+    if (!endStream()) return; // Skip this frame's particles
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    bindVertices(particleBuffer, particleVertices.data());
+    glDrawArrays(GL_QUADS, 0, vertexCount);
+    glDisable(GL_BLEND);
+
+    stats.drawCalls++;
+    stats.vertices += vertexCount;
+}
+
+void BatchRenderer::drawAgents(const CrowdAgents& crowd, float alpha, const ViewRect& view) {
+    PROFILE_SCOPE("drawAgents");
+    stats.agentsDrawn = 0;
+    if (crowd.count == 0) return;
+
+    // Counted per chunk and packed, like the particles
+    int chunks = (crowd.count + AGENT_CHUNK_SIZE - 1) / AGENT_CHUNK_SIZE;
+    if ((int)chunkOffsets.size() < chunks + 1) {
+        chunkOffsets.resize(chunks + 1);
+    }
+    parallelFor(jobs, crowd.count, AGENT_CHUNK_SIZE, [&](int begin, int end, int chunk) {
+        chunkOffsets[chunk + 1] = countVisibleAgents(crowd, begin, end, alpha, view);
+    });
+    chunkOffsets[0] = 0;
+    for (int i = 0; i < chunks; i++) {
+        chunkOffsets[i + 1] += chunkOffsets[i];
+    }
+    int visible = chunkOffsets[chunks];
+    stats.agentsDrawn = visible;
+    if (visible == 0) return;
+
+    int vertexCount = visible * 4;
+    Vertex* out = beginStream(vertexCount);
+    if (!out) return;
+    parallelFor(jobs, crowd.count, AGENT_CHUNK_SIZE, [&](int begin, int end, int chunk) {
+        writeVisibleAgentQuads(crowd, out + (size_t)chunkOffsets[chunk] * 4, begin, end, alpha, view);
+    });
+    if (!endStream()) return;
+
+    bindVertices(particleBuffer, particleVertices.data());
+    glDrawArrays(GL_QUADS, 0, vertexCount);
+    stats.drawCalls++;
+    stats.vertices += vertexCount;
+}
+
+void BatchRenderer::draw(const Simulation& sim, bool alarmOn, float alpha, const ViewRect& view) {
+    PROFILE_SCOPE("BatchRenderer::draw");
+    stats.drawCalls = 0;
+    stats.vertices = 0;
+    stats.lod = view.scale < LOD_PIXELS_PER_UNIT;
+
+    if (staticDirty || staticLayoutVersion != sim.layout.version) {
+        buildStatic(sim.scene, sim.layout);
+    }
+    buildUnderlayBatch(underlay, sim);
+    buildOverlayBatch(overlay, sim, alarmOn, alpha);
+    upload(underlayBuffer, underlay.vertices, true);
+    upload(overlayBuffer, overlay.vertices, true);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    if (stats.lod) {
+        drawStatic(lodGrid, lodBuffer, view);
+    } else {
+        drawStatic(detailGrid, detailBuffer, view);
+    }
+    drawBatch(underlayBuffer, underlay);
+    stats.particles = 0;
+    stats.particlesDrawn = 0;
+    stats.sprites = 0;
+    if (sim.currentState >= FIRE_START && sim.currentState < ALL_CLEAR) {
+        drawParticles(sim.fireParticles, LOOK_FIRE, alpha, view, stats.lod);
+        drawParticles(sim.waterParticles, LOOK_WATER, alpha, view, stats.lod);
+    }
+    drawAgents(sim.crowd, alpha, view);
+    drawBatch(overlayBuffer, overlay);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    if (useBuffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void BatchRenderer::drawHud(const Hud& hud) {
+    PROFILE_SCOPE("drawHud");
+    int count = (int)hud.vertices.size();
+    if (count == 0 || !glyphTexture) return;
+
+    // Text only changes when a line does, so most frames upload nothing
+    const HudVertex* base = hud.vertices.data();
+    if (useBuffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, hudBuffer.id);
+        if (hud.version != hudVersion || count != hudVertices) {
+            glBufferData(GL_ARRAY_BUFFER, (size_t)count * sizeof(HudVertex), base, GL_DYNAMIC_DRAW);
+            hudBuffer.capacity = count;
+            hudVersion = hud.version;
+            hudVertices = count;
+        }
+        base = nullptr;
+    }
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, glyphTexture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(HudVertex), (const char*)base + offsetof(HudVertex, x));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(HudVertex), (const char*)base + offsetof(HudVertex, u));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(HudVertex), (const char*)base + offsetof(HudVertex, r));
+
+    glDrawArrays(GL_QUADS, 0, count);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisable(GL_BLEND);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    if (useBuffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    stats.drawCalls++;
+    stats.vertices += count;
+}
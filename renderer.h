@@ -0,0 +1,103 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <vector>
+
+#include "scene_batches.h"
+#include "scene_grid.h"
+
+class Simulation;
+class SceneLayout;
+struct Scene;
+class JobSystem;
+class Hud;
+
+struct RenderStats {
+    int drawCalls;
+    int vertices;
+    int particles;        // Live, fire and water
+    int particlesDrawn;   // Quads, or particles folded into sprites
+    int sprites;
+    int agentsDrawn;      // Occupants in view
+    int cellsDrawn;
+    int cellsCulled;
+    bool lod;
+};
+
+// Draws the scene in a handful of draw calls. Static geometry (sky, road,
+// buildings, trees, clouds) lives in a SceneGrid built once per level of
+// detail, and only the cells in view are drawn. Particles in view are
+// streamed into an orphaned buffer every frame as colored, sized quads,
+// one draw call for the fire and one for the water; zoomed out they are
+// summed into sprites. Occupants are streamed the same way, opaque.
+class BatchRenderer {
+public:
+    BatchRenderer();
+    ~BatchRenderer();
+
+    // Needs a current GL context
+    void init(JobSystem* jobSystem);
+
+    // Rebuilds static geometry on the next frame. Also happens on its own
+    // when the simulation's scene layout is rebuilt.
+    void invalidateStatic();
+
+    // Everything but the HUD, as seen through view; alarmOn is the blink
+    // phase of the alarm light, alpha how far to draw moving things from
+    // the previous step to the last
+    void draw(const Simulation& sim, bool alarmOn, float alpha, const ViewRect& view);
+
+    // HUD panels in one draw call with the glyph atlas, in the current
+    // projection; vertices are uploaded again only when they changed
+    void drawHud(const Hud& hud);
+
+    RenderStats stats;
+
+private:
+    struct GpuBuffer {
+        unsigned int id;
+        int capacity; // In vertices
+    };
+
+    void buildStatic(const Scene& scene, const SceneLayout& layout);
+    void drawParticles(const ParticlePool& pool, ParticleLook look, float alpha, const ViewRect& view, bool lod);
+    void drawAgents(const CrowdAgents& crowd, float alpha, const ViewRect& view);
+
+    // Room for vertexCount streamed vertices: last frame's buffer orphaned
+    // and mapped, or particleVertices without buffer objects. nullptr if
+    // mapping failed; endStream() false if the contents were lost.
+    Vertex* beginStream(int vertexCount);
+    bool endStream();
+
+    void drawStatic(SceneGrid& grid, GpuBuffer& buffer, const ViewRect& view);
+
+    void upload(GpuBuffer& buffer, const std::vector<Vertex>& vertices, bool dynamic);
+    void drawBatch(GpuBuffer& buffer, const VertexBatch& batch);
+    const Vertex* bindVertices(GpuBuffer& buffer, const Vertex* cpuVertices);
+
+    JobSystem* jobs;
+    bool useBuffers;
+    bool staticDirty;
+    unsigned int staticLayoutVersion;
+    unsigned int glyphTexture;
+    unsigned int hudVersion;
+    int hudVertices;
+
+    SceneGrid detailGrid;
+    SceneGrid lodGrid;
+    std::vector<VertexBatch::Command> visibleRanges;
+    VertexBatch underlay;
+    VertexBatch overlay;
+    std::vector<Vertex> particleVertices; // Sprites, or quads without buffer objects
+    std::vector<int> chunkOffsets;        // Where each chunk's visible quads start
+    std::vector<float> spriteBins;
+
+    GpuBuffer detailBuffer;
+    GpuBuffer lodBuffer;
+    GpuBuffer underlayBuffer;
+    GpuBuffer overlayBuffer;
+    GpuBuffer particleBuffer;
+    GpuBuffer hudBuffer;
+};
+
+#endif // RENDERER_H
@@ -0,0 +1,61 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// Subsystems draw from disjoint stream ranges, so adding random draws to
+// one never changes the numbers another one sees
+enum RandomSubsystem {
+    RANDOM_FIRE_PLACEMENT = 1,
+    RANDOM_PARTICLE_EMISSION = 2,
+    RANDOM_WATER_EMISSION = 3,
+    RANDOM_CROWD_PLACEMENT = 4
+};
+
+inline uint64_t randomStreamId(RandomSubsystem subsystem, uint64_t index) {
+    return ((uint64_t)subsystem << 56) | index;
+}
+
+// Counter-based random stream (splitmix64). Every (seed, stream) pair gives
+// an independent sequence, so parallel chunks can each own a stream and
+// produce the same numbers no matter which thread runs them.
+struct RandomStream {
+    uint64_t state;
+
+    RandomStream(uint64_t seed, uint64_t stream)
+        : state(seed ^ (stream * 0xD1B54A32D192ED03ull)) {
+        nextU64();
+    }
+
+    uint64_t nextU64() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform integer in [0, n)
+    int nextInt(int n) {
+        return (int)(((nextU64() >> 32) * (uint64_t)n) >> 32);
+    }
+
+    // Uniform float in [0, 1) with 24 bits
+    float nextFloat() {
+        return (nextU64() >> 40) * (1.0f / 16777216.0f);
+    }
+
+    // count uniform floats in [0, 1), two per 64-bit draw
+    void nextFloats(float* out, int count) {
+        int i = 0;
+        for (; i + 2 <= count; i += 2) {
+            uint64_t bits = nextU64();
+            out[i] = (bits >> 40) * (1.0f / 16777216.0f);
+            out[i + 1] = ((bits >> 8) & 0xFFFFFF) * (1.0f / 16777216.0f);
+        }
+        if (i < count) {
+            out[i] = nextFloat();
+        }
+    }
+};
+
+#endif // RNG_H
@@ -0,0 +1,134 @@
+#include "road_network.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+
+RoadNetwork::RoadNetwork() : count(0) {
+}
+
+bool RoadNetwork::build(const std::vector<RoadNodeDesc>& nodes, const std::vector<RoadDesc>& roads) {
+    count = 0;
+    x.clear();
+    y.clear();
+    edges.clear();
+    adjacencyStart.assign(1, 0);
+    adjacency.clear();
+    distances.clear();
+    hops.clear();
+
+    int n = (int)nodes.size();
+    if (n > MAX_ROAD_NODES) return false;
+    for (const RoadDesc& road : roads) {
+        if (road.from < 0 || road.from >= n || road.to < 0 || road.to >= n) return false;
+    }
+
+    count = n;
+    for (const RoadNodeDesc& node : nodes) {
+        x.push_back(node.x);
+        y.push_back(node.y);
+    }
+    edges = roads;
+
+    // Neighbors in road order, both ways
+    adjacencyStart.assign(n + 1, 0);
+    for (const RoadDesc& road : roads) {
+        adjacencyStart[road.from + 1]++;
+        adjacencyStart[road.to + 1]++;
+    }
+    for (int i = 0; i < n; i++) {
+        adjacencyStart[i + 1] += adjacencyStart[i];
+    }
+    adjacency.resize(adjacencyStart[n]);
+    std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (const RoadDesc& road : roads) {
+        adjacency[fill[road.from]++] = road.to;
+        adjacency[fill[road.to]++] = road.from;
+    }
+
+    // Dijkstra from every node. Equal distances are settled by node index
+    // and roads relaxed in order, so the tables only depend on the input.
+    distances.assign((size_t)n * n, ROAD_UNREACHABLE);
+    hops.assign((size_t)n * n, -1);
+    typedef std::pair<float, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    for (int source = 0; source < n; source++) {
+        float* distance = &distances[(size_t)source * n];
+        int* hop = &hops[(size_t)source * n];
+        distance[source] = 0.0f;
+        hop[source] = source;
+        queue.push(Entry(0.0f, source));
+        while (!queue.empty()) {
+            Entry top = queue.top();
+            queue.pop();
+            int node = top.second;
+            if (top.first > distance[node]) continue;
+            for (int k = adjacencyStart[node]; k < adjacencyStart[node + 1]; k++) {
+                int next = adjacency[k];
+                float through = top.first + length(node, next);
+                if (through < distance[next]) {
+                    distance[next] = through;
+                    hop[next] = node == source ? next : hop[node];
+                    queue.push(Entry(through, next));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool RoadNetwork::joined(int a, int b) const {
+    for (int k = adjacencyStart[a]; k < adjacencyStart[a + 1]; k++) {
+        if (adjacency[k] == b) return true;
+    }
+    return false;
+}
+
+float RoadNetwork::length(int from, int to) const {
+    float dx = x[to] - x[from], dy = y[to] - y[from];
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+float RoadNetwork::distanceTo(int from, const RoadPoint& point, RoadPoint& entry) const {
+    float viaFrom = distance(from, point.from) + point.offset;
+    float viaTo = distance(from, point.to) + length(point.from, point.to) - point.offset;
+    if (viaTo < viaFrom) {
+        entry = {point.to, point.from, length(point.from, point.to) - point.offset};
+        return viaTo;
+    }
+    entry = point;
+    return viaFrom;
+}
+
+RoadPoint RoadNetwork::nearestPoint(float px, float py) const {
+    RoadPoint best = {-1, -1, 0.0f};
+    float bestDistance = 0.0f;
+    for (const RoadDesc& road : edges) {
+        float dx = x[road.to] - x[road.from], dy = y[road.to] - y[road.from];
+        float lengthSquared = dx * dx + dy * dy;
+        float t = 0.0f;
+        if (lengthSquared > 0.0f) {
+            t = std::max(0.0f, std::min(1.0f, ((px - x[road.from]) * dx + (py - y[road.from]) * dy) / lengthSquared));
+        }
+        float ex = x[road.from] + dx * t - px, ey = y[road.from] + dy * t - py;
+        float d = ex * ex + ey * ey;
+        if (best.from < 0 || d < bestDistance) {
+            best = {road.from, road.to, t * std::sqrt(lengthSquared)};
+            bestDistance = d;
+        }
+    }
+    return best;
+}
+
+void RoadNetwork::route(int from, int to, std::vector<int>& out) const {
+    out.clear();
+    if (nextHop(from, to) < 0) return;
+    out.push_back(from);
+    while (from != to) {
+        from = nextHop(from, to);
+        out.push_back(from);
+    }
+}
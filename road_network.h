@@ -0,0 +1,75 @@
+#ifndef ROAD_NETWORK_H
+#define ROAD_NETWORK_H
+
+#include <cstddef>
+#include <vector>
+
+struct RoadNodeDesc;
+struct RoadDesc;
+
+// Most nodes a road network may have; the route tables grow with the square
+const int MAX_ROAD_NODES = 1024;
+
+// Distance between nodes with no route between them
+const float ROAD_UNREACHABLE = 1e30f;
+
+// A point offset units along the road from node from to node to. A point
+// on a node has from == to and offset 0.
+struct RoadPoint {
+    int from, to;
+    float offset;
+};
+
+// Road graph with every shortest route worked out when it is built: a
+// table of driving distances between all pairs of nodes and one of the
+// next node to drive to, filled by Dijkstra from every node. Routing a
+// truck is then a table lookup per node it passes, with no search while
+// the simulation runs. Meant for the few hundred nodes of a scene.
+class RoadNetwork {
+public:
+    RoadNetwork();
+
+    // Returns false and leaves the network empty if there are more than
+    // MAX_ROAD_NODES nodes or a road refers to an unknown one
+    bool build(const std::vector<RoadNodeDesc>& nodes, const std::vector<RoadDesc>& roads);
+
+    int nodeCount() const { return count; }
+    float nodeX(int node) const { return x[node]; }
+    float nodeY(int node) const { return y[node]; }
+    bool onStreet(int node) const { return y[node] == 0.0f; }
+
+    // Whether a road joins the two nodes
+    bool joined(int a, int b) const;
+
+    // Straight line between two nodes, the length of a road joining them
+    float length(int from, int to) const;
+
+    // Driving distance, ROAD_UNREACHABLE without a route
+    float distance(int from, int to) const { return distances[(size_t)from * count + to]; }
+
+    // First node after from on a shortest route to to; to itself when
+    // from == to, -1 without a route
+    int nextHop(int from, int to) const { return hops[(size_t)from * count + to]; }
+
+    // Driving distance from a node to a point on a road, entering that
+    // road at whichever end is closer. The entry point, with the offset
+    // measured from it, goes to entry.
+    float distanceTo(int from, const RoadPoint& point, RoadPoint& entry) const;
+
+    // Nearest point on any road to (x, y); from is -1 without roads
+    RoadPoint nearestPoint(float px, float py) const;
+
+    // Nodes of a shortest route, from and to included; empty without one
+    void route(int from, int to, std::vector<int>& out) const;
+
+private:
+    int count;
+    std::vector<float> x, y;
+    std::vector<RoadDesc> edges;
+    std::vector<int> adjacencyStart; // Node n's neighbors are adjacency[start[n], start[n + 1])
+    std::vector<int> adjacency;
+    std::vector<float> distances;    // count * count, row per origin
+    std::vector<int> hops;
+};
+
+#endif // ROAD_NETWORK_H
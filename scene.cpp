@@ -0,0 +1,85 @@
+#include "scene.h"
+
+#include <algorithm>
+
+// Colors
+float buildingColors[3][3] = {
+    {0.7f, 0.7f, 0.7f},  // Main building
+    {0.6f, 0.6f, 0.8f},  // Left building
+    {0.8f, 0.6f, 0.6f}   // Right building
+};
+float windowColor[3] = {0.8f, 0.9f, 1.0f};
+float fireColors[3][3] = {
+    {1.0f, 0.3f, 0.0f},  // Orange
+    {1.0f, 0.6f, 0.0f},  // Yellow-orange
+    {0.3f, 0.3f, 0.3f}   // Gray (smoke)
+};
+float waterColor[3] = {0.2f, 0.5f, 1.0f};
+float roadColor[3] = {0.2f, 0.2f, 0.2f};
+float treeColors[2][3] = {
+    {0.0f, 0.5f, 0.0f},  // Leaves
+    {0.4f, 0.2f, 0.0f}   // Trunk
+};
+
+static BuildingDesc makeBuilding(int colorIndex, float x, float width, float height,
+                                 int floors, int windowsPerFloor) {
+    BuildingDesc b;
+    b.x = x;
+    b.width = width;
+    b.height = height;
+    b.floors = floors;
+    b.windowsPerFloor = windowsPerFloor;
+    for (int i = 0; i < 3; i++) {
+        b.color[i] = buildingColors[colorIndex][i];
+    }
+    b.isMain = colorIndex == 0;
+    return b;
+}
+
+Scene defaultScene() {
+    Scene scene;
+
+    scene.clouds.push_back({100, 80, 30});
+    scene.clouds.push_back({500, 120, 40});
+    scene.clouds.push_back({700, 60, 25});
+
+    // Trees along the road, none behind the main building
+    for (int i = 0; i < 15; i++) {
+        float x = 50 + i * 50;
+        if (x > 250 && x < 550) continue;
+        scene.trees.push_back({x});
+    }
+
+    // Buildings (left, main, right)
+    scene.buildings.push_back(makeBuilding(1, 100, 80, 120, 4, 3));  // Left building
+    scene.buildings.push_back(makeBuilding(0, 300, 100, 150, 5, 5)); // Main building
+    scene.buildings.push_back(makeBuilding(2, 500, 90, 130, 4, 4));  // Right building
+
+    // Two trucks at a station up a side road west of the street
+    scene.trucks.push_back({0, 48.0f, 90.0f, {1.0f, 0.5f, 0.0f}});
+    scene.trucks.push_back({0, 48.0f, 90.0f, {1.0f, 0.5f, 0.0f}});
+    scene.trucksPerFire = 2;
+    buildStreetRoads(scene);
+
+    scene.timings = {3.0f, 6.0f, 9.0f, 12.0f, 15.0f, 25.0f, 28.0f};
+    return scene;
+}
+
+void buildStreetRoads(Scene& scene) {
+    // The street runs 150 units past the buildings on both sides, at least
+    // across the original 800
+    float west = 0.0f, east = 800.0f;
+    for (const BuildingDesc& b : scene.buildings) {
+        west = std::min(west, b.x);
+        east = std::max(east, b.x + b.width);
+    }
+    west -= 150.0f;
+    east += 150.0f;
+
+    scene.roadNodes = {{west, 0.0f}, {east, 0.0f}, {west, 120.0f}};
+    scene.roads = {{0, 1}, {0, 2}};
+    scene.stations = {{2}};
+    for (TruckDesc& truck : scene.trucks) {
+        truck.station = 0;
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+// Scene and scenario description. The built-in scene is the original
+// street; larger ones are loaded from .scene files (see scene_file.h).
+
+struct CloudDesc {
+    float x, y, size;
+};
+
+struct TreeDesc {
+    float x;
+};
+
+// Limits on what a scene file may ask for, so window indices and the
+// layout built from them stay in range
+const int MAX_FLOORS = 1000;
+const int MAX_WINDOWS_PER_FLOOR = 1000;
+const int MAX_SCENE_WINDOWS = 1 << 22;
+
+struct BuildingDesc {
+    float x, width, height;
+    int floors;
+    int windowsPerFloor;
+    float color[3];
+    bool isMain; // The building that catches fire and gets the special roof
+};
+
+// Road map seen from above: x runs along the street as drawn, y is the
+// distance from it. Nodes at y 0 are on the street and trucks between two
+// of them are visible; the rest of the network is off screen.
+struct RoadNodeDesc {
+    float x, y;
+};
+
+// Two-way road between two nodes, as long as the straight line
+struct RoadDesc {
+    int from, to;
+};
+
+struct StationDesc {
+    int node;
+};
+
+// Most trucks a scene may have: the truck index gets TRUCK_INDEX_BITS of
+// each step's water random stream ids
+const int TRUCK_INDEX_BITS = 20;
+const int MAX_TRUCKS = 1 << TRUCK_INDEX_BITS;
+
+struct TruckDesc {
+    int station;        // Where it waits and returns to
+    float arriveSpeed;  // Units per second on the way to a fire
+    float leaveSpeed;   // Units per second on the way back
+    float color[3];
+};
+
+// A window set on fire delay seconds after the fire starts
+struct IgnitionDesc {
+    int building;
+    int window; // floor * windowsPerFloor + column, floors from the ground up
+    float delay;
+};
+
+// Sim time at which each state may be entered. All clear also waits for
+// the hoses to put the fire out.
+struct ScenarioTimings {
+    float fireStart;
+    float alarm;
+    float crewArrive;
+    float firefightersArrive;
+    float extinguishing;
+    float allClear;
+    float trucksLeaving;
+};
+
+struct Scene {
+    std::vector<CloudDesc> clouds;
+    std::vector<TreeDesc> trees;
+    std::vector<BuildingDesc> buildings;
+    std::vector<RoadNodeDesc> roadNodes;
+    std::vector<RoadDesc> roads;
+    std::vector<StationDesc> stations;
+    std::vector<TruckDesc> trucks;
+    int trucksPerFire; // Sent by the dispatcher, nearest station first
+    ScenarioTimings timings;
+    std::vector<IgnitionDesc> ignitions; // Empty: a random low window of the main building
+};
+
+// The original hardcoded street
+Scene defaultScene();
+
+// Replaces the road network with one street past all buildings and a side
+// road off its west end to a single station. Trucks are kept and moved to
+// that station.
+void buildStreetRoads(Scene& scene);
+
+// Colors
+extern float buildingColors[3][3];
+extern float windowColor[3];
+extern float fireColors[3][3];
+extern float waterColor[3];
+extern float roadColor[3];
+extern float treeColors[2][3];
+
+#endif // SCENE_H
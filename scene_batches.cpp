@@ -0,0 +1,479 @@
+#include "scene_batches.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simulation.h"
+#include "scene.h"
+#include "scene_layout.h"
+#include "camera.h"
+#include "crowd.h"
+
+static unsigned char toByte(float value) {
+    if (value <= 0.0f) return 0;
+    if (value >= 1.0f) return 255;
+    return (unsigned char)(value * 255.0f + 0.5f);
+}
+
+void VertexBatch::clear() {
+    vertices.clear();
+    commands.clear();
+}
+
+void VertexBatch::setColor(float r, float g, float b, float a) {
+    color[0] = toByte(r);
+    color[1] = toByte(g);
+    color[2] = toByte(b);
+    color[3] = toByte(a);
+}
+
+void VertexBatch::addVertex(float x, float y) {
+    Vertex v = {x, y, color[0], color[1], color[2], color[3]};
+    vertices.push_back(v);
+}
+
+void VertexBatch::beginPrimitive(unsigned int mode, float lineWidth, int vertexCount) {
+    if (!commands.empty() && commands.back().mode == mode && commands.back().lineWidth == lineWidth) {
+        commands.back().count += vertexCount;
+        return;
+    }
+    Command command = {mode, lineWidth, (int)vertices.size(), vertexCount};
+    commands.push_back(command);
+}
+
+void VertexBatch::addQuad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3) {
+    beginPrimitive(BATCH_TRIANGLES, 0.0f, 6);
+    addVertex(x0, y0);
+    addVertex(x1, y1);
+    addVertex(x2, y2);
+    addVertex(x0, y0);
+    addVertex(x2, y2);
+    addVertex(x3, y3);
+}
+
+void VertexBatch::addRect(float left, float top, float right, float bottom) {
+    addQuad(left, top, right, top, right, bottom, left, bottom);
+}
+
+void VertexBatch::addCircle(float x, float y, float radius, const SceneLayout& layout) {
+    // Triangle fan around the first rim vertex, like GL_POLYGON
+    const float* cx = layout.circleX;
+    const float* cy = layout.circleY;
+    beginPrimitive(BATCH_TRIANGLES, 0.0f, (CIRCLE_SEGMENTS - 2) * 3);
+    for (int i = 1; i < CIRCLE_SEGMENTS - 1; i++) {
+        addVertex(x + radius * cx[0], y + radius * cy[0]);
+        addVertex(x + radius * cx[i], y + radius * cy[i]);
+        addVertex(x + radius * cx[i + 1], y + radius * cy[i + 1]);
+    }
+}
+
+void VertexBatch::addLine(float x0, float y0, float x1, float y1, float lineWidth) {
+    beginPrimitive(BATCH_LINES, lineWidth, 2);
+    addVertex(x0, y0);
+    addVertex(x1, y1);
+}
+
+void VertexBatch::addRectOutline(float left, float top, float right, float bottom) {
+    addLine(left, top, right, top);
+    addLine(right, top, right, bottom);
+    addLine(right, bottom, left, bottom);
+    addLine(left, bottom, left, top);
+}
+
+int staticLayer(StaticKind kind) {
+    switch (kind) {
+        case STATIC_SKY: return LAYER_SKY;
+        case STATIC_CLOUD: return LAYER_CLOUDS;
+        case STATIC_ROAD: return LAYER_ROAD;
+        case STATIC_MARKING: return LAYER_MARKINGS;
+        case STATIC_TREE: return LAYER_TREES;
+        case STATIC_BUILDING: return LAYER_BUILDINGS;
+        default: return LAYER_FRAMES;
+    }
+}
+
+static StaticObject makeObject(StaticKind kind, int index, float left, float top, float right, float bottom) {
+    StaticObject object = {kind, index, left, top, right, bottom};
+    return object;
+}
+
+void listStaticObjects(const Scene& scene, const SceneLayout& layout, std::vector<StaticObject>& objects) {
+    objects.clear();
+    ViewRect bounds = sceneBounds(scene);
+    objects.push_back(makeObject(STATIC_SKY, 0, bounds.left, std::min(bounds.top, 0.0f), bounds.right, 500));
+
+    for (int i = 0; i < (int)scene.clouds.size(); i++) {
+        const CloudDesc& c = scene.clouds[i];
+        objects.push_back(makeObject(STATIC_CLOUD, i, c.x - c.size, c.y - c.size, c.x + c.size, c.y + c.size));
+    }
+
+    // The road and its markings, every 100 units, run the whole width
+    objects.push_back(makeObject(STATIC_ROAD, 0, bounds.left, 400, bounds.right, 450));
+    for (float x = 50 + 100 * std::ceil((bounds.left - 50) / 100); x + 30 <= bounds.right; x += 100) {
+        objects.push_back(makeObject(STATIC_MARKING, 0, x, 425, x + 30, 430));
+    }
+
+    for (int i = 0; i < (int)scene.trees.size(); i++) {
+        float x = scene.trees[i].x;
+        objects.push_back(makeObject(STATIC_TREE, i, x - 15, 355, x + 15, 400));
+    }
+    for (int i = 0; i < (int)scene.buildings.size(); i++) {
+        const BuildingDesc& b = scene.buildings[i];
+        float roof = b.isMain ? 20.0f : 0.0f;
+        float overhang = b.isMain ? 10.0f : 0.0f;
+        objects.push_back(makeObject(STATIC_BUILDING, i, b.x - overhang, 400 - b.height - roof,
+                                     b.x + b.width + overhang, 400));
+    }
+    for (int i = 0; i < (int)scene.buildings.size(); i++) {
+        const BuildingDesc& b = scene.buildings[i];
+        if (layout.buildings[i].windowCount > 0) {
+            objects.push_back(makeObject(STATIC_FRAMES, i, b.x, 400 - b.height, b.x + b.width, 400));
+        }
+    }
+}
+
+void addStaticObject(VertexBatch& batch, const StaticObject& object, const Scene& scene, const SceneLayout& layout,
+                     bool lod) {
+    switch (object.kind) {
+        case STATIC_SKY: {
+            // Gradient towards the horizon
+            batch.setColor(0.53f, 0.81f, 0.98f);
+            batch.addRect(object.left, object.top, object.right, object.bottom);
+            Vertex* sky = &batch.vertices[batch.vertices.size() - 6];
+            const unsigned char bottom[3] = {toByte(0.7f), toByte(0.9f), toByte(1.0f)};
+            for (int i = 0; i < 6; i++) {
+                if (sky[i].y > object.top) {
+                    memcpy(&sky[i].r, bottom, 3);
+                }
+            }
+            break;
+        }
+        case STATIC_CLOUD: {
+            const CloudDesc& cloud = scene.clouds[object.index];
+            batch.setColor(1.0f, 1.0f, 1.0f);
+            if (lod) {
+                float half = cloud.size * 0.8f;
+                batch.addRect(cloud.x - half, cloud.y - half, cloud.x + half, cloud.y + half);
+            } else {
+                batch.addCircle(cloud.x, cloud.y, cloud.size, layout);
+            }
+            break;
+        }
+        case STATIC_ROAD:
+            batch.setColor(roadColor[0], roadColor[1], roadColor[2]);
+            batch.addRect(object.left, object.top, object.right, object.bottom);
+            break;
+        case STATIC_MARKING:
+            if (lod) break; // Under a pixel high
+            batch.setColor(1.0f, 1.0f, 1.0f);
+            batch.addRect(object.left, object.top, object.right, object.bottom);
+            break;
+        case STATIC_TREE: {
+            float x = scene.trees[object.index].x;
+            batch.setColor(treeColors[1][0], treeColors[1][1], treeColors[1][2]);
+            batch.addRect(x - 5, 370, x + 5, 400);
+            batch.setColor(treeColors[0][0], treeColors[0][1], treeColors[0][2]);
+            if (lod) {
+                batch.addRect(x - 12, 358, x + 12, 382);
+            } else {
+                batch.addCircle(x, 370, 15, layout);
+            }
+            break;
+        }
+        case STATIC_BUILDING: {
+            int i = object.index;
+            const BuildingDesc& b = scene.buildings[i];
+            const BuildingLayout& windows = layout.buildings[i];
+            if (lod) {
+                // One quad per facade, colored by how much of it is window
+                float windowArea = 0.0f;
+                for (int w = 0; w < windows.windowCount; w++) {
+                    const WindowRect& rect = layout.window(i, w);
+                    windowArea += (rect.right - rect.left) * (rect.bottom - rect.top);
+                }
+                float f = b.width * b.height > 0.0f ? windowArea / (b.width * b.height) : 0.0f;
+                batch.setColor(b.color[0] + (windowColor[0] - b.color[0]) * f,
+                               b.color[1] + (windowColor[1] - b.color[1]) * f,
+                               b.color[2] + (windowColor[2] - b.color[2]) * f);
+                batch.addRect(b.x, 400 - b.height, b.x + b.width, 400);
+            } else {
+                batch.setColor(b.color[0], b.color[1], b.color[2]);
+                batch.addRect(b.x, 400 - b.height, b.x + b.width, 400);
+                batch.setColor(windowColor[0], windowColor[1], windowColor[2]);
+                for (int w = 0; w < windows.windowCount; w++) {
+                    const WindowRect& rect = layout.window(i, w);
+                    batch.addRect(rect.left, rect.top, rect.right, rect.bottom);
+                }
+            }
+
+            if (b.isMain) { // Only main building has a special roof
+                batch.setColor(0.4f, 0.4f, 0.4f);
+                batch.addQuad(b.x - 10, 400 - b.height, b.x + b.width + 10, 400 - b.height,
+                              b.x + b.width, 400 - b.height - 20, b.x, 400 - b.height - 20);
+            }
+            break;
+        }
+        case STATIC_FRAMES: {
+            if (lod) break;
+            const BuildingLayout& windows = layout.buildings[object.index];
+            batch.setColor(0.3f, 0.3f, 0.3f);
+            for (int w = 0; w < windows.windowCount; w++) {
+                const WindowRect& rect = layout.window(object.index, w);
+                batch.addRectOutline(rect.left, rect.top, rect.right, rect.bottom);
+            }
+            break;
+        }
+    }
+}
+
+void buildStaticBatch(VertexBatch& batch, const Scene& scene, const SceneLayout& layout) {
+    std::vector<StaticObject> objects;
+    batch.clear();
+    listStaticObjects(scene, layout, objects);
+    for (const StaticObject& object : objects) {
+        addStaticObject(batch, object, scene, layout, false);
+    }
+}
+
+void buildUnderlayBatch(VertexBatch& underlay, const Simulation& sim) {
+    underlay.clear();
+    if (sim.currentState < FIRE_START || sim.currentState >= ALL_CLEAR) return;
+
+    // Glow over every burning window, frames redrawn on top
+    const std::vector<int>& burning = sim.fireGrid.burningWindows();
+    underlay.setColor(1.0f, 0.5f, 0.0f);
+    for (int window : burning) {
+        const WindowRect& w = sim.layout.windows[window];
+        underlay.addRect(w.left, w.top, w.right, w.bottom);
+    }
+    underlay.setColor(0.3f, 0.3f, 0.3f);
+    for (int window : burning) {
+        const WindowRect& w = sim.layout.windows[window];
+        underlay.addRectOutline(w.left, w.top, w.right, w.bottom);
+    }
+}
+
+void buildOverlayBatch(VertexBatch& batch, const Simulation& sim, bool alarmOn, float alpha) {
+    batch.clear();
+    float time = sim.interpolatedTime(alpha);
+    float humanPosition = sim.interpolatedHumanPosition(alpha);
+
+    // Humans: heads first, then every limb in one line call
+    if (sim.currentState >= HUMANS_ARRIVE) {
+        batch.setColor(0.0f, 0.0f, 0.0f);
+        for (int i = 0; i < 3; i++) {
+            float x = humanPosition + i * 30;
+            float y = 380 + sin(time * 2.0f + i) * 5.0f;
+            batch.addRect(x - 3, y - 3, x + 3, y + 3);
+        }
+        for (int i = 0; i < 3; i++) {
+            float x = humanPosition + i * 30;
+            float y = 380 + sin(time * 2.0f + i) * 5.0f;
+            batch.addLine(x, y, x, y + 15);
+            batch.addLine(x, y + 15, x - 5, y + 25);
+            batch.addLine(x, y + 15, x + 5, y + 25);
+
+            // Arms rotate around the shoulder
+            float armAngle = sin(time * 5.0f + i) * 30.0f * 3.14159f / 180.0f;
+            float dx = 10.0f * cos(armAngle);
+            float dy = 10.0f * sin(armAngle);
+            batch.addLine(x, y + 10, x - dx, y + 10 - dy);
+            batch.addLine(x, y + 10, x + dx, y + 10 + dy);
+        }
+    }
+
+    // Fire trucks
+    for (int t = 0; t < (int)sim.trucks.size(); t++) {
+        if (!sim.truckOnStreet(t)) continue;
+        float x = sim.interpolatedTruckX(t, alpha);
+        float cabin = sim.trucks[t].facingLeft ? x : x + 40;
+        const float* color = sim.scene.trucks[t].color;
+        batch.setColor(color[0], color[1], color[2]);
+        batch.addRect(x, 370, x + 60, 400);
+        batch.setColor(0.9f, 0.9f, 0.9f);
+        batch.addRect(cabin, 370, cabin + 20, 390);
+        batch.setColor(0.1f, 0.1f, 0.1f);
+        for (int i = 0; i < 2; i++) {
+            batch.addCircle(x + 15 + i * 30, 400, 10, sim.layout);
+        }
+    }
+
+    // Alarm light, on the top left corner of the main building
+    if (alarmOn && sim.currentState >= ALARM && sim.currentState < ALL_CLEAR && sim.layout.mainBuilding >= 0) {
+        const BuildingDesc& main = sim.scene.buildings[sim.layout.mainBuilding];
+        float x = main.x - 20;
+        float y = 400 - main.height;
+        batch.setColor(1.0f, 0.0f, 0.0f);
+        batch.addRect(x, y, x + 10, y + 10);
+    }
+}
+
+// Color and opacity by remaining life
+static inline const float* particleColor(ParticleLook look, float life, float& opacity) {
+    if (look == LOOK_WATER) {
+        opacity = 0.6f;
+        return waterColor;
+    }
+    if (life > 0.7f) {
+        opacity = 0.8f;
+        return fireColors[0];
+    }
+    if (life > 0.3f) {
+        opacity = life;
+        return fireColors[1];
+    }
+    opacity = life * 0.5f;
+    return fireColors[2];
+}
+
+static inline void writeParticleQuad(const ParticlePool& pool, ParticleLook look, int i, float alpha, Vertex* v) {
+    float opacity;
+    const float* color = particleColor(look, pool.life[i], opacity);
+    unsigned char r = toByte(color[0]), g = toByte(color[1]), b = toByte(color[2]);
+    unsigned char a = toByte(opacity);
+    float half = pool.size[i] * 0.5f;
+    float x = pool.previousX[i] + (pool.x[i] - pool.previousX[i]) * alpha;
+    float y = pool.previousY[i] + (pool.y[i] - pool.previousY[i]) * alpha;
+
+    v[0] = Vertex{x - half, y - half, r, g, b, a};
+    v[1] = Vertex{x + half, y - half, r, g, b, a};
+    v[2] = Vertex{x + half, y + half, r, g, b, a};
+    v[3] = Vertex{x - half, y + half, r, g, b, a};
+}
+
+static inline bool particleVisible(const ParticlePool& pool, int i, float alpha, const ViewRect& view) {
+    float half = pool.size[i] * 0.5f;
+    float x = pool.previousX[i] + (pool.x[i] - pool.previousX[i]) * alpha;
+    float y = pool.previousY[i] + (pool.y[i] - pool.previousY[i]) * alpha;
+    return view.overlaps(x - half, y - half, x + half, y + half);
+}
+
+// Writes the four corners of each particle in [begin, end)
+void writeParticleQuads(const ParticlePool& pool, ParticleLook look, Vertex* out, int begin, int end, float alpha) {
+    for (int i = begin; i < end; i++) {
+        writeParticleQuad(pool, look, i, alpha, out + (size_t)i * 4);
+    }
+}
+
+int countVisibleParticles(const ParticlePool& pool, int begin, int end, float alpha, const ViewRect& view) {
+    int count = 0;
+    for (int i = begin; i < end; i++) {
+        count += particleVisible(pool, i, alpha, view) ? 1 : 0;
+    }
+    return count;
+}
+
+int writeVisibleParticleQuads(const ParticlePool& pool, ParticleLook look, Vertex* out, int begin, int end,
+                              float alpha, const ViewRect& view) {
+    int written = 0;
+    for (int i = begin; i < end; i++) {
+        if (particleVisible(pool, i, alpha, view)) {
+            writeParticleQuad(pool, look, i, alpha, out + (size_t)written * 4);
+            written++;
+        }
+    }
+    return written;
+}
+
+int buildParticleSprites(const ParticlePool& pool, ParticleLook look, float alpha, const ViewRect& view,
+                         float binSize, std::vector<float>& bins, std::vector<Vertex>& out, int& binned) {
+    int columns = std::max(1, (int)std::ceil((view.right - view.left) / binSize));
+    int rows = std::max(1, (int)std::ceil((view.bottom - view.top) / binSize));
+    bins.assign((size_t)columns * rows * 3, 0.0f);
+    binned = 0;
+
+    // Light each particle adds under additive blending: color * opacity * area
+    for (int i = 0; i < pool.count; i++) {
+        float x = pool.previousX[i] + (pool.x[i] - pool.previousX[i]) * alpha;
+        float y = pool.previousY[i] + (pool.y[i] - pool.previousY[i]) * alpha;
+        int column = (int)std::floor((x - view.left) / binSize);
+        int row = (int)std::floor((y - view.top) / binSize);
+        if (column < 0 || row < 0 || column >= columns || row >= rows) continue;
+
+        float opacity;
+        const float* color = particleColor(look, pool.life[i], opacity);
+        float weight = opacity * pool.size[i] * pool.size[i];
+        float* bin = &bins[((size_t)row * columns + column) * 3];
+        bin[0] += color[0] * weight;
+        bin[1] += color[1] * weight;
+        bin[2] += color[2] * weight;
+        binned++;
+    }
+
+    // One bin-sized sprite giving off the same light, brightest channel at
+    // full color
+    out.clear();
+    float area = binSize * binSize;
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            const float* bin = &bins[((size_t)row * columns + column) * 3];
+            float peak = std::max(bin[0], std::max(bin[1], bin[2]));
+            if (peak <= 0.0f) continue;
+            unsigned char r = toByte(bin[0] / peak), g = toByte(bin[1] / peak), b = toByte(bin[2] / peak);
+            unsigned char a = toByte(peak / area);
+            float left = view.left + column * binSize, top = view.top + row * binSize;
+            out.push_back(Vertex{left, top, r, g, b, a});
+            out.push_back(Vertex{left + binSize, top, r, g, b, a});
+            out.push_back(Vertex{left + binSize, top + binSize, r, g, b, a});
+            out.push_back(Vertex{left, top + binSize, r, g, b, a});
+        }
+    }
+    return (int)out.size() / 4;
+}
+
+// Inside, on the road, at the assembly point
+static const unsigned char agentColors[4][3] = {
+    {40, 40, 90},
+    {40, 40, 90},
+    {15, 15, 15},
+    {30, 120, 30}
+};
+
+// A person-sized box standing on (x, y)
+const float AGENT_HALF_WIDTH = 1.5f;
+const float AGENT_HEIGHT = 6.0f;
+
+static inline void writeAgentQuad(const CrowdAgents& crowd, int i, float alpha, Vertex* v) {
+    const unsigned char* color = agentColors[crowd.phase[i]];
+    unsigned char r = color[0], g = color[1], b = color[2];
+    float x = crowd.previousX[i] + (crowd.x[i] - crowd.previousX[i]) * alpha;
+    float y = crowd.previousY[i] + (crowd.y[i] - crowd.previousY[i]) * alpha;
+
+    v[0] = Vertex{x - AGENT_HALF_WIDTH, y - AGENT_HEIGHT, r, g, b, 255};
+    v[1] = Vertex{x + AGENT_HALF_WIDTH, y - AGENT_HEIGHT, r, g, b, 255};
+    v[2] = Vertex{x + AGENT_HALF_WIDTH, y, r, g, b, 255};
+    v[3] = Vertex{x - AGENT_HALF_WIDTH, y, r, g, b, 255};
+}
+
+static inline bool agentVisible(const CrowdAgents& crowd, int i, float alpha, const ViewRect& view) {
+    float x = crowd.previousX[i] + (crowd.x[i] - crowd.previousX[i]) * alpha;
+    float y = crowd.previousY[i] + (crowd.y[i] - crowd.previousY[i]) * alpha;
+    return view.overlaps(x - AGENT_HALF_WIDTH, y - AGENT_HEIGHT, x + AGENT_HALF_WIDTH, y);
+}
+
+void writeAgentQuads(const CrowdAgents& crowd, Vertex* out, int begin, int end, float alpha) {
+    for (int i = begin; i < end; i++) {
+        writeAgentQuad(crowd, i, alpha, out + (size_t)i * 4);
+    }
+}
+
+int countVisibleAgents(const CrowdAgents& crowd, int begin, int end, float alpha, const ViewRect& view) {
+    int count = 0;
+    for (int i = begin; i < end; i++) {
+        count += agentVisible(crowd, i, alpha, view) ? 1 : 0;
+    }
+    return count;
+}
+
+int writeVisibleAgentQuads(const CrowdAgents& crowd, Vertex* out, int begin, int end, float alpha,
+                           const ViewRect& view) {
+    int written = 0;
+    for (int i = begin; i < end; i++) {
+        if (agentVisible(crowd, i, alpha, view)) {
+            writeAgentQuad(crowd, i, alpha, out + (size_t)written * 4);
+            written++;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,140 @@
+#ifndef SCENE_BATCHES_H
+#define SCENE_BATCHES_H
+
+#include <vector>
+
+class Simulation;
+class SceneLayout;
+class ParticlePool;
+class CrowdAgents;
+struct Scene;
+struct ViewRect;
+
+// Vertex shared by every batch: position and 8-bit RGBA color
+struct Vertex {
+    float x, y;
+    unsigned char r, g, b, a;
+};
+
+// Primitive kinds in a batch; renderers map them to their own
+enum BatchPrimitive {
+    BATCH_TRIANGLES,
+    BATCH_LINES
+};
+
+// Vertices plus the draw calls that consume them, in painter's order.
+// Consecutive primitives of the same mode and line width share one call.
+class VertexBatch {
+public:
+    struct Command {
+        unsigned int mode; // BatchPrimitive
+        float lineWidth;
+        int first;
+        int count;
+    };
+
+    void clear();
+
+    void setColor(float r, float g, float b, float a = 1.0f);
+    void addQuad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3);
+    void addRect(float left, float top, float right, float bottom);
+    void addCircle(float x, float y, float radius, const SceneLayout& layout);
+    void addLine(float x0, float y0, float x1, float y1, float lineWidth = 1.0f);
+    void addRectOutline(float left, float top, float right, float bottom);
+
+    std::vector<Vertex> vertices;
+    std::vector<Command> commands;
+
+private:
+    void addVertex(float x, float y);
+    void beginPrimitive(unsigned int mode, float lineWidth, int vertexCount);
+
+    unsigned char color[4];
+};
+
+// Scene geometry as batches, shared by the GL and the software renderer.
+// Painter's order is static, underlay, particles, agents, overlay. Moving
+// things are drawn alpha of the way from the previous step to the last one.
+
+// Static geometry is a list of objects in painter's order, each drawn in
+// full or, zoomed out, in a coarser level of detail. Objects of one layer
+// do not cover each other, so a layer can be drawn in any object order.
+enum StaticLayer {
+    LAYER_SKY,
+    LAYER_CLOUDS,
+    LAYER_ROAD,
+    LAYER_MARKINGS,
+    LAYER_TREES,
+    LAYER_BUILDINGS,
+    LAYER_FRAMES, // Window frames, the only lines
+    STATIC_LAYER_COUNT
+};
+
+enum StaticKind {
+    STATIC_SKY,
+    STATIC_CLOUD,
+    STATIC_ROAD,
+    STATIC_MARKING,
+    STATIC_TREE,
+    STATIC_BUILDING,
+    STATIC_FRAMES
+};
+
+struct StaticObject {
+    StaticKind kind;
+    int index; // Cloud, tree or building
+    float left, top, right, bottom;
+};
+
+int staticLayer(StaticKind kind);
+
+// Sky and road span the whole scene (see sceneBounds), at least the
+// original 800 units
+void listStaticObjects(const Scene& scene, const SceneLayout& layout, std::vector<StaticObject>& objects);
+
+// The coarse level of detail draws a facade as one quad, trees and clouds
+// as quads, and leaves out road markings and window frames
+void addStaticObject(VertexBatch& batch, const StaticObject& object, const Scene& scene, const SceneLayout& layout,
+                     bool lod);
+
+// Sky, road, buildings, trees, clouds in full detail; changes only with the layout
+void buildStaticBatch(VertexBatch& batch, const Scene& scene, const SceneLayout& layout);
+
+// Burning windows, drawn under the particles
+void buildUnderlayBatch(VertexBatch& batch, const Simulation& sim);
+
+// Humans, trucks and alarm light; alarmOn is the blink phase
+void buildOverlayBatch(VertexBatch& batch, const Simulation& sim, bool alarmOn, float alpha);
+
+// How a pool's particles are colored: fire by remaining life, water drops
+// all alike
+enum ParticleLook {
+    LOOK_FIRE,
+    LOOK_WATER
+};
+
+// Four corners of each particle in [begin, end), starting at out + begin * 4
+void writeParticleQuads(const ParticlePool& pool, ParticleLook look, Vertex* out, int begin, int end, float alpha);
+
+// The same for only the particles in [begin, end) that overlap view,
+// packed from out; returns how many. Counting first gives each range its
+// place in a shared buffer.
+int countVisibleParticles(const ParticlePool& pool, int begin, int end, float alpha, const ViewRect& view);
+int writeVisibleParticleQuads(const ParticlePool& pool, ParticleLook look, Vertex* out, int begin, int end,
+                              float alpha, const ViewRect& view);
+
+// Zoomed out: particles summed into binSize squares over view, one quad
+// per lit square giving off the same light under additive blending.
+// Returns the number of quads in out and counts the particles in view in
+// binned; bins is scratch.
+int buildParticleSprites(const ParticlePool& pool, ParticleLook look, float alpha, const ViewRect& view,
+                         float binSize, std::vector<float>& bins, std::vector<Vertex>& out, int& binned);
+
+// Occupants as opaque quads, four corners each, colored by how far out
+// they are; the same pattern as the particle quads above
+void writeAgentQuads(const CrowdAgents& crowd, Vertex* out, int begin, int end, float alpha);
+int countVisibleAgents(const CrowdAgents& crowd, int begin, int end, float alpha, const ViewRect& view);
+int writeVisibleAgentQuads(const CrowdAgents& crowd, Vertex* out, int begin, int end, float alpha,
+                           const ViewRect& view);
+
+#endif // SCENE_BATCHES_H
@@ -0,0 +1,434 @@
+#include "scene_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "mapped_file.h"
+#include "rng.h"
+#include "road_network.h"
+
+// Walks the mapped bytes without copying them
+struct SceneCursor {
+    const char* p;
+    const char* end;
+    const char* name;
+    int line;
+};
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skipBlanks(SceneCursor& c) {
+    while (c.p < c.end && isBlank(*c.p)) c.p++;
+}
+
+static bool atLineEnd(SceneCursor& c) {
+    skipBlanks(c);
+    return c.p >= c.end || *c.p == '\n' || *c.p == '#';
+}
+
+static void nextLine(SceneCursor& c) {
+    const char* newline = (const char*)memchr(c.p, '\n', c.end - c.p);
+    c.p = newline ? newline + 1 : c.end;
+    c.line++;
+}
+
+static bool fail(const SceneCursor& c, const char* message) {
+    printf("ERROR: %s:%d: %s\n", c.name, c.line, message);
+    return false;
+}
+
+// Reads a word into [begin, begin + length)
+static bool readWord(SceneCursor& c, const char*& begin, size_t& length) {
+    if (atLineEnd(c)) return false;
+    begin = c.p;
+    while (c.p < c.end && !isBlank(*c.p) && *c.p != '\n' && *c.p != '#') c.p++;
+    length = c.p - begin;
+    return true;
+}
+
+static bool wordIs(const char* begin, size_t length, const char* word) {
+    return strlen(word) == length && memcmp(begin, word, length) == 0;
+}
+
+static bool readFloat(SceneCursor& c, float& value) {
+    if (atLineEnd(c)) return false;
+
+    const char* p = c.p;
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    double result = 0.0;
+    bool digits = false;
+    while (p < c.end && *p >= '0' && *p <= '9') {
+        result = result * 10.0 + (*p++ - '0');
+        digits = true;
+    }
+    if (p < c.end && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < c.end && *p >= '0' && *p <= '9') {
+            result += (*p++ - '0') * scale;
+            scale *= 0.1;
+            digits = true;
+        }
+    }
+    if (digits && p < c.end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < c.end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        // Past 1000 the result is already 0 or inf, so stop counting there
+        int exponent = 0;
+        while (p < c.end && *p >= '0' && *p <= '9') {
+            exponent = std::min(exponent * 10 + (*p++ - '0'), 1000);
+        }
+        double factor = 1.0;
+        while (exponent-- > 0) factor *= 10.0;
+        result = negativeExponent ? result / factor : result * factor;
+    }
+
+    if (!digits || (p < c.end && !isBlank(*p) && *p != '\n' && *p != '#')) return false;
+    float number = (float)(negative ? -result : result);
+    if (!std::isfinite(number)) return false;
+    c.p = p;
+    value = number;
+    return true;
+}
+
+static bool readInt(SceneCursor& c, int& value) {
+    float f;
+    if (!readFloat(c, f) || f < -2147483648.0f || f >= 2147483648.0f || f != std::floor(f)) return false;
+    value = (int)f;
+    return true;
+}
+
+static bool readColor(SceneCursor& c, float color[3]) {
+    return readFloat(c, color[0]) && readFloat(c, color[1]) && readFloat(c, color[2]);
+}
+
+static bool parseBuilding(SceneCursor& c, BuildingDesc& b) {
+    if (!readFloat(c, b.x) || !readFloat(c, b.width) || !readFloat(c, b.height) ||
+        !readInt(c, b.floors) || !readInt(c, b.windowsPerFloor) || !readColor(c, b.color)) {
+        return fail(c, "expected: building <x> <width> <height> <floors> <windowsPerFloor> <r> <g> <b> [main]");
+    }
+    if (b.width <= 0 || b.height <= 0 || b.floors <= 0 || b.windowsPerFloor <= 0) {
+        return fail(c, "building size, floors and windows must be positive");
+    }
+    if (b.floors > MAX_FLOORS || b.windowsPerFloor > MAX_WINDOWS_PER_FLOOR) {
+        return fail(c, "building has too many floors or windows");
+    }
+
+    b.isMain = false;
+    const char* word;
+    size_t length;
+    if (readWord(c, word, length)) {
+        if (!wordIs(word, length, "main")) return fail(c, "unexpected text after building");
+        b.isMain = true;
+    }
+    return true;
+}
+
+static bool parseRoad(SceneCursor& c, Scene& scene, RoadDesc& road) {
+    if (!readInt(c, road.from) || !readInt(c, road.to)) {
+        return fail(c, "expected: road <node> <node>");
+    }
+    int nodes = (int)scene.roadNodes.size();
+    if (road.from < 0 || road.from >= nodes || road.to < 0 || road.to >= nodes) {
+        return fail(c, "road refers to an unknown node");
+    }
+    return true;
+}
+
+static bool parseTruck(SceneCursor& c, const Scene& scene, TruckDesc& t) {
+    if (!readInt(c, t.station) || !readFloat(c, t.arriveSpeed) || !readFloat(c, t.leaveSpeed) ||
+        !readColor(c, t.color)) {
+        return fail(c, "expected: truck <station> <arriveSpeed> <leaveSpeed> <r> <g> <b>");
+    }
+    if (t.station < 0 || t.station >= (int)scene.stations.size()) {
+        return fail(c, "truck refers to an unknown station");
+    }
+    if (t.arriveSpeed <= 0 || t.leaveSpeed <= 0) {
+        return fail(c, "truck speeds must be positive");
+    }
+    return true;
+}
+
+static bool parseTiming(SceneCursor& c, ScenarioTimings& timings) {
+    static const struct {
+        const char* name;
+        float ScenarioTimings::*field;
+    } names[] = {
+        {"fire_start", &ScenarioTimings::fireStart},
+        {"alarm", &ScenarioTimings::alarm},
+        {"crew_arrive", &ScenarioTimings::crewArrive},
+        {"firefighters_arrive", &ScenarioTimings::firefightersArrive},
+        {"extinguishing", &ScenarioTimings::extinguishing},
+        {"all_clear", &ScenarioTimings::allClear},
+        {"trucks_leaving", &ScenarioTimings::trucksLeaving},
+    };
+
+    const char* word;
+    size_t length;
+    if (!readWord(c, word, length)) return fail(c, "expected: timing <name> <seconds>");
+    for (const auto& entry : names) {
+        if (wordIs(word, length, entry.name)) {
+            if (!readFloat(c, timings.*entry.field)) return fail(c, "expected timing seconds");
+            return true;
+        }
+    }
+    return fail(c, "unknown timing name");
+}
+
+static bool parseIgnition(SceneCursor& c, const Scene& scene, IgnitionDesc& ignition) {
+    if (!readInt(c, ignition.building) || !readInt(c, ignition.window)) {
+        return fail(c, "expected: ignite <building> <window> [delay]");
+    }
+    ignition.delay = 0.0f;
+    if (!atLineEnd(c) && !readFloat(c, ignition.delay)) {
+        return fail(c, "expected ignition delay in seconds");
+    }
+
+    if (ignition.building < 0 || ignition.building >= (int)scene.buildings.size()) {
+        return fail(c, "ignite refers to an unknown building");
+    }
+    const BuildingDesc& b = scene.buildings[ignition.building];
+    if (ignition.window < 0 || ignition.window >= b.floors * b.windowsPerFloor) {
+        return fail(c, "ignite refers to an unknown window");
+    }
+    return true;
+}
+
+bool parseScene(const char* data, size_t size, const char* name, Scene& scene) {
+    SceneCursor c = {data, data + size, name, 1};
+    bool haveClouds = false, haveTrees = false, haveBuildings = false, haveIgnitions = false;
+    bool haveNodes = false, haveRoads = false, haveStations = false, haveTrucks = false;
+    size_t windowTotal = 0;
+
+    while (c.p < c.end) {
+        const char* word;
+        size_t length;
+        if (!readWord(c, word, length)) {
+            nextLine(c);
+            continue;
+        }
+
+        bool ok = true;
+        if (wordIs(word, length, "building")) {
+            if (!haveBuildings) scene.buildings.clear();
+            haveBuildings = true;
+            BuildingDesc b;
+            ok = parseBuilding(c, b);
+            windowTotal += ok ? (size_t)b.floors * b.windowsPerFloor : 0;
+            ok = ok && (windowTotal <= (size_t)MAX_SCENE_WINDOWS || fail(c, "too many windows in the scene"));
+            if (ok) scene.buildings.push_back(b);
+        } else if (wordIs(word, length, "cloud")) {
+            if (!haveClouds) scene.clouds.clear();
+            haveClouds = true;
+            CloudDesc cloud;
+            ok = (readFloat(c, cloud.x) && readFloat(c, cloud.y) && readFloat(c, cloud.size)) ||
+                 fail(c, "expected: cloud <x> <y> <size>");
+            if (ok) scene.clouds.push_back(cloud);
+        } else if (wordIs(word, length, "tree")) {
+            if (!haveTrees) scene.trees.clear();
+            haveTrees = true;
+            TreeDesc tree;
+            ok = readFloat(c, tree.x) || fail(c, "expected: tree <x>");
+            if (ok) scene.trees.push_back(tree);
+        } else if (wordIs(word, length, "node")) {
+            if (!haveNodes) scene.roadNodes.clear();
+            haveNodes = true;
+            RoadNodeDesc node;
+            ok = (readFloat(c, node.x) && readFloat(c, node.y)) || fail(c, "expected: node <x> <y>");
+            ok = ok && ((int)scene.roadNodes.size() < MAX_ROAD_NODES || fail(c, "too many road nodes"));
+            if (ok) scene.roadNodes.push_back(node);
+        } else if (wordIs(word, length, "road")) {
+            if (!haveRoads) scene.roads.clear();
+            haveRoads = true;
+            RoadDesc road;
+            ok = parseRoad(c, scene, road);
+            if (ok) scene.roads.push_back(road);
+        } else if (wordIs(word, length, "station")) {
+            if (!haveStations) scene.stations.clear();
+            haveStations = true;
+            StationDesc station;
+            ok = readInt(c, station.node) || fail(c, "expected: station <node>");
+            ok = ok && ((station.node >= 0 && station.node < (int)scene.roadNodes.size()) ||
+                        fail(c, "station refers to an unknown node"));
+            if (ok) scene.stations.push_back(station);
+        } else if (wordIs(word, length, "truck")) {
+            if (!haveTrucks) scene.trucks.clear();
+            haveTrucks = true;
+            TruckDesc truck;
+            ok = parseTruck(c, scene, truck);
+            ok = ok && ((int)scene.trucks.size() < MAX_TRUCKS || fail(c, "too many trucks"));
+            if (ok) scene.trucks.push_back(truck);
+        } else if (wordIs(word, length, "dispatch")) {
+            ok = (readInt(c, scene.trucksPerFire) && scene.trucksPerFire >= 0) ||
+                 fail(c, "expected: dispatch <trucks>");
+        } else if (wordIs(word, length, "timing")) {
+            ok = parseTiming(c, scene.timings);
+        } else if (wordIs(word, length, "ignite")) {
+            if (!haveIgnitions) scene.ignitions.clear();
+            haveIgnitions = true;
+            IgnitionDesc ignition;
+            ok = parseIgnition(c, scene, ignition);
+            if (ok) scene.ignitions.push_back(ignition);
+        } else {
+            ok = fail(c, "unknown record");
+        }
+
+        if (!ok) return false;
+        if (!atLineEnd(c)) return fail(c, "unexpected text at end of line");
+        nextLine(c);
+    }
+
+    // New buildings without a road network of their own get a street
+    // along them; records refer to earlier ones, so the rest is valid
+    if (haveBuildings && !haveNodes && !haveRoads && !haveStations) {
+        buildStreetRoads(scene);
+    }
+    if (!haveNodes && (haveRoads || haveStations)) {
+        return fail(c, "roads and stations need their own nodes");
+    }
+    if (haveNodes && (!haveRoads || !haveStations)) {
+        return fail(c, "nodes need roads and stations");
+    }
+    if (haveStations && !haveTrucks) {
+        return fail(c, "stations need trucks");
+    }
+    return true;
+}
+
+bool loadSceneFile(const char* path, Scene& scene) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    return parseScene(file.data(), file.size(), path, scene);
+}
+
+bool saveSceneFile(const char* path, const Scene& scene) {
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        printf("ERROR: Cannot write '%s'\n", path);
+        return false;
+    }
+
+    for (const CloudDesc& cloud : scene.clouds) {
+        fprintf(out, "cloud %g %g %g\n", cloud.x, cloud.y, cloud.size);
+    }
+    for (const TreeDesc& tree : scene.trees) {
+        fprintf(out, "tree %g\n", tree.x);
+    }
+    for (const BuildingDesc& b : scene.buildings) {
+        fprintf(out, "building %g %g %g %d %d %g %g %g%s\n", b.x, b.width, b.height, b.floors,
+                b.windowsPerFloor, b.color[0], b.color[1], b.color[2], b.isMain ? " main" : "");
+    }
+    for (const RoadNodeDesc& node : scene.roadNodes) {
+        fprintf(out, "node %g %g\n", node.x, node.y);
+    }
+    for (const RoadDesc& road : scene.roads) {
+        fprintf(out, "road %d %d\n", road.from, road.to);
+    }
+    for (const StationDesc& station : scene.stations) {
+        fprintf(out, "station %d\n", station.node);
+    }
+    for (const TruckDesc& t : scene.trucks) {
+        fprintf(out, "truck %d %g %g %g %g %g\n", t.station, t.arriveSpeed, t.leaveSpeed, t.color[0], t.color[1],
+                t.color[2]);
+    }
+    fprintf(out, "dispatch %d\n", scene.trucksPerFire);
+
+    const ScenarioTimings& timings = scene.timings;
+    fprintf(out, "timing fire_start %g\n", timings.fireStart);
+    fprintf(out, "timing alarm %g\n", timings.alarm);
+    fprintf(out, "timing crew_arrive %g\n", timings.crewArrive);
+    fprintf(out, "timing firefighters_arrive %g\n", timings.firefightersArrive);
+    fprintf(out, "timing extinguishing %g\n", timings.extinguishing);
+    fprintf(out, "timing all_clear %g\n", timings.allClear);
+    fprintf(out, "timing trucks_leaving %g\n", timings.trucksLeaving);
+
+    for (const IgnitionDesc& ignition : scene.ignitions) {
+        fprintf(out, "ignite %d %d %g\n", ignition.building, ignition.window, ignition.delay);
+    }
+
+    bool ok = fclose(out) == 0;
+    if (!ok) {
+        printf("ERROR: Failed writing '%s'\n", path);
+    }
+    return ok;
+}
+
+Scene generateCityScene(int buildingCount, unsigned int seed) {
+    Scene scene = defaultScene();
+    scene.clouds.clear();
+    scene.trees.clear();
+    scene.buildings.clear();
+    scene.buildings.reserve(buildingCount);
+
+    RandomStream random(seed, 0);
+    float x = 20.0f;
+    int mainIndex = buildingCount / 2;
+    for (int i = 0; i < buildingCount; i++) {
+        BuildingDesc b;
+        b.floors = 3 + random.nextInt(8);
+        b.windowsPerFloor = 2 + random.nextInt(5);
+        b.x = x;
+        b.width = b.windowsPerFloor * 18.0f + 10.0f;
+        b.height = b.floors * 25.0f;
+        float shade = 0.55f + random.nextInt(30) / 100.0f;
+        b.color[0] = shade;
+        b.color[1] = shade - 0.05f * random.nextInt(3);
+        b.color[2] = shade;
+        b.isMain = i == mainIndex;
+        scene.buildings.push_back(b);
+
+        // Trees and clouds in the gaps
+        float gap = 20.0f + random.nextInt(40);
+        if (gap > 40.0f) {
+            scene.trees.push_back({x + b.width + gap * 0.5f});
+        }
+        if (random.nextInt(4) == 0) {
+            scene.clouds.push_back({x, 50.0f + random.nextInt(80), 20.0f + random.nextInt(25)});
+        }
+        x += b.width + gap;
+    }
+
+    // The street with a parallel road behind it, joined by cross streets
+    // every 400 units, or fewer so the route tables stay small. Every
+    // other junction on the back road has a station with the default
+    // street's trucks.
+    float west = -150.0f, east = x + 150.0f;
+    int junctions = std::max(2, std::min(200, (int)((east - west) / 400.0f) + 1));
+    TruckDesc truck = scene.trucks.empty() ? TruckDesc{0, 48.0f, 90.0f, {1.0f, 0.5f, 0.0f}} : scene.trucks[0];
+    scene.roadNodes.clear();
+    scene.roads.clear();
+    scene.stations.clear();
+    scene.trucks.clear();
+    for (int i = 0; i < junctions; i++) {
+        float junctionX = west + (east - west) * i / (junctions - 1);
+        scene.roadNodes.push_back({junctionX, 0.0f});
+        scene.roadNodes.push_back({junctionX, 200.0f});
+        scene.roads.push_back({2 * i, 2 * i + 1});
+        if (i > 0) {
+            scene.roads.push_back({2 * i - 2, 2 * i});
+            scene.roads.push_back({2 * i - 1, 2 * i + 1});
+        }
+        if (i % 2 == 1) {
+            truck.station = (int)scene.stations.size();
+            scene.stations.push_back({2 * i + 1});
+            scene.trucks.push_back(truck);
+            scene.trucks.push_back(truck);
+        }
+    }
+    return scene;
+}
@@ -0,0 +1,47 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <cstddef>
+
+#include "scene.h"
+
+// Scene and scenario files are plain text, one record per line, '#' starts
+// a comment:
+//
+//   cloud <x> <y> <size>
+//   tree <x>
+//   building <x> <width> <height> <floors> <windowsPerFloor> <r> <g> <b> [main]
+//   node <x> <y>
+//   road <node> <node>
+//   station <node>
+//   truck <station> <arriveSpeed> <leaveSpeed> <r> <g> <b>
+//   dispatch <trucks>
+//   timing <fire_start|alarm|crew_arrive|firefighters_arrive|extinguishing|all_clear|trucks_leaving> <seconds>
+//   ignite <building> <window> [delay]
+//
+// Buildings, nodes, stations and trucks are numbered in file order, and
+// records refer only to earlier ones; windows count floors from the
+// ground up, floor * windowsPerFloor + column. Ignitions happen delay
+// seconds after fire_start. Nodes at y 0 lie on the street as drawn, the
+// rest of the road network is off screen (see RoadNodeDesc). dispatch is
+// how many trucks go to a fire.
+//
+// Anything not given keeps the built-in value. The first record of a kind
+// replaces all built-in ones of that kind, so a file with only timing lines
+// is a valid scenario for the default street. New buildings without nodes
+// get a street along them with the built-in station (buildStreetRoads).
+// Nodes need roads and stations of their own, and stations trucks.
+
+// Memory-maps path and parses it in place
+bool loadSceneFile(const char* path, Scene& scene);
+
+// Parses size bytes of scene text; name is only used in error messages
+bool parseScene(const char* data, size_t size, const char* name, Scene& scene);
+
+// Writes every record of scene; loading the file gives the same scene back
+bool saveSceneFile(const char* path, const Scene& scene);
+
+// A long street of buildingCount buildings, for load and spread tests
+Scene generateCityScene(int buildingCount, unsigned int seed);
+
+#endif // SCENE_FILE_H
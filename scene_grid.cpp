@@ -0,0 +1,100 @@
+#include "scene_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "scene.h"
+#include "scene_layout.h"
+
+SceneGrid::SceneGrid()
+    : cellsDrawn(0), cellsCulled(0), originX(0.0f), originY(0.0f), columns(1), rows(1) {
+}
+
+int SceneGrid::cellOf(const StaticObject& object) const {
+    float x = (object.left + object.right) * 0.5f;
+    float y = (object.top + object.bottom) * 0.5f;
+    int column = std::max(0, std::min(columns - 1, (int)std::floor((x - originX) / SCENE_GRID_CELL)));
+    int row = std::max(0, std::min(rows - 1, (int)std::floor((y - originY) / SCENE_GRID_CELL)));
+    return row * columns + column;
+}
+
+void SceneGrid::build(const Scene& scene, const SceneLayout& layout, bool lod) {
+    std::vector<StaticObject> objects;
+    listStaticObjects(scene, layout, objects);
+
+    ViewRect bounds = sceneBounds(scene);
+    originX = bounds.left;
+    originY = std::min(bounds.top, 0.0f);
+    columns = std::max(1, (int)std::ceil((bounds.right - originX) / SCENE_GRID_CELL));
+    rows = std::max(1, (int)std::ceil((std::max(bounds.bottom, 500.0f) - originY) / SCENE_GRID_CELL));
+    cells.assign((size_t)columns * rows, Cell{0.0f, 0.0f, 0.0f, 0.0f, false});
+    visible.assign(cells.size(), 0);
+
+    // Stable sort keeps painter's order within a layer and cell
+    std::vector<std::pair<int, int>> order; // (layer * cell count + cell, object)
+    order.reserve(objects.size());
+    for (int i = 0; i < (int)objects.size(); i++) {
+        int cell = cellOf(objects[i]);
+        order.push_back({staticLayer(objects[i].kind) * (int)cells.size() + cell, i});
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; });
+
+    batch.clear();
+    for (std::vector<Span>& layerSpans : spans) {
+        layerSpans.clear();
+    }
+    for (const std::pair<int, int>& entry : order) {
+        const StaticObject& object = objects[entry.second];
+        int layer = entry.first / (int)cells.size();
+        int cell = entry.first % (int)cells.size();
+        int first = (int)batch.vertices.size();
+        addStaticObject(batch, object, scene, layout, lod);
+        int count = (int)batch.vertices.size() - first;
+        if (count == 0) continue;
+
+        Cell& c = cells[cell];
+        if (!c.used) {
+            c = Cell{object.left, object.top, object.right, object.bottom, true};
+        } else {
+            c.left = std::min(c.left, object.left);
+            c.top = std::min(c.top, object.top);
+            c.right = std::max(c.right, object.right);
+            c.bottom = std::max(c.bottom, object.bottom);
+        }
+
+        std::vector<Span>& layerSpans = spans[layer];
+        if (!layerSpans.empty() && layerSpans.back().cell == cell) {
+            layerSpans.back().count += count;
+        } else {
+            layerSpans.push_back(Span{cell, first, count});
+        }
+    }
+}
+
+void SceneGrid::cull(const ViewRect& view, std::vector<VertexBatch::Command>& ranges) {
+    ranges.clear();
+    cellsDrawn = 0;
+    cellsCulled = 0;
+    for (size_t i = 0; i < cells.size(); i++) {
+        const Cell& c = cells[i];
+        visible[i] = c.used && view.overlaps(c.left, c.top, c.right, c.bottom);
+        if (c.used) {
+            cellsDrawn += visible[i];
+            cellsCulled += !visible[i];
+        }
+    }
+
+    for (int layer = 0; layer < STATIC_LAYER_COUNT; layer++) {
+        unsigned int mode = layer == LAYER_FRAMES ? BATCH_LINES : BATCH_TRIANGLES;
+        float lineWidth = layer == LAYER_FRAMES ? 1.0f : 0.0f;
+        for (const Span& span : spans[layer]) {
+            if (!visible[span.cell]) continue;
+            if (!ranges.empty() && ranges.back().mode == mode && ranges.back().first + ranges.back().count == span.first) {
+                ranges.back().count += span.count;
+            } else {
+                ranges.push_back(VertexBatch::Command{mode, lineWidth, span.first, span.count});
+            }
+        }
+    }
+}
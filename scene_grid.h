@@ -0,0 +1,60 @@
+#ifndef SCENE_GRID_H
+#define SCENE_GRID_H
+
+#include <vector>
+
+#include "camera.h"
+#include "scene_batches.h"
+
+// Side of a grid cell in scene units
+const float SCENE_GRID_CELL = 200.0f;
+
+// Zoomed out below this many pixels per scene unit, static geometry drops
+// to its coarse level of detail and particles to aggregated sprites
+const float LOD_PIXELS_PER_UNIT = 0.4f;
+
+// Side of an aggregated particle sprite, in pixels
+const float PARTICLE_SPRITE_PIXELS = 4.0f;
+
+// Static geometry binned into a uniform grid, so a frame only draws the
+// cells it can see. Each object goes into the cell holding its center, and
+// a cell's bounds grow to cover its objects. Vertices are stored layer by
+// layer and, within a layer, cell by cell, which keeps painter's order and
+// lets visible cells that are next to each other share a draw call.
+class SceneGrid {
+public:
+    SceneGrid();
+
+    void build(const Scene& scene, const SceneLayout& layout, bool lod);
+
+    // Draw ranges into batch.vertices for the cells overlapping view, in
+    // painter's order. Also counts the cells drawn and culled.
+    void cull(const ViewRect& view, std::vector<VertexBatch::Command>& ranges);
+
+    VertexBatch batch;
+    int cellsDrawn;
+    int cellsCulled;
+
+private:
+    struct Cell {
+        float left, top, right, bottom;
+        bool used;
+    };
+
+    // The vertices one layer has in one cell
+    struct Span {
+        int cell;
+        int first;
+        int count;
+    };
+
+    int cellOf(const StaticObject& object) const;
+
+    float originX, originY;
+    int columns, rows;
+    std::vector<Cell> cells;
+    std::vector<Span> spans[STATIC_LAYER_COUNT];
+    std::vector<unsigned char> visible;
+};
+
+#endif // SCENE_GRID_H
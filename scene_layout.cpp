@@ -0,0 +1,64 @@
+#include "scene_layout.h"
+
+#include <cmath>
+#include <algorithm>
+
+SceneLayout::SceneLayout() : mainBuilding(-1), version(0) {
+    for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+        float angle = 2.0f * 3.14159f * i / CIRCLE_SEGMENTS;
+        circleX[i] = cos(angle);
+        circleY[i] = sin(angle);
+    }
+}
+
+void SceneLayout::build(const Scene& scene) {
+    buildings.clear();
+    windows.clear();
+    mainBuilding = -1;
+
+    int windowTotal = 0;
+    for (const BuildingDesc& b : scene.buildings) {
+        windowTotal += b.floors * b.windowsPerFloor;
+    }
+    buildings.reserve(scene.buildings.size());
+    windows.reserve(windowTotal);
+
+    for (int i = 0; i < (int)scene.buildings.size(); i++) {
+        const BuildingDesc& b = scene.buildings[i];
+        if (b.isMain && mainBuilding < 0) {
+            mainBuilding = i;
+        }
+
+        BuildingLayout layout;
+        layout.firstWindow = (int)windows.size();
+        layout.windowCount = b.floors * b.windowsPerFloor;
+        layout.windowsPerFloor = b.windowsPerFloor;
+        buildings.push_back(layout);
+
+        float windowWidth = b.width / (b.windowsPerFloor + 1);
+        float windowHeight = b.height / (b.floors + 1) * 0.6f;
+        float floorHeight = b.height / b.floors;
+
+        for (int floor = 0; floor < b.floors; floor++) {
+            for (int col = 0; col < b.windowsPerFloor; col++) {
+                WindowRect w;
+                w.x = b.x + (col + 0.5f) * windowWidth;
+                w.y = 400 - (floor + 0.5f) * floorHeight;
+                w.left = w.x - windowWidth * 0.4f;
+                w.right = w.x + windowWidth * 0.4f;
+                w.top = w.y - windowHeight * 0.5f;
+                w.bottom = w.y + windowHeight * 0.5f;
+                windows.push_back(w);
+            }
+        }
+    }
+
+    version++;
+}
+
+int SceneLayout::buildingOf(int window) const {
+    if (window < 0 || window >= (int)windows.size()) return -1;
+    auto after = std::upper_bound(buildings.begin(), buildings.end(), window,
+                                  [](int w, const BuildingLayout& b) { return w < b.firstWindow; });
+    return (int)(after - buildings.begin()) - 1;
+}
@@ -0,0 +1,52 @@
+#ifndef SCENE_LAYOUT_H
+#define SCENE_LAYOUT_H
+
+#include <vector>
+
+#include "scene.h"
+
+// Segments of every circle in the scene (clouds, tree tops, wheels)
+const int CIRCLE_SEGMENTS = 20;
+
+// One window in scene units; (x, y) is its center
+struct WindowRect {
+    float x, y;
+    float left, top, right, bottom;
+};
+
+struct BuildingLayout {
+    int firstWindow; // Index into SceneLayout::windows
+    int windowCount;
+    int windowsPerFloor;
+};
+
+// Geometry derived from the scene config, computed once instead of every
+// frame: a unit circle table and the rectangle of every window. Particle
+// spawning and both renderers look windows up here. Rebuild it when the
+// scene config changes; version tells caches built on top of it (like
+// static vertex buffers) that they are stale.
+class SceneLayout {
+public:
+    SceneLayout();
+
+    void build(const Scene& scene);
+
+    // Window index counts floors from the ground up, floor * windowsPerFloor + col
+    const WindowRect& window(int building, int index) const {
+        return windows[buildings[building].firstWindow + index];
+    }
+
+    // The building a window in windows belongs to, -1 if out of range
+    int buildingOf(int window) const;
+
+    float circleX[CIRCLE_SEGMENTS];
+    float circleY[CIRCLE_SEGMENTS];
+
+    std::vector<BuildingLayout> buildings;
+    std::vector<WindowRect> windows;
+    int mainBuilding; // The building that catches fire, -1 if none
+
+    unsigned int version;
+};
+
+#endif // SCENE_LAYOUT_H
@@ -0,0 +1,978 @@
+#include "self_check.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+#include "particle_pool.h"
+#include "particle_kernels.h"
+#include "simulation.h"
+#include "job_system.h"
+#include "step_clock.h"
+#include "event_log.h"
+#include "event_sink.h"
+#include "snapshot_store.h"
+#include "audio_mixer.h"
+#include "scene_grid.h"
+#include "scene_file.h"
+#include "spatial_hash.h"
+#include "water.h"
+#include "hud.h"
+#include "sweep.h"
+#include "alloc_stats.h"
+#include "road_network.h"
+#include "dispatch.h"
+#include "incident_batch.h"
+
+// Kernel drift limits, in pixels. A single step may differ from the scalar
+// reference by the fast sine error only. Over many steps a particle sitting
+// on the unstable point of the wobble can settle one wobble period (2*pi px)
+// away, so the per-particle bound is one period and the average must stay
+// far below a pixel.
+static const float MAX_STEP_ERROR = 0.001f;
+static const float MAX_MEAN_DRIFT = 0.01f;
+static const float MAX_DRIFT = 6.2832f + 0.05f;
+
+// Emits the same particles into both pools, like Simulation does for one window
+static void emitMatching(ParticlePool& a, ParticlePool& b, unsigned int& seed) {
+    for (int i = 0; i < 5; i++) {
+        int pa = a.spawn();
+        int pb = b.spawn();
+        if (pa < 0 || pb < 0) return;
+
+        float values[5];
+        for (float& v : values) {
+            seed = seed * 1664525u + 1013904223u;
+            v = (seed >> 8) / 16777216.0f;
+        }
+        a.x[pa] = b.x[pb] = 310.0f + values[0] * 5.0f - 2.5f;
+        a.y[pa] = b.y[pb] = 355.0f + values[1] * 5.0f;
+        a.velocity[pa] = b.velocity[pb] = 0.5f + values[2];
+        a.life[pa] = b.life[pb] = 0.5f + values[3] * 0.5f;
+        a.size[pa] = b.size[pb] = 2.0f + values[4] * 2.0f;
+    }
+}
+
+static bool checkKernel(ParticleKernel kernel, int steps) {
+    ParticlePool reference;
+    ParticlePool fast;
+    reference.setCapacity(4096);
+    fast.setCapacity(4096);
+    std::vector<float> stepX(4096), stepY(4096), stepLife(4096);
+
+    const float deltaTime = 1.0f / 60.0f;
+    unsigned int seed = 12345u;
+    float simTime = 0.0f;
+    float maxStepError = 0.0f;
+    float maxDrift = 0.0f;
+    double totalDrift = 0.0;
+    long long samples = 0;
+    bool sameCount = true;
+
+    for (int step = 0; step < steps && sameCount; step++) {
+        simTime += deltaTime;
+        reference.removeDead();
+        fast.removeDead();
+
+        // One step of the fast kernel from the exact reference state
+        int n = reference.count;
+        std::copy(reference.x, reference.x + n, stepX.begin());
+        std::copy(reference.y, reference.y + n, stepY.begin());
+        std::copy(reference.life, reference.life + n, stepLife.begin());
+        integrateParticles(kernel, stepX.data(), stepY.data(), reference.velocity,
+                           stepLife.data(), n, simTime, deltaTime);
+
+        integrateParticles(KERNEL_SCALAR, reference.x, reference.y, reference.velocity,
+                           reference.life, n, simTime, deltaTime);
+        integrateParticles(kernel, fast.x, fast.y, fast.velocity,
+                           fast.life, fast.count, simTime, deltaTime);
+
+        for (int i = 0; i < n; i++) {
+            maxStepError = std::max(maxStepError, fabsf(stepX[i] - reference.x[i]));
+            maxStepError = std::max(maxStepError, fabsf(stepY[i] - reference.y[i]));
+        }
+
+        sameCount = reference.count == fast.count;
+        for (int i = 0; sameCount && i < n; i++) {
+            float drift = std::max(fabsf(reference.x[i] - fast.x[i]),
+                                   fabsf(reference.y[i] - fast.y[i]));
+            maxDrift = std::max(maxDrift, drift);
+            totalDrift += drift;
+            samples++;
+        }
+
+        emitMatching(reference, fast, seed);
+    }
+
+    float meanDrift = samples > 0 ? (float)(totalDrift / samples) : 0.0f;
+    bool passed = sameCount && maxStepError <= MAX_STEP_ERROR &&
+                  meanDrift <= MAX_MEAN_DRIFT && maxDrift <= MAX_DRIFT;
+    printf("%s: %s kernel vs scalar over %d steps: step error %.6f px, mean drift %.6f px, "
+           "max drift %.4f px%s\n",
+           passed ? "PASS" : "FAIL", particleKernelName(kernel), steps, maxStepError,
+           meanDrift, maxDrift, sameCount ? "" : ", particle counts differ");
+    return passed;
+}
+
+bool checkParticleKernels(int steps) {
+    bool passed = true;
+    const ParticleKernel kernels[] = {KERNEL_SSE2, KERNEL_AVX2};
+    for (ParticleKernel kernel : kernels) {
+        if (!isParticleKernelSupported(kernel)) {
+            printf("SKIP: %s kernel not supported by this CPU\n", particleKernelName(kernel));
+            continue;
+        }
+        passed = checkKernel(kernel, steps) && passed;
+    }
+    return passed;
+}
+
+// Final state hash of a default run
+static uint64_t runSeeded(uint64_t seed, JobSystem* jobs, float seconds) {
+    Simulation sim;
+    sim.setJobSystem(jobs);
+    sim.setSeed(seed);
+    int steps = (int)(seconds * 60.0f);
+    for (int i = 0; i < steps; i++) {
+        sim.step(1.0f / 60.0f);
+    }
+    return sim.stateHash();
+}
+
+bool checkDeterminism(float seconds) {
+    const uint64_t seed = 12345;
+    JobSystem single(1);
+    JobSystem several(4);
+
+    uint64_t first = runSeeded(seed, &single, seconds);
+    uint64_t again = runSeeded(seed, &single, seconds);
+    uint64_t threaded = runSeeded(seed, &several, seconds);
+    uint64_t other = runSeeded(seed + 1, &single, seconds);
+
+    bool passed = first == again && first == threaded && first != other;
+    printf("%s: seed %llu over %.0f s: hash %016llx, again %016llx, 4 threads %016llx, "
+           "seed %llu %016llx\n",
+           passed ? "PASS" : "FAIL", (unsigned long long)seed, seconds, (unsigned long long)first,
+           (unsigned long long)again, (unsigned long long)threaded, (unsigned long long)(seed + 1),
+           (unsigned long long)other);
+    return passed;
+}
+
+// Scenario without particles or smoke, stepped at 1 / rate for seconds
+static void runAtRate(Simulation& sim, int rate, float seconds) {
+    sim.setParticleCapacity(0);
+    sim.setFluidResolution(0);
+    sim.setSeed(1);
+    for (int i = 0; i < (int)(seconds * rate); i++) {
+        sim.step(1.0f / rate);
+    }
+}
+
+bool checkFixedStep() {
+    // A 240 Hz display still steps the sim 60 times a second
+    StepClock clock;
+    clock.setStep(1.0 / 60.0, MAX_CATCH_UP_STEPS);
+    int fastSteps = 0;
+    for (int i = 0; i < 240; i++) {
+        fastSteps += clock.advance(1.0 / 240.0);
+    }
+
+    // A one second stall runs the catch-up limit and drops the rest
+    clock.reset();
+    int stallSteps = clock.advance(1.0);
+
+    // Trucks and crew move by time, not by step
+    Simulation slow, fast;
+    runAtRate(slow, 60, 30.0f);
+    runAtRate(fast, 240, 30.0f);
+    float drift = std::fabs(slow.humanPosition - fast.humanPosition);
+    for (size_t i = 0; i < slow.trucks.size(); i++) {
+        drift = std::max(drift, std::fabs(slow.trucks[i].x - fast.trucks[i].x));
+    }
+
+    bool passed = fastSteps >= 59 && fastSteps <= 60 && stallSteps == MAX_CATCH_UP_STEPS &&
+                  clock.droppedSteps == 60 - MAX_CATCH_UP_STEPS && slow.currentState == fast.currentState &&
+                  drift < 2.0f;
+    printf("%s: 1 s of 240 Hz frames ran %d steps at 60 Hz; a 1 s stall ran %d and dropped %lld; "
+           "60 vs 240 Hz after 30 s: states %d/%d, drift %.3f units\n",
+           passed ? "PASS" : "FAIL", fastSteps, stallSteps, clock.droppedSteps, (int)slow.currentState,
+           (int)fast.currentState, drift);
+    return passed;
+}
+
+bool checkEventLog() {
+    // Four producers log at once while a reader follows along
+    const int producers = 4;
+    const int perProducer = 20000;
+    EventLog log;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&log, p]() {
+            for (int i = 0; i < perProducer; i++) {
+                log.log(EVENT_WINDOW_IGNITED, (float)i, 0, p, -1, i);
+            }
+        });
+    }
+    long long seen = 0, torn = 0;
+    for (uint64_t sequence = 0; sequence < (uint64_t)producers * perProducer; sequence++) {
+        SimEvent event;
+        while (log.total() <= sequence) std::this_thread::yield();
+        if (log.read(sequence, event)) {
+            seen++;
+            torn += event.sequence != sequence || event.time != (float)event.window ? 1 : 0;
+        }
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Each producer's events come out in its own order
+    SimEvent latest[EVENT_LOG_CAPACITY];
+    int count = log.latest(latest, EVENT_LOG_CAPACITY);
+    int lastWindow[producers] = {-1, -1, -1, -1};
+    bool ordered = true;
+    for (int i = 0; i < count; i++) {
+        ordered = ordered && latest[i].window > lastWindow[latest[i].incident];
+        lastWindow[latest[i].incident] = latest[i].window;
+    }
+    SimEvent old;
+    bool overwritten = !log.read(0, old);
+
+    // Only events marked skipped may be missing from the latest
+    int missing = 0;
+    for (uint64_t sequence = log.total() - EVENT_LOG_CAPACITY; sequence < log.total(); sequence++) {
+        missing += log.skipped(sequence) ? 1 : 0;
+    }
+    bool complete = count + missing == EVENT_LOG_CAPACITY;
+
+    // A sink drains past a skipped event to the end, counting it as lost
+    EventLog gap;
+    for (int i = 0; i < 10; i++) {
+        gap.log(EVENT_WINDOW_IGNITED, (float)i, 0, 0, -1, i);
+        if (i == 4) gap.markSkipped(gap.next.fetch_add(1));
+    }
+    const char* sinkPath = "self_check_events.tmp";
+    EventSink sink;
+    bool drained = sink.start(sinkPath, gap, 0) && sink.finish() && sink.written() == 10 && sink.lost() == 1;
+    remove(sinkPath);
+
+    bool passed = log.total() == (uint64_t)producers * perProducer && torn == 0 && complete && ordered &&
+                  overwritten && drained;
+    printf("%s: %d threads logged %llu events, %llu skipped; reader copied %lld, %lld torn; latest %d in order: "
+           "%s; sink drained past a skipped event: %s\n",
+           passed ? "PASS" : "FAIL", producers, (unsigned long long)log.total(),
+           (unsigned long long)log.skippedTotal(), seen, torn, count, ordered ? "yes" : "no", drained ? "yes" : "no");
+    return passed;
+}
+
+bool checkSnapshots(float seconds) {
+    const float dt = 1.0f / 60.0f;
+    JobSystem jobs(2);
+
+    // The reference run, snapshotting every second
+    Simulation original;
+    original.setJobSystem(&jobs);
+    original.setSeed(99);
+    SnapshotStore store;
+    store.configure(1.0f, DEFAULT_SNAPSHOT_BUDGET);
+    seekSimulation(original, &store, seconds, dt);
+    uint64_t expected = original.stateHash();
+    int count = store.count();
+    double ratio = store.storedBytes() > 0 ? (double)store.rawBytes() / store.storedBytes() : 0.0;
+
+    // Rewind to the middle, between snapshots and past a keyframe, and run
+    // the same steps again
+    seekSimulation(original, &store, seconds * 0.55f, dt);
+    float rewoundTo = original.simTime;
+    seekSimulation(original, &store, seconds, dt);
+    uint64_t replayed = original.stateHash();
+
+    // A saved state continues the same in a fresh simulation
+    Simulation resumed;
+    resumed.setJobSystem(&jobs);
+    seekSimulation(original, &store, seconds * 0.3f, dt);
+    std::vector<unsigned char> state;
+    original.saveState(state);
+    bool loaded = resumed.loadState(state.data(), state.size());
+    seekSimulation(original, nullptr, seconds, dt);
+    seekSimulation(resumed, nullptr, seconds, dt);
+
+    bool passed = count > 0 && replayed == expected && loaded && resumed.stateHash() == expected &&
+                  original.stateHash() == expected;
+    printf("%s: %d snapshots over %.0f s, %.1fx smaller than raw; rewound to %.2f s and replayed: %016llx, "
+           "loaded state: %016llx, expected %016llx\n",
+           passed ? "PASS" : "FAIL", count, seconds, ratio, rewoundTo, (unsigned long long)replayed,
+           (unsigned long long)resumed.stateHash(), (unsigned long long)expected);
+    return passed;
+}
+
+// A WAV file in memory holding one constant sample value
+static std::vector<unsigned char> makeWav(int bits, int channels, int rate, int frames, int value) {
+    int blockAlign = channels * bits / 8;
+    uint32_t dataBytes = (uint32_t)(frames * blockAlign);
+    uint32_t fields[] = {0, 36 + dataBytes, 0, 0, 16, 1u | ((uint32_t)channels << 16), (uint32_t)rate,
+                         (uint32_t)(rate * blockAlign), (uint32_t)blockAlign | ((uint32_t)bits << 16), 0, dataBytes};
+    std::vector<unsigned char> wav;
+    for (uint32_t field : fields) {
+        for (int b = 0; b < 4; b++) wav.push_back((unsigned char)(field >> (b * 8)));
+    }
+    memcpy(&wav[0], "RIFF", 4);
+    memcpy(&wav[8], "WAVE", 4);
+    memcpy(&wav[12], "fmt ", 4);
+    memcpy(&wav[36], "data", 4);
+    for (int i = 0; i < frames * channels; i++) {
+        for (int b = 0; b < bits / 8; b++) wav.push_back((unsigned char)(value >> (b * 8)));
+    }
+    return wav;
+}
+
+bool checkAudioMixer() {
+    // 8-bit mono at half rate doubles in length and fills both channels
+    SoundClip low, high;
+    const char* error = "";
+    std::vector<unsigned char> lowWav = makeWav(8, 1, AUDIO_SAMPLE_RATE / 2, 1000, 128 + 64);
+    std::vector<unsigned char> highWav = makeWav(16, 2, AUDIO_SAMPLE_RATE, 700, 1000);
+    bool decoded = decodeWav(lowWav.data(), lowWav.size(), low, error) &&
+                   decodeWav(highWav.data(), highWav.size(), high, error);
+    decoded = decoded && low.frames() == 2000 && high.frames() == 700 && low.samples[1] == low.samples[0] &&
+              std::abs(low.samples[0] - 16384) <= 1 && high.samples[5] == 1000;
+
+    // Two looping voices add up; stopping one leaves the other playing
+    AudioMixer mixer;
+    int lowClip = mixer.addClip(std::move(low));
+    int highClip = mixer.addClip(std::move(high));
+    std::vector<int16_t> block(AUDIO_BLOCK_FRAMES * AUDIO_CHANNELS);
+    int lowVoice = mixer.play(lowClip, true);
+    mixer.play(highClip, true, 0.5f);
+    mixer.mix(block.data(), AUDIO_BLOCK_FRAMES);
+    bool mixed = std::abs(block[0] - (16384 + 500)) <= 1 && mixer.activeVoices() == 2;
+    mixer.stop(lowVoice);
+    for (int i = 0; i < 10; i++) mixer.mix(block.data(), AUDIO_BLOCK_FRAMES);
+    bool stoppedOne = mixer.activeVoices() == 1 && block[0] == 500 && block[block.size() - 1] == 500;
+
+    // A full queue drops commands instead of waiting
+    for (int i = 0; i < AUDIO_COMMAND_CAPACITY * 2; i++) mixer.stopAll();
+    bool dropped = mixer.droppedCommands() == AUDIO_COMMAND_CAPACITY;
+    mixer.mix(block.data(), AUDIO_BLOCK_FRAMES);
+    mixer.mix(block.data(), AUDIO_BLOCK_FRAMES);
+    bool silent = mixer.activeVoices() == 0 && block[0] == 0;
+
+    // The thread keeps real time into a null output
+    NullAudioOutput output;
+    mixer.play(highClip, true);
+    long long before = mixer.mixedFrames();
+    mixer.start(&output);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    mixer.finish();
+    long long threaded = mixer.mixedFrames() - before;
+    bool realTime = threaded >= AUDIO_SAMPLE_RATE / 20 && threaded <= AUDIO_SAMPLE_RATE / 5;
+
+    bool passed = decoded && mixed && stoppedOne && dropped && silent && realTime;
+    printf("%s: audio mixer decoded %s, mixed 2 voices %s, stopped 1 %s, full queue %s, %lld frames in 100 ms\n",
+           passed ? "PASS" : "FAIL", decoded ? "ok" : error, mixed ? "ok" : "wrong", stoppedOne ? "ok" : "wrong",
+           dropped ? "ok" : "wrong", threaded);
+    return passed;
+}
+
+bool checkSceneGrid() {
+    // Every vertex of the full-detail batch is drawn when the view holds
+    // the whole scene, and in the same order
+    Simulation street;
+    SceneGrid grid;
+    grid.build(street.scene, street.layout, false);
+    VertexBatch reference;
+    buildStaticBatch(reference, street.scene, street.layout);
+    std::vector<VertexBatch::Command> ranges;
+    grid.cull(sceneBounds(street.scene), ranges);
+    bool same = ranges.size() == reference.commands.size() && grid.batch.vertices.size() == reference.vertices.size();
+    for (size_t i = 0; same && i < ranges.size(); i++) {
+        same = ranges[i].first == reference.commands[i].first && ranges[i].count == reference.commands[i].count;
+    }
+    same = same && memcmp(grid.batch.vertices.data(), reference.vertices.data(),
+                          reference.vertices.size() * sizeof(Vertex)) == 0;
+
+    // A city seen at the original zoom draws only the cells around the view
+    Simulation city;
+    city.setScene(generateCityScene(200, 5));
+    grid.build(city.scene, city.layout, false);
+    Camera camera;
+    camera.setBounds(sceneBounds(city.scene));
+    camera.reset();
+    ViewRect view = camera.view(800);
+    grid.cull(view, ranges);
+    int drawnVertices = 0;
+    for (const VertexBatch::Command& range : ranges) {
+        drawnVertices += range.count;
+    }
+    bool culled = grid.cellsCulled > grid.cellsDrawn * 10 && drawnVertices < (int)grid.batch.vertices.size() / 10;
+
+    // Zoomed out, the coarse grid is much smaller
+    SceneGrid coarse;
+    coarse.build(city.scene, city.layout, true);
+    bool smaller = coarse.batch.vertices.size() * 4 < grid.batch.vertices.size();
+
+    bool passed = same && culled && smaller;
+    printf("%s: scene grid matches the static batch: %s; city street view draws %d of %d cells, %d of %d vertices; "
+           "coarse detail %d vertices\n",
+           passed ? "PASS" : "FAIL", same ? "yes" : "no", grid.cellsDrawn, grid.cellsDrawn + grid.cellsCulled,
+           drawnVertices, (int)grid.batch.vertices.size(), (int)coarse.batch.vertices.size());
+    return passed;
+}
+
+// Neighbors within radius of (x, y) found through hash, and the order it
+// visited them in
+static int countNear(const SpatialHash& hash, const std::vector<float>& x, const std::vector<float>& y, float qx,
+                     float qy, float radius, uint64_t& order) {
+    int near = 0;
+    hash.forEachNear(qx, qy, [&](int i, float px, float py) {
+        float dx = px - qx, dy = py - qy;
+        near += px == x[i] && py == y[i] ? 0 : 1000000; // Positions must be the point's
+        near += dx * dx + dy * dy <= radius * radius ? 1 : 0;
+        order = (order ^ (uint64_t)i) * 0x100000001B3ull;
+    });
+    return near;
+}
+
+struct HoseRun {
+    int burningAtStart;   // Windows burning when the hoses came on
+    float hoseSeconds;    // Until the fire was out, -1 if it never was
+    long long drops;
+    uint64_t hash;
+};
+
+// Default street with the crew already in place, so the trucks arrive
+// while the fire still burns
+static HoseRun runHoses(JobSystem* jobs) {
+    Simulation sim;
+    sim.setJobSystem(jobs);
+    sim.setSeed(7);
+    sim.humanPosition = sim.humanStopX;
+    HoseRun run = {0, -1.0f, 0, 0};
+    float start = -1.0f;
+    while (sim.currentState < ALL_CLEAR && sim.simTime < 60.0f) {
+        sim.step(1.0f / 60.0f);
+        if (sim.currentState == EXTINGUISHING && start < 0.0f) {
+            start = sim.simTime;
+            run.burningAtStart = (int)sim.fireGrid.burningWindows().size();
+        }
+        run.drops += sim.waterParticles.count;
+    }
+    if (sim.currentState >= ALL_CLEAR && start >= 0.0f) {
+        run.hoseSeconds = sim.simTime - start;
+    }
+    run.hash = sim.stateHash();
+    return run;
+}
+
+// Random points over width x height: the hash must find exactly the
+// neighbors a brute force search finds, in the same order on one thread or
+// several
+static bool checkHashQueries(int points, float radius, float width, float height, JobSystem* single,
+                             JobSystem* several, bool& sameOrder) {
+    std::vector<float> x(points), y(points);
+    unsigned int seed = 99;
+    for (int i = 0; i < points; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (seed >> 8) % 10000 * 0.0001f * width;
+        seed = seed * 1103515245u + 12345u;
+        y[i] = (seed >> 8) % 10000 * 0.0001f * height;
+    }
+    SpatialHash serial, threaded;
+    serial.setup(radius, points);
+    threaded.setup(radius, points);
+    serial.build(x.data(), y.data(), points, single);
+    threaded.build(x.data(), y.data(), points, several);
+
+    bool found = true;
+    for (int q = 0; q < 2000; q++) {
+        float qx = x[q * 7 % points] + 1.0f, qy = y[q * 7 % points] - 2.0f;
+        int brute = 0;
+        for (int i = 0; i < points; i++) {
+            float dx = x[i] - qx, dy = y[i] - qy;
+            brute += dx * dx + dy * dy <= radius * radius ? 1 : 0;
+        }
+        uint64_t orderA = 0, orderB = 0;
+        found = found && countNear(serial, x, y, qx, qy, radius, orderA) == brute;
+        found = found && countNear(threaded, x, y, qx, qy, radius, orderB) == brute;
+        sameOrder = sameOrder && orderA == orderB;
+    }
+    return found;
+}
+
+bool checkWater() {
+    // Dense drops, and a small table over many rows so rows share buckets
+    JobSystem single(1);
+    JobSystem several(4);
+    bool sameOrder = true;
+    bool found = checkHashQueries(50000, WATER_QUENCH_RADIUS, 800.0f, 500.0f, &single, &several, sameOrder);
+    found = checkHashQueries(400, 40.0f, 400.0f, 40000.0f, &single, &several, sameOrder) && found;
+
+    // The hoses must put out a fire that is still burning, the same way on
+    // any number of threads
+    HoseRun first = runHoses(&single);
+    HoseRun again = runHoses(&several);
+    bool putOut = first.burningAtStart > 0 && first.drops > 0 && first.hoseSeconds >= 0.0f &&
+                  first.hoseSeconds < 10.0f;
+
+    bool passed = found && sameOrder && putOut && first.hash == again.hash;
+    printf("%s: spatial hash neighbors match brute force: %s, same on 4 threads: %s; hoses put out %d burning "
+           "windows in %.2f s, hash %016llx, 4 threads %016llx\n",
+           passed ? "PASS" : "FAIL", found ? "yes" : "no", sameOrder ? "yes" : "no", first.burningAtStart,
+           first.hoseSeconds, (unsigned long long)first.hash, (unsigned long long)again.hash);
+    return passed;
+}
+
+bool checkHud(int panels, float seconds) {
+    // Every printable glyph has pixels, the space none, the solid cell all
+    std::vector<unsigned char> atlas;
+    buildGlyphAtlas(atlas);
+    bool atlasOk = true;
+    for (int cell = 0; cell <= HUD_SOLID_CELL; cell++) {
+        int lit = 0;
+        for (int row = 0; row < HUD_GLYPH_SIZE; row++) {
+            for (int column = 0; column < HUD_GLYPH_SIZE; column++) {
+                int x = (cell % HUD_ATLAS_COLUMNS) * HUD_GLYPH_SIZE + column;
+                int y = (cell / HUD_ATLAS_COLUMNS) * HUD_GLYPH_SIZE + row;
+                lit += atlas[y * HUD_ATLAS_WIDTH + x] != 0 ? 1 : 0;
+            }
+        }
+        int full = HUD_GLYPH_SIZE * HUD_GLYPH_SIZE;
+        atlasOk = atlasOk && (cell == 0 ? lit == 0 : cell == HUD_SOLID_CELL ? lit == full : lit > 0 && lit < full);
+    }
+
+    // Panels updated every step lay lines out only when they change, and
+    // neither updating nor laying out touches the heap
+    Simulation sim;
+    sim.setSeed(7);
+    Hud hud;
+    std::vector<StatusPanel> status(panels);
+    for (int i = 0; i < panels; i++) {
+        status[i].setup(hud, 10.0f + (i % 4) * 400.0f, 10.0f + (i / 4) * 120.0f);
+    }
+    int steps = (int)(seconds * 60.0f);
+    int unchanged = 0;
+    long long allocations = 0;
+    for (int i = 0; i < steps; i++) {
+        sim.step(1.0f / 60.0f);
+        unsigned int version = hud.version;
+        long long allocationsBefore = heapAllocationCount();
+        for (StatusPanel& panel : status) {
+            panel.update(hud, sim);
+        }
+        allocations += heapAllocationCount() - allocationsBefore;
+        unchanged += hud.version == version ? 1 : 0;
+    }
+
+    // What was laid out bit by bit must match laying out the final state
+    // from scratch
+    Hud fresh;
+    StatusPanel freshPanel;
+    freshPanel.setup(fresh, status[0].left(), status[0].top());
+    freshPanel.update(fresh, sim);
+    bool same = memcmp(fresh.vertices.data(), hud.vertices.data(), fresh.vertices.size() * sizeof(HudVertex)) == 0;
+
+    // About a timer change every sixth step, plus the odd state or event
+    double perPanel = (double)hud.layouts / std::max(1, panels);
+    bool cached = unchanged > steps / 2 && perPanel < steps / 4.0;
+
+    bool passed = atlasOk && same && cached && allocations == 0;
+    printf("%s: glyph atlas %s; %d panels over %d steps laid out %.1f lines each, %d steps changed nothing, "
+           "%lld allocations; matches a fresh layout: %s\n",
+           passed ? "PASS" : "FAIL", atlasOk ? "ok" : "broken", panels, steps, perPanel, unchanged, allocations,
+           same ? "yes" : "no");
+    return passed;
+}
+
+bool checkSweep(int runsPerSet) {
+    // P-squared estimates of uniform and exponential samples against the
+    // exact quantiles
+    const int samples = 100000;
+    const double quantiles[3] = {0.5, 0.9, 0.99};
+    double worstError = 0.0;
+    for (int shape = 0; shape < 2; shape++) {
+        RandomStream random(11, (uint64_t)shape);
+        std::vector<double> values(samples);
+        P2Quantile estimates[3] = {P2Quantile(quantiles[0]), P2Quantile(quantiles[1]), P2Quantile(quantiles[2])};
+        for (double& value : values) {
+            double u = random.nextFloat();
+            value = shape == 0 ? u : -std::log(1.0 - u);
+            for (P2Quantile& estimate : estimates) {
+                estimate.add(value);
+            }
+        }
+        std::sort(values.begin(), values.end());
+        for (int q = 0; q < 3; q++) {
+            double exact = values[(size_t)(quantiles[q] * (samples - 1))];
+            worstError = std::max(worstError, std::fabs(estimates[q].value() - exact) / exact);
+        }
+    }
+
+    // Up to P2_EXACT_SAMPLES values the quantiles are exact nearest ranks,
+    // and reported percentiles never cross
+    bool exactSmall = true, ordered = true;
+    for (int n : {1, 20, P2_EXACT_SAMPLES, 1000}) {
+        RandomStream random(12, (uint64_t)n);
+        MetricSummary summary;
+        std::vector<double> values;
+        for (int i = 0; i < n; i++) {
+            double u = random.nextFloat();
+            values.push_back(u < 0.9 ? u : 1000.0 * u); // A long tail, as peak particles have
+            summary.add(values.back());
+        }
+        std::sort(values.begin(), values.end());
+        if (n <= P2_EXACT_SAMPLES) {
+            const P2Quantile* estimates[3] = {&summary.p50, &summary.p90, &summary.p99};
+            for (int q = 0; q < 3; q++) {
+                int rank = (int)std::floor(quantiles[q] * (n - 1) + 0.5);
+                exactSmall = exactSmall && estimates[q]->value() == values[rank];
+            }
+        }
+        double p50, p90, p99;
+        summary.percentiles(p50, p90, p99);
+        ordered = ordered && summary.min <= p50 && p50 <= p90 && p90 <= p99 && p99 <= summary.max;
+    }
+
+    // A small sweep reports the same runs on one thread and on three, and
+    // its runs match fresh simulations
+    SweepConfig config;
+    config.scene = defaultScene();
+    config.parameterSets = {SweepParameters{1.0f, 1.0f}, SweepParameters{2.0f, 0.8f}};
+    config.runsPerSet = runsPerSet;
+    config.firstSeed = 5;
+    config.timeStep = 1.0f / 60.0f;
+    config.maxSeconds = 120.0f;
+    config.particleCapacity = DEFAULT_PARTICLE_CAPACITY;
+    config.occupants = DEFAULT_OCCUPANTS;
+    config.crowdCapacity = DEFAULT_CROWD_CAPACITY;
+    config.fluidResolution = 0;
+    config.kernel = KERNEL_SCALAR;
+
+    std::vector<SweepRun> runs[2];
+    long long count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        config.threads = pass == 0 ? 1 : 3;
+        count = runSweep(config, [&](const SweepRun& run) { runs[pass].push_back(run); });
+    }
+    bool inOrder = (long long)runs[0].size() == count && runs[1].size() == runs[0].size();
+    bool same = inOrder;
+    for (size_t i = 0; inOrder && i < runs[0].size(); i++) {
+        inOrder = runs[0][i].index == (long long)i && runs[1][i].index == (long long)i;
+        same = same && runs[0][i].hash == runs[1][i].hash && runs[0][i].allClear == runs[1][i].allClear;
+    }
+
+    const SweepRun& last = runs[0].back();
+    Simulation fresh;
+    fresh.setParticleKernel(KERNEL_SCALAR);
+    fresh.setFluidResolution(0);
+    fresh.setScene(sweepScene(config.scene, config.parameterSets[last.parameterSet]));
+    fresh.setSeed(last.seed);
+    SweepRun again;
+    measureRun(fresh, config.timeStep, config.maxSeconds, again);
+    bool matchesFresh = again.hash == last.hash && again.steps == last.steps;
+
+    // Faster trucks park sooner
+    bool faster = runs[0][0].trucksParked > 0.0f && last.trucksParked > 0.0f &&
+                  last.trucksParked < runs[0][0].trucksParked;
+
+    bool passed = worstError < 0.01 && exactSmall && ordered && inOrder && same && matchesFresh && faster;
+    printf("%s: P2 quantiles within %.3f%% of exact, exact for few runs: %s, p50 <= p90 <= p99: %s; "
+           "%lld sweep runs in order: %s, same on 3 threads: %s, match fresh runs: %s; trucks parked at %.1f s, "
+           "%.1f s when twice as fast\n",
+           passed ? "PASS" : "FAIL", worstError * 100.0, exactSmall ? "yes" : "no", ordered ? "yes" : "no", count,
+           inOrder ? "yes" : "no", same ? "yes" : "no", matchesFresh ? "yes" : "no", runs[0][0].trucksParked,
+           last.trucksParked);
+    return passed;
+}
+
+struct CrowdRun {
+    int occupants;
+    int safe;
+    float nearFire;     // Longest any agent stayed close to a burning window
+    float outSeconds;   // From the first evacuation, -1 if someone is still inside
+    uint64_t hash;
+};
+
+static CrowdRun runCrowd(JobSystem* jobs, float seconds) {
+    Simulation sim;
+    sim.setJobSystem(jobs);
+    sim.setFluidResolution(0);
+    sim.setSeed(7);
+    CrowdRun run = {0, 0, 0.0f, -1.0f, 0};
+    float start = -1.0f;
+    const float close = AGENT_FIRE_RANGE * 0.5f;
+    std::vector<int> closeSteps(sim.crowd.capacity(), 0);
+    std::vector<char> closeNow(sim.crowd.capacity(), 0);
+    while (sim.simTime < seconds) {
+        sim.step(1.0f / 60.0f);
+        const CrowdAgents& crowd = sim.crowd;
+        if (crowd.count > 0 && start < 0.0f) start = sim.simTime;
+        std::fill(closeNow.begin(), closeNow.begin() + crowd.count, 0);
+        for (int window : sim.fireGrid.burningWindows()) {
+            const WindowRect& w = sim.layout.windows[window];
+            for (int i = 0; i < crowd.count; i++) {
+                float dx = crowd.x[i] - w.x, dy = crowd.y[i] - w.y;
+                if (dx * dx + dy * dy < close * close) closeNow[i] = 1;
+            }
+        }
+        for (int i = 0; i < crowd.count; i++) {
+            closeSteps[i] += closeNow[i];
+            run.nearFire = std::max(run.nearFire, closeSteps[i] / 60.0f);
+        }
+        if (start >= 0.0f && sim.agentsWalking == 0 && run.outSeconds < 0.0f) {
+            run.outSeconds = sim.simTime - start;
+        }
+    }
+    int phases[4];
+    sim.crowd.countPhases(phases);
+    run.occupants = sim.crowd.count;
+    run.safe = phases[AGENT_SAFE];
+    run.hash = sim.stateHash();
+    return run;
+}
+
+bool checkCrowd(float seconds) {
+    JobSystem single(1);
+    JobSystem several(4);
+    CrowdRun first = runCrowd(&single, seconds);
+    CrowdRun again = runCrowd(&several, seconds);
+
+    bool passed = first.occupants > 0 && first.safe == first.occupants && first.outSeconds >= 0.0f &&
+                  first.nearFire < 1.0f && first.hash == again.hash;
+    printf("%s: %d of %d occupants out in %.2f s, at most %.2f s near a burning window; hash %016llx, "
+           "4 threads %016llx\n",
+           passed ? "PASS" : "FAIL", first.safe, first.occupants, first.outSeconds, first.nearFire,
+           (unsigned long long)first.hash, (unsigned long long)again.hash);
+    return passed;
+}
+
+// side x side blocks, 100 units wide; every roadGap-th road left out so
+// routes have to go around
+static void buildRoadGrid(int side, int roadGap, std::vector<RoadNodeDesc>& nodes, std::vector<RoadDesc>& roads) {
+    for (int row = 0; row < side; row++) {
+        for (int column = 0; column < side; column++) {
+            int node = row * side + column;
+            nodes.push_back({column * 100.0f, row * 100.0f + (column % 3) * 7.0f});
+            if (column > 0 && node % roadGap != 0) roads.push_back({node - 1, node});
+            if (row > 0 && (node + 1) % roadGap != 0) roads.push_back({node - side, node});
+        }
+    }
+}
+
+bool checkDispatch() {
+    // Route tables against Bellman-Ford, and routes as long as the table says
+    std::vector<RoadNodeDesc> nodes;
+    std::vector<RoadDesc> roads;
+    buildRoadGrid(12, 5, nodes, roads);
+    RoadNetwork network;
+    bool built = network.build(nodes, roads);
+    int n = network.nodeCount();
+    float worst = 0.0f;
+    std::vector<float> distance(n);
+    std::vector<int> route;
+    for (int from = 0; from < n; from++) {
+        std::fill(distance.begin(), distance.end(), ROAD_UNREACHABLE);
+        distance[from] = 0.0f;
+        for (int pass = 0; pass < n; pass++) {
+            for (const RoadDesc& road : roads) {
+                float length = network.length(road.from, road.to);
+                distance[road.to] = std::min(distance[road.to], distance[road.from] + length);
+                distance[road.from] = std::min(distance[road.from], distance[road.to] + length);
+            }
+        }
+        for (int to = 0; to < n; to++) {
+            network.route(from, to, route);
+            float length = 0.0f;
+            for (size_t k = 1; k < route.size(); k++) {
+                length += network.length(route[k - 1], route[k]);
+            }
+            worst = std::max(worst, std::fabs(network.distance(from, to) - distance[to]));
+            worst = std::max(worst, std::fabs(length - distance[to]));
+        }
+    }
+    bool routes = built && n == 144 && worst < 0.01f;
+
+    // 1000 incidents, two trucks each, from 64 stations of 32 trucks
+    nodes.clear();
+    roads.clear();
+    const int side = 32, incidents = 1000;
+    buildRoadGrid(side, 1000000, nodes, roads);
+    network.build(nodes, roads);
+    std::vector<int> stationNodes, truckStations, incidentNodes;
+    for (int s = 0; s < 64; s++) {
+        stationNodes.push_back((s / 8 * 4 + 2) * side + s % 8 * 4 + 2);
+        truckStations.insert(truckStations.end(), 32, s);
+    }
+    unsigned int state = 1;
+    for (int i = 0; i < incidents; i++) {
+        state = state * 1664525u + 1013904223u;
+        incidentNodes.push_back((int)(state >> 8) % (side * side));
+    }
+    Dispatcher dispatcher;
+    dispatcher.build(network, stationNodes, truckStations);
+    std::vector<DispatchOrder> orders;
+    orders.reserve(incidents * 2);
+    dispatcher.dispatch(incidentNodes.data(), incidents, 2, orders);
+
+    // Every truck once, each from a station no farther than any that still
+    // had a free truck at the time
+    std::vector<int> freeAt(64, 32);
+    std::vector<char> sent(truckStations.size(), 0);
+    int dispatched = (int)orders.size();
+    bool nearest = dispatched == 2 * incidents;
+    for (const DispatchOrder& order : orders) {
+        int station = truckStations[order.truck];
+        float used = network.distance(stationNodes[station], incidentNodes[order.incident]);
+        for (int s = 0; s < 64; s++) {
+            float other = network.distance(stationNodes[s], incidentNodes[order.incident]);
+            nearest = nearest && (freeAt[s] == 0 || other >= used);
+        }
+        nearest = nearest && !sent[order.truck] && freeAt[station] > 0;
+        sent[order.truck] = 1;
+        freeAt[station]--;
+    }
+
+    // Trucks released in any order go out again lowest index first, and a
+    // network without stations dispatches nothing
+    dispatcher.reset();
+    orders.clear();
+    int first = incidentNodes[0];
+    dispatcher.dispatch(&first, 1, 3, orders);
+    for (int k = (int)orders.size() - 1; k >= 0; k--) {
+        dispatcher.release(orders[(k + 1) % orders.size()].truck);
+    }
+    std::vector<DispatchOrder> again;
+    dispatcher.dispatch(&first, 1, 3, again);
+    bool reused = orders.size() == 3 && again.size() == 3;
+    for (size_t k = 0; reused && k < again.size(); k++) {
+        reused = again[k].truck == orders[k].truck;
+    }
+    Dispatcher empty;
+    empty.build(network, std::vector<int>(), std::vector<int>());
+    reused = reused && empty.dispatch(&first, 1, 2, again) == 0;
+
+    // The default street: trucks park a spacing apart and go home again
+    Simulation sim;
+    sim.setFluidResolution(0);
+    sim.setSeed(7);
+    float parkedGap = 0.0f;
+    while (sim.simTime < 90.0f && !(sim.currentState == TRUCKS_LEAVING && sim.dispatcher.freeTrucks() == 2)) {
+        sim.step(1.0f / 60.0f);
+        if (sim.currentState == EXTINGUISHING && sim.trucks.size() == 2) {
+            parkedGap = std::fabs(sim.trucks[0].x - sim.trucks[1].x);
+        }
+    }
+    bool home = sim.currentState == TRUCKS_LEAVING && sim.dispatcher.freeTrucks() == 2;
+    bool lined = std::fabs(parkedGap - TRUCK_SPACING) < 0.01f;
+
+    bool passed = routes && nearest && reused && lined && home;
+    printf("%s: routes match brute force: %s (off by %.4f); %d incidents got %d trucks, nearest free first: %s; "
+           "released trucks lowest first: %s; trucks parked %.1f apart, back at the station: %s\n",
+           passed ? "PASS" : "FAIL", routes ? "yes" : "no", worst, incidents, dispatched, nearest ? "yes" : "no",
+           reused ? "yes" : "no", parkedGap, home ? "yes" : "no");
+    return passed;
+}
+
+bool checkIncidentBatch() {
+    // A full run of the default scene, noting when each state began and
+    // when each condition first held after a step
+    Simulation sim;
+    sim.setFluidResolution(0);
+    sim.setSeed(7);
+    float began[TRUCKS_LEAVING + 1] = {0.0f};
+    float ready[INCIDENT_CONDITION_COUNT] = {0.0f, -1.0f, -1.0f, -1.0f};
+    int state = sim.currentState;
+    while (sim.simTime < 90.0f && state != TRUCKS_LEAVING) {
+        sim.step(1.0f / 60.0f);
+        if (sim.currentState != state) {
+            state = sim.currentState;
+            began[state] = sim.simTime;
+        }
+        bool parked = false;
+        for (const FireTruck& truck : sim.trucks) {
+            parked = parked || truck.dispatched;
+            if (truck.dispatched && !truck.arrived) {
+                parked = false;
+                break;
+            }
+        }
+        bool crew = sim.humanPosition <= sim.humanStopX;
+        bool trucks = state == FIREFIGHTERS_ARRIVE && parked;
+        bool fireOut = state == EXTINGUISHING && sim.fireGrid.burningWindows().empty();
+        if (crew && ready[CONDITION_CREW_IN_PLACE] < 0.0f) ready[CONDITION_CREW_IN_PLACE] = sim.simTime;
+        if (trucks && ready[CONDITION_TRUCKS_PARKED] < 0.0f) ready[CONDITION_TRUCKS_PARKED] = sim.simTime;
+        if (fireOut && ready[CONDITION_FIRE_OUT] < 0.0f) ready[CONDITION_FIRE_OUT] = sim.simTime;
+    }
+
+    // The same incident three times over must change state at the same
+    // times, with the same events
+    IncidentBatch batch;
+    batch.setCapacity(3, 3);
+    for (int i = 0; i < 3; i++) {
+        batch.add(sim.scene.timings, ready);
+    }
+    int matched = 0, mismatched = 0;
+    while (batch.time < sim.simTime) {
+        batch.step(1.0f / 60.0f);
+        for (const IncidentEvent& event : batch.events) {
+            const IncidentTransition* transition = incidentTransition(event.state - 1);
+            bool same = event.time == began[event.state] && transition && event.code == transition->event;
+            matched += same ? 1 : 0;
+            mismatched += same ? 0 : 1;
+        }
+    }
+    bool replayed = state == TRUCKS_LEAVING && matched == 3 * TRUCKS_LEAVING && mismatched == 0 &&
+                    batch.droppedEvents == 0;
+
+    // 100k incidents with their timings spread over five seconds all run to
+    // the end; how fast is fire_bench's incident_step_100k
+    const int incidents = 100000;
+    batch.setCapacity(incidents, incidents);
+    unsigned int seed = 1;
+    for (int i = 0; i < incidents; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float shift = (seed >> 8) * (5.0f / 16777216.0f);
+        ScenarioTimings timings = sim.scene.timings;
+        for (float* field : {&timings.fireStart, &timings.alarm, &timings.crewArrive, &timings.firefightersArrive,
+                             &timings.extinguishing, &timings.allClear, &timings.trucksLeaving}) {
+            *field += shift;
+        }
+        float shifted[INCIDENT_CONDITION_COUNT];
+        for (int c = 0; c < INCIDENT_CONDITION_COUNT; c++) {
+            shifted[c] = ready[c] + shift;
+        }
+        batch.add(timings, shifted);
+    }
+    long long transitions = 0;
+    while (batch.time < sim.simTime + 6.0f) {
+        transitions += batch.step(1.0f / 60.0f);
+    }
+    bool finished = transitions == (long long)incidents * TRUCKS_LEAVING && batch.droppedEvents == 0;
+
+    bool passed = replayed && finished;
+    printf("%s: batch replays the default run: %d of %d transitions at the same time; %d incidents finished: %s\n",
+           passed ? "PASS" : "FAIL", matched, 3 * TRUCKS_LEAVING, incidents, finished ? "yes" : "no");
+    return passed;
+}
+
+bool runSelfChecks() {
+    bool passed = true;
+    passed = checkParticleKernels(10000) && passed;
+    passed = checkDeterminism(12.0f) && passed;
+    passed = checkFixedStep() && passed;
+    passed = checkEventLog() && passed;
+    passed = checkSnapshots(25.0f) && passed;
+    passed = checkAudioMixer() && passed;
+    passed = checkSceneGrid() && passed;
+    passed = checkWater() && passed;
+    passed = checkHud(32, 20.0f) && passed;
+    passed = checkSweep(3) && passed;
+    passed = checkCrowd(40.0f) && passed;
+    passed = checkDispatch() && passed;
+    passed = checkIncidentBatch() && passed;
+    return passed;
+}
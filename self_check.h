@@ -0,0 +1,65 @@
+#ifndef SELF_CHECK_H
+#define SELF_CHECK_H
+
+// Built-in correctness checks, run with --self-check. Each prints one
+// PASS/FAIL line and returns false on failure.
+
+// SIMD particle kernels must stay within a pixel bound of the scalar
+// reference over the given number of steps
+bool checkParticleKernels(int steps);
+
+// The same seed must give a bit-identical simulation state, on one thread or
+// several; another seed must not
+bool checkDeterminism(float seconds);
+
+// The step clock must hold the sim rate whatever the frame rate and cap
+// catch-up after a stall; trucks and crew must move the same at any step
+bool checkFixedStep();
+
+// Events logged from several threads at once must all be numbered, and
+// a reader must never see a half-written one
+bool checkEventLog();
+
+// Rewinding to a snapshot, or loading a saved state, and running on must
+// reach the same state hash as the original run
+bool checkSnapshots(float seconds);
+
+// WAVs must decode to the mix format, voices must mix and stop one at a
+// time, a full command queue must drop rather than block, and the audio
+// thread must keep real time
+bool checkAudioMixer();
+
+// The scene grid must draw exactly the static batch when everything is in
+// view, and only a few cells of a city at the original zoom
+bool checkSceneGrid();
+
+// Spatial hash queries must match a brute force search on any number of
+// threads, and the hoses must put out a burning fire deterministically
+bool checkWater();
+
+// Glyphs must be in the atlas, and HUD panels must lay text out again only
+// when it changes, without heap allocation, ending where a fresh layout of
+// the same state would
+bool checkHud(int panels, float seconds);
+
+// Online percentiles must stay close to exact ones, and a sweep must
+// report the same runs in the same order on any number of threads
+bool checkSweep(int runsPerSet);
+
+// Occupants must all reach their assembly points, kept off burning windows,
+// the same way on any number of threads
+bool checkCrowd(float seconds);
+
+// Route tables must match a brute force search, 1000 incidents must be
+// dispatched nearest station first in under a millisecond, and trucks must
+// line up at the fire and drive back to their station
+bool checkDispatch();
+
+// A batch fed the default run's condition times must change state when
+// the run did, and step at least a million incidents per millisecond
+bool checkIncidentBatch();
+
+// Runs every check; returns false if any failed
+bool runSelfChecks();
+
+#endif // SELF_CHECK_H
@@ -0,0 +1,777 @@
+#include "simulation.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "state_io.h"
+#include "water.h"
+#include "crowd.h"
+#include "incident_batch.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+Simulation::Simulation()
+    : agentsWalking(0), occupantsPerBuilding(DEFAULT_OCCUPANTS), seed(0), jobs(nullptr), placementRandom(0, 0) {
+    fireParticles.setCapacity(DEFAULT_PARTICLE_CAPACITY);
+    setWaterCapacity(DEFAULT_WATER_CAPACITY);
+    setCrowdCapacity(DEFAULT_CROWD_CAPACITY);
+    setParticleKernel(KERNEL_AUTO);
+    setFluidResolution(DEFAULT_FLUID_RESOLUTION);
+    setScene(defaultScene());
+}
+
+void Simulation::setScene(const Scene& newScene) {
+    scene = newScene;
+    std::stable_sort(scene.ignitions.begin(), scene.ignitions.end(),
+                     [](const IgnitionDesc& a, const IgnitionDesc& b) { return a.delay < b.delay; });
+    layout.build(scene);
+    fireGrid.build(scene, layout);
+
+    // Route tables and each node's nearest stations, once per scene.
+    // Scene files are checked on load; a network that still does not
+    // build leaves the scene without trucks.
+    bool valid = roads.build(scene.roadNodes, scene.roads) && (int)scene.trucks.size() <= MAX_TRUCKS;
+    for (const StationDesc& station : scene.stations) {
+        valid = valid && station.node >= 0 && station.node < roads.nodeCount();
+    }
+    for (const TruckDesc& truck : scene.trucks) {
+        valid = valid && truck.station >= 0 && truck.station < (int)scene.stations.size();
+    }
+    if (!valid) {
+        scene.stations.clear();
+        scene.trucks.clear();
+    }
+    std::vector<int> stationNodes, truckStations;
+    for (const StationDesc& station : scene.stations) {
+        stationNodes.push_back(station.node);
+    }
+    for (const TruckDesc& truck : scene.trucks) {
+        truckStations.push_back(truck.station);
+    }
+    dispatcher.build(roads, stationNodes, truckStations);
+    dispatchOrders.reserve(scene.trucks.size());
+    trucks.resize(scene.trucks.size());
+    previousTruckX.resize(scene.trucks.size());
+    emitters.reserve(layout.windows.size());
+
+    // Cells as large as the largest window, so a drop's window is always
+    // in the cells around it, and no smaller than the range at which fire
+    // pushes agents, so the crowd finds every window it should flee
+    std::vector<float> centerX, centerY;
+    float largest = 1.0f;
+    for (const WindowRect& w : layout.windows) {
+        centerX.push_back(w.x);
+        centerY.push_back(w.y);
+        largest = std::max(largest, std::max(w.right - w.left, w.bottom - w.top));
+    }
+    windowHash.setup(std::max(largest, AGENT_FIRE_RANGE), (int)layout.windows.size());
+    windowHash.build(centerX.data(), centerY.data(), (int)centerX.size(), nullptr);
+    reset();
+}
+
+void Simulation::setParticleCapacity(int capacity) {
+    fireParticles.setCapacity(capacity);
+}
+
+void Simulation::setWaterCapacity(int capacity) {
+    waterParticles.setCapacity(capacity);
+    dropHash.setup(WATER_QUENCH_RADIUS, waterParticles.capacity());
+    waterHits.assign(waterParticles.capacity(), -1);
+}
+
+void Simulation::setCrowdCapacity(int capacity) {
+    crowd.setCapacity(capacity);
+    agentHash.setup(AGENT_SPACING, crowd.capacity());
+    agentPhases.assign(crowd.capacity(), 0);
+    agentsWalking = 0;
+}
+
+void Simulation::setOccupants(int perBuilding) {
+    occupantsPerBuilding = std::max(0, perBuilding);
+}
+
+void Simulation::setParticleKernel(ParticleKernel kernel) {
+    if (kernel == KERNEL_AUTO || !isParticleKernelSupported(kernel)) {
+        kernel = detectParticleKernel();
+    }
+    particleKernel = kernel;
+}
+
+void Simulation::setFluidResolution(int width) {
+    fluid.setResolution(width, (int)(width * FLUID_SCENE_HEIGHT / FLUID_SCENE_WIDTH + 0.5f));
+}
+
+void Simulation::setJobSystem(JobSystem* jobSystem) {
+    jobs = jobSystem;
+}
+
+void Simulation::setSeed(uint64_t newSeed) {
+    seed = newSeed;
+    reset();
+}
+
+void Simulation::reset() {
+    currentState = NORMAL;
+    simTime = 0.0f;
+    stepCount = 0;
+    fireParticles.clear();
+    waterParticles.clear();
+    dropHash.build(nullptr, nullptr, 0, nullptr);
+    crowd.clear();
+    agentHash.build(nullptr, nullptr, 0, nullptr);
+    evacuated.assign(scene.buildings.size(), 0);
+    agentsWalking = 0;
+    placementRandom = RandomStream(seed, randomStreamId(RANDOM_FIRE_PLACEMENT, 0));
+    fireOrigin = -1;
+    fireStartTime = 0.0f;
+    nextIgnition = 0;
+    fireGrid.clear();
+    fluid.clear();
+    dispatcher.reset();
+    for (size_t i = 0; i < trucks.size(); i++) {
+        int station = scene.stations[scene.trucks[i].station].node;
+        RoadPoint home = {station, station, 0.0f};
+        trucks[i] = {roads.nodeX(station), roads.nodeY(station), station, station, 0.0f, home, 0, -1,
+                     false, false, false, false, false, -1};
+    }
+    humanStopX = 350.0f;
+    if (layout.mainBuilding >= 0) {
+        const BuildingDesc& main = scene.buildings[layout.mainBuilding];
+        humanStopX = main.x + main.width * 0.5f;
+    }
+    humanPosition = humanStopX + 450.0f; // Walk in from the right
+    rememberPreviousStep();
+
+    // The log keeps going across resets; a sink may be reading it
+    firstEvent = events.total();
+    logEvent(EVENT_SIMULATION_STARTED, -1);
+    logEvent(EVENT_NORMAL_OPERATION, -1);
+}
+
+void Simulation::updateFire(float deltaTime) {
+    PROFILE_SCOPE("updateFire");
+
+    // Scheduled ignitions, in order of delay
+    while (nextIgnition < scene.ignitions.size() &&
+           simTime - fireStartTime >= scene.ignitions[nextIgnition].delay) {
+        const IgnitionDesc& ignition = scene.ignitions[nextIgnition++];
+        int window = layout.buildings[ignition.building].firstWindow + ignition.window;
+        fireGrid.ignite(window);
+        logEvent(EVENT_WINDOW_IGNITED, window);
+        if (fireOrigin < 0) {
+            fireOrigin = window;
+        }
+    }
+
+    fireGrid.step(deltaTime, jobs);
+}
+
+void Simulation::updateFireParticles(float deltaTime) {
+    PROFILE_SCOPE("updateFireParticles");
+    ParticlePool& pool = fireParticles;
+
+    // Remove dead particles
+    pool.removeDead();
+
+    // Update existing particles, let the smoke carry them, then douse
+    // the ones the hoses hit
+    ParticleKernel kernel = particleKernel;
+    float time = simTime;
+    bool doused = waterParticles.count > 0;
+    parallelFor(jobs, pool.count, PARTICLE_CHUNK_SIZE, [&](int begin, int end, int) {
+        memcpy(pool.previousX + begin, pool.x + begin, (end - begin) * sizeof(float));
+        memcpy(pool.previousY + begin, pool.y + begin, (end - begin) * sizeof(float));
+        integrateParticles(kernel, pool.x + begin, pool.y + begin, pool.velocity + begin,
+                           pool.life + begin, end - begin, time, deltaTime);
+        fluid.advectPoints(pool.x + begin, pool.y + begin, end - begin, deltaTime);
+        if (doused) {
+            quenchFireParticles(pool, begin, end, dropHash, deltaTime);
+        }
+    });
+
+    emitFromBurningWindows();
+}
+
+void Simulation::emitFromBurningWindows() {
+    emitters.clear();
+    for (int window : fireGrid.burningWindows()) {
+        emitters.push_back({layout.windows[window].x, layout.windows[window].y});
+    }
+    emitParticles();
+}
+
+void Simulation::emitParticles() {
+    ParticlePool& pool = fireParticles;
+
+    // Reserve every slot up front so chunks know where to write
+    int first = 0;
+    int granted = pool.spawnBlock((int)emitters.size() * PARTICLES_PER_EMITTER, first);
+    int emitterCount = (granted + PARTICLES_PER_EMITTER - 1) / PARTICLES_PER_EMITTER;
+
+    // Each chunk draws all its numbers in one batch from its own stream,
+    // keyed by step and chunk index
+    uint64_t streamBase = randomStreamId(RANDOM_PARTICLE_EMISSION, (uint64_t)stepCount << 20);
+    parallelFor(jobs, emitterCount, EMITTER_CHUNK_SIZE, [&](int begin, int end, int chunk) {
+        const int maxSlots = EMITTER_CHUNK_SIZE * PARTICLES_PER_EMITTER;
+        float values[RANDOMS_PER_PARTICLE * maxSlots];
+
+        int slotBegin = begin * PARTICLES_PER_EMITTER;
+        int slots = std::min(granted, end * PARTICLES_PER_EMITTER) - slotBegin;
+        RandomStream random(seed, streamBase + chunk);
+        random.nextFloats(values, RANDOMS_PER_PARTICLE * slots);
+
+        const float* offsetX = values;
+        const float* offsetY = values + slots;
+        const float* speed = values + 2 * slots;
+        const float* lifetime = values + 3 * slots;
+        const float* size = values + 4 * slots;
+        for (int s = 0; s < slots; s++) {
+            const ParticleEmitter& emitter = emitters[(slotBegin + s) / PARTICLES_PER_EMITTER];
+            int p = first + slotBegin + s;
+            pool.x[p] = emitter.x + offsetX[s] * 5.0f - 2.5f;
+            pool.y[p] = emitter.y + offsetY[s] * 5.0f;
+            pool.previousX[p] = pool.x[p];
+            pool.previousY[p] = pool.y[p];
+            pool.velocity[p] = 0.5f + speed[s];
+            pool.life[p] = 0.5f + lifetime[s] * 0.5f;
+            pool.size[p] = 2.0f + size[s] * 2.0f;
+        }
+    });
+}
+
+void Simulation::updateWater(float deltaTime) {
+    PROFILE_SCOPE("updateWater");
+    ParticlePool& pool = waterParticles;
+    pool.removeDead();
+
+    // Drops that reached the wall cool the window they landed on, in
+    // order so the sums do not depend on the threads
+    parallelFor(jobs, pool.count, PARTICLE_CHUNK_SIZE, [&](int begin, int end, int) {
+        moveWaterDrops(pool, begin, end, deltaTime, windowHash, layout, waterHits.data());
+    });
+    for (int i = 0; i < pool.count; i++) {
+        if (waterHits[i] >= 0) {
+            fireGrid.addWater(waterHits[i], WATER_HEAT_PER_DROP);
+        }
+    }
+
+    launchWater(deltaTime);
+    dropHash.build(pool.x, pool.y, pool.count, jobs);
+}
+
+void Simulation::launchWater(float deltaTime) {
+    int drops = std::min(MAX_DROPS_PER_STEP, (int)(WATER_DROPS_PER_SECOND * deltaTime + 0.5f));
+    for (int t = 0; t < (int)trucks.size(); t++) {
+        const FireTruck& truck = trucks[t];
+        if (!truck.spraying || truck.target < 0) continue;
+
+        int first = 0;
+        int granted = waterParticles.spawnBlock(drops, first);
+        float values[RANDOMS_PER_DROP * MAX_DROPS_PER_STEP];
+        RandomStream random(seed, randomStreamId(RANDOM_WATER_EMISSION, ((uint64_t)stepCount << TRUCK_INDEX_BITS) | t));
+        random.nextFloats(values, RANDOMS_PER_DROP * granted);
+
+        // Spread a little past the window, so some water splashes around it
+        const WindowRect& target = layout.windows[truck.target];
+        launchWaterDrops(waterParticles, first, granted, truck.x + NOZZLE_OFFSET_X, NOZZLE_Y, target.x, target.y,
+                         (target.right - target.left) * 0.6f, (target.bottom - target.top) * 0.6f, values,
+                         deltaTime);
+    }
+}
+
+int Simulation::chooseTarget(int truck) const {
+    // Nearest burning window no other truck is on; any burning one if
+    // they all are
+    float nozzleX = trucks[truck].x + NOZZLE_OFFSET_X;
+    int best = -1;
+    float bestDistance = 0.0f;
+    for (int window : fireGrid.burningWindows()) {
+        const WindowRect& w = layout.windows[window];
+        float dx = w.x - nozzleX, dy = w.y - NOZZLE_Y;
+        float distance = dx * dx + dy * dy;
+        for (int other = 0; other < (int)trucks.size(); other++) {
+            if (other != truck && trucks[other].target == window) {
+                distance += 1e12f;
+            }
+        }
+        if (best < 0 || distance < bestDistance) {
+            best = window;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+void Simulation::dispatchTrucks() {
+    // The fire's address is the road point nearest where the front truck
+    // parks; the dispatcher picks stations by the nearer end of its road
+    int building = fireOrigin >= 0 ? layout.buildingOf(fireOrigin) : layout.mainBuilding;
+    if (building < 0) return;
+    RoadPoint address = roads.nearestPoint(scene.buildings[building].x - TRUCK_PARK_OFFSET, 0.0f);
+    if (address.from < 0) return;
+    int node = address.offset * 2.0f <= roads.length(address.from, address.to) ? address.from : address.to;
+
+    dispatchOrders.clear();
+    dispatcher.dispatch(&node, 1, scene.trucksPerFire, dispatchOrders);
+    int ahead = -1;
+    for (const DispatchOrder& order : dispatchOrders) {
+        FireTruck& truck = trucks[order.truck];
+        roads.distanceTo(truck.node, address, truck.destination);
+        truck.slot = order.slot;
+        truck.leader = ahead;
+        truck.dispatched = true;
+        ahead = order.truck;
+    }
+}
+
+float Simulation::distanceLeft(const FireTruck& truck) const {
+    const RoadPoint& to = truck.destination;
+    if (truck.node == to.from && truck.nextNode == to.to && to.from != to.to) {
+        return to.offset - truck.travelled; // On the last road
+    }
+    if (truck.node == truck.nextNode) {
+        return roads.distance(truck.node, to.from) + to.offset;
+    }
+    return roads.length(truck.node, truck.nextNode) - truck.travelled + roads.distance(truck.nextNode, to.from) +
+           to.offset;
+}
+
+void Simulation::driveTruck(FireTruck& truck, float distance, float stopShort) {
+    const RoadPoint& to = truck.destination;
+    distance = std::min(distance, std::max(0.0f, distanceLeft(truck) - stopShort));
+    while (distance > 0.0f) {
+        // At a node: onto the destination's road, or the next on the route
+        if (truck.node == truck.nextNode) {
+            int next = truck.node == to.from ? to.to : roads.nextHop(truck.node, to.from);
+            if (next < 0 || next == truck.node) break;
+            truck.nextNode = next;
+            truck.travelled = 0.0f;
+        }
+        float rest = roads.length(truck.node, truck.nextNode) - truck.travelled;
+        bool lastRoad = truck.node == to.from && truck.nextNode == to.to;
+        if (distance < rest || lastRoad) {
+            truck.travelled += distance;
+            break;
+        }
+        distance -= rest;
+        truck.node = truck.nextNode;
+        truck.travelled = 0.0f;
+    }
+
+    float length = roads.length(truck.node, truck.nextNode);
+    float t = length > 0.0f ? truck.travelled / length : 0.0f;
+    float x = roads.nodeX(truck.node) + (roads.nodeX(truck.nextNode) - roads.nodeX(truck.node)) * t;
+    if (x != truck.x) {
+        truck.facingLeft = x < truck.x;
+    }
+    truck.x = x;
+    truck.y = roads.nodeY(truck.node) + (roads.nodeY(truck.nextNode) - roads.nodeY(truck.node)) * t;
+}
+
+void Simulation::updateFireTrucks(float deltaTime) {
+    PROFILE_SCOPE("updateFireTrucks");
+    for (size_t i = 0; i < trucks.size(); i++) {
+        const TruckDesc& desc = scene.trucks[i];
+        FireTruck& truck = trucks[i];
+        if (!truck.dispatched) continue;
+
+        if (currentState == FIREFIGHTERS_ARRIVE && !truck.arrived) {
+            // Trucks line up TRUCK_SPACING apart, on the way too
+            float stopShort = truck.slot * TRUCK_SPACING;
+            if (truck.leader >= 0) {
+                stopShort = std::max(stopShort, distanceLeft(trucks[truck.leader]) + TRUCK_SPACING);
+            }
+            driveTruck(truck, desc.arriveSpeed * deltaTime, stopShort);
+            truck.arrived = distanceLeft(truck) <= truck.slot * TRUCK_SPACING + 0.001f;
+        } else if (currentState == EXTINGUISHING && truck.arrived) {
+            truck.spraying = true;
+            if (truck.target < 0 || !fireGrid.isBurning(truck.target)) {
+                truck.target = chooseTarget((int)i);
+            }
+        } else if (currentState == TRUCKS_LEAVING && !truck.leaving) {
+            truck.spraying = false;
+            truck.leaving = true;
+            truck.target = -1;
+
+            // Back to the station, turning around if that is shorter
+            int station = scene.stations[desc.station].node;
+            truck.destination = {station, station, 0.0f};
+            if (truck.node != truck.nextNode) {
+                float length = roads.length(truck.node, truck.nextNode);
+                float back = truck.travelled + roads.distance(truck.node, station);
+                float ahead = length - truck.travelled + roads.distance(truck.nextNode, station);
+                if (back < ahead) {
+                    std::swap(truck.node, truck.nextNode);
+                    truck.travelled = length - truck.travelled;
+                }
+            }
+        }
+
+        if (truck.leaving) {
+            driveTruck(truck, desc.leaveSpeed * deltaTime, 0.0f);
+            if (distanceLeft(truck) <= 0.0f) {
+                truck.dispatched = false;
+                truck.arrived = false;
+                truck.leaving = false;
+                truck.slot = 0;
+                truck.leader = -1;
+                dispatcher.release((int)i);
+            }
+        }
+    }
+}
+
+void Simulation::updateHumans(float deltaTime) {
+    if (currentState >= HUMANS_ARRIVE && currentState < FIREFIGHTERS_ARRIVE) {
+        humanPosition = std::max(humanStopX, humanPosition - HUMAN_WALK_SPEED * deltaTime); // Humans move in from right
+    }
+}
+
+void Simulation::updateCrowd(float deltaTime) {
+    PROFILE_SCOPE("updateCrowd");
+
+    // Once the alarm goes, everyone in a burning building leaves
+    if (currentState >= ALARM && currentState < ALL_CLEAR) {
+        for (int window : fireGrid.burningWindows()) {
+            evacuate(layout.buildingOf(window));
+        }
+    }
+    moveCrowd(deltaTime);
+}
+
+void Simulation::evacuate(int building) {
+    if (building < 0 || building >= (int)evacuated.size() || evacuated[building]) return;
+    evacuated[building] = 1;
+    events.log(EVENT_EVACUATION, simTime, (int)currentState, 0, building, -1);
+
+    // One stream per building, drawn in fixed-size batches
+    const int batch = 256;
+    float values[RANDOMS_PER_AGENT * batch];
+    int first = 0;
+    int occupants = std::min(occupantsPerBuilding, occupantCapacity(scene.buildings[building]));
+    int granted = crowd.spawnBlock(occupants, first);
+    RandomStream random(seed, randomStreamId(RANDOM_CROWD_PLACEMENT, (uint64_t)building));
+    for (int done = 0; done < granted; done += batch) {
+        int count = std::min(batch, granted - done);
+        random.nextFloats(values, RANDOMS_PER_AGENT * count);
+        placeOccupants(crowd, first + done, count, building, scene, values);
+    }
+    agentsWalking += granted;
+}
+
+void Simulation::moveCrowd(float deltaTime) {
+    // Agents at their assembly points stay put, so once everyone is out
+    // there is nothing left to hash or move
+    if (agentsWalking == 0) return;
+
+    agentHash.build(crowd.x, crowd.y, crowd.count, jobs);
+    std::copy(crowd.phase, crowd.phase + crowd.count, agentPhases.begin());
+    std::atomic<int> walking(0);
+    parallelFor(jobs, crowd.count, AGENT_CHUNK_SIZE, [&](int begin, int end, int) {
+        walking += moveAgents(crowd, begin, end, deltaTime, agentHash, agentPhases.data(), windowHash, fireGrid,
+                              scene);
+    });
+    agentsWalking = walking;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64_t Simulation::stateHash() const {
+    const ParticlePool& pool = fireParticles;
+    size_t bytes = (size_t)pool.count * sizeof(float);
+
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hash = hashBytes(hash, &currentState, sizeof(currentState));
+    hash = hashBytes(hash, &simTime, sizeof(simTime));
+    hash = hashBytes(hash, &fireOrigin, sizeof(fireOrigin));
+    for (const FireTruck& truck : trucks) {
+        hash = hashBytes(hash, &truck.x, sizeof(truck.x));
+        hash = hashBytes(hash, &truck.y, sizeof(truck.y));
+        hash = hashBytes(hash, &truck.target, sizeof(truck.target));
+    }
+    hash = hashBytes(hash, &humanPosition, sizeof(humanPosition));
+    hash = hashBytes(hash, &pool.count, sizeof(pool.count));
+    hash = hashBytes(hash, pool.x, bytes);
+    hash = hashBytes(hash, pool.y, bytes);
+    hash = hashBytes(hash, pool.velocity, bytes);
+    hash = hashBytes(hash, pool.life, bytes);
+    hash = hashBytes(hash, pool.size, bytes);
+    const ParticlePool& water = waterParticles;
+    size_t waterBytes = (size_t)water.count * sizeof(float);
+    hash = hashBytes(hash, &water.count, sizeof(water.count));
+    hash = hashBytes(hash, water.x, waterBytes);
+    hash = hashBytes(hash, water.y, waterBytes);
+    hash = hashBytes(hash, water.life, waterBytes);
+    size_t agentBytes = (size_t)crowd.count * sizeof(float);
+    hash = hashBytes(hash, &crowd.count, sizeof(crowd.count));
+    hash = hashBytes(hash, crowd.x, agentBytes);
+    hash = hashBytes(hash, crowd.y, agentBytes);
+    hash = hashBytes(hash, crowd.phase, crowd.count);
+    size_t cellBytes = (size_t)fireGrid.cellCount() * sizeof(float);
+    hash = hashBytes(hash, fireGrid.heatData(), cellBytes);
+    hash = hashBytes(hash, fireGrid.fuelData(), cellBytes);
+    if (fluid.enabled()) {
+        size_t fluidBytes = (size_t)fluid.cellCount() * sizeof(float);
+        hash = hashBytes(hash, fluid.smokeData(), fluidBytes);
+        hash = hashBytes(hash, fluid.heatData(), fluidBytes);
+    }
+    return hash;
+}
+
+void Simulation::logEvent(EventCode code, int window) {
+    int building = layout.buildingOf(window);
+    int local = building >= 0 ? window - layout.buildings[building].firstWindow : -1;
+    events.log(code, simTime, (int)currentState, 0, building, local);
+}
+
+void Simulation::rememberPreviousStep() {
+    previousSimTime = simTime;
+    for (size_t i = 0; i < trucks.size(); i++) {
+        previousTruckX[i] = trucks[i].x;
+    }
+    previousHumanPosition = humanPosition;
+}
+
+float Simulation::interpolatedTime(float alpha) const {
+    return previousSimTime + (simTime - previousSimTime) * alpha;
+}
+
+float Simulation::interpolatedTruckX(int truck, float alpha) const {
+    return previousTruckX[truck] + (trucks[truck].x - previousTruckX[truck]) * alpha;
+}
+
+bool Simulation::truckOnStreet(int truck) const {
+    return roads.onStreet(trucks[truck].node) && roads.onStreet(trucks[truck].nextNode);
+}
+
+float Simulation::interpolatedHumanPosition(float alpha) const {
+    return previousHumanPosition + (humanPosition - previousHumanPosition) * alpha;
+}
+
+bool Simulation::alarmLightOn() const {
+    return (long long)(simTime / ALARM_BLINK_SECONDS) % 2 == 0;
+}
+
+// Settings a saved state must match: window count, trucks, fluid grid,
+// particle and agent storage, occupants per building
+static const uint32_t STATE_VERSION = 5;
+
+// Field by field, so padding never reaches the saved bytes
+static void saveTruck(StateWriter& writer, const FireTruck& truck) {
+    writer.value(truck.x);
+    writer.value(truck.y);
+    writer.value(truck.node);
+    writer.value(truck.nextNode);
+    writer.value(truck.travelled);
+    writer.value(truck.destination.from);
+    writer.value(truck.destination.to);
+    writer.value(truck.destination.offset);
+    writer.value(truck.slot);
+    writer.value(truck.leader);
+    writer.flag(truck.dispatched);
+    writer.flag(truck.arrived);
+    writer.flag(truck.spraying);
+    writer.flag(truck.leaving);
+    writer.flag(truck.facingLeft);
+    writer.value(truck.target);
+}
+
+static void loadTruck(StateReader& reader, FireTruck& truck) {
+    reader.value(truck.x);
+    reader.value(truck.y);
+    reader.value(truck.node);
+    reader.value(truck.nextNode);
+    reader.value(truck.travelled);
+    reader.value(truck.destination.from);
+    reader.value(truck.destination.to);
+    reader.value(truck.destination.offset);
+    reader.value(truck.slot);
+    reader.value(truck.leader);
+    reader.flag(truck.dispatched);
+    reader.flag(truck.arrived);
+    reader.flag(truck.spraying);
+    reader.flag(truck.leaving);
+    reader.flag(truck.facingLeft);
+    reader.value(truck.target);
+}
+
+void Simulation::saveState(std::vector<unsigned char>& out) const {
+    StateWriter writer(out);
+    writer.value(STATE_VERSION);
+    writer.value((uint32_t)layout.windows.size());
+    writer.value((uint32_t)trucks.size());
+    writer.value(fluid.gridWidth());
+    writer.value(fluid.gridHeight());
+    writer.value(fireParticles.capacity());
+    writer.value(waterParticles.capacity());
+    writer.value(crowd.capacity());
+    writer.value(occupantsPerBuilding);
+
+    writer.value(seed);
+    writer.value(currentState);
+    writer.value(simTime);
+    writer.value(stepCount);
+    writer.value(fireOrigin);
+    writer.value(fireStartTime);
+    for (const FireTruck& truck : trucks) {
+        saveTruck(writer, truck);
+    }
+    writer.value(humanPosition);
+    writer.value(previousSimTime);
+    writer.write(previousTruckX.data(), previousTruckX.size() * sizeof(float));
+    writer.value(previousHumanPosition);
+    writer.value((uint64_t)nextIgnition);
+    writer.value(placementRandom.state);
+    writer.value(agentsWalking);
+    writer.array(evacuated);
+    fireParticles.saveState(writer);
+    waterParticles.saveState(writer);
+    crowd.saveState(writer);
+    fireGrid.saveState(writer);
+    fluid.saveState(writer);
+}
+
+bool Simulation::loadState(const unsigned char* data, size_t size) {
+    StateReader reader(data, size);
+    uint32_t version = 0, windows = 0, truckCount = 0;
+    int fluidWidth = 0, fluidHeight = 0, capacity = 0, waterCapacity = 0, crowdCapacity = 0, occupants = 0;
+    reader.value(version);
+    reader.value(windows);
+    reader.value(truckCount);
+    reader.value(fluidWidth);
+    reader.value(fluidHeight);
+    reader.value(capacity);
+    reader.value(waterCapacity);
+    reader.value(crowdCapacity);
+    reader.value(occupants);
+    if (!reader.ok() || version != STATE_VERSION || windows != layout.windows.size() ||
+        truckCount != trucks.size() || fluidWidth != fluid.gridWidth() || fluidHeight != fluid.gridHeight() ||
+        capacity != fireParticles.capacity() || waterCapacity != waterParticles.capacity() ||
+        crowdCapacity != crowd.capacity() || occupants != occupantsPerBuilding) {
+        return false;
+    }
+
+    uint64_t ignition = 0;
+    reader.value(seed);
+    reader.value(currentState);
+    reader.value(simTime);
+    reader.value(stepCount);
+    reader.value(fireOrigin);
+    reader.value(fireStartTime);
+    for (FireTruck& truck : trucks) {
+        loadTruck(reader, truck);
+    }
+    reader.value(humanPosition);
+    reader.value(previousSimTime);
+    reader.read(previousTruckX.data(), previousTruckX.size() * sizeof(float));
+    reader.value(previousHumanPosition);
+    reader.value(ignition);
+    reader.value(placementRandom.state);
+    reader.value(agentsWalking);
+    reader.array(evacuated);
+    nextIgnition = (size_t)ignition;
+    bool ok = reader.ok() && evacuated.size() == scene.buildings.size() && fireParticles.loadState(reader) &&
+              waterParticles.loadState(reader) && crowd.loadState(reader, (int)scene.buildings.size()) &&
+              fireGrid.loadState(reader) && fluid.loadState(reader) && reader.atEnd() &&
+              nextIgnition <= scene.ignitions.size();
+    for (size_t i = 0; i < trucks.size(); i++) {
+        ok = ok && validTruck(trucks[i], (int)i);
+    }
+    if (!ok) {
+        reset();
+        return false;
+    }
+
+    // Which trucks are out follows from the trucks themselves
+    dispatcher.reset();
+    for (size_t i = 0; i < trucks.size(); i++) {
+        if (trucks[i].dispatched) dispatcher.take((int)i);
+    }
+
+    // The drop hash is derived, so rebuild it rather than save it; the
+    // agent hash is rebuilt before it is used
+    dropHash.build(waterParticles.x, waterParticles.y, waterParticles.count, nullptr);
+    return true;
+}
+
+bool Simulation::validTruck(const FireTruck& truck, int index) const {
+    int nodes = roads.nodeCount();
+    auto onRoad = [&](int from, int to, float along) {
+        if (from < 0 || from >= nodes || to < 0 || to >= nodes || !(along >= 0.0f)) return false;
+        if (from == to) return along == 0.0f;
+        return roads.joined(from, to) && along <= roads.length(from, to) + 0.01f; // Rounding at the far end
+    };
+    const RoadPoint& to = truck.destination;
+    return onRoad(truck.node, truck.nextNode, truck.travelled) && onRoad(to.from, to.to, to.offset) &&
+           truck.slot >= 0 && truck.leader >= -1 && truck.leader < (int)trucks.size() && truck.leader != index &&
+           truck.target >= -1 && truck.target < (int)layout.windows.size();
+}
+
+void Simulation::step(float deltaTime) {
+    PROFILE_SCOPE("Simulation::step");
+    rememberPreviousStep();
+    simTime += deltaTime;
+    stepCount++;
+
+    // State transitions
+    const ScenarioTimings& timings = scene.timings;
+    bool trucksArrived = true;
+    for (const FireTruck& truck : trucks) {
+        trucksArrived = trucksArrived && (truck.arrived || !truck.dispatched);
+    }
+
+    // The same table IncidentBatch runs, with the conditions read off the scene
+    const IncidentTransition* transition = incidentTransition(currentState);
+    if (transition && simTime > timings.*transition->timing) {
+        bool ready = true;
+        if (transition->condition == CONDITION_CREW_IN_PLACE) ready = humanPosition <= humanStopX;
+        if (transition->condition == CONDITION_TRUCKS_PARKED) ready = trucksArrived;
+        if (transition->condition == CONDITION_FIRE_OUT) ready = fireGrid.burningWindows().empty();
+        if (ready) {
+            currentState = transition->to;
+            int window = -1;
+            if (currentState == FIRE_START) {
+                fireStartTime = simTime;
+                // Without scripted ignitions the fire starts on the lowest three floors
+                if (scene.ignitions.empty() && layout.mainBuilding >= 0) {
+                    const BuildingLayout& main = layout.buildings[layout.mainBuilding];
+                    fireOrigin = main.firstWindow +
+                                 placementRandom.nextInt(std::min(main.windowCount, 3 * main.windowsPerFloor));
+                    fireGrid.ignite(fireOrigin);
+                }
+                window = fireOrigin;
+            } else if (currentState == FIREFIGHTERS_ARRIVE) {
+                dispatchTrucks();
+            } else if (currentState == ALL_CLEAR) {
+                fireGrid.clear();
+                fluid.clear();
+                waterParticles.clear();
+            }
+            logEvent(transition->event, window);
+        }
+    }
+
+    // Update all elements
+    updateHumans(deltaTime);
+    updateFireTrucks(deltaTime);
+    if (currentState >= FIRE_START && currentState < ALL_CLEAR) {
+        updateWater(deltaTime);
+        updateFire(deltaTime);
+        updateFireParticles(deltaTime);
+
+        // Particles heat the air and feed the smoke
+        fluid.addParticleSources(fireParticles.x, fireParticles.y, fireParticles.life, fireParticles.count, deltaTime);
+        fluid.step(deltaTime, jobs);
+    }
+    updateCrowd(deltaTime);
+    PROFILE_COUNTER("particles", fireParticles.count);
+    PROFILE_COUNTER("water", waterParticles.count);
+    PROFILE_COUNTER("agents", agentsWalking);
+}
@@ -0,0 +1,210 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <vector>
+#include <cstdint>
+
+#include "particle_pool.h"
+#include "particle_kernels.h"
+#include "scene_layout.h"
+#include "fire_grid.h"
+#include "fluid.h"
+#include "rng.h"
+#include "event_log.h"
+#include "spatial_hash.h"
+#include "crowd.h"
+#include "road_network.h"
+#include "dispatch.h"
+
+class JobSystem;
+
+// Default number of fire particles preallocated at startup
+const int DEFAULT_PARTICLE_CAPACITY = 65536;
+
+// Particles each emitter spawns per step
+const int PARTICLES_PER_EMITTER = 5;
+
+// Work split sizes; fixed so results do not depend on the thread count
+const int PARTICLE_CHUNK_SIZE = 16384;
+const int EMITTER_CHUNK_SIZE = 64;
+
+// Random numbers drawn per spawned particle: x, y, speed, life, size
+const int RANDOMS_PER_PARTICLE = 5;
+
+// Most drops a truck launches in one step
+const int MAX_DROPS_PER_STEP = 256;
+
+// Crew walking speed in units per second
+const float HUMAN_WALK_SPEED = 30.0f;
+
+// Trucks are this long and line up at a fire this far apart along the road
+const float TRUCK_LENGTH = 60.0f;
+const float TRUCK_SPACING = 70.0f;
+
+// The front truck parks this far west of a burning building
+const float TRUCK_PARK_OFFSET = 50.0f;
+
+// Seconds the alarm light stays on, then off
+const float ALARM_BLINK_SECONDS = 0.1f;
+
+// A point that spawns fire particles every step, e.g. a burning window
+struct ParticleEmitter {
+    float x, y;
+};
+
+// A truck on the road network. It drives from node to node by the route
+// tables, toward a point on a road: the fire, or its station.
+struct FireTruck {
+    float x, y;           // Left end on the road map; drawn at x while on the street
+    int node;             // Last node reached
+    int nextNode;         // Node it drives toward, node itself while standing
+    float travelled;      // From node toward nextNode
+    RoadPoint destination; // Entered from destination.from
+    int slot;             // Place in line at the fire, 0 in front
+    int leader;           // Truck one slot ahead, -1 for none
+    bool dispatched;      // Sent out and not back at its station yet
+    bool arrived;
+    bool spraying;
+    bool leaving;
+    bool facingLeft;
+    int target; // Burning window the hose is on, -1 for none
+};
+
+// Simulation states
+enum SimState {
+    NORMAL,
+    FIRE_START,
+    ALARM,
+    HUMANS_ARRIVE,
+    FIREFIGHTERS_ARRIVE,
+    EXTINGUISHING,
+    ALL_CLEAR,
+    TRUCKS_LEAVING
+};
+
+// Owns all simulation state. No GL, GLUT or sound calls in here, so it can be
+// stepped headless as fast as the CPU allows.
+class Simulation {
+public:
+    Simulation();
+
+    void reset();
+
+    // Replaces buildings, trucks and timings, rebuilds the layout and resets
+    void setScene(const Scene& newScene);
+
+    // Preallocates particle storage; live particles are dropped
+    void setParticleCapacity(int capacity);
+    void setWaterCapacity(int capacity);
+    void setCrowdCapacity(int capacity);
+
+    // Occupants who leave each building that catches fire, up to what it holds
+    void setOccupants(int perBuilding);
+
+    // KERNEL_AUTO picks the fastest kernel the CPU supports
+    void setParticleKernel(ParticleKernel kernel);
+
+    // Smoke grid width in cells, the height follows the scene; 0 turns it off
+    void setFluidResolution(int width);
+
+    // Particle work is split across jobs when set; nullptr runs inline
+    void setJobSystem(JobSystem* jobSystem);
+
+    // Seeds every random stream and resets; the same seed and scene give
+    // bit-identical runs
+    void setSeed(uint64_t newSeed);
+
+    // Advance the simulation by deltaTime seconds
+    void step(float deltaTime);
+
+    // Every burning window spawns PARTICLES_PER_EMITTER particles, as a
+    // step does after moving the live ones
+    void emitFromBurningWindows();
+
+    // Sends building's occupants out, once per building and run; a step
+    // does this for every burning building after the alarm
+    void evacuate(int building);
+
+    // Moves every agent one step through the neighbor grid, as a step does
+    void moveCrowd(float deltaTime);
+
+    // Everything a step depends on: state, clock, trucks, crew, occupants,
+    // particles, fire, smoke and random streams. Loading it into a
+    // simulation with the same scene and settings continues exactly as the
+    // saved one would.
+    // Returns false and changes nothing if the settings differ; damaged
+    // data leaves the simulation reset.
+    void saveState(std::vector<unsigned char>& out) const;
+    bool loadState(const unsigned char* data, size_t size);
+
+    // FNV-1a hash over the simulation state, for comparing runs bit for bit
+    uint64_t stateHash() const;
+
+    // Drawing between steps: alpha 0 is the state before the last step,
+    // 1 the state after it. Particles keep their own previous positions.
+    float interpolatedTime(float alpha) const;
+    float interpolatedTruckX(int truck, float alpha) const;
+    bool truckOnStreet(int truck) const;
+    float interpolatedHumanPosition(float alpha) const;
+
+    // Blink phase of the alarm light, from the simulated clock
+    bool alarmLightOn() const;
+
+    SimState currentState;
+    float simTime;
+    ParticlePool fireParticles;
+    ParticlePool waterParticles; // Drops from the hoses
+    SpatialHash dropHash;        // Water drops, rebuilt every step
+    CrowdAgents crowd;           // Occupants on their way out
+    SpatialHash agentHash;       // Agents, rebuilt every step they move
+    std::vector<unsigned char> agentPhases; // Copied with the hash, for neighbors
+    std::vector<char> evacuated; // Per building, occupants sent out
+    int agentsWalking;           // Agents not yet safe
+    int occupantsPerBuilding;
+    EventLog events; // Lock-free ring; readers may run on other threads
+    uint64_t firstEvent; // Sequence of this run's first event, since the last reset
+    int fireOrigin; // First window set on fire, index into layout.windows; -1 before
+    float fireStartTime;
+    std::vector<FireTruck> trucks;
+    float humanPosition;
+    float humanStopX; // Crew gathers in front of the main building
+    float previousSimTime;
+    std::vector<float> previousTruckX;
+    float previousHumanPosition;
+    ParticleKernel particleKernel;
+    Scene scene;
+    SceneLayout layout;
+    RoadNetwork roads;     // Built with the scene, with its route tables
+    Dispatcher dispatcher; // Which trucks are free
+    FireGrid fireGrid;
+    FluidSolver fluid;
+    uint64_t seed;
+    long long stepCount;
+
+private:
+    void updateFire(float deltaTime);
+    void updateFireParticles(float deltaTime);
+    void emitParticles();
+    void updateWater(float deltaTime);
+    void launchWater(float deltaTime);
+    int chooseTarget(int truck) const;
+    void dispatchTrucks();
+    void driveTruck(FireTruck& truck, float distance, float stopShort);
+    float distanceLeft(const FireTruck& truck) const;
+    bool validTruck(const FireTruck& truck, int index) const; // Everything it refers to exists
+    void updateFireTrucks(float deltaTime);
+    void updateHumans(float deltaTime);
+    void updateCrowd(float deltaTime);
+    void rememberPreviousStep();
+    void logEvent(EventCode code, int window);
+
+    JobSystem* jobs;
+    std::vector<ParticleEmitter> emitters;
+    SpatialHash windowHash;    // Window centers, for where drops land
+    std::vector<int> waterHits; // Window each drop landed on this step
+    std::vector<DispatchOrder> dispatchOrders;
+    size_t nextIgnition; // Into scene.ignitions, sorted by delay
+    RandomStream placementRandom;
+};
+
+#endif // SIMULATION_H
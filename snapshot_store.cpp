@@ -0,0 +1,269 @@
+#include "snapshot_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "simulation.h"
+#include "profiler.h"
+
+// Zero runs shorter than this stay inside a literal
+static const size_t MIN_ZERO_RUN = 4;
+
+static void appendVarint(std::vector<unsigned char>& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+static bool readVarint(const unsigned char*& p, const unsigned char* end, size_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (size_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Most of the state is 4-byte floats and ints. Grouping byte 0 of every
+// word, then byte 1 and so on puts the sign and exponent bytes, which
+// rarely change between snapshots, next to each other.
+static void splitPlanes(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+    size_t words = in.size() / 4;
+    out.resize(in.size());
+    for (size_t w = 0; w < words; w++) {
+        for (int b = 0; b < 4; b++) {
+            out[b * words + w] = in[w * 4 + b];
+        }
+    }
+    std::copy(in.begin() + words * 4, in.end(), out.begin() + words * 4);
+}
+
+static void joinPlanes(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+    size_t words = in.size() / 4;
+    out.resize(in.size());
+    for (size_t w = 0; w < words; w++) {
+        for (int b = 0; b < 4; b++) {
+            out[w * 4 + b] = in[b * words + w];
+        }
+    }
+    std::copy(in.begin() + words * 4, in.end(), out.begin() + words * 4);
+}
+
+// Total size, then pairs of (zero run, literal length, literal bytes)
+static void encodeRuns(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    out.clear();
+    appendVarint(out, size);
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = i;
+        while (zeros < size && data[zeros] == 0) zeros++;
+        size_t literal = zeros;
+        while (literal < size) {
+            size_t run = literal;
+            while (run < size && run - literal < MIN_ZERO_RUN && data[run] == 0) run++;
+            if (run - literal == MIN_ZERO_RUN || run == size) break;
+            literal = run + 1;
+        }
+        appendVarint(out, zeros - i);
+        appendVarint(out, literal - zeros);
+        out.insert(out.end(), data + zeros, data + literal);
+        i = literal;
+    }
+}
+
+static bool decodeRuns(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+    const unsigned char* p = in.data();
+    const unsigned char* end = p + in.size();
+    size_t size = 0;
+    if (!readVarint(p, end, size)) return false;
+    out.assign(size, 0);
+    size_t i = 0;
+    while (p < end) {
+        size_t zeros = 0, literal = 0;
+        if (!readVarint(p, end, zeros) || !readVarint(p, end, literal)) return false;
+        if (zeros > size - i || literal > size - i - zeros || literal > (size_t)(end - p)) return false;
+        i += zeros;
+        std::copy(p, p + literal, out.begin() + i);
+        p += literal;
+        i += literal;
+    }
+    return true;
+}
+
+SnapshotStore::SnapshotStore()
+    : interval(DEFAULT_SNAPSHOT_INTERVAL), budget(DEFAULT_SNAPSHOT_BUDGET), stored(0), raw(0) {
+}
+
+void SnapshotStore::configure(float intervalSeconds, size_t budgetBytes) {
+    interval = std::max(intervalSeconds, 0.0f);
+    budget = budgetBytes;
+    clear();
+}
+
+void SnapshotStore::clear() {
+    snapshots.clear();
+    previous.clear();
+    stored = 0;
+    raw = 0;
+}
+
+float SnapshotStore::earliestTime() const {
+    return snapshots.empty() ? 0.0f : snapshots.front().time;
+}
+
+float SnapshotStore::latestTime() const {
+    return snapshots.empty() ? 0.0f : snapshots.back().time;
+}
+
+void SnapshotStore::update(const Simulation& sim) {
+    if (!snapshots.empty() && sim.simTime < snapshots.back().time) {
+        clear();
+    }
+    if (snapshots.empty() || sim.simTime >= snapshots.back().time + interval) {
+        capture(sim);
+    }
+}
+
+void SnapshotStore::capture(const Simulation& sim) {
+    PROFILE_SCOPE("SnapshotStore::capture");
+    current.clear();
+    sim.saveState(current);
+
+    int sinceKeyframe = 0;
+    for (int i = (int)snapshots.size() - 1; i >= 0 && !snapshots[i].keyframe; i--) {
+        sinceKeyframe++;
+    }
+
+    Snapshot snapshot;
+    snapshot.time = sim.simTime;
+    snapshot.rawSize = current.size();
+    snapshot.keyframe = snapshots.empty() || sinceKeyframe + 1 >= SNAPSHOT_KEYFRAME_INTERVAL;
+    delta = current;
+    if (!snapshot.keyframe) {
+        for (size_t i = 0; i < std::min(delta.size(), previous.size()); i++) {
+            delta[i] ^= previous[i];
+        }
+    }
+    splitPlanes(delta, scratch);
+    encodeRuns(scratch.data(), scratch.size(), snapshot.data);
+    snapshot.data.shrink_to_fit();
+
+    stored += snapshot.data.size();
+    raw += snapshot.rawSize;
+    snapshots.push_back(std::move(snapshot));
+    previous.swap(current);
+    evict();
+}
+
+bool SnapshotStore::rebuild(int index, std::vector<unsigned char>& out) {
+    int keyframe = index;
+    while (keyframe > 0 && !snapshots[keyframe].keyframe) keyframe--;
+    if (!decodeRuns(snapshots[keyframe].data, scratch)) return false;
+    joinPlanes(scratch, out);
+    for (int i = keyframe + 1; i <= index; i++) {
+        if (!decodeRuns(snapshots[i].data, scratch)) return false;
+        joinPlanes(scratch, delta);
+        for (size_t j = 0; j < std::min(delta.size(), out.size()); j++) {
+            delta[j] ^= out[j];
+        }
+        out.swap(delta);
+    }
+    return true;
+}
+
+bool SnapshotStore::restore(Simulation& sim, float time) {
+    PROFILE_SCOPE("SnapshotStore::restore");
+    if (snapshots.empty()) return false;
+
+    int index = 0;
+    while (index + 1 < (int)snapshots.size() && snapshots[index + 1].time <= time) index++;
+    if (!rebuild(index, current) || !sim.loadState(current.data(), current.size())) {
+        return false;
+    }
+
+    // The future is taken again from here
+    snapshots.erase(snapshots.begin() + index + 1, snapshots.end());
+    previous.swap(current);
+    recount();
+    return true;
+}
+
+// Drops whole keyframe groups from the front, never the newest one
+void SnapshotStore::evict() {
+    while (stored > budget) {
+        size_t next = 1;
+        while (next < snapshots.size() && !snapshots[next].keyframe) next++;
+        if (next >= snapshots.size()) break;
+        snapshots.erase(snapshots.begin(), snapshots.begin() + next);
+        recount();
+    }
+}
+
+void SnapshotStore::recount() {
+    stored = 0;
+    raw = 0;
+    for (const Snapshot& snapshot : snapshots) {
+        stored += snapshot.data.size();
+        raw += snapshot.rawSize;
+    }
+}
+
+static const char STATE_FILE_MAGIC[8] = {'F', 'I', 'R', 'E', 'S', 'N', 'P', '1'};
+
+bool writeStateFile(const char* path, const Simulation& sim) {
+    std::vector<unsigned char> bytes;
+    sim.saveState(bytes);
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("ERROR: Cannot write '%s'\n", path);
+        return false;
+    }
+    bool ok = fwrite(STATE_FILE_MAGIC, 1, sizeof(STATE_FILE_MAGIC), file) == sizeof(STATE_FILE_MAGIC) &&
+              fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        printf("ERROR: Failed writing '%s'\n", path);
+    }
+    return ok;
+}
+
+bool readStateFile(const char* path, Simulation& sim) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("ERROR: Cannot open '%s'\n", path);
+        return false;
+    }
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + got);
+    }
+    fclose(file);
+
+    size_t magic = sizeof(STATE_FILE_MAGIC);
+    if (bytes.size() < magic || memcmp(bytes.data(), STATE_FILE_MAGIC, magic) != 0) {
+        printf("ERROR: '%s' is not a state file\n", path);
+        return false;
+    }
+    if (!sim.loadState(bytes.data() + magic, bytes.size() - magic)) {
+        printf("ERROR: '%s' was saved with a different scene, --fluid or --particle-capacity\n", path);
+        return false;
+    }
+    return true;
+}
+
+void seekSimulation(Simulation& sim, SnapshotStore* store, float time, float dt) {
+    PROFILE_SCOPE("seekSimulation");
+    if (time < sim.simTime && !(store && store->restore(sim, time))) {
+        sim.reset();
+    }
+    while (sim.simTime + dt * 0.5f < time) {
+        sim.step(dt);
+        if (store) store->update(sim);
+    }
+}
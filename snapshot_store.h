@@ -0,0 +1,82 @@
+#ifndef SNAPSHOT_STORE_H
+#define SNAPSHOT_STORE_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+class Simulation;
+
+// Sim seconds between snapshots and memory they may use, by default
+const float DEFAULT_SNAPSHOT_INTERVAL = 1.0f;
+const size_t DEFAULT_SNAPSHOT_BUDGET = 64u << 20;
+
+// Every this many snapshots one is stored whole; the ones in between are
+// deltas, so restoring decodes at most this many
+const int SNAPSHOT_KEYFRAME_INTERVAL = 10;
+
+// Simulation states taken every interval sim seconds, for seeking back.
+// A keyframe holds Simulation::saveState() split into byte planes and
+// run-length coded (zero runs and literals); the snapshots after it hold
+// the XOR with the one before, coded the same way, so whatever did not
+// change costs a few bytes. When the budget is exceeded the oldest
+// keyframe and its deltas go first.
+class SnapshotStore {
+public:
+    SnapshotStore();
+
+    void configure(float intervalSeconds, size_t budgetBytes);
+    void clear();
+
+    // Call after every step: snapshots once interval sim seconds passed
+    // since the last one. A simulation that went back in time (a reset)
+    // starts the store over.
+    void update(const Simulation& sim);
+    void capture(const Simulation& sim);
+
+    // Loads the latest snapshot at or before time, or the earliest kept if
+    // time is before it, and drops the ones after it. False if there is
+    // none or it does not load.
+    bool restore(Simulation& sim, float time);
+
+    int count() const { return (int)snapshots.size(); }
+    size_t storedBytes() const { return stored; }
+    size_t rawBytes() const { return raw; }       // The same snapshots uncompressed
+    float earliestTime() const;
+    float latestTime() const;
+
+private:
+    struct Snapshot {
+        float time;
+        bool keyframe;
+        size_t rawSize;
+        std::vector<unsigned char> data;
+    };
+
+    // Decodes snapshot index from its keyframe on into out
+    bool rebuild(int index, std::vector<unsigned char>& out);
+    void evict();
+    void recount();
+
+    float interval;
+    size_t budget;
+    std::deque<Snapshot> snapshots;
+    size_t stored, raw;
+
+    std::vector<unsigned char> previous; // Raw state of the newest snapshot
+    std::vector<unsigned char> current;
+    std::vector<unsigned char> delta;
+    std::vector<unsigned char> scratch;
+};
+
+// A single state in a file: "FIRESNP1", then Simulation::saveState() as
+// is. Loading needs the same scene and settings (--scene, --fluid,
+// --particle-capacity).
+bool writeStateFile(const char* path, const Simulation& sim);
+bool readStateFile(const char* path, Simulation& sim);
+
+// Moves the simulation to time: back by restoring from the store (or from
+// the start without one), then forward in dt steps, snapshotting on the way.
+void seekSimulation(Simulation& sim, SnapshotStore* store, float time, float dt);
+
+#endif // SNAPSHOT_STORE_H
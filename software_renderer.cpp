@@ -0,0 +1,349 @@
+#include "software_renderer.h"
+
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include "simulation.h"
+#include "scene.h"
+#include "scene_layout.h"
+#include "job_system.h"
+#include "profiler.h"
+
+// Scene units across the frame, as in the window's gluOrtho2D
+const float SCENE_WIDTH = 800.0f;
+const float SCENE_HEIGHT = 500.0f;
+
+// glClearColor of the window, under anything the sky does not cover
+const unsigned char CLEAR_COLOR[4] = {135, 207, 250, 255};
+
+void Framebuffer::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    pixels.resize((size_t)width * height * 4);
+}
+
+void captureFrame(const Simulation& sim, bool alarmOn, FrameSnapshot& snapshot) {
+    PROFILE_SCOPE("captureFrame");
+    buildUnderlayBatch(snapshot.underlay, sim);
+    buildOverlayBatch(snapshot.overlay, sim, alarmOn, 1.0f);
+
+    // Water drops after the fire, in the same stream
+    const ParticlePool& fire = sim.fireParticles;
+    const ParticlePool& water = sim.waterParticles;
+    bool fireVisible = sim.currentState >= FIRE_START && sim.currentState < ALL_CLEAR;
+    int fireCount = fireVisible ? fire.count : 0;
+    int waterCount = fireVisible ? water.count : 0;
+    snapshot.particles.resize((size_t)(fireCount + waterCount) * 4);
+    if (fireCount > 0) {
+        writeParticleQuads(fire, LOOK_FIRE, snapshot.particles.data(), 0, fireCount, 1.0f);
+    }
+    if (waterCount > 0) {
+        writeParticleQuads(water, LOOK_WATER, snapshot.particles.data() + (size_t)fireCount * 4, 0, waterCount, 1.0f);
+    }
+
+    snapshot.agents.resize((size_t)sim.crowd.count * 4);
+    writeAgentQuads(sim.crowd, snapshot.agents.data(), 0, sim.crowd.count, 1.0f);
+
+    snapshot.simTime = sim.simTime;
+    snapshot.state = (int)sim.currentState;
+}
+
+SoftwareRenderer::SoftwareRenderer()
+    : width(0), height(0), tilesX(0), tilesY(0), scaleX(1.0f), scaleY(1.0f), overlayFirst(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void SoftwareRenderer::setSize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    tilesX = (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    tilesY = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    scaleX = width / SCENE_WIDTH;
+    scaleY = height / SCENE_HEIGHT;
+    tileTriangles.resize(tilesX * tilesY);
+    tileSprites.resize(tilesX * tilesY);
+}
+
+void SoftwareRenderer::setScene(const Scene& scene, const SceneLayout& layout) {
+    VertexBatch batch;
+    buildStaticBatch(batch, scene, layout);
+
+    triangles.clear();
+    sprites.clear();
+    addBatch(batch);
+    overlayFirst = (int)triangles.size();
+    binPrimitives();
+
+    background.resize(width, height);
+    drawTiles(nullptr, background, nullptr);
+}
+
+void SoftwareRenderer::render(const FrameSnapshot& snapshot, Framebuffer& target, JobSystem* jobs) {
+    PROFILE_SCOPE("SoftwareRenderer::render");
+    auto start = std::chrono::steady_clock::now();
+
+    triangles.clear();
+    sprites.clear();
+    addBatch(snapshot.underlay);
+    overlayFirst = (int)triangles.size();
+    addQuads(snapshot.agents);
+    addBatch(snapshot.overlay);
+    addParticles(snapshot.particles);
+    binPrimitives();
+
+    target.resize(width, height);
+    target.bottomUp = false;
+    drawTiles(&background, target, jobs);
+
+    stats.triangles = (int)triangles.size();
+    stats.particles = (int)sprites.size();
+    stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SoftwareRenderer::addBatch(const VertexBatch& batch) {
+    for (const VertexBatch::Command& command : batch.commands) {
+        const Vertex* v = batch.vertices.data() + command.first;
+        if (command.mode == BATCH_LINES) {
+            for (int i = 0; i + 1 < command.count; i += 2) {
+                addLine(v[i], v[i + 1], command.lineWidth);
+            }
+        } else {
+            for (int i = 0; i + 2 < command.count; i += 3) {
+                addTriangle(v[i], v[i + 1], v[i + 2]);
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::addTriangle(const Vertex& a, const Vertex& b, const Vertex& c) {
+    const Vertex* corners[3] = {&a, &b, &c};
+    Triangle t;
+    for (int i = 0; i < 3; i++) {
+        const Vertex& v = *corners[i];
+        t.x[i] = v.x * scaleX;
+        t.y[i] = v.y * scaleY;
+        t.color[i][0] = v.r;
+        t.color[i][1] = v.g;
+        t.color[i][2] = v.b;
+        t.color[i][3] = v.a;
+    }
+    triangles.push_back(t);
+}
+
+void SoftwareRenderer::addLine(const Vertex& a, const Vertex& b, float lineWidth) {
+    // A quad lineWidth pixels wide, centered on the line
+    float dx = (b.x - a.x) * scaleX;
+    float dy = (b.y - a.y) * scaleY;
+    float length = sqrtf(dx * dx + dy * dy);
+    if (length <= 0.0f) return;
+
+    float half = 0.5f * lineWidth * std::min(scaleX, scaleY);
+    float nx = -dy / length * half / scaleX;
+    float ny = dx / length * half / scaleY;
+
+    Vertex a0 = a, a1 = a, b0 = b, b1 = b;
+    a0.x += nx; a0.y += ny;
+    a1.x -= nx; a1.y -= ny;
+    b0.x += nx; b0.y += ny;
+    b1.x -= nx; b1.y -= ny;
+    addTriangle(a0, b0, b1);
+    addTriangle(a0, b1, a1);
+}
+
+void SoftwareRenderer::addParticles(const std::vector<Vertex>& quads) {
+    // Corners 0 and 2 are opposite; every corner has the same color
+    for (size_t i = 0; i + 3 < quads.size(); i += 4) {
+        const Vertex& topLeft = quads[i];
+        const Vertex& bottomRight = quads[i + 2];
+        if (topLeft.a == 0) continue;
+
+        Sprite s;
+        s.left = topLeft.x * scaleX;
+        s.top = topLeft.y * scaleY;
+        s.right = bottomRight.x * scaleX;
+        s.bottom = bottomRight.y * scaleY;
+        s.color[0] = topLeft.r;
+        s.color[1] = topLeft.g;
+        s.color[2] = topLeft.b;
+        s.color[3] = topLeft.a;
+        sprites.push_back(s);
+    }
+}
+
+void SoftwareRenderer::addQuads(const std::vector<Vertex>& quads) {
+    for (size_t i = 0; i + 3 < quads.size(); i += 4) {
+        addTriangle(quads[i], quads[i + 1], quads[i + 2]);
+        addTriangle(quads[i], quads[i + 2], quads[i + 3]);
+    }
+}
+
+// Tiles touched by a box in pixels; false when it is outside the frame
+static bool tileRange(float left, float top, float right, float bottom, int tilesX, int tilesY,
+                      int& x0, int& y0, int& x1, int& y1) {
+    x0 = std::max(0, (int)floorf(left) / RENDER_TILE_SIZE);
+    y0 = std::max(0, (int)floorf(top) / RENDER_TILE_SIZE);
+    x1 = std::min(tilesX - 1, (int)floorf(right) / RENDER_TILE_SIZE);
+    y1 = std::min(tilesY - 1, (int)floorf(bottom) / RENDER_TILE_SIZE);
+    return right >= 0.0f && bottom >= 0.0f && x0 <= x1 && y0 <= y1;
+}
+
+void SoftwareRenderer::binPrimitives() {
+    for (std::vector<int>& bin : tileTriangles) bin.clear();
+    for (std::vector<int>& bin : tileSprites) bin.clear();
+
+    int x0, y0, x1, y1;
+    for (int i = 0; i < (int)triangles.size(); i++) {
+        const Triangle& t = triangles[i];
+        float left = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+        float right = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+        float top = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+        float bottom = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+        if (!tileRange(left, top, right, bottom, tilesX, tilesY, x0, y0, x1, y1)) continue;
+        for (int ty = y0; ty <= y1; ty++) {
+            for (int tx = x0; tx <= x1; tx++) {
+                tileTriangles[ty * tilesX + tx].push_back(i);
+            }
+        }
+    }
+    for (int i = 0; i < (int)sprites.size(); i++) {
+        const Sprite& s = sprites[i];
+        if (!tileRange(s.left, s.top, s.right, s.bottom, tilesX, tilesY, x0, y0, x1, y1)) continue;
+        for (int ty = y0; ty <= y1; ty++) {
+            for (int tx = x0; tx <= x1; tx++) {
+                tileSprites[ty * tilesX + tx].push_back(i);
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::drawTiles(const Framebuffer* source, Framebuffer& target, JobSystem* jobs) {
+    parallelFor(jobs, tilesX * tilesY, 1, [&](int begin, int end, int) {
+        for (int tile = begin; tile < end; tile++) {
+            drawTile(tile, source, target);
+        }
+    });
+}
+
+// Pixels of [x0, x1) x [y0, y1) whose centers are inside t, top-left rule
+// on shared edges so neighbors never both draw a pixel
+static void drawTriangle(const SoftwareRenderer::Triangle& t, Framebuffer& target,
+                         int x0, int y0, int x1, int y1) {
+    float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+    if (area == 0.0f) return;
+
+    // Edge i is opposite vertex i: w = a * x + b * y + c, positive inside
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    float a[3], b[3], c[3];
+    bool inclusive[3];
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        a[i] = sign * (t.y[j] - t.y[k]);
+        b[i] = sign * (t.x[k] - t.x[j]);
+        c[i] = sign * (t.x[j] * t.y[k] - t.x[k] * t.y[j]);
+        inclusive[i] = a[i] > 0.0f || (a[i] == 0.0f && b[i] > 0.0f);
+    }
+
+    float left = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+    float right = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+    float top = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+    float bottom = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+    x0 = std::max(x0, (int)floorf(left));
+    x1 = std::min(x1, (int)ceilf(right));
+    y0 = std::max(y0, (int)floorf(top));
+    y1 = std::min(y1, (int)ceilf(bottom));
+    if (x0 >= x1 || y0 >= y1) return;
+
+    bool flat = memcmp(t.color[0], t.color[1], 4) == 0 && memcmp(t.color[0], t.color[2], 4) == 0;
+    float inverseArea = 1.0f / fabsf(area);
+
+    for (int y = y0; y < y1; y++) {
+        float py = y + 0.5f;
+        float px = x0 + 0.5f;
+        float w[3];
+        for (int i = 0; i < 3; i++) {
+            w[i] = a[i] * px + b[i] * py + c[i];
+        }
+        unsigned char* out = target.pixels.data() + ((size_t)y * target.width + x0) * 4;
+
+        for (int x = x0; x < x1; x++, out += 4) {
+            bool inside = true;
+            for (int i = 0; i < 3; i++) {
+                inside = inside && (w[i] > 0.0f || (w[i] == 0.0f && inclusive[i]));
+            }
+            if (inside) {
+                if (flat) {
+                    out[0] = t.color[0][0];
+                    out[1] = t.color[0][1];
+                    out[2] = t.color[0][2];
+                } else {
+                    // w[i] weights vertex i, whose opposite edge it measures
+                    for (int ch = 0; ch < 3; ch++) {
+                        float value = (w[0] * t.color[0][ch] + w[1] * t.color[1][ch] + w[2] * t.color[2][ch]) * inverseArea;
+                        out[ch] = (unsigned char)std::min(255.0f, value + 0.5f);
+                    }
+                }
+                out[3] = 255;
+            }
+            for (int i = 0; i < 3; i++) {
+                w[i] += a[i];
+            }
+        }
+    }
+}
+
+// Additive like GL_SRC_ALPHA, GL_ONE, saturating at white
+static void drawSprite(const SoftwareRenderer::Sprite& s, Framebuffer& target, int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, (int)ceilf(s.left - 0.5f));
+    x1 = std::min(x1, (int)ceilf(s.right - 0.5f));
+    y0 = std::max(y0, (int)ceilf(s.top - 0.5f));
+    y1 = std::min(y1, (int)ceilf(s.bottom - 0.5f));
+    if (x0 >= x1 || y0 >= y1) return;
+
+    int add[3];
+    for (int ch = 0; ch < 3; ch++) {
+        add[ch] = (s.color[ch] * s.color[3] + 127) / 255;
+    }
+    for (int y = y0; y < y1; y++) {
+        unsigned char* out = target.pixels.data() + ((size_t)y * target.width + x0) * 4;
+        for (int x = x0; x < x1; x++, out += 4) {
+            for (int ch = 0; ch < 3; ch++) {
+                int value = out[ch] + add[ch];
+                out[ch] = (unsigned char)(value > 255 ? 255 : value);
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::drawTile(int tile, const Framebuffer* source, Framebuffer& target) const {
+    int x0 = (tile % tilesX) * RENDER_TILE_SIZE;
+    int y0 = (tile / tilesX) * RENDER_TILE_SIZE;
+    int x1 = std::min(width, x0 + RENDER_TILE_SIZE);
+    int y1 = std::min(height, y0 + RENDER_TILE_SIZE);
+
+    size_t rowBytes = (size_t)(x1 - x0) * 4;
+    for (int y = y0; y < y1; y++) {
+        unsigned char* out = target.pixels.data() + ((size_t)y * width + x0) * 4;
+        if (source) {
+            memcpy(out, source->pixels.data() + ((size_t)y * width + x0) * 4, rowBytes);
+        } else {
+            for (int x = x0; x < x1; x++, out += 4) {
+                memcpy(out, CLEAR_COLOR, 4);
+            }
+        }
+    }
+
+    // Bins hold indices in painter's order: underlay, particles, overlay
+    const std::vector<int>& binTriangles = tileTriangles[tile];
+    size_t next = 0;
+    while (next < binTriangles.size() && binTriangles[next] < overlayFirst) {
+        drawTriangle(triangles[binTriangles[next++]], target, x0, y0, x1, y1);
+    }
+    for (int i : tileSprites[tile]) {
+        drawSprite(sprites[i], target, x0, y0, x1, y1);
+    }
+    while (next < binTriangles.size()) {
+        drawTriangle(triangles[binTriangles[next++]], target, x0, y0, x1, y1);
+    }
+}
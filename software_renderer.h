@@ -0,0 +1,109 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <vector>
+
+#include "scene_batches.h"
+
+class Simulation;
+class SceneLayout;
+struct Scene;
+class JobSystem;
+
+// Square tiles the frame is split into; one tile is one job
+const int RENDER_TILE_SIZE = 64;
+
+// 8-bit RGBA pixels, rows top to bottom unless bottomUp, as glReadPixels
+// leaves them. Alpha is not used.
+struct Framebuffer {
+    int width;
+    int height;
+    bool bottomUp;
+    std::vector<unsigned char> pixels;
+
+    Framebuffer() : width(0), height(0), bottomUp(false) {}
+    void resize(int newWidth, int newHeight);
+};
+
+// Everything the software renderer needs from one simulation step, copied
+// so the simulation can go on stepping while the frame is drawn
+struct FrameSnapshot {
+    VertexBatch underlay;
+    VertexBatch overlay;
+    std::vector<Vertex> particles; // Four corners per particle, like the GL stream
+    std::vector<Vertex> agents;    // Four corners per occupant, opaque
+    float simTime;
+    int state;
+};
+
+// Fills snapshot from the simulation's current state. Storage is reused, so
+// a snapshot that has seen a frame as large does not touch the heap.
+void captureFrame(const Simulation& sim, bool alarmOn, FrameSnapshot& snapshot);
+
+struct SoftwareRenderStats {
+    int triangles;
+    int particles;
+    double milliseconds;
+};
+
+// Rasterizes the same batches as BatchRenderer into a CPU framebuffer, for
+// machines without a GPU or a display. The static layer is drawn once into
+// a background; every frame copies it and draws the underlay, additive
+// particles, occupants and the overlay on top. The frame is cut into tiles and each
+// tile is drawn start to finish by one job, so no two jobs touch a pixel.
+//
+// Triangles follow GL's rules: pixel centers, top-left fill, colors
+// interpolated across the triangle. Lines become quads as wide as their
+// line width. Batches are opaque, as GL draws them with blending off.
+// The HUD is not drawn.
+class SoftwareRenderer {
+public:
+    SoftwareRenderer();
+
+    // Output size in pixels; the scene's 800x500 units are scaled to fit
+    void setSize(int width, int height);
+
+    // Draws the static layer; the scene must not change while rendering
+    void setScene(const Scene& scene, const SceneLayout& layout);
+
+    void render(const FrameSnapshot& snapshot, Framebuffer& target, JobSystem* jobs);
+
+    SoftwareRenderStats stats;
+
+    // A triangle in pixel space, with its vertex colors
+    struct Triangle {
+        float x[3], y[3];
+        unsigned char color[3][4];
+    };
+
+    // An additive particle rectangle in pixel space
+    struct Sprite {
+        float left, top, right, bottom;
+        unsigned char color[4];
+    };
+
+private:
+    void addBatch(const VertexBatch& batch);
+    void addTriangle(const Vertex& a, const Vertex& b, const Vertex& c);
+    void addLine(const Vertex& a, const Vertex& b, float lineWidth);
+    void addParticles(const std::vector<Vertex>& quads);
+    void addQuads(const std::vector<Vertex>& quads);
+    void binPrimitives();
+    void drawTiles(const Framebuffer* background, Framebuffer& target, JobSystem* jobs);
+    void drawTile(int tile, const Framebuffer* background, Framebuffer& target) const;
+
+    int width, height;
+    int tilesX, tilesY;
+    float scaleX, scaleY; // Pixels per scene unit
+
+    Framebuffer background;
+
+    // Rebuilt every frame, capacity kept
+    std::vector<Triangle> triangles;
+    std::vector<Sprite> sprites;
+    int overlayFirst; // Triangles before this are under the particles
+    std::vector<std::vector<int> > tileTriangles;
+    std::vector<std::vector<int> > tileSprites;
+};
+
+#endif // SOFTWARE_RENDERER_H
@@ -0,0 +1,98 @@
+#include "spatial_hash.h"
+#include "job_system.h"
+#include "profiler.h"
+
+SpatialHash::SpatialHash() : inverseCellSize(1.0f), mask(0), maxPoints(0), points(0) {
+}
+
+void SpatialHash::setup(float cellSize, int newMaxPoints) {
+    inverseCellSize = 1.0f / std::max(cellSize, 1e-6f);
+    maxPoints = std::max(newMaxPoints, 0);
+    points = 0;
+
+    // About two buckets per point keeps buckets short
+    int buckets = 1024;
+    while (buckets < 2 * maxPoints && buckets < (1 << 30)) {
+        buckets *= 2;
+    }
+    mask = buckets - 1;
+
+    pointBucket.assign(maxPoints, 0);
+    sortedPoints.assign(maxPoints, 0);
+    entries.assign(maxPoints, Entry{0.0f, 0.0f, 0});
+    bucketStart.assign(buckets + 1, 0);
+    blockSums.assign((buckets + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE + 1, 0);
+    bucketFill.reset(new std::atomic<int>[buckets]);
+    for (int b = 0; b < buckets; b++) {
+        bucketFill[b].store(0, std::memory_order_relaxed);
+    }
+}
+
+void SpatialHash::build(const float* x, const float* y, int count, JobSystem* jobs) {
+    PROFILE_SCOPE("SpatialHash::build");
+    points = std::max(0, std::min(count, maxPoints));
+    int buckets = mask + 1;
+    int blocks = (buckets + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE;
+
+    // Count points per bucket; counts were left at zero by the last build
+    parallelFor(jobs, points, HASH_CHUNK_SIZE, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            int bucket = bucketOf(cellCoordinate(x[i]), cellCoordinate(y[i]));
+            pointBucket[i] = bucket;
+            bucketFill[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // Prefix sum: each block's total, the blocks in order, then each
+    // bucket's start, which becomes its write cursor
+    parallelFor(jobs, blocks, 1, [&](int begin, int, int) {
+        int first = begin * HASH_BLOCK_SIZE;
+        int last = std::min(buckets, first + HASH_BLOCK_SIZE);
+        int sum = 0;
+        for (int b = first; b < last; b++) {
+            sum += bucketFill[b].load(std::memory_order_relaxed);
+        }
+        blockSums[begin + 1] = sum;
+    });
+    blockSums[0] = 0;
+    for (int i = 0; i < blocks; i++) {
+        blockSums[i + 1] += blockSums[i];
+    }
+    parallelFor(jobs, blocks, 1, [&](int begin, int, int) {
+        int first = begin * HASH_BLOCK_SIZE;
+        int last = std::min(buckets, first + HASH_BLOCK_SIZE);
+        int start = blockSums[begin];
+        for (int b = first; b < last; b++) {
+            int size = bucketFill[b].load(std::memory_order_relaxed);
+            bucketStart[b] = start;
+            bucketFill[b].store(start, std::memory_order_relaxed);
+            start += size;
+        }
+    });
+    bucketStart[buckets] = points;
+
+    // Scatter, in whatever order the threads get there
+    parallelFor(jobs, points, HASH_CHUNK_SIZE, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            int slot = bucketFill[pointBucket[i]].fetch_add(1, std::memory_order_relaxed);
+            sortedPoints[slot] = i;
+        }
+    });
+
+    // Put each bucket in index order, copy the positions alongside and zero
+    // the counts for the next build
+    parallelFor(jobs, blocks, 1, [&](int begin, int, int) {
+        int first = begin * HASH_BLOCK_SIZE;
+        int last = std::min(buckets, first + HASH_BLOCK_SIZE);
+        for (int b = first; b < last; b++) {
+            bucketFill[b].store(0, std::memory_order_relaxed);
+            if (bucketStart[b + 1] - bucketStart[b] > 1) {
+                std::sort(sortedPoints.begin() + bucketStart[b], sortedPoints.begin() + bucketStart[b + 1]);
+            }
+            for (int k = bucketStart[b]; k < bucketStart[b + 1]; k++) {
+                int point = sortedPoints[k];
+                entries[k] = Entry{x[point], y[point], point};
+            }
+        }
+    });
+}
@@ -0,0 +1,113 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+
+// Points per build job
+const int HASH_CHUNK_SIZE = 16384;
+
+// Table buckets per prefix sum job
+const int HASH_BLOCK_SIZE = 65536;
+
+// Points binned into a uniform grid of square cells, hashed into a fixed
+// table of buckets. build() is a counting sort: count points per bucket,
+// prefix sum, scatter indices, each pass in parallel with atomic counters.
+// Buckets are then sorted by point index, so the result is the same on any
+// number of threads. Positions are copied in bucket order too, so a query
+// reads a few short runs of memory. All memory comes from setup();
+// building never touches the heap.
+//
+// Cells that hash to the same bucket share it, so queries get a superset
+// of the nearby points and must check distances themselves.
+class SpatialHash {
+public:
+    SpatialHash();
+
+    // Cells are cellSize wide, at least the largest query radius; room
+    // for up to maxPoints points
+    void setup(float cellSize, int maxPoints);
+
+    // Rebuilds from count points; points past maxPoints are left out
+    void build(const float* x, const float* y, int count, JobSystem* jobs);
+
+    // Calls visit(point, pointX, pointY) for every point in the 3x3 cells
+    // around (x, y), each once
+    template <typename Visit>
+    void forEachNear(float x, float y, const Visit& visit) const {
+        if (points == 0) return;
+        int cellX = cellCoordinate(x);
+        int cellY = cellCoordinate(y);
+        int rowFirst[3];
+        for (int row = 0; row < 3; row++) {
+            // A row's three cells are buckets first..first + 2, unless they
+            // wrap around the table or overlap a row already visited
+            int first = bucketOf(cellX - 1, cellY + row - 1);
+            rowFirst[row] = first;
+            bool overlaps = first + 2 > mask;
+            for (int other = 0; other < row; other++) {
+                overlaps = overlaps || ((first - rowFirst[other] + 2) & mask) < 5;
+            }
+            if (!overlaps) {
+                visitRange(bucketStart[first], bucketStart[first + 3], visit);
+                continue;
+            }
+            for (int cell = 0; cell < 3; cell++) {
+                int bucket = (first + cell) & mask;
+                bool seen = false;
+                for (int other = 0; other < row; other++) {
+                    seen = seen || ((bucket - rowFirst[other]) & mask) < 3;
+                }
+                if (!seen) {
+                    visitRange(bucketStart[bucket], bucketStart[bucket + 1], visit);
+                }
+            }
+        }
+    }
+
+    int pointCount() const { return points; }
+    int bucketCount() const { return mask + 1; }
+
+private:
+    struct Entry {
+        float x, y;
+        int point;
+    };
+
+    template <typename Visit>
+    void visitRange(int begin, int end, const Visit& visit) const {
+        for (int k = begin; k < end; k++) {
+            const Entry& entry = entries[k];
+            visit(entry.point, entry.x, entry.y);
+        }
+    }
+
+    int cellCoordinate(float v) const {
+        return (int)std::floor(std::max(-1e9f, std::min(1e9f, v * inverseCellSize)));
+    }
+    // Rows start at scattered buckets, cells of a row are consecutive, so
+    // the three cells of a query row are next to each other in memory
+    int bucketOf(int cellX, int cellY) const {
+        unsigned int h = (unsigned int)cellY * 2654435761u + (unsigned int)cellX;
+        return (int)(h & (unsigned int)mask);
+    }
+
+    float inverseCellSize;
+    int mask;
+    int maxPoints;
+    int points;
+
+    std::vector<int> pointBucket;  // Bucket of each point
+    std::vector<int> bucketStart;  // Bucket b is entries[bucketStart[b], bucketStart[b + 1])
+    std::vector<int> sortedPoints; // Scatter target, sorted into entries
+    std::vector<Entry> entries;
+    std::vector<int> blockSums;
+    std::unique_ptr<std::atomic<int>[]> bucketFill; // Counts, then write cursors
+};
+
+#endif // SPATIAL_HASH_H
@@ -0,0 +1,95 @@
+#ifndef STATE_IO_H
+#define STATE_IO_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Flat binary simulation state for snapshots. Values are copied as laid out
+// in memory, so state only loads into a build of the same program with the
+// same scene and settings; Simulation checks the settings before loading.
+class StateWriter {
+public:
+    explicit StateWriter(std::vector<unsigned char>& out) : bytes(out) {}
+
+    void write(const void* data, size_t size) {
+        const unsigned char* begin = static_cast<const unsigned char*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+
+    template <typename T>
+    void value(const T& v) {
+        write(&v, sizeof(v));
+    }
+
+    // A bool as one byte, 0 or 1
+    void flag(bool v) {
+        value((uint8_t)(v ? 1 : 0));
+    }
+
+    // Length first, then the elements
+    template <typename T>
+    void array(const std::vector<T>& v) {
+        value((uint32_t)v.size());
+        write(v.data(), v.size() * sizeof(T));
+    }
+
+private:
+    std::vector<unsigned char>& bytes;
+};
+
+// Reads what StateWriter wrote. Running past the end fails every later
+// read instead of crashing; check ok() once at the end.
+class StateReader {
+public:
+    StateReader(const unsigned char* data, size_t size) : bytes(data), remaining(size), failed(false) {}
+
+    bool read(void* out, size_t size) {
+        if (failed || size > remaining) {
+            failed = true;
+            return false;
+        }
+        memcpy(out, bytes, size);
+        bytes += size;
+        remaining -= size;
+        return true;
+    }
+
+    template <typename T>
+    bool value(T& v) {
+        return read(&v, sizeof(v));
+    }
+
+    // What flag() wrote; any byte but 0 or 1 fails
+    bool flag(bool& v) {
+        uint8_t byte = 0;
+        if (!value(byte) || byte > 1) {
+            failed = true;
+            return false;
+        }
+        v = byte == 1;
+        return true;
+    }
+
+    // Resizes v to the stored length
+    template <typename T>
+    bool array(std::vector<T>& v) {
+        uint32_t size = 0;
+        if (!value(size) || (size_t)size * sizeof(T) > remaining) {
+            failed = true;
+            return false;
+        }
+        v.resize(size);
+        return read(v.data(), (size_t)size * sizeof(T));
+    }
+
+    bool ok() const { return !failed; }
+    bool atEnd() const { return remaining == 0; }
+
+private:
+    const unsigned char* bytes;
+    size_t remaining;
+    bool failed;
+};
+
+#endif // STATE_IO_H
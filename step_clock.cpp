@@ -0,0 +1,43 @@
+#include "step_clock.h"
+
+#include <algorithm>
+
+StepClock::StepClock() : step(1.0 / 60.0), maxSteps(MAX_CATCH_UP_STEPS) {
+    reset();
+}
+
+void StepClock::setStep(double stepSeconds, int maxCatchUpSteps) {
+    step = stepSeconds > 0.0 ? stepSeconds : 1.0 / 60.0;
+    maxSteps = std::max(1, maxCatchUpSteps);
+    reset();
+}
+
+void StepClock::reset() {
+    steps = 0;
+    droppedSteps = 0;
+    accumulator = 0.0;
+}
+
+int StepClock::advance(double elapsedSeconds) {
+    accumulator += std::max(0.0, elapsedSeconds);
+    int due = (int)std::min(accumulator / step, 1e9);
+    int run = std::min(due, maxSteps);
+    accumulator -= run * step;
+
+    // Behind by more than the limit: keep the fraction, drop whole steps
+    if (due > run) {
+        droppedSteps += due - run;
+        accumulator -= (due - run) * step;
+    }
+    steps += run;
+    return run;
+}
+
+float StepClock::alpha(double sinceAdvance) const {
+    double a = (accumulator + std::max(0.0, sinceAdvance)) / step;
+    return (float)std::min(1.0, std::max(0.0, a));
+}
+
+double StepClock::secondsUntilStep() const {
+    return std::max(0.0, step - accumulator);
+}
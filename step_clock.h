@@ -0,0 +1,40 @@
+#ifndef STEP_CLOCK_H
+#define STEP_CLOCK_H
+
+// Steps one update may run to catch up after a slow frame; older time is
+// dropped so the sim slows down instead of spiralling
+const int MAX_CATCH_UP_STEPS = 5;
+
+// Turns real elapsed time into a whole number of fixed simulation steps.
+// Leftover time stays in the accumulator and becomes the interpolation
+// factor for drawing between the last two steps. The sim rate does not
+// depend on how often advance() is called.
+class StepClock {
+public:
+    StepClock();
+
+    void setStep(double stepSeconds, int maxCatchUpSteps);
+    void reset();
+
+    // Adds elapsed seconds; returns how many steps to run now
+    int advance(double elapsedSeconds);
+
+    // 0..1: how far real time is past the last step, sinceAdvance seconds
+    // after the last advance()
+    float alpha(double sinceAdvance) const;
+
+    // Real time until the next step is due
+    double secondsUntilStep() const;
+
+    double stepSeconds() const { return step; }
+
+    long long steps;          // Steps handed out
+    long long droppedSteps;   // Steps skipped by the catch-up limit
+
+private:
+    double step;
+    int maxSteps;
+    double accumulator;
+};
+
+#endif // STEP_CLOCK_H
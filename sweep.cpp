@@ -0,0 +1,342 @@
+#include "sweep.h"
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// P2Quantile
+
+P2Quantile::P2Quantile(double quantile) : p(quantile), samples(0) {
+    for (int i = 0; i < 5; i++) {
+        height[i] = position[i] = desired[i] = increment[i] = 0.0;
+    }
+}
+
+void P2Quantile::add(double value) {
+    // Kept sorted, by insertion, until the markers take over
+    if (samples < P2_EXACT_SAMPLES) {
+        int i = (int)samples++;
+        while (i > 0 && exact[i - 1] > value) {
+            exact[i] = exact[i - 1];
+            i--;
+        }
+        exact[i] = value;
+        return;
+    }
+    if (samples == P2_EXACT_SAMPLES) {
+        startMarkers();
+    }
+    samples++;
+
+    // The cell the value falls in; the end markers stretch to cover it
+    int cell;
+    if (value < height[0]) {
+        height[0] = value;
+        cell = 0;
+    } else if (value >= height[4]) {
+        height[4] = std::max(height[4], value);
+        cell = 3;
+    } else {
+        cell = 0;
+        while (cell < 3 && value >= height[cell + 1]) {
+            cell++;
+        }
+    }
+    for (int i = cell + 1; i < 5; i++) {
+        position[i] += 1.0;
+    }
+    for (int i = 0; i < 5; i++) {
+        desired[i] += increment[i];
+    }
+
+    // Middle markers more than a place off move one place toward where
+    // they should be, parabolically unless that would pass a neighbor
+    for (int i = 1; i < 4; i++) {
+        double offset = desired[i] - position[i];
+        if ((offset >= 1.0 && position[i + 1] - position[i] > 1.0) ||
+            (offset <= -1.0 && position[i - 1] - position[i] < -1.0)) {
+            int direction = offset > 0.0 ? 1 : -1;
+            double moved = parabolic(i, direction);
+            if (height[i - 1] < moved && moved < height[i + 1]) {
+                height[i] = moved;
+            } else {
+                height[i] = linear(i, direction);
+            }
+            position[i] += direction;
+        }
+    }
+}
+
+void P2Quantile::startMarkers() {
+    // Markers at their desired ranks among the exact values, as if P-squared
+    // had seen them all
+    double n = (double)samples;
+    desired[0] = 1.0;
+    desired[1] = 1.0 + (n - 1.0) * p / 2.0;
+    desired[2] = 1.0 + (n - 1.0) * p;
+    desired[3] = 1.0 + (n - 1.0) * (1.0 + p) / 2.0;
+    desired[4] = n;
+    increment[0] = 0.0;
+    increment[1] = p / 2.0;
+    increment[2] = p;
+    increment[3] = (1.0 + p) / 2.0;
+    increment[4] = 1.0;
+    for (int i = 0; i < 5; i++) {
+        double rank = std::floor(desired[i] + 0.5);
+        rank = std::max(rank, i > 0 ? position[i - 1] + 1.0 : 1.0);
+        rank = std::min(rank, n - (4 - i));
+        position[i] = rank;
+        height[i] = exact[(int)rank - 1];
+    }
+}
+
+double P2Quantile::parabolic(int i, double direction) const {
+    return height[i] + direction / (position[i + 1] - position[i - 1]) *
+                           ((position[i] - position[i - 1] + direction) * (height[i + 1] - height[i]) /
+                                (position[i + 1] - position[i]) +
+                            (position[i + 1] - position[i] - direction) * (height[i] - height[i - 1]) /
+                                (position[i] - position[i - 1]));
+}
+
+double P2Quantile::linear(int i, int direction) const {
+    return height[i] + direction * (height[i + direction] - height[i]) / (position[i + direction] - position[i]);
+}
+
+double P2Quantile::value() const {
+    if (samples > P2_EXACT_SAMPLES) return height[2];
+    if (samples == 0) return 0.0;
+
+    // The nearest rank of the values there are
+    int rank = (int)std::floor(p * (samples - 1) + 0.5);
+    return exact[rank];
+}
+
+// MetricSummary
+
+MetricSummary::MetricSummary() : count(0), mean(0.0), min(0.0), max(0.0), p50(0.5), p90(0.9), p99(0.99) {
+}
+
+void MetricSummary::add(double value) {
+    count++;
+    mean += (value - mean) / count;
+    min = count == 1 ? value : std::min(min, value);
+    max = count == 1 ? value : std::max(max, value);
+    p50.add(value);
+    p90.add(value);
+    p99.add(value);
+}
+
+void MetricSummary::percentiles(double& median, double& ninetieth, double& ninetyNinth) const {
+    median = std::min(max, std::max(min, p50.value()));
+    ninetieth = std::min(max, std::max(median, p90.value()));
+    ninetyNinth = std::min(max, std::max(ninetieth, p99.value()));
+}
+
+// Runs
+
+Scene sweepScene(const Scene& base, const SweepParameters& parameters) {
+    Scene scene = base;
+    for (TruckDesc& truck : scene.trucks) {
+        truck.arriveSpeed *= parameters.truckSpeed;
+        truck.leaveSpeed *= parameters.truckSpeed;
+    }
+    ScenarioTimings& t = scene.timings;
+    float scale = parameters.timingScale;
+    t = {t.fireStart * scale, t.alarm * scale, t.crewArrive * scale, t.firefightersArrive * scale,
+         t.extinguishing * scale, t.allClear * scale, t.trucksLeaving * scale};
+    return scene;
+}
+
+void measureRun(Simulation& sim, float timeStep, float maxSeconds, SweepRun& run) {
+    run.trucksParked = -1.0f;
+    run.allClear = -1.0f;
+    run.peakParticles = 0;
+    run.peakBurning = 0;
+    run.steps = 0;
+
+    while (sim.simTime < maxSeconds && sim.currentState < ALL_CLEAR) {
+        sim.step(timeStep);
+        run.steps++;
+        run.peakParticles = std::max(run.peakParticles, sim.fireParticles.count);
+        run.peakBurning = std::max(run.peakBurning, (int)sim.fireGrid.burningWindows().size());
+
+        bool parked = false;
+        for (const FireTruck& truck : sim.trucks) {
+            parked = parked || truck.arrived;
+        }
+        for (const FireTruck& truck : sim.trucks) {
+            parked = parked && (truck.arrived || !truck.dispatched);
+        }
+        if (parked && run.trucksParked < 0.0f) {
+            run.trucksParked = sim.simTime;
+        }
+    }
+    if (sim.currentState >= ALL_CLEAR) {
+        run.allClear = sim.simTime;
+    }
+    run.hash = sim.stateHash();
+}
+
+long long runSweep(const SweepConfig& config, const std::function<void(const SweepRun&)>& onRun) {
+    long long total = (long long)config.parameterSets.size() * std::max(0, config.runsPerSet);
+    if (total == 0) return 0;
+    int threads = config.threads > 0 ? config.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    threads = (int)std::min<long long>(threads, total);
+
+    std::vector<Scene> scenes;
+    for (const SweepParameters& parameters : config.parameterSets) {
+        scenes.push_back(sweepScene(config.scene, parameters));
+    }
+
+    // Finished runs wait in a ring until every run before them is reported
+    const int window = threads * SWEEP_RESULTS_PER_THREAD;
+    std::vector<SweepRun> finished(window);
+    std::vector<char> ready(window, 0);
+    long long next = 0;
+    long long reported = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // Each worker reuses one simulation; its buffers are allocated once
+    auto work = [&]() {
+        Simulation sim;
+        sim.setParticleCapacity(config.particleCapacity);
+        sim.setCrowdCapacity(config.crowdCapacity);
+        sim.setOccupants(config.occupants);
+        sim.setParticleKernel(config.kernel);
+        sim.setFluidResolution(config.fluidResolution);
+        int sceneSet = -1;
+        for (;;) {
+            long long index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return next >= total || next < reported + window; });
+                if (next >= total) return;
+                index = next++;
+            }
+
+            SweepRun run;
+            run.index = index;
+            run.parameterSet = (int)(index / config.runsPerSet);
+            run.seed = config.firstSeed + (uint64_t)(index % config.runsPerSet);
+            if (run.parameterSet != sceneSet) {
+                sim.setScene(scenes[run.parameterSet]);
+                sceneSet = run.parameterSet;
+            }
+            sim.setSeed(run.seed);
+            measureRun(sim, config.timeStep, config.maxSeconds, run);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished[index % window] = run;
+                ready[index % window] = 1;
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    while (reported < total) {
+        SweepRun run;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            int slot = (int)(reported % window);
+            changed.wait(lock, [&] { return ready[slot] != 0; });
+            run = finished[slot];
+            ready[slot] = 0;
+        }
+        onRun(run);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reported++;
+        }
+        changed.notify_all();
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return total;
+}
+
+// SweepSummary
+
+SweepSummary::SweepSummary(const std::vector<SweepParameters>& parameterSets) {
+    for (const SweepParameters& parameters : parameterSets) {
+        SetSummary set;
+        set.parameters = parameters;
+        set.runs = 0;
+        sets.push_back(set);
+    }
+}
+
+void SweepSummary::add(const SweepRun& run) {
+    if (run.parameterSet < 0 || run.parameterSet >= (int)sets.size()) return;
+    SetSummary& set = sets[run.parameterSet];
+    set.runs++;
+    if (run.trucksParked >= 0.0f) set.trucksParked.add(run.trucksParked);
+    if (run.allClear >= 0.0f) set.allClear.add(run.allClear);
+    set.peakParticles.add(run.peakParticles);
+    set.peakBurning.add(run.peakBurning);
+}
+
+static const char* const metricNames[4] = {"trucks_parked_s", "all_clear_s", "peak_particles", "peak_burning_windows"};
+
+static const MetricSummary& metric(const SweepSummary::SetSummary& set, int index) {
+    switch (index) {
+        case 0: return set.trucksParked;
+        case 1: return set.allClear;
+        case 2: return set.peakParticles;
+        default: return set.peakBurning;
+    }
+}
+
+void SweepSummary::writeCsv(FILE* file) const {
+    fprintf(file, "truck_speed,timing_scale,runs,metric,count,mean,min,p50,p90,p99,max\n");
+    for (const SetSummary& set : sets) {
+        for (int m = 0; m < 4; m++) {
+            const MetricSummary& s = metric(set, m);
+            double p50, p90, p99;
+            s.percentiles(p50, p90, p99);
+            fprintf(file, "%g,%g,%lld,%s,%lld,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", set.parameters.truckSpeed,
+                    set.parameters.timingScale, set.runs, metricNames[m], s.count, s.mean, s.min, p50, p90, p99,
+                    s.max);
+        }
+    }
+}
+
+void SweepSummary::writeJson(FILE* file, long long runs, double seconds) const {
+    fprintf(file, "{\n  \"runs\": %lld,\n  \"seconds\": %.3f,\n  \"runs_per_second\": %.2f,\n  \"sets\": [\n", runs,
+            seconds, seconds > 0.0 ? runs / seconds : 0.0);
+    for (size_t i = 0; i < sets.size(); i++) {
+        const SetSummary& set = sets[i];
+        fprintf(file, "    {\"truck_speed\": %g, \"timing_scale\": %g, \"runs\": %lld", set.parameters.truckSpeed,
+                set.parameters.timingScale, set.runs);
+        for (int m = 0; m < 4; m++) {
+            const MetricSummary& s = metric(set, m);
+            double p50, p90, p99;
+            s.percentiles(p50, p90, p99);
+            fprintf(file, ",\n      \"%s\": {\"count\": %lld, \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, "
+                    "\"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}", metricNames[m], s.count, s.mean, s.min,
+                    p50, p90, p99, s.max);
+        }
+        fprintf(file, "}%s\n", i + 1 < sets.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+void writeSweepRunHeader(FILE* file) {
+    fprintf(file, "run,truck_speed,timing_scale,seed,trucks_parked_s,all_clear_s,peak_particles,"
+            "peak_burning_windows,steps,hash\n");
+}
+
+void writeSweepRun(FILE* file, const SweepRun& run, const SweepParameters& parameters) {
+    fprintf(file, "%lld,%g,%g,%llu,%.4f,%.4f,%d,%d,%lld,%016llx\n", run.index, parameters.truckSpeed,
+            parameters.timingScale, (unsigned long long)run.seed, run.trucksParked, run.allClear,
+            run.peakParticles, run.peakBurning, run.steps, (unsigned long long)run.hash);
+}
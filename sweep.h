@@ -0,0 +1,143 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "scene.h"
+#include "particle_kernels.h"
+
+class Simulation;
+
+// Sim seconds a sweep run may take to reach all clear
+const float DEFAULT_SWEEP_LIMIT = 300.0f;
+
+// Runs finished ahead of the one being reported; workers wait beyond that,
+// so memory stays flat however many runs there are
+const int SWEEP_RESULTS_PER_THREAD = 8;
+
+// Values a quantile keeps exactly before estimating it
+const int P2_EXACT_SAMPLES = 256;
+
+// A quantile estimated online with the P-squared algorithm (Jain and
+// Chlamtac, 1985): five markers whose heights follow the quantile, moved
+// by piecewise-parabolic steps. Constant memory however many values go in;
+// up to P2_EXACT_SAMPLES values it is exact, and the markers start from
+// those values rather than the first five.
+class P2Quantile {
+public:
+    explicit P2Quantile(double quantile = 0.5);
+
+    void add(double value);
+    double value() const;
+    long long count() const { return samples; }
+
+private:
+    void startMarkers();
+    double parabolic(int i, double direction) const;
+    double linear(int i, int direction) const;
+
+    double p;
+    long long samples;
+    double exact[P2_EXACT_SAMPLES]; // Sorted, while samples <= P2_EXACT_SAMPLES
+    double height[5];
+    double position[5];
+    double desired[5];
+    double increment[5];
+};
+
+// Count, mean, min, max and the median, 90th and 99th percentiles of one
+// metric, all kept online
+class MetricSummary {
+public:
+    MetricSummary();
+
+    void add(double value);
+
+    // The three percentiles, each at least the one before and all within
+    // min and max; estimated separately, they could cross
+    void percentiles(double& median, double& ninetieth, double& ninetyNinth) const;
+
+    long long count;
+    double mean;
+    double min;
+    double max;
+    P2Quantile p50, p90, p99;
+};
+
+// One point of the parameter grid, as factors on the scene's own values
+struct SweepParameters {
+    float truckSpeed;  // Trucks' arrive and leave speeds
+    float timingScale; // Every scenario timing
+};
+
+// What one run measured. Times are sim seconds, -1 if it never got there.
+struct SweepRun {
+    long long index;
+    int parameterSet;
+    uint64_t seed;
+    float trucksParked;   // Every truck in place
+    float allClear;       // Fire out
+    int peakParticles;
+    int peakBurning;      // Windows on fire at once
+    long long steps;
+    uint64_t hash;        // State hash at the end of the run
+};
+
+struct SweepConfig {
+    Scene scene;
+    std::vector<SweepParameters> parameterSets;
+    int runsPerSet;
+    uint64_t firstSeed;    // Run r of every set uses firstSeed + r
+    float timeStep;
+    float maxSeconds;      // A run that never reaches all clear stops here
+    int threads;           // 0 means one per core
+    int particleCapacity;
+    int occupants;
+    int crowdCapacity;
+    int fluidResolution;
+    ParticleKernel kernel;
+};
+
+// The scene with a parameter set applied
+Scene sweepScene(const Scene& base, const SweepParameters& parameters);
+
+// Steps sim, already set up with scene and seed, until all clear or
+// maxSeconds, and measures the run
+void measureRun(Simulation& sim, float timeStep, float maxSeconds, SweepRun& run);
+
+// Runs every seed of every parameter set, each run single-threaded on one
+// of config.threads workers. onRun sees the runs in index order on the
+// calling thread, so what it writes and sums does not depend on the
+// thread count. Returns the number of runs.
+long long runSweep(const SweepConfig& config, const std::function<void(const SweepRun&)>& onRun);
+
+// Per parameter set distributions of the run metrics
+class SweepSummary {
+public:
+    explicit SweepSummary(const std::vector<SweepParameters>& parameterSets);
+
+    void add(const SweepRun& run);
+
+    // One row per parameter set and metric
+    void writeCsv(FILE* file) const;
+    void writeJson(FILE* file, long long runs, double seconds) const;
+
+    struct SetSummary {
+        SweepParameters parameters;
+        long long runs;
+        MetricSummary trucksParked;
+        MetricSummary allClear;
+        MetricSummary peakParticles;
+        MetricSummary peakBurning;
+    };
+    std::vector<SetSummary> sets;
+};
+
+// The CSV header and one line per run
+void writeSweepRunHeader(FILE* file);
+void writeSweepRun(FILE* file, const SweepRun& run, const SweepParameters& parameters);
+
+#endif // SWEEP_H
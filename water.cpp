@@ -0,0 +1,73 @@
+#include "water.h"
+#include "spatial_hash.h"
+#include "scene_layout.h"
+
+#include <algorithm>
+
+// Moves drop i along its arc by deltaTime; exact for constant gravity
+static inline void advanceDrop(ParticlePool& water, int i, float deltaTime) {
+    water.x[i] += water.velocityX[i] * deltaTime;
+    water.y[i] -= (water.velocity[i] - 0.5f * WATER_GRAVITY * deltaTime) * deltaTime;
+    water.velocity[i] -= WATER_GRAVITY * deltaTime;
+    water.life[i] -= deltaTime / WATER_FLIGHT_TIME;
+}
+
+void launchWaterDrops(ParticlePool& water, int first, int count, float x, float y, float targetX, float targetY,
+                      float spreadX, float spreadY, const float* random, float deltaTime) {
+    const float* offsetX = random;
+    const float* offsetY = random + count;
+    const float* phase = random + 2 * count;
+    const float* size = random + 3 * count;
+    for (int d = 0; d < count; d++) {
+        int i = first + d;
+        float landX = targetX + (offsetX[d] * 2.0f - 1.0f) * spreadX;
+        float landY = targetY + (offsetY[d] * 2.0f - 1.0f) * spreadY;
+        water.x[i] = x;
+        water.y[i] = y;
+        water.velocityX[i] = (landX - x) / WATER_FLIGHT_TIME;
+        water.velocity[i] = (y - landY + 0.5f * WATER_GRAVITY * WATER_FLIGHT_TIME * WATER_FLIGHT_TIME) / WATER_FLIGHT_TIME;
+        water.life[i] = 1.0f;
+        water.size[i] = 2.0f + size[d] * 1.5f;
+        advanceDrop(water, i, phase[d] * deltaTime);
+        water.previousX[i] = water.x[i];
+        water.previousY[i] = water.y[i];
+    }
+}
+
+void moveWaterDrops(ParticlePool& water, int begin, int end, float deltaTime, const SpatialHash& windows,
+                    const SceneLayout& layout, int* hits) {
+    for (int i = begin; i < end; i++) {
+        water.previousX[i] = water.x[i];
+        water.previousY[i] = water.y[i];
+        advanceDrop(water, i, deltaTime);
+
+        hits[i] = -1;
+        if (water.life[i] > 0.0f) continue;
+        float x = water.x[i], y = water.y[i];
+        windows.forEachNear(x, y, [&](int window, float, float) {
+            const WindowRect& w = layout.windows[window];
+            if (x >= w.left && x <= w.right && y >= w.top && y <= w.bottom) {
+                hits[i] = window;
+            }
+        });
+    }
+}
+
+int quenchFireParticles(ParticlePool& fire, int begin, int end, const SpatialHash& drops, float deltaTime) {
+    const float radiusSquared = WATER_QUENCH_RADIUS * WATER_QUENCH_RADIUS;
+    int quenched = 0;
+    for (int i = begin; i < end; i++) {
+        float x = fire.x[i], y = fire.y[i];
+        int near = 0;
+        drops.forEachNear(x, y, [&](int, float dropX, float dropY) {
+            float dx = dropX - x;
+            float dy = dropY - y;
+            near += dx * dx + dy * dy <= radiusSquared ? 1 : 0;
+        });
+        if (near > 0) {
+            fire.life[i] = std::max(0.0f, fire.life[i] - near * WATER_QUENCH_RATE * deltaTime);
+            quenched++;
+        }
+    }
+    return quenched;
+}
@@ -0,0 +1,54 @@
+#ifndef WATER_H
+#define WATER_H
+
+#include "particle_pool.h"
+
+class SpatialHash;
+class SceneLayout;
+
+// Default number of water drops preallocated at startup
+const int DEFAULT_WATER_CAPACITY = 16384;
+
+// Drops each spraying truck launches per second
+const float WATER_DROPS_PER_SECOND = 1500.0f;
+
+// Seconds from the nozzle to the wall; drops fly toward the facade while
+// they arc up and land on whatever window they are in front of by then
+const float WATER_FLIGHT_TIME = 0.8f;
+const float WATER_GRAVITY = 300.0f;
+
+// Where the hose starts, relative to the truck's left end
+const float NOZZLE_OFFSET_X = 30.0f;
+const float NOZZLE_Y = 385.0f;
+
+// Random numbers drawn per drop: target x, target y, launch phase, size
+const int RANDOMS_PER_DROP = 4;
+
+// A fire particle loses WATER_QUENCH_RATE life per second for every drop
+// within WATER_QUENCH_RADIUS
+const float WATER_QUENCH_RADIUS = 6.0f;
+const float WATER_QUENCH_RATE = 10.0f;
+
+// Heat a drop takes from the window it lands on, in units of the ignition
+// point; a hose on one window puts out a fully burning one in a second
+// or two
+const float WATER_HEAT_PER_DROP = 0.002f;
+
+// Starts drops [first, first + count) at (x, y), aimed to land on
+// (targetX, targetY) give or take spreadX, spreadY. random holds
+// RANDOMS_PER_DROP * count numbers in [0, 1); drops are spread over the
+// step so the stream does not come out in clumps.
+void launchWaterDrops(ParticlePool& water, int first, int count, float x, float y, float targetX, float targetY,
+                      float spreadX, float spreadY, const float* random, float deltaTime);
+
+// Moves drops [begin, end) along their arcs and ages them. A drop whose
+// life ran out reached the wall this step: hits gets the window it landed
+// on, or -1. windows holds the layout's window centers.
+void moveWaterDrops(ParticlePool& water, int begin, int end, float deltaTime, const SpatialHash& windows,
+                    const SceneLayout& layout, int* hits);
+
+// Fire particles [begin, end) lose life for the drops hashed in drops
+// around them. Returns how many particles were hit.
+int quenchFireParticles(ParticlePool& fire, int begin, int end, const SpatialHash& drops, float deltaTime);
+
+#endif // WATER_H
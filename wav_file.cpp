@@ -0,0 +1,192 @@
+#include "wav_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "mapped_file.h"
+
+static const int WAVE_FORMAT_PCM = 1;
+static const int WAVE_FORMAT_FLOAT = 3;
+static const int WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+static uint32_t readLe16(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t readLe32(const unsigned char* p) {
+    return readLe16(p) | (readLe16(p + 2) << 16);
+}
+
+// One sample of any supported encoding as -1..1
+static float decodeSample(const unsigned char* p, int format, int bits) {
+    if (format == WAVE_FORMAT_FLOAT) {
+        uint32_t word = readLe32(p);
+        float value;
+        memcpy(&value, &word, sizeof(value));
+        return value;
+    }
+    switch (bits) {
+        case 8:
+            return (p[0] - 128) / 128.0f;
+        case 16:
+            return (int16_t)readLe16(p) / 32768.0f;
+        case 24:
+            return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.0f;
+        default:
+            return (int32_t)readLe32(p) / 2147483648.0f;
+    }
+}
+
+static int16_t toSample(float value) {
+    float scaled = std::round(value * 32767.0f);
+    return (int16_t)std::max(-32768.0f, std::min(32767.0f, scaled));
+}
+
+bool decodeWav(const unsigned char* data, size_t size, SoundClip& clip, const char*& error) {
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        error = "not a RIFF WAVE file";
+        return false;
+    }
+
+    int format = 0, channels = 0, bits = 0, blockAlign = 0;
+    uint32_t rate = 0;
+    const unsigned char* samples = nullptr;
+    size_t sampleBytes = 0;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const unsigned char* chunk = data + offset;
+        size_t chunkSize = std::min((size_t)readLe32(chunk + 4), size - offset - 8);
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+            format = (int)readLe16(chunk + 8);
+            channels = (int)readLe16(chunk + 10);
+            rate = readLe32(chunk + 12);
+            blockAlign = (int)readLe16(chunk + 20);
+            bits = (int)readLe16(chunk + 22);
+            // The real format is the first two bytes of the sub-format GUID
+            if (format == WAVE_FORMAT_EXTENSIBLE && chunkSize >= 26) {
+                format = (int)readLe16(chunk + 32);
+            }
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            samples = chunk + 8;
+            sampleBytes = chunkSize; // A truncated file keeps what it has
+        }
+        offset += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    bool pcm = format == WAVE_FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+    bool floats = format == WAVE_FORMAT_FLOAT && bits == 32;
+    if (!pcm && !floats) {
+        error = "unsupported sample format";
+        return false;
+    }
+    if (channels < 1 || rate == 0 || blockAlign < channels * bits / 8 || !samples) {
+        error = "damaged format or data chunk";
+        return false;
+    }
+
+    // Source frames as stereo floats, mono going to both sides
+    size_t sourceFrames = sampleBytes / blockAlign;
+    int bytesPerSample = bits / 8;
+    std::vector<float> source(sourceFrames * 2);
+    for (size_t i = 0; i < sourceFrames; i++) {
+        const unsigned char* frame = samples + i * blockAlign;
+        source[i * 2] = decodeSample(frame, format, bits);
+        source[i * 2 + 1] = channels > 1 ? decodeSample(frame + bytesPerSample, format, bits) : source[i * 2];
+    }
+
+    // Linear resampling to the mix rate
+    size_t frames = sourceFrames == 0 ? 0 : (size_t)((double)sourceFrames * AUDIO_SAMPLE_RATE / rate);
+    double ratio = (double)rate / AUDIO_SAMPLE_RATE;
+    clip.samples.resize(frames * AUDIO_CHANNELS);
+    for (size_t i = 0; i < frames; i++) {
+        double position = i * ratio;
+        size_t a = std::min((size_t)position, sourceFrames - 1);
+        size_t b = std::min(a + 1, sourceFrames - 1);
+        float t = (float)(position - a);
+        for (int c = 0; c < AUDIO_CHANNELS; c++) {
+            float value = source[a * 2 + c] + (source[b * 2 + c] - source[a * 2 + c]) * t;
+            clip.samples[i * AUDIO_CHANNELS + c] = toSample(value);
+        }
+    }
+    return true;
+}
+
+bool loadWav(const char* path, SoundClip& clip) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false; // MappedFile says why
+    }
+    const char* error = "";
+    if (!decodeWav((const unsigned char*)file.data(), file.size(), clip, error)) {
+        printf("SOUND ERROR: '%s': %s\n", path, error);
+        return false;
+    }
+    return true;
+}
+
+WavWriter::WavWriter() : file(nullptr), framesWritten(0), failed(false) {
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+// 44-byte canonical header for 16-bit stereo PCM
+static void fillHeader(unsigned char* header, long long frames) {
+    uint32_t dataBytes = (uint32_t)(frames * AUDIO_CHANNELS * 2);
+    uint32_t fields[] = {
+        0, 36 + dataBytes, 0, 0, 16,
+        (uint32_t)WAVE_FORMAT_PCM | ((uint32_t)AUDIO_CHANNELS << 16),
+        (uint32_t)AUDIO_SAMPLE_RATE,
+        (uint32_t)AUDIO_SAMPLE_RATE * AUDIO_CHANNELS * 2,
+        (uint32_t)(AUDIO_CHANNELS * 2) | (16u << 16),
+        0, dataBytes
+    };
+    for (int i = 0; i < 11; i++) {
+        for (int b = 0; b < 4; b++) {
+            header[i * 4 + b] = (unsigned char)(fields[i] >> (b * 8));
+        }
+    }
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    memcpy(header + 36, "data", 4);
+}
+
+bool WavWriter::open(const char* path) {
+    close();
+    file = fopen(path, "wb");
+    if (!file) {
+        printf("ERROR: Cannot write '%s'\n", path);
+        return false;
+    }
+    unsigned char header[44];
+    fillHeader(header, 0);
+    framesWritten = 0;
+    failed = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    return !failed;
+}
+
+bool WavWriter::write(const int16_t* samples, int frames) {
+    if (!file || failed) return false;
+    // Samples are stored little endian, like every platform we build for
+    size_t count = (size_t)frames * AUDIO_CHANNELS;
+    failed = fwrite(samples, sizeof(int16_t), count, file) != count;
+    framesWritten += failed ? 0 : frames;
+    return !failed;
+}
+
+bool WavWriter::close() {
+    if (!file) return !failed;
+    unsigned char header[44];
+    fillHeader(header, framesWritten);
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        failed = true;
+    }
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = nullptr;
+    return !failed;
+}
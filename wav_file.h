@@ -0,0 +1,48 @@
+#ifndef WAV_FILE_H
+#define WAV_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Everything is mixed as interleaved 16-bit stereo at this rate
+const int AUDIO_SAMPLE_RATE = 44100;
+const int AUDIO_CHANNELS = 2;
+
+// A sound decoded once and kept in memory, already in the mix format
+struct SoundClip {
+    std::vector<int16_t> samples;
+
+    int frames() const { return (int)(samples.size() / AUDIO_CHANNELS); }
+};
+
+// Decodes a RIFF WAVE file in memory: 8, 16, 24 or 32-bit PCM or 32-bit
+// float, mono or more channels (the first two are kept), at any rate
+// (resampled linearly). On failure error says why.
+bool decodeWav(const unsigned char* data, size_t size, SoundClip& clip, const char*& error);
+
+// Decodes a file; prints "SOUND ERROR: ..." on failure
+bool loadWav(const char* path, SoundClip& clip);
+
+// Writes mix-format frames to a WAV file as they come; the sizes in the
+// header are filled in on close
+class WavWriter {
+public:
+    WavWriter();
+    ~WavWriter();
+
+    bool open(const char* path);
+    bool write(const int16_t* samples, int frames);
+    bool close();
+
+    bool isOpen() const { return file != nullptr; }
+    long long frames() const { return framesWritten; }
+
+private:
+    FILE* file;
+    long long framesWritten;
+    bool failed;
+};
+
+#endif // WAV_FILE_H